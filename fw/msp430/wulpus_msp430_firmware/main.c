@@ -28,8 +28,25 @@
 // First two Bytes of the measurement header
 // Used to indicate the start of an US frame
 #define MEAS_START_OF_FRAME_MASK 0xFF
+// Flags in byte 7 of the measurement header
+// (bits 2-6 are reserved for the delta encoding of the nRF52)
+#define MEAS_FLAG_CODE_COMPLEMENTARY BIT0
+#define MEAS_FLAG_ADAPTIVE_PERIOD    BIT1
+#define MEAS_FLAG_REF_SUBTRACTED     BIT7
+// PLL unlock recovery since the last frame in the upper nibble of the TX RX config ID:
+// shots retried (bits 4-5) and shots dropped (bits 6-7), both saturated
+#define MEAS_PLL_RETRIES_POS         4
+#define MEAS_PLL_DROPPED_POS         6
+#define MEAS_PLL_COUNT_MAX           0x03
+// Trigger-to-trigger jitter not measured
+#define MEAS_TRIG_JITTER_INVALID     0x8000
 // US measurement header
-static uint8_t meas_header[4] = {0};
+// [0] start of frame, [1] TX RX config ID (bits 0-3), PLL retries (bits 4-5) and dropped shots (bits 6-7), [2-3] frame number,
+// [4-5] measurement period (ACLK ticks), [6] applied PGA gain (SDHSCTL6), [7] flags,
+// [8-9] trigger latency after the slow timer tick (SMCLK cycles, 0xFFFF: not measured),
+// [10-11] trigger-to-trigger jitter, i.e. change of the latency since the last frame
+//         (signed SMCLK cycles, 0x8000: not measured)
+static uint8_t meas_header[US_FRAME_HEADER_LEN] = {0};
 static uint16_t meas_frame_nr = 0;
 
 // Empty config with MSP settings for US acquisition
@@ -37,6 +54,15 @@ msp_config_t msp_config;
 
 // TX RX active config ID
 uint8_t tx_rx_id = 0;
+// Transmit the complementary code (toggled after every sweep of TX RX configs)
+static bool ppg_code_complementary = false;
+// Measurement period requested by the motion-adaptive mode (ACLK ticks)
+static uint16_t adapt_period = 0;
+// PLL recovery counters at the last frame sent
+static uint16_t pll_retries_reported = 0;
+static uint16_t pll_dropped_reported = 0;
+// Trigger latency of the last frame sent
+static uint16_t last_trig_latency = TRIG_LATENCY_INVALID;
 
 // A routine to get configuration package from nRF
 static void getConfigPack(void);
@@ -45,6 +71,11 @@ static void getConfigPack(void);
 static void configAfterPowerUp(void);
 static void receiveUssConfPackage(void);
 static void usAcquisitionLoop(void);
+static bool flushFramRing(void);
+static void buildMeasHeader(void);
+static void prepUsShot(void);
+static uint8_t takePllStats(void);
+static void putTrigTiming(uint8_t * frame);
 
 // Callbacks implementation
 static void hsPllUnlockCallback(void);
@@ -52,6 +83,12 @@ static void saphSeqAcqDoneCallback(void);
 static void slowTimerCc2Callback(void);
 static void fastTimerCc0Callback(void);
 
+// The per-frame path runs from RAM, see uslib_timers_isrs.c
+#pragma CODE_SECTION(buildMeasHeader, ".TI.ramfunc")
+#pragma CODE_SECTION(saphSeqAcqDoneCallback, ".TI.ramfunc")
+#pragma CODE_SECTION(slowTimerCc2Callback, ".TI.ramfunc")
+#pragma CODE_SECTION(fastTimerCc0Callback, ".TI.ramfunc")
+
 int main(void)
 {
 
@@ -68,10 +105,34 @@ int main(void)
         // Set default parameters
         tx_rx_id = 0;
         meas_frame_nr = 0;
+        ppg_code_complementary = false;
+        last_trig_latency = TRIG_LATENCY_INVALID;
+        framRingReset();
 
         // Receive Uss configuration package from nRF
         receiveUssConfPackage();
 
+        // Start the motion-adaptive mode from the requested period
+        if (msp_config.adaptMaxPeriod != 0)
+        {
+            adapt_period = msp_config.measPeriod;
+            if (adapt_period < msp_config.adaptMinPeriod)
+                adapt_period = msp_config.adaptMinPeriod;
+            if (adapt_period > msp_config.adaptMaxPeriod)
+                adapt_period = msp_config.adaptMaxPeriod;
+
+            msp_config.measPeriod = adapt_period;
+            setNewUsConfig(&msp_config);
+            motionReset();
+        }
+
+        // Capture or load the reference frames
+        refFrameInit(msp_config.refMode, msp_config.refAvgShift);
+
+        // Start the AGC of all TX/RX configs from the configured gain
+        agcInit(msp_config.rxGain, msp_config.agcMinGain,
+                msp_config.agcMaxGain, msp_config.agcTargetRms);
+
         // Configure Uss according to the new package
         confUsSubsystem();
 
@@ -121,8 +182,8 @@ void configAfterPowerUp(void)
 
     // Timer Slow CC2 callback enables HV DC-DC and opAmp
     TIMER_SLOW_CCR2_CALLBACK = &slowTimerCc2Callback;
-    // Timer Slow CC0 callback reloads parameters of the capture
-    // such as measurement period and dc-dc turn on time
+    // Timer Slow CC0 callback starts the armed shot and reloads parameters
+    // of the capture such as measurement period and dc-dc turn on time
     TIMER_SLOW_CCR0_CALLBACK = &reloadTimerSlowSwEvents;
 
     // Timer Fast CC1 callback triggers acquisition and
@@ -131,6 +192,8 @@ void configAfterPowerUp(void)
     // Timer Fast CC0 callback switches HV MUX to receive,
     // stops the DC-DC converter and the Fast timer
     TIMER_FAST_CCR0_CALLBACK = &fastTimerCc0Callback;
+    // Timer Fast CC2 callback captures the ACLK edges after the trigger
+    TIMER_FAST_CCR2_CALLBACK = &captureTrigAclkEdge;
 
     // Hook other callbacks
     HS_PLL_UNLOCK_CALLBACK = &hsPllUnlockCallback;
@@ -175,43 +238,95 @@ static void usAcquisitionLoop(void)
 {
 
     bool no_error = true;
+    bool stream_direct;
+    uint8_t pll_retries;
+    uint16_t spi_drain_start;
+    uint16_t motion_energy;
 
     while(1)
     {
-        // Check if nRF52 BLE connection is ready
-        if(isBleReady())
+        // Update the measurement header
+        buildMeasHeader();
+
+        // Prepare the shot ahead of its period
+        prepUsShot();
+
+        // Trigger ultrasound acquisition at the start of the next period
+        // (the slow timer CC0 ISR starts the armed shot)
+        no_error = triggerUsAcqAtPeriod();
+
+        // Retry a shot lost to a PLL unlock within the same period
+        pll_retries = 0;
+        while ((no_error == false) && pllUnlockRecover(pll_retries))
         {
+            pll_retries++;
+
+            // The HV DC-DC may have been disabled after the pulses
+            enableHvPcbDcDc();
+            enableOpAmp();
+            timerSlowDelay(PLL_RETRY_SETTLE_ACLK_TICKS, LPM3_bits);
 
-            // Update the measurement header
-            meas_header[0] = MEAS_START_OF_FRAME_MASK;
-            meas_header[1] = tx_rx_id;
-            meas_header[2] = (uint8_t) (meas_frame_nr & 0xFF);
-            meas_header[3] = (uint8_t) (meas_frame_nr >> 8);
-            memcpy((uint16_t *) 0x4000, &meas_header, 4);
-
-            // Configure TX config (applied immediately)
-            hvMuxConfTx(msp_config.txConfigs[tx_rx_id]);
-            // Configure RX config (loaded into shift register but not latched)
-            // Latching will occur in the timer interrupt after completion
-            // of pulse generation
-            hvMuxConfRx(msp_config.rxConfigs[tx_rx_id]);
-
-            // Trigger ultrasound acquisition
+            prepUsShot();
             no_error = triggerUsAcq();
-            if (no_error == false)
+        }
+
+        if (no_error == false)
+        {
+            // Try again in the next period
+            continue;
+        }
+
+        // If instead aquisition sequencer finished as expected
+        // and we reached this line, then
+        // wait for the SPI DMA transaction to be completed
+
+        spi_drain_start = timerSlowGetCount();
+
+        // Remove ringdown and crosstalk before the frame leaves the probe
+        // (the DMA has only loaded the first header byte so far)
+        if (refFrameProcess(tx_rx_id, (int16_t *) US_FRAME_SAMPLES_ADDR))
+            ((uint8_t *) US_FRAME_ADDR)[7] |= MEAS_FLAG_REF_SUBTRACTED;
+
+        // Report the PLL recovery since the last frame (incl. retries of this one)
+        ((uint8_t *) US_FRAME_ADDR)[1] |= takePllStats();
+
+        // Report the measured trigger timing
+        putTrigTiming((uint8_t *) US_FRAME_ADDR);
+
+        // Stream the frame directly unless the nRF52 BLE link is not ready
+        // or older frames are still waiting in FRAM. Acquisitions continue
+        // while the link is not ready, the frames are kept in FRAM.
+        stream_direct = isBleReady() && framRingIsEmpty();
+
+        // Adapt the measurement period to the motion in the scene
+        // and the RX gain to the signal level
+        // (computed while the DMA drains the frame over SPI)
+        if ((msp_config.adaptMaxPeriod != 0) || (msp_config.agcTargetRms != 0))
+        {
+            if (stream_direct)
+                usSpiSetDataReady();
+
+            if (msp_config.adaptMaxPeriod != 0)
             {
-                // Wait for timer to elapse
-                waitTimerSlowElapse();
-                continue;
+                motion_energy = motionGetEnergy(tx_rx_id,
+                                                (const int16_t *) US_FRAME_SAMPLES_ADDR);
+                adapt_period = motionAdaptPeriod(adapt_period,
+                                                 motion_energy,
+                                                 msp_config.motionThreshold,
+                                                 msp_config.adaptMinPeriod,
+                                                 msp_config.adaptMaxPeriod);
+                setMeasPeriod(adapt_period);
             }
 
-            // If instead aquisition sequencer finished as expected
-            // and we reached this line, then
-            // wait for the SPI DMA transaction to be completed
+            agcUpdate(tx_rx_id, (const int16_t *) US_FRAME_SAMPLES_ADDR);
+        }
 
+        if (stream_direct)
+        {
             // Wait for SPI DMA transmission to complete
+            // and feed the measured drain time back to the scheduler
             usWaitForSpiDmaRx();
-
+            updateSpiDrainTime(timerSlowGetCount() - spi_drain_start);
 
             // Check the SPI RX buffer for restart command
             if (isRestartCondition(usSpiGetRxPtr()))
@@ -219,28 +334,151 @@ static void usAcquisitionLoop(void)
                 pauseTimerSlowSwEvents();
                 return;
             }
+        }
+        else
+        {
+            // Keep the frame in FRAM (the armed SPI transfer is dropped)
+            framRingPush((const uint8_t *) US_FRAME_ADDR);
 
-            // Wait for timer to elapse
-            waitTimerSlowElapse();
+            // Flush the backlog once the link is ready again
+            if (flushFramRing() == false)
+            {
+                pauseTimerSlowSwEvents();
+                return;
+            }
+        }
 
-            // Increment measurement frame number
-            // And TX RX configuration ID
-            meas_frame_nr++;
-            tx_rx_id++;
-            if(tx_rx_id == msp_config.txRxConfLen)
-                tx_rx_id = 0;
+        // Increment measurement frame number
+        // And TX RX configuration ID
+        meas_frame_nr++;
+        tx_rx_id++;
+        if(tx_rx_id == US_CONF_TX_RX_CONF_LEN(msp_config))
+        {
+            tx_rx_id = 0;
+            ppg_code_complementary = !ppg_code_complementary;
         }
     }
 }
 
 //// HELPER FUNCTIONS  ////
 
+// Build the measurement header and copy it in front of the samples
+static void buildMeasHeader(void)
+{
+    uint8_t * frame = (uint8_t *) US_FRAME_ADDR;
+    uint16_t meas_period = getMeasPeriod();
+    uint8_t i;
+
+    meas_header[0] = MEAS_START_OF_FRAME_MASK;
+    meas_header[1] = tx_rx_id;
+    meas_header[2] = (uint8_t) (meas_frame_nr & 0xFF);
+    meas_header[3] = (uint8_t) (meas_frame_nr >> 8);
+    meas_header[4] = (uint8_t) (meas_period & 0xFF);
+    meas_header[5] = (uint8_t) (meas_period >> 8);
+    meas_header[6] = agcGetGain(tx_rx_id);
+    meas_header[7] = 0;
+    if (ppg_code_complementary)
+        meas_header[7] |= MEAS_FLAG_CODE_COMPLEMENTARY;
+    if (msp_config.adaptMaxPeriod != 0)
+        meas_header[7] |= MEAS_FLAG_ADAPTIVE_PERIOD;
+    // Trigger timing is filled in after the shot
+    meas_header[8] = (uint8_t) (TRIG_LATENCY_INVALID & 0xFF);
+    meas_header[9] = (uint8_t) (TRIG_LATENCY_INVALID >> 8);
+    meas_header[10] = (uint8_t) (MEAS_TRIG_JITTER_INVALID & 0xFF);
+    meas_header[11] = (uint8_t) (MEAS_TRIG_JITTER_INVALID >> 8);
+
+    // Copy byte-wise instead of calling memcpy of the RTS library (in FRAM)
+    for (i = 0; i < US_FRAME_HEADER_LEN; i++)
+        frame[i] = meas_header[i];
+}
+
+// Configure the HV MUX and the pulser for the active TX RX config
+static void prepUsShot(void)
+{
+    // Configure TX config (applied immediately)
+    hvMuxConfTx(US_CONF_TX_CONFIG(msp_config, tx_rx_id));
+    // Configure RX config (loaded into shift register but not latched)
+    // Latching will occur in the timer interrupt after completion
+    // of pulse generation
+    hvMuxConfRx(US_CONF_RX_CONFIG(msp_config, tx_rx_id));
+
+    // Load the coded burst (if coded excitation is enabled)
+    armPpgCode(ppg_code_complementary);
+
+    // Apply the gain of the AGC for this config
+    if (msp_config.agcTargetRms != 0)
+        setRxGain(meas_header[6]);
+}
+
+// PLL retries and dropped shots since the last call (saturated to the header fields)
+static uint8_t takePllStats(void)
+{
+    const us_pll_stats_t * stats = getPllStats();
+    uint16_t retries = stats->retries - pll_retries_reported;
+    uint16_t dropped = stats->dropped - pll_dropped_reported;
+
+    pll_retries_reported += retries;
+    pll_dropped_reported += dropped;
+
+    if (retries > MEAS_PLL_COUNT_MAX)
+        retries = MEAS_PLL_COUNT_MAX;
+    if (dropped > MEAS_PLL_COUNT_MAX)
+        dropped = MEAS_PLL_COUNT_MAX;
+
+    return (uint8_t) ((retries << MEAS_PLL_RETRIES_POS) | (dropped << MEAS_PLL_DROPPED_POS));
+}
+
+// Write the trigger latency of this shot and its change since the last frame
+// The slow timer ticks are crystal based, so the change is the deviation of the
+// trigger-to-trigger interval from the measurement period
+static void putTrigTiming(uint8_t * frame)
+{
+    uint16_t latency = getTrigLatency();
+    uint16_t jitter = MEAS_TRIG_JITTER_INVALID;
+
+    if ((latency != TRIG_LATENCY_INVALID) && (last_trig_latency != TRIG_LATENCY_INVALID))
+        jitter = latency - last_trig_latency;
+
+    last_trig_latency = latency;
+
+    frame[8] = (uint8_t) (latency & 0xFF);
+    frame[9] = (uint8_t) (latency >> 8);
+    frame[10] = (uint8_t) (jitter & 0xFF);
+    frame[11] = (uint8_t) (jitter >> 8);
+}
+
+// Send the frames kept in FRAM back-to-back while the link is ready
+// Returns false if a restart command was received
+static bool flushFramRing(void)
+{
+    // The nRF52 sends the restart command also while the link is not ready
+    if (isRestartCondition(usSpiGetRxPtr()))
+        return false;
+
+    while (isBleReady() && !framRingIsEmpty())
+    {
+        // Start SPI transaction from FRAM
+        usStartSPIFrom((uint32_t) framRingPeek());
+        usSpiEnableDmaRxIsr();
+
+        // Wait for SPI DMA RX to be completed
+        usWaitForSpiDmaRx();
+        framRingPop();
+
+        // Check the SPI RX buffer for restart command
+        if (isRestartCondition(usSpiGetRxPtr()))
+            return false;
+    }
+
+    return true;
+}
+
 // Get configuration package from nRF
 static void getConfigPack(void)
 {
     // Initiate an SPI transaction to receive a config file
     // Clear TX buffer
-    memset((uint16_t *) 0x4000, 0, (uint32_t)BYTES_PR_XFER_TX);
+    memset((uint16_t *) US_FRAME_ADDR, 0, (uint32_t)BYTES_PR_XFER_TX);
     // Start SPI transaction
     usStartSPI();
 
@@ -287,6 +525,8 @@ static void saphSeqAcqDoneCallback(void)
 
 static void slowTimerCc2Callback(void)
 {
+    // Fires dcDcTurnOnTime before the next shot, so the charge-up
+    // overlaps the SPI drain of the previous frame
     // Turn On DC-DCs
     enableHvPcbDcDc();
     // Enable RX OPA836
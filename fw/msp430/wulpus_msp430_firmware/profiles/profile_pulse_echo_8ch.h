@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2024 ETH Zurich. All rights reserved.
+ *
+ * Author: Sergei Vostrikov, ETH Zurich
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * 
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef PROFILES_PROFILE_PULSE_ECHO_8CH_H_
+#define PROFILES_PROFILE_PULSE_ECHO_8CH_H_
+
+// Pulse-echo sweep over all eight channels
+// Config i transmits and receives on channel i (optimized switching)
+
+#define PROFILE_NUM_SAMPLES         400
+#define PROFILE_OVER_SAMPL_RATE     SDHS_OVER_SAMPL_RATE_10     // 8 MHz
+
+#define PROFILE_PULSE_FREQ          2250000UL
+#define PROFILE_PULSE_DUTY_CYCLE    50
+#define PROFILE_NUM_PULSES          2
+#define PROFILE_PULSE_CODE          PPG_CODE_NONE
+
+#define PROFILE_TX_RX_CONF_LEN      8
+#define PROFILE_TX_CONFIGS          {0x0003, 0x000C, 0x0030, 0x00C0, \
+                                     0x0300, 0x0C00, 0x3000, 0xC000}
+#define PROFILE_RX_CONFIGS          {0x0001, 0x0004, 0x0010, 0x0040, \
+                                     0x0100, 0x0400, 0x1000, 0x4000}
+
+#endif /* PROFILES_PROFILE_PULSE_ECHO_8CH_H_ */
@@ -0,0 +1,39 @@
+/*
+ * Copyright (C) 2024 ETH Zurich. All rights reserved.
+ *
+ * Author: Sergei Vostrikov, ETH Zurich
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * 
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef PROFILES_PROFILE_WATERBATH_H_
+#define PROFILES_PROFILE_WATERBATH_H_
+
+// Water bath protocol (sw/examples/uss_waterbath.json, trx_waterbath.json)
+// Single TX/RX config: TX on channel 7, RX on channel 0, optimized switching
+
+#define PROFILE_NUM_SAMPLES         400
+#define PROFILE_OVER_SAMPL_RATE     SDHS_OVER_SAMPL_RATE_20     // 4 MHz
+
+#define PROFILE_PULSE_FREQ          1000000UL
+#define PROFILE_PULSE_DUTY_CYCLE    50
+#define PROFILE_NUM_PULSES          10
+#define PROFILE_PULSE_CODE          PPG_CODE_NONE
+
+#define PROFILE_TX_RX_CONF_LEN      1
+#define PROFILE_TX_CONFIGS          {0x8001}
+#define PROFILE_RX_CONFIGS          {0x0001}
+
+#endif /* PROFILES_PROFILE_WATERBATH_H_ */
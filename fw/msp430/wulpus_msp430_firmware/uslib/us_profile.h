@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2024 ETH Zurich. All rights reserved.
+ *
+ * Author: Sergei Vostrikov, ETH Zurich
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * 
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef USLIB_US_PROFILE_H_
+#define USLIB_US_PROFILE_H_
+
+// Compile-time acquisition profiles
+//
+// The generic firmware takes all acquisition settings from the config
+// package of the host. A build with WULPUS_PROFILE="<profile header>"
+// (see the Profile_* build configurations and the profiles folder)
+// fixes the sample size, oversampling rate, pulse settings and TX/RX
+// table instead, so the compiler folds them into the code and drops the
+// unused paths (e.g. coded excitation, PPG period computation).
+// The host still sends its config package, packages which do not match
+// the profile are rejected.
+//
+// The US_CONF_* macros return the setting of a config struct in the
+// generic build and the profile constant in a profile build.
+
+#ifdef WULPUS_PROFILE
+
+#include WULPUS_PROFILE
+
+#define US_PROFILE_FIXED                1
+
+// Sample size as sent by the host (2 x number of samples)
+#define PROFILE_SAMPLE_SIZE             (2 * PROFILE_NUM_SAMPLES)
+
+// PPG periods at HSPLL_OUT_80_MHZ, same arithmetic as confPPG()
+#define PROFILE_HSPLL_FREQ              80000000ULL
+#define PROFILE_PPG_PER                 ((PROFILE_HSPLL_FREQ + (PROFILE_PULSE_FREQ >> 1)) / PROFILE_PULSE_FREQ)
+#define PROFILE_PPG_HPER                (((PROFILE_HSPLL_FREQ * PROFILE_PULSE_DUTY_CYCLE - (PROFILE_PULSE_FREQ >> 1)) / PROFILE_PULSE_FREQ + 99) / 100)
+#define PROFILE_PPG_LPER                (PROFILE_PPG_PER - PROFILE_PPG_HPER)
+
+#if (PROFILE_PPG_HPER > 255) || (PROFILE_PPG_LPER > 255)
+#error "Pulse frequency of the profile is too low for the pulse generator"
+#endif
+#if (PROFILE_TX_RX_CONF_LEN < 1) || (PROFILE_TX_RX_CONF_LEN > TX_RX_CONF_LEN_MAX)
+#error "Number of TX/RX configs of the profile is out of range"
+#endif
+
+// TX/RX table of the profile (defined in wulpus_sys.c)
+extern const uint16_t profileTxConfigs[PROFILE_TX_RX_CONF_LEN];
+extern const uint16_t profileRxConfigs[PROFILE_TX_RX_CONF_LEN];
+
+#define US_CONF_OVER_SAMPL_RATE(c)      (PROFILE_OVER_SAMPL_RATE)
+#define US_CONF_SAMPLE_SIZE(c)          (PROFILE_SAMPLE_SIZE)
+#define US_CONF_NUM_PULSES(c)           (PROFILE_NUM_PULSES)
+#define US_CONF_PULSE_CODE(c)           (PROFILE_PULSE_CODE)
+#define US_CONF_TX_RX_CONF_LEN(c)       (PROFILE_TX_RX_CONF_LEN)
+#define US_CONF_TX_CONFIG(c, i)         (profileTxConfigs[i])
+#define US_CONF_RX_CONFIG(c, i)         (profileRxConfigs[i])
+
+#else
+
+#define US_PROFILE_FIXED                0
+
+#define US_CONF_OVER_SAMPL_RATE(c)      ((c).overSamplRate)
+#define US_CONF_SAMPLE_SIZE(c)          ((c).sampleSize)
+#define US_CONF_NUM_PULSES(c)           ((c).numPulses)
+#define US_CONF_PULSE_CODE(c)           ((c).pulseCode)
+#define US_CONF_TX_RX_CONF_LEN(c)       ((c).txRxConfLen)
+#define US_CONF_TX_CONFIG(c, i)         ((c).txConfigs[i])
+#define US_CONF_RX_CONFIG(c, i)         ((c).rxConfigs[i])
+
+#endif
+
+#endif /* USLIB_US_PROFILE_H_ */
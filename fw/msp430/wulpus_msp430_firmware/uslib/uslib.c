@@ -19,10 +19,95 @@
  */
 
 #include "uslib.h"
+#include "dma.h"
 
 static msp_config_t config;
 static bool config_updated = false;
 
+// Chips of the coded excitation sequences
+// Stored MSB first, a set bit is a +1 chip, a cleared bit a -1 chip
+typedef struct
+{
+    uint16_t chips;
+    uint8_t  len;
+} ppg_code_chips_t;
+
+// Sequence A and its complementary sequence B for each ppg_code_t
+static const ppg_code_chips_t ppgCodeChips[][2] =
+{
+    {{0x0001, 1},  {0x0001, 1}},    // PPG_CODE_NONE
+    {{0x001D, 5},  {0x001D, 5}},    // PPG_CODE_BARKER_5:  +++-+
+    {{0x0072, 7},  {0x0072, 7}},    // PPG_CODE_BARKER_7:  +++--+-
+    {{0x0712, 11}, {0x0712, 11}},   // PPG_CODE_BARKER_11: +++---+--+-
+    {{0x1F35, 13}, {0x1F35, 13}},   // PPG_CODE_BARKER_13: +++++--++-+-+
+    {{0x00ED, 8},  {0x00E2, 8}},    // PPG_CODE_GOLAY_8:   +++-++-+ / +++---+-
+};
+
+// Low period of every pulse of the coded bursts (A and B)
+static uint16_t ppgCodeLper[2][PPG_CODE_MAX_PULSES];
+static uint8_t  ppgCodePulses = 0;
+
+// Schedule of the slow timer events (in ACLK ticks)
+static uint16_t measPeriod = 0;
+static uint16_t minMeasPeriod = 0;
+static uint16_t dcDcTurnOnOffset = 0;
+static uint16_t spiDrainTicks = SPI_DRAIN_EST_ACLK_TICKS;
+// Time a retried shot needs until the end of its SPI drain
+static uint16_t pllRetryTicks = 0;
+
+// Shot armed for the start of the next period (started by the CC0 ISR)
+static volatile bool trigArmed = false;
+// Last shot was triggered by the slow timer tick
+static bool trigScheduled = false;
+// Fast timer count at the first two ACLK edges after the ASQ trigger
+static volatile uint16_t trigAclkEdge[2];
+static volatile uint8_t  trigAclkEdgeCnt = 0;
+
+// USS registers written by confUsSubsystem(), re-applied after the
+// software reset of a PLL unlock without recomputing the configuration
+typedef struct
+{
+    uint16_t hspllCtl;
+    uint16_t hspllUssXtlCtl;
+    uint16_t uupsCtl;
+    uint16_t saphMcnf;
+    uint16_t saphOctl1;
+    uint16_t saphPgc;
+    uint16_t saphXpgCtl;
+    uint16_t saphPgLper;
+    uint16_t saphPgHper;
+    uint16_t saphPgCtl;
+    uint16_t saphOsel;
+    uint16_t saphBctl;
+    uint16_t saphIctl0;
+    uint16_t saphAsCtl0;
+    uint16_t saphAsCtl1;
+    uint16_t saphApol;
+    uint16_t saphAphiz;
+    uint16_t saphAplev;
+    uint16_t saphAtm[6];
+    uint16_t sdhsCtl0;
+    uint16_t sdhsCtl1;
+    uint16_t sdhsCtl2;
+    uint16_t sdhsCtl6;
+    uint16_t sdhsCtl7;
+    uint16_t sdhsDtcda;
+} us_reg_cache_t;
+
+static us_reg_cache_t usRegCache;
+static bool usRegCacheValid = false;
+static us_pll_stats_t pllStats = {0};
+
+static void updateTimerSlowSchedule(void);
+static void saveUsRegCache(void);
+static void restoreUsRegCache(void);
+static bool wakeUpUss(void);
+static bool finishUsAcq(void);
+
+// Started from the slow timer CC0 ISR, keep it in RAM with the ISR
+#pragma CODE_SECTION(startTimerFast, ".TI.ramfunc")
+#pragma CODE_SECTION(captureTrigAclkEdge, ".TI.ramfunc")
+
 void setNewUsConfig(msp_config_t *newConfig)
 {
     config = *newConfig;
@@ -36,6 +121,8 @@ bool confUsSubsystem(void)
     if (config_updated == false)
         return false;
 
+    usRegCacheValid = false;
+
     // Check if no active conversion is in progress
     if(UUPSCTL & USS_BUSY)
     {
@@ -281,9 +368,9 @@ bool confUsSubsystem(void)
     // SDHS.WINHITH, SDHS.WINLOTH, SDHS.DTCSA  registers
     SDHSCTL0 = TRGSRC + SHIFT_0 + OBR_0 + DFMSEL_0 + DALGN_0 + + INTDLY_0 +
            AUTOSSDIS;
-    SDHSCTL1 = config.overSamplRate;
+    SDHSCTL1 = US_CONF_OVER_SAMPL_RATE(config);
 
-    SDHSCTL2 = DTCOFF_0 + (config.sampleSize - 1);
+    SDHSCTL2 = DTCOFF_0 + (US_CONF_SAMPLE_SIZE(config) - 1);
 
 
     //// Configure PGA Gain ////
@@ -323,45 +410,201 @@ bool confUsSubsystem(void)
     // Unlock SDHS registers
     SDHSCTL3 &= ~(TRIGEN);
     //Restore SDHSDTCDA address
-    // LEA start address (0x4000)
+    // LEA start address (0x4000), samples follow the frame header
     // Destination location = base address + DTCDA x 2
-    SDHSDTCDA = ((uint32_t)((0x4005) - (0x4000))>>1);
+    SDHSDTCDA = ((uint32_t)((US_FRAME_SAMPLES_ADDR + 1) - (US_FRAME_ADDR))>>1);
     // Lock SDHS registers
     SDHSCTL3 |= (TRIGEN);
 
+    saveUsRegCache();
+
     return true;
 }
 
+static void saveUsRegCache(void)
+{
+    usRegCache.hspllCtl = HSPLLCTL;
+    usRegCache.hspllUssXtlCtl = HSPLLUSSXTLCTL;
+    usRegCache.uupsCtl = UUPSCTL & (ASQEN | LBHDEL_3);
+
+    usRegCache.saphMcnf = SAPH_AMCNF;
+    usRegCache.saphOctl1 = SAPH_AOCTL1;
+    usRegCache.saphPgc = SAPH_APGC;
+    usRegCache.saphXpgCtl = SAPH_AXPGCTL;
+    usRegCache.saphPgLper = SAPH_APGLPER;
+    usRegCache.saphPgHper = SAPH_APGHPER;
+    usRegCache.saphPgCtl = SAPH_APGCTL;
+    usRegCache.saphOsel = SAPH_AOSEL;
+    usRegCache.saphBctl = SAPH_ABCTL;
+    usRegCache.saphIctl0 = SAPH_AICTL0;
+    usRegCache.saphAsCtl0 = SAPH_AASCTL0;
+    usRegCache.saphAsCtl1 = SAPH_AASCTL1;
+    usRegCache.saphApol = SAPH_AAPOL;
+    usRegCache.saphAphiz = SAPH_AAPHIZ;
+    usRegCache.saphAplev = SAPH_AAPLEV;
+    usRegCache.saphAtm[0] = SAPH_AATM_A;
+    usRegCache.saphAtm[1] = SAPH_AATM_B;
+    usRegCache.saphAtm[2] = SAPH_AATM_C;
+    usRegCache.saphAtm[3] = SAPH_AATM_D;
+    usRegCache.saphAtm[4] = SAPH_AATM_E;
+    usRegCache.saphAtm[5] = SAPH_AATM_F;
+
+    usRegCache.sdhsCtl0 = SDHSCTL0;
+    usRegCache.sdhsCtl1 = SDHSCTL1;
+    usRegCache.sdhsCtl2 = SDHSCTL2;
+    usRegCache.sdhsCtl6 = SDHSCTL6;
+    usRegCache.sdhsCtl7 = SDHSCTL7;
+    usRegCache.sdhsDtcda = SDHSDTCDA;
+
+    usRegCacheValid = true;
+}
+
+// Same order as confUsSubsystem(), PPG and ASQ are enabled last
+static void restoreUsRegCache(void)
+{
+    UUPSCTL = usRegCache.uupsCtl;
+
+    HSPLLCTL = usRegCache.hspllCtl;
+    HSPLLUSSXTLCTL = usRegCache.hspllUssXtlCtl;
+
+    // Unlock SAPH and SAPH trim registers
+    SAPH_AKEY = KEY;
+    SAPH_ATACTL |= (UNLOCK);
+    SAPH_AMCNF = usRegCache.saphMcnf;
+    SAPH_ATACTL &= ~(UNLOCK);
+
+    // Disable ACQ and PPG
+    SAPH_AASCTL0 &= ~(ASQTEN);
+    SAPH_APGCTL &= ~(PPGEN);
+
+    SAPH_AOCTL1 = usRegCache.saphOctl1;
+    SAPH_APGC = usRegCache.saphPgc;
+    SAPH_AXPGCTL = usRegCache.saphXpgCtl;
+    SAPH_APGLPER = usRegCache.saphPgLper;
+    SAPH_APGHPER = usRegCache.saphPgHper;
+    SAPH_AOSEL = usRegCache.saphOsel;
+    SAPH_APGCTL = usRegCache.saphPgCtl;
+
+    SAPH_ABCTL = usRegCache.saphBctl;
+    SAPH_AICTL0 = usRegCache.saphIctl0;
+    SAPH_AASCTL1 = usRegCache.saphAsCtl1;
+    SAPH_AAPOL = usRegCache.saphApol;
+    SAPH_AAPHIZ = usRegCache.saphAphiz;
+    SAPH_AAPLEV = usRegCache.saphAplev;
+    SAPH_AATM_A = usRegCache.saphAtm[0];
+    SAPH_AATM_B = usRegCache.saphAtm[1];
+    SAPH_AATM_C = usRegCache.saphAtm[2];
+    SAPH_AATM_D = usRegCache.saphAtm[3];
+    SAPH_AATM_E = usRegCache.saphAtm[4];
+    SAPH_AATM_F = usRegCache.saphAtm[5];
+    SAPH_AASCTL0 = usRegCache.saphAsCtl0;
+
+    // Lock SAPH registers
+    SAPH_AKEY = 0;
+
+    // Unlock SDHS registers for configuration
+    SDHSCTL3 &= ~(TRIGEN);
+    SDHSCTL0 = usRegCache.sdhsCtl0;
+    SDHSCTL1 = usRegCache.sdhsCtl1;
+    SDHSCTL2 = usRegCache.sdhsCtl2;
+    SDHSCTL6 = usRegCache.sdhsCtl6;
+    SDHSCTL7 = usRegCache.sdhsCtl7;
+    SDHSCTL4 = 0;
+    SDHSCTL5 = 0;
+    SDHSDTCDA = usRegCache.sdhsDtcda;
+    // Lock SDHS registers
+    SDHSCTL3 |= (TRIGEN);
+}
+
+
+// Build the low period of every pulse of the coded bursts
+// A phase flip between two chips is generated by stretching the low
+// period of the last pulse of a chip by half of the carrier period
+static bool buildPpgCode(uint16_t lper, uint16_t per)
+{
+    uint16_t flipLper = lper + (per >> 1);
+    uint8_t len = ppgCodeChips[US_CONF_PULSE_CODE(config)][0].len;
+    uint8_t seq, i, p, k;
+    bool chip, nextChip;
+
+    if (flipLper > 255)
+        return false;
+
+    if (((uint16_t)len * US_CONF_NUM_PULSES(config)) > PPG_CODE_MAX_PULSES)
+        return false;
+
+    for (seq = 0; seq < 2; seq++)
+    {
+        uint16_t chips = ppgCodeChips[US_CONF_PULSE_CODE(config)][seq].chips;
+
+        k = 0;
+        for (i = 0; i < len; i++)
+        {
+            chip = (chips >> (len - 1 - i)) & 1;
+            nextChip = (i + 1 < len) ? ((chips >> (len - 2 - i)) & 1) : chip;
+
+            for (p = 0; p < US_CONF_NUM_PULSES(config); p++)
+            {
+                if ((p == US_CONF_NUM_PULSES(config) - 1) && (chip != nextChip))
+                    ppgCodeLper[seq][k++] = flipLper;
+                else
+                    ppgCodeLper[seq][k++] = lper;
+            }
+        }
+    }
+
+    ppgCodePulses = k;
+
+    return true;
+}
 
 static inline bool confPPG(void)
 {
     // Refer to the slau367p (page 498)
 
+#if !US_PROFILE_FIXED
     uint64_t temp;
     uint32_t hspllFreq;
+#endif
     volatile uint16_t lper;
     volatile uint16_t per, hper;
 
-    hspllFreq = (uint32_t)(config.pllOutFreq) * 1000000;
-
     // Configure Drive strength
     SAPH_AOCTL1 = ((config.driveStrength << 1) + (config.driveStrength));
 
+#if US_PROFILE_FIXED
+    // Periods are folded in from the profile
+    lper = PROFILE_PPG_LPER;
+    hper = PROFILE_PPG_HPER;
+    per = PROFILE_PPG_PER;
+#else
+    if (config.ppgRegsValid)
+    {
+        // Periods were precomputed by the host
+        lper = config.ppgLper;
+        hper = config.ppgHper;
+        per = lper + hper;
+    }
+    else
+    {
+        hspllFreq = (uint32_t)(config.pllOutFreq) * 1000000;
 
-    // Calculate the period
-    temp = (uint64_t)((uint64_t)hspllFreq + ((uint64_t)config.pulseFreq >> 1));
-    temp /= (uint64_t)(config.pulseFreq);
-    per = (uint16_t) temp;
+        // Calculate the period
+        temp = (uint64_t)((uint64_t)hspllFreq + ((uint64_t)config.pulseFreq >> 1));
+        temp /= (uint64_t)(config.pulseFreq);
+        per = (uint16_t) temp;
 
 
-    // Calculate the ON time
-    temp = (uint64_t)((uint64_t)hspllFreq * (uint64_t)config.pulsesDutyCycle);
-    temp = (uint64_t)((uint64_t)temp - ((uint64_t)(config.pulseFreq) >> 1));
-    temp /= (uint64_t)(config.pulseFreq);
-    hper = (uint16_t) ((temp + 99)/100);
+        // Calculate the ON time
+        temp = (uint64_t)((uint64_t)hspllFreq * (uint64_t)config.pulsesDutyCycle);
+        temp = (uint64_t)((uint64_t)temp - ((uint64_t)(config.pulseFreq) >> 1));
+        temp /= (uint64_t)(config.pulseFreq);
+        hper = (uint16_t) ((temp + 99)/100);
 
-    // Calculate OFF time
-    lper = per - hper;
+        // Calculate OFF time
+        lper = per - hper;
+    }
+#endif
 
     // Check for the maximum value
     if((hper > 255) || (lper > 255))
@@ -369,10 +612,10 @@ static inline bool confPPG(void)
         // PPG cannot generate the selected frequency (too low)
         return false;
     }
-    else
+    else if (US_CONF_PULSE_CODE(config) == PPG_CODE_NONE)
     {
         // Start PPG Configuration
-        SAPH_APGC = ((config.numPulses) |
+        SAPH_APGC = ((US_CONF_NUM_PULSES(config)) |
                     ((config.numStopPulses) << 8));
 
         SAPH_AXPGCTL = (ETY_0 | XMOD_0);
@@ -380,6 +623,39 @@ static inline bool confPPG(void)
         SAPH_APGLPER = lper;
         SAPH_APGHPER = hper;
     }
+    else
+    {
+        // Coded excitation
+        if (buildPpgCode(lper, per) == false)
+        {
+            // Code does not fit into the PPG limits
+            return false;
+        }
+
+        SAPH_APGC = ((ppgCodePulses) |
+                    ((config.numStopPulses) << 8));
+
+        // PPG event after every pulse triggers the DMA
+        // which loads the low period of the next pulse
+        SAPH_AXPGCTL = (ETY_1 | XMOD_0);
+
+        SAPH_APGLPER = ppgCodeLper[0][0];
+        SAPH_APGHPER = hper;
+
+        // Word transfers from the code table to the PPG low period register
+        DMA_initParam param = {0};
+        param.channelSelect = PPG_CODE_DMA_CHANNEL;
+        param.transferModeSelect = DMA_TRANSFER_SINGLE;
+        param.transferSize = ppgCodePulses - 1;
+        param.triggerSourceSelect = PPG_CODE_DMA_TRIGGER;
+        param.transferUnitSelect = DMA_SIZE_SRCWORD_DSTWORD;
+        param.triggerTypeSelect = DMA_TRIGGER_RISINGEDGE;
+        DMA_init(&param);
+
+        DMA_setDstAddress(PPG_CODE_DMA_CHANNEL,
+                          (uint32_t) &SAPH_APGLPER,
+                          DMA_DIRECTION_UNCHANGED);
+    }
 
     // Configure Trigger from ACQ, channel skection by ASQ
     SAPH_APGCTL |= (TRSEL_1 + PGSEL_1);
@@ -392,8 +668,148 @@ static inline bool confPPG(void)
     return true;
 }
 
+void armPpgCode(bool complementary)
+{
+    uint8_t seq = complementary ? 1 : 0;
+
+    if ((US_CONF_PULSE_CODE(config) == PPG_CODE_NONE) || (ppgCodePulses < 2))
+        return;
+
+    // First pulse is loaded directly, the rest is reloaded by the DMA
+    SAPH_AKEY = KEY;
+    SAPH_APGLPER = ppgCodeLper[seq][0];
+    SAPH_AKEY = 0;
+
+    DMA_disableTransfers(PPG_CODE_DMA_CHANNEL);
+    DMA_setSrcAddress(PPG_CODE_DMA_CHANNEL,
+                      (uint32_t) &ppgCodeLper[seq][1],
+                      DMA_DIRECTION_INCREMENT);
+    DMA_setTransferSize(PPG_CODE_DMA_CHANNEL, ppgCodePulses - 1);
+    DMA_enableTransfers(PPG_CODE_DMA_CHANNEL);
+
+    return;
+}
+
+void setRxGain(uint8_t gain)
+{
+    if (SDHSCTL6 == gain)
+        return;
+
+    // SDHS is powered down between the shots
+    // Unlock SDHS registers
+    SDHSCTL3 &= ~(TRIGEN);
+    SDHSCTL6 = gain;
+    // Lock SDHS registers
+    SDHSCTL3 |= (TRIGEN);
+
+    return;
+}
+
 
 bool triggerUsAcq(void)
+{
+    if (wakeUpUss() == false)
+        return false;
+
+    // Not aligned to the slow timer tick, the latency is not measured
+    trigScheduled = false;
+
+    // Trigger through the timer interrupt
+    // This helps to synchronize the start with the other time-sensitive SW events
+    // Such as switching HV MUX to RX
+    startTimerFast();
+
+    return finishUsAcq();
+}
+
+bool triggerUsAcqAtPeriod(void)
+{
+    uint16_t trigger;
+    uint16_t wakeUp;
+    // Save GIE status
+    uint16_t gieStatus = ( __get_SR_register() & GIE);
+
+    // The next period starts at the CC0 compare value
+    trigger = HWREG16(TIMER_SLOW_BASE + OFS_TAxCCR0);
+    wakeUp = trigger - (USS_WAKE_UP_ACLK_TICKS + SCHEDULE_MARGIN_ACLK_TICKS);
+
+    // Too late to wake up the USS before this period, take the next one
+    // (a pending CC0 interrupt has not reloaded the compare value yet)
+    if ((HWREG16(TIMER_SLOW_BASE + OFS_TAxCCTL0) & CCIFG) ||
+        ((uint16_t)(trigger - timerSlowGetCount()) <
+         (USS_WAKE_UP_ACLK_TICKS + SCHEDULE_MARGIN_ACLK_TICKS + 2)))
+    {
+        // The CC0 ISR reloads the compare value
+        __disable_interrupt();
+        while (HWREG16(TIMER_SLOW_BASE + OFS_TAxCCR0) == trigger)
+        {
+            __bis_SR_register(LPM3_bits + GIE);
+            __disable_interrupt();
+        }
+
+        if(gieStatus == GIE)
+        {
+            __bis_SR_register(GIE);
+        }
+
+        trigger = HWREG16(TIMER_SLOW_BASE + OFS_TAxCCR0);
+        wakeUp = trigger - (USS_WAKE_UP_ACLK_TICKS + SCHEDULE_MARGIN_ACLK_TICKS);
+    }
+
+    // Sleep until the USS wake-up, the shot is already prepared
+    timerSlowWaitUntil(wakeUp, LPM3_bits);
+
+    if (wakeUpUss() == false)
+        return false;
+
+    __disable_interrupt();
+
+    if (HWREG16(TIMER_SLOW_BASE + OFS_TAxCCR0) == trigger)
+    {
+        // Arm the shot, the slow timer CC0 ISR starts the fast timer
+        trigArmed = true;
+        trigScheduled = true;
+    }
+    else
+    {
+        // The wake-up took longer than planned, trigger late
+        trigScheduled = false;
+        startTimerFast();
+    }
+
+    // Restore GIE status
+    if(gieStatus == GIE)
+    {
+        __bis_SR_register(GIE);
+    }
+
+    // Stay in LPM0 until the trigger, the DCO wakes up without delay
+    return finishUsAcq();
+}
+
+uint16_t getTrigLatency(void)
+{
+    uint16_t aclkPeriod;
+    uint16_t firstEdge;
+
+    if ((trigScheduled == false) || (trigAclkEdgeCnt < 2))
+        return TRIG_LATENCY_INVALID;
+
+    // The edges are counted from the trigger, the two edges give the ACLK
+    // period in SMCLK cycles (independent of the DCO tolerance)
+    aclkPeriod = trigAclkEdge[1] - trigAclkEdge[0];
+    firstEdge = trigAclkEdge[0];
+
+    // The latency is shorter than one ACLK period, an edge right at the
+    // trigger is missed if the capture was not enabled yet
+    if (firstEdge > aclkPeriod)
+        return 2 * aclkPeriod - firstEdge;
+
+    return aclkPeriod - firstEdge;
+}
+
+// USSXT and UUPS start-up, returns false if either does not start
+static bool wakeUpUss(void)
 {
 
     // Configure SAPH
@@ -469,8 +885,8 @@ bool triggerUsAcq(void)
             return false;
         }
 
-        // ~ 30 us delay
-        timerSlowDelay(1, LPM3_bits);
+        // ~ 60 us delay (shortest delay of the running timer)
+        timerSlowDelay(2, LPM3_bits);
         ussxtl_timeout++;
     }
 
@@ -491,21 +907,28 @@ bool triggerUsAcq(void)
             return false;
         }
 
-        // ~ 30 us delay
-        timerSlowDelay(1, LPM3_bits);
+        // ~ 60 us delay (shortest delay of the running timer)
+        timerSlowDelay(2, LPM3_bits);
         uups_timeout++;
     }
 
-    // Trigger through the timer interrupt
-    // This helps to synchronize the start with the other time-sensitive SW events
-    // Such as switching HV MUX to RX
-    startTimerFast();
+    return true;
+}
 
+// Wait for the acquisition and power down the USS
+static bool finishUsAcq(void)
+{
     // Wait for any of the events
-    waitEvent((SAPH_SEQ_ACQ_DONE_EVENT)  ||
-              (UUPS_INTERRUPT_DBG_EVENT) ||
+    waitEvent((SAPH_SEQ_ACQ_DONE_EVENT)  |
+              (UUPS_INTERRUPT_DBG_EVENT) |
               (HS_PLL_UNLOCK_EVENT), false, LPM0_bits);
 
+    // A shot which failed before its period started is not triggered anymore
+    trigArmed = false;
+
+    // Stop capturing ACLK edges
+    HWREG16(TIMER_FAST_BASE + OFS_TAxCCTL2) = 0;
+
     // Configure GPIOs after conversion
     // E.g. disable OPA
 
@@ -520,6 +943,9 @@ bool triggerUsAcq(void)
         return false;
     }
 
+    // An unlock after the capture does not affect the frame
+    HSPLLIMSC &= ~(PLLUNLOCK);
+
     // Power Down the UUPS after the acquisition is complete
     UUPSCTL |= USSPWRDN;
 
@@ -531,9 +957,9 @@ bool triggerUsAcq(void)
     // Unlock SDHS registers
     SDHSCTL3 &= ~(TRIGEN);
     // Restore SDHSDTCDA address
-    // LEA start address (0x4000)
+    // LEA start address (0x4000), samples follow the frame header
     // Destination location = base address + DTCDA x 2
-    SDHSDTCDA = ((uint32_t)((0x4005) - (0x4000))>>1);
+    SDHSDTCDA = ((uint32_t)((US_FRAME_SAMPLES_ADDR + 1) - (US_FRAME_ADDR))>>1);
     // Lock SDHS registers
     SDHSCTL3 |= (TRIGEN);
 
@@ -543,19 +969,63 @@ bool triggerUsAcq(void)
 void pllUnlockCallback(void)
 {
     // Troubleshooting as described in slau367p (page 481)
+    // Only stop the USS here, the recovery runs from the main loop
+    // (see pllUnlockRecover)
 
     HSPLLIMSC &= ~(PLLUNLOCK);
 
+    // Power Down the UUPS
+    UUPSCTL |= USSPWRDN;
+
+    return;
+}
+
+bool pllUnlockRecover(uint8_t retries)
+{
+    uint16_t remaining;
+
+    // Other errors are not retried
+    if (isEventFlagSet(HS_PLL_UNLOCK_EVENT) == false)
+        return false;
+
+    // The unlock may have stopped the shot before the HV MUX was switched
+    timerStop(TIMER_FAST_BASE);
+    timerDisableCcInt(TIMER_FAST_BASE, OFS_TAxCCTL0);
+    timerDisableCcInt(TIMER_FAST_BASE, OFS_TAxCCTL1);
+
+    // Power off USSXTAL
+    HSPLLUSSXTLCTL &= ~USSXTEN;
+
     // Reset USS Module
     UUPSCTL |= (USSSWRST);
 
     // Release from reset
     UUPSCTL &= ~(USSSWRST);
 
-    // Configure
-    confUsSubsystem();
+    // Time left until the trigger of the next period
+    // (the CC0 compare value is reloaded when the period starts)
+    remaining = HWREG16(TIMER_SLOW_BASE + OFS_TAxCCR0) - timerSlowGetCount();
 
-    return;
+    if ((retries >= PLL_UNLOCK_MAX_RETRIES) ||
+        (usRegCacheValid == false) ||
+        (remaining < pllRetryTicks))
+    {
+        // Drop the shot and apply the full configuration
+        pllStats.dropped++;
+        confUsSubsystem();
+        return false;
+    }
+
+    // Re-apply the cached registers instead of the full configuration
+    restoreUsRegCache();
+    pllStats.retries++;
+
+    return true;
+}
+
+const us_pll_stats_t * getPllStats(void)
+{
+    return &pllStats;
 }
 
 
@@ -564,21 +1034,122 @@ void waitTimerSlowElapse(void)
     waitEvent(TIMER_SLOW_CCR0_EVENT, true, LPM3_bits);
 }
 
+// Convert microseconds to ACLK (32.768 kHz) ticks, rounded up
+static inline uint32_t usToAclkTicks(uint32_t us)
+{
+    // 2148 / 2^16 is slightly above 32768 / 10^6
+    return ((us * 2148UL) >> 16) + 1;
+}
+
+// Length of the capture from the SW trigger until the last sample (in us)
+static uint32_t getCaptureLengthUs(void)
+{
+    uint32_t captureUs;
+
+    // Delay between the SW trigger and the ASQ trigger (SMCLK = 8 MHz)
+    captureUs = ACQUIS_START_DELAY_SMCLK_CYCLES >> 3;
+
+    // ADC sampling start time mark is clocked from HSPLL / 16
+    captureUs += ((uint32_t)config.startAdcSamplCnt << 4) / config.pllOutFreq;
+
+    // Samples are acquired at HSPLL / oversampling rate
+    captureUs += ((uint32_t)US_CONF_SAMPLE_SIZE(config) * (10U << US_CONF_OVER_SAMPL_RATE(config))) /
+                 config.pllOutFreq;
+
+    return captureUs;
+}
+
+// Compute the measurement period and the DC-DC turn on time
+// A period starts with the trigger of the shot, its phases are:
+//   [capture][SPI drain of this frame, prep of the next][USS wake-up]
+//            [DC-DC charge-up for the next shot                     ]
+// The DC-DC converters are turned off once the capture is done,
+// so the charge-up for the next shot can overlap the SPI drain.
+static void updateTimerSlowSchedule(void)
+{
+    uint32_t wakeUp;
+    uint32_t acqEnd;
+    uint32_t drain;
+    uint32_t dcDcSettle;
+    uint32_t minPeriod;
+
+    // The shot is armed a margin before the trigger
+    wakeUp = USS_WAKE_UP_ACLK_TICKS + SCHEDULE_MARGIN_ACLK_TICKS;
+
+    acqEnd = usToAclkTicks(getCaptureLengthUs()) +
+             SCHEDULE_MARGIN_ACLK_TICKS;
+
+    drain = spiDrainTicks + SCHEDULE_MARGIN_ACLK_TICKS;
+
+    dcDcSettle = config.dcDcTurnOnTime;
+    if (dcDcSettle < DCDC_MIN_SETTLE_ACLK_TICKS)
+    {
+        dcDcSettle = DCDC_MIN_SETTLE_ACLK_TICKS;
+    }
+
+    // Both phases run in parallel after the capture
+    if (drain + wakeUp > dcDcSettle)
+    {
+        minPeriod = acqEnd + drain + wakeUp;
+    }
+    else
+    {
+        minPeriod = acqEnd + dcDcSettle;
+    }
+
+    if (minPeriod > 0xFFFF)
+    {
+        minPeriod = 0xFFFF;
+    }
+
+    minMeasPeriod = (uint16_t) minPeriod;
+
+    // A retried shot starts over after the HV DC-DC recharge and
+    // has to leave time for the wake-up before the next period
+    minPeriod = PLL_RETRY_SETTLE_ACLK_TICKS + 2 * wakeUp + acqEnd + drain;
+    pllRetryTicks = (minPeriod > 0xFFFF) ? 0xFFFF : (uint16_t) minPeriod;
+
+    // Never go below the minimum safe period
+    if (config.measPeriod > minMeasPeriod)
+    {
+        measPeriod = config.measPeriod;
+    }
+    else
+    {
+        measPeriod = minMeasPeriod;
+    }
+
+    // DC-DC converters are enabled dcDcSettle ticks before the next shot,
+    // but not earlier than the end of the current capture
+    if (dcDcSettle + acqEnd > measPeriod)
+    {
+        dcDcTurnOnOffset = (uint16_t) acqEnd;
+    }
+    else
+    {
+        dcDcTurnOnOffset = measPeriod - (uint16_t) dcDcSettle;
+    }
+}
+
 void confTimerSlowSwEvents(void)
 {
     // Stop Slow Timer
     timerStop(TIMER_SLOW_BASE);
 
+    // Start from the estimated SPI drain time for the new config
+    spiDrainTicks = SPI_DRAIN_EST_ACLK_TICKS;
+    updateTimerSlowSchedule();
+
     // Configure measurement period
     timerSetCcReg(TIMER_SLOW_BASE,
-                  config.measPeriod,
+                  measPeriod,
                   OFS_TAxCCR0,
                   true,
                   false);
 
     // Configure the time to enable DC-DC converter
     timerSetCcReg(TIMER_SLOW_BASE,
-                  config.dcDcTurnOnTime,
+                  dcDcTurnOnOffset,
                   OFS_TAxCCR2,
                   true,
                   false);
@@ -595,21 +1166,86 @@ void confTimerSlowSwEvents(void)
     timerStartContinuous(TIMER_SLOW_BASE);
 }
 
+#pragma CODE_SECTION(reloadTimerSlowSwEvents, ".TI.ramfunc")
 void reloadTimerSlowSwEvents(void)
 {
-    uint16_t counter;
+    uint16_t periodStart;
 
-    counter = HWREG16(TIMER_SLOW_BASE + OFS_TAxR);
+    // Start the armed shot first, this path sets the trigger latency
+    if (trigArmed)
+    {
+        trigArmed = false;
+        startTimerFast();
+    }
+
+    // Reload from the compare value instead of the counter,
+    // the periods do not drift with the ISR latency
+    periodStart = HWREG16(TIMER_SLOW_BASE + OFS_TAxCCR0);
 
     // Reload measurement period
-    HWREG16(TIMER_SLOW_BASE + OFS_TAxCCR0) = counter + config.measPeriod;
+    HWREG16(TIMER_SLOW_BASE + OFS_TAxCCR0) = periodStart + measPeriod;
 
     // Reload DC-DC turn on time
-    HWREG16(TIMER_SLOW_BASE + OFS_TAxCCR2) = counter + config.dcDcTurnOnTime;
+    HWREG16(TIMER_SLOW_BASE + OFS_TAxCCR2) = periodStart + dcDcTurnOnOffset;
+
+    return;
+}
+
+void updateSpiDrainTime(uint16_t drainTicks)
+{
+    // Keep the longest drain time seen with the active config
+    if (drainTicks <= spiDrainTicks)
+        return;
+
+    // Save GIE status
+    uint16_t gieStatus = ( __get_SR_register() & GIE);
+
+    // The schedule is read by the slow timer CC0 ISR
+    __disable_interrupt();
+
+    spiDrainTicks = drainTicks;
+    updateTimerSlowSchedule();
+
+    // Restore GIE status
+    if(gieStatus == GIE)
+    {
+        __bis_SR_register(GIE);
+    }
+
+    return;
+}
+
+void setMeasPeriod(uint16_t period)
+{
+    // Save GIE status
+    uint16_t gieStatus = ( __get_SR_register() & GIE);
+
+    // The schedule is read by the slow timer CC0 ISR
+    __disable_interrupt();
+
+    config.measPeriod = period;
+    updateTimerSlowSchedule();
+
+    // Restore GIE status
+    if(gieStatus == GIE)
+    {
+        __bis_SR_register(GIE);
+    }
 
     return;
 }
 
+uint16_t getMinMeasPeriod(void)
+{
+    return minMeasPeriod;
+}
+
+#pragma CODE_SECTION(getMeasPeriod, ".TI.ramfunc")
+uint16_t getMeasPeriod(void)
+{
+    return measPeriod;
+}
+
 void pauseTimerSlowSwEvents(void)
 {
     // Disable interrupts associated with US acquisition
@@ -678,6 +1314,7 @@ void startTimerFast(void)
     timerStartContinuous(TIMER_FAST_BASE);
 }
 
+#pragma CODE_SECTION(triggerAcqTimerFastEvent, ".TI.ramfunc")
 void triggerAcqTimerFastEvent(void)
 {
     // Stop fast timer
@@ -700,8 +1337,28 @@ void triggerAcqTimerFastEvent(void)
 
     timerStartContinuous(TIMER_FAST_BASE);
 
+    // Capture the next two ACLK edges to measure the trigger latency
+    // (see getTrigLatency)
+    trigAclkEdgeCnt = 0;
+    HWREG16(TIMER_FAST_BASE + OFS_TAxCCTL2) =
+            (CM_1 | TIMER_FAST_ACLK_CCIS | SCS | CAP | CCIE);
+
     // Trigger ASQ
     SAPH_AASQTRIG = ASQTRIG;
 
     return;
 }
+
+void captureTrigAclkEdge(void)
+{
+    trigAclkEdge[trigAclkEdgeCnt] = HWREG16(TIMER_FAST_BASE + OFS_TAxCCR2);
+    trigAclkEdgeCnt++;
+
+    // Two edges are enough
+    if (trigAclkEdgeCnt == 2)
+    {
+        HWREG16(TIMER_FAST_BASE + OFS_TAxCCTL2) = 0;
+    }
+
+    return;
+}
@@ -180,9 +180,70 @@ typedef enum
 
 } pga_gain_t;
 
+// Coded excitation sequence of the PPG
+typedef enum
+{
+    PPG_CODE_NONE,
+    PPG_CODE_BARKER_5,
+    PPG_CODE_BARKER_7,
+    PPG_CODE_BARKER_11,
+    PPG_CODE_BARKER_13,
+    // Complementary pair, A and B are transmitted on alternating sweeps
+    PPG_CODE_GOLAY_8,
+
+} ppg_code_t;
+
+// Maximum number of pulses of a (coded) burst
+#define PPG_CODE_MAX_PULSES    30
+
+// DMA channel reloading the PPG low period for every pulse of a coded burst
+#define PPG_CODE_DMA_CHANNEL   DMA_CHANNEL_2
+// SAPH_A PPG event (DMA trigger assignments of the MSP430FR5043 datasheet)
+#define PPG_CODE_DMA_TRIGGER   DMA_TRIGGERSOURCE_29
+
 // Around 9 uS
 #define ACQUIS_START_DELAY_SMCLK_CYCLES    72
 
+// US frame in LEA RAM: header followed by the samples
+#define US_FRAME_ADDR          (0x4000)
+#define US_FRAME_HEADER_LEN    (12)
+#define US_FRAME_NUM_SAMPLES   (400)
+#define US_FRAME_SAMPLES_ADDR  (US_FRAME_ADDR + US_FRAME_HEADER_LEN)
+
+//// Slow timer (ACLK, 32.768 kHz) scheduling of the measurement period ////
+
+// USSXT and UUPS start-up before the ASQ is triggered (~250 us)
+#define USS_WAKE_UP_ACLK_TICKS             8
+// Initial estimate of the time the nRF52 needs to drain one frame over SPI
+// (4 transfers paced at 300 us + transfer time), replaced by the measured one
+#define SPI_DRAIN_EST_ACLK_TICKS           49
+// Safety margin added to every phase of the schedule (~60 us)
+#define SCHEDULE_MARGIN_ACLK_TICKS         2
+
+//// Trigger timing ////
+
+// Shots are armed ahead of the period and started by the slow timer CC0 ISR.
+// The fast timer captures the ACLK edges after the ASQ trigger to measure
+// the latency from the slow timer tick to the trigger (in SMCLK cycles).
+#define TRIG_LATENCY_INVALID               0xFFFF
+
+//// Recovery from HSPLL unlock events ////
+
+// Retries of a shot lost to a PLL unlock within the same period
+#define PLL_UNLOCK_MAX_RETRIES             2
+// Recharge time of the HV DC-DC before a retried shot (~1 ms)
+#define PLL_RETRY_SETTLE_ACLK_TICKS        33
+// Shortest HV DC-DC settle time before a shot (~5 ms), shorter
+// settings would fire before the HV is charged
+#define DCDC_MIN_SETTLE_ACLK_TICKS         164
+
+// PLL unlock recovery counters since power-up (every unlock ends in a retry or a drop)
+typedef struct
+{
+    uint16_t retries;   // Shots retried with the cached registers
+    uint16_t dropped;   // Shots dropped (no time left or retries exhausted)
+} us_pll_stats_t;
+
 // MSP ultrasound sybsystem configuration struct
 typedef struct
 {
@@ -208,6 +269,7 @@ typedef struct
 
     // Extra time events (SW-managed)
     uint16_t startHvMuxRxCnt;
+    // HV DC-DC settle time before the shot (ACLK ticks)
     uint16_t dcDcTurnOnTime;
 
 
@@ -217,6 +279,20 @@ typedef struct
     uint8_t  rxGain;
     uint16_t measPeriod;
 
+    // Adaptive measurement period (disabled if adaptMaxPeriod is 0)
+    uint16_t adaptMinPeriod;
+    uint16_t adaptMaxPeriod;
+    uint16_t motionThreshold;
+
+    // Reference frame subtraction (mode and log2 of the averaged frames)
+    uint8_t refMode;
+    uint8_t refAvgShift;
+
+    // Automatic gain control (disabled if agcTargetRms is 0)
+    uint16_t agcTargetRms;
+    uint8_t  agcMinGain;
+    uint8_t  agcMaxGain;
+
     // TX/RX configurations
     uint8_t  txRxConfLen;
     uint16_t txConfigs[TX_RX_CONF_LEN_MAX];
@@ -228,8 +304,13 @@ typedef struct
     uint32_t transFreq; // Reserved, not used
     uint32_t pulseFreq;
     uint8_t  pulsesDutyCycle; // 0-255 ( 0 - 100 %)
-    uint8_t  numPulses;
+    uint8_t  numPulses; // Pulses per chip if pulseCode is set
     uint8_t  numStopPulses;
+    ppg_code_t pulseCode;
+    // Precomputed PPG periods (register-level config package)
+    bool ppgRegsValid;
+    uint16_t ppgLper;
+    uint16_t ppgHper;
     ppg_pulse_polarity_t pulserPolarity;
     ppg_pause_state_t pulserPauseState;
 
@@ -240,11 +321,26 @@ typedef struct
 void setNewUsConfig(msp_config_t *newConfig);
 bool confUsSubsystem(void);
 static inline bool confPPG(void);
+// Load the coded burst for the next shot (no effect without coded excitation)
+void armPpgCode(bool complementary);
+// Change the PGA gain (SDHSCTL6) for the next shot
+void setRxGain(uint8_t gain);
+// Trigger immediately (e.g. to retry a shot)
 bool triggerUsAcq(void);
+// Wake up the USS before the next slow timer period and trigger at its start
+bool triggerUsAcqAtPeriod(void);
+// Latency of the last shot from the slow timer tick to the ASQ trigger
+// (SMCLK cycles, TRIG_LATENCY_INVALID if the shot was not triggered by the period)
+uint16_t getTrigLatency(void);
 
 //// Helper-Ultrasound functions ////
 
 void pllUnlockCallback(void);
+// Recover from a PLL unlock of the last shot by re-applying the cached
+// register set. Returns true if the shot can be retried in this period,
+// otherwise the full configuration is applied and the shot is dropped.
+bool pllUnlockRecover(uint8_t retries);
+const us_pll_stats_t * getPllStats(void);
 
 // Slow-timer related functions
 void waitTimerSlowElapse(void);
@@ -252,10 +348,24 @@ void confTimerSlowSwEvents(void);
 void reloadTimerSlowSwEvents(void);
 void pauseTimerSlowSwEvents(void);
 
+// Report the measured SPI drain time of the last frame (in ACLK ticks)
+// The schedule of the next periods is extended if required
+void updateSpiDrainTime(uint16_t drainTicks);
+// Minimum safe measurement period for the active config (in ACLK ticks)
+uint16_t getMinMeasPeriod(void);
+// Measurement period actually applied by the slow timer (in ACLK ticks)
+uint16_t getMeasPeriod(void);
+// Change the requested measurement period of the active config (in ACLK ticks)
+// Takes effect with the next period
+void setMeasPeriod(uint16_t period);
+
 // Fast timer related functions
 void confTimerFastSwEvents(void);
 void startTimerFast(void);
 void triggerAcqTimerFastEvent(void);
+void captureTrigAclkEdge(void);
 
+// Compile-time acquisition profile (US_CONF_* accessors)
+#include "us_profile.h"
 
 #endif /* USLIB_USLIB_H_ */
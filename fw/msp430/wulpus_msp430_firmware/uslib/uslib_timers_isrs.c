@@ -20,23 +20,29 @@
 
 #include "uslib_timers_isrs.h"
 
-// FRAM variables
-#pragma PERSISTENT(TIMER_SLOW_CCR0_CALLBACK)
-#pragma PERSISTENT(TIMER_SLOW_CCR1_CALLBACK)
-#pragma PERSISTENT(TIMER_SLOW_CCR2_CALLBACK)
-
-#pragma PERSISTENT(TIMER_FAST_CCR0_CALLBACK)
-#pragma PERSISTENT(TIMER_FAST_CCR1_CALLBACK)
-#pragma PERSISTENT(TIMER_FAST_CCR2_CALLBACK)
-
-#pragma PERSISTENT(HS_PLL_UNLOCK_CALLBACK)
-#pragma PERSISTENT(UUPS_PWR_UP_TIMEOUT_CALLBACK)
-#pragma PERSISTENT(UUPS_INTERRUPT_DBG_CALLBACK)
-#pragma PERSISTENT(SAPH_DATA_ERROR_CALLBACK)
-#pragma PERSISTENT(SAPH_TIME_MF_TIMEOUT_CALLBACK)
-#pragma PERSISTENT(SAPH_SEQ_ACQ_DONE_CALLBACK)
-#pragma PERSISTENT(SAPH_PNGND_CALLBACK)
-
+// Functions of the per-frame interrupt path run from RAM
+// (FRAM needs wait states at MCLK = 16 MHz, RAM does not)
+#pragma CODE_SECTION(timerSlowCc0Int, ".TI.ramfunc")
+#pragma CODE_SECTION(timerSlowCc1Int, ".TI.ramfunc")
+#pragma CODE_SECTION(timerFastCc0Int, ".TI.ramfunc")
+#pragma CODE_SECTION(timerFastCc1Int, ".TI.ramfunc")
+#pragma CODE_SECTION(ISR_SAPH, ".TI.ramfunc")
+
+#pragma CODE_SECTION(timerSetCcReg, ".TI.ramfunc")
+#pragma CODE_SECTION(timerStop, ".TI.ramfunc")
+#pragma CODE_SECTION(timerStartContinuous, ".TI.ramfunc")
+#pragma CODE_SECTION(timerClearCcIntFlag, ".TI.ramfunc")
+#pragma CODE_SECTION(timerEnableCcInt, ".TI.ramfunc")
+#pragma CODE_SECTION(timerDisableCcInt, ".TI.ramfunc")
+#pragma CODE_SECTION(timerFastStop, ".TI.ramfunc")
+
+#pragma CODE_SECTION(waitEvent, ".TI.ramfunc")
+#pragma CODE_SECTION(isEventFlagSet, ".TI.ramfunc")
+#pragma CODE_SECTION(setEventFlag, ".TI.ramfunc")
+#pragma CODE_SECTION(clearEventFlag, ".TI.ramfunc")
+
+// Callbacks are hooked after every power-up (see configAfterPowerUp),
+// keep them in RAM so the ISRs do not fetch them from FRAM
 
 void (*TIMER_SLOW_CCR0_CALLBACK) (void)=0;
 void (*TIMER_SLOW_CCR1_CALLBACK) (void)=0;
@@ -97,18 +103,41 @@ void timerSlowStop()
     return;
 }
 
+uint16_t timerSlowGetCount(void)
+{
+    // ACLK is asynchronous to MCLK, read until two values match
+    uint16_t count;
+
+    do
+    {
+        count = HWREG16(TIMER_SLOW_BASE + OFS_TAxR);
+    } while (count != HWREG16(TIMER_SLOW_BASE + OFS_TAxR));
+
+    return count;
+}
+
 
 void timerSlowDelay(uint16_t delay, uint16_t lpmBits)
+{
+    // A compare value the counter reaches before it is written is missed
+    if (delay < 2)
+    {
+        delay = 2;
+    }
+
+    timerSlowWaitUntil(timerSlowGetCount() + delay, lpmBits);
+
+    return;
+}
+
+void timerSlowWaitUntil(uint16_t count, uint16_t lpmBits)
 {
     // Save GIE status
     uint16_t gieStatus = ( __get_SR_register() & GIE);
 
-    // Write delay value to the capture compare reg 1
-    timerSetCcReg(TIMER_SLOW_BASE,
-                  delay,
-                  OFS_TAxCCR1,
-                  true,
-                  true);
+    // Write the absolute time to the capture compare reg 1
+    // The timer is not halted, halting it shifts the measurement period
+    HWREG16(TIMER_SLOW_BASE + OFS_TAxCCR1) = count;
 
     // Clear pending interrupt flag
     HWREG16(TIMER_SLOW_BASE + OFS_TAxCCTL1) &= ~(CCIFG);
@@ -42,6 +42,9 @@
 #define TIMER_FAST_BASE          (TIMER_A0_BASE)
 #define TIMER_FAST_CC0_VECTOR    (TIMER0_A0_VECTOR)
 #define TIMER_FAST_CC1_VECTOR    (TIMER0_A1_VECTOR)
+// ACLK is internally connected to the CCI2B input of the fast timer,
+// CCR2 captures the ACLK edges following the ASQ trigger
+#define TIMER_FAST_ACLK_CCIS     (CCIS_1)
 
 // Callbacks
 extern void (*TIMER_SLOW_CCR0_CALLBACK)(void);
@@ -84,8 +87,12 @@ extern void (*SAPH_PNGND_CALLBACK)          (void);
 
 void timerSlowInit(void);
 void timerSlowStop(void);
-// Blocking function
+// Current value of the free-running slow timer counter
+uint16_t timerSlowGetCount(void);
+// Blocking functions, the slow timer keeps running (at least 2 ticks)
 void timerSlowDelay(uint16_t delay, uint16_t lpmBits);
+// Wait until the counter reaches count (at least 2 ticks ahead)
+void timerSlowWaitUntil(uint16_t count, uint16_t lpmBits);
 
 
 void timerFastInit(void);
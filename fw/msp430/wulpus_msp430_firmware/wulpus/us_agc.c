@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2024 ETH Zurich. All rights reserved.
+ *
+ * Author: Sergei Vostrikov, ETH Zurich
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * 
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "us_agc.h"
+#include "uslib.h"
+
+// Current gain and smoothed mean square of every TX/RX config
+static uint8_t agcGain[TX_RX_CONF_LEN_MAX];
+static uint32_t agcMeanSq[TX_RX_CONF_LEN_MAX];
+static bool agcMeanSqValid[TX_RX_CONF_LEN_MAX];
+
+static bool agcEnabled = false;
+static uint8_t agcMinGain;
+static uint8_t agcMaxGain;
+// Mean square band around the target (about -2 dB and +2 dB)
+static uint32_t agcLowerMeanSq;
+static uint32_t agcUpperMeanSq;
+
+void agcInit(uint8_t gain, uint8_t minGain, uint8_t maxGain, uint16_t targetRms)
+{
+    uint32_t targetMeanSq = (uint32_t)targetRms * targetRms;
+    uint8_t i;
+
+    agcEnabled = (targetRms != 0);
+    agcMinGain = minGain;
+    agcMaxGain = maxGain;
+    agcLowerMeanSq = (targetMeanSq * 5) >> 3;
+    agcUpperMeanSq = (targetMeanSq * 8) / 5;
+
+    if (agcEnabled)
+    {
+        if (gain < minGain)
+            gain = minGain;
+        if (gain > maxGain)
+            gain = maxGain;
+    }
+
+    for (i = 0; i < TX_RX_CONF_LEN_MAX; i++)
+    {
+        agcGain[i] = gain;
+        agcMeanSqValid[i] = false;
+    }
+    return;
+}
+
+#pragma CODE_SECTION(agcGetGain, ".TI.ramfunc")
+uint8_t agcGetGain(uint8_t txRxId)
+{
+    return agcGain[txRxId];
+}
+
+void agcUpdate(uint8_t txRxId, const int16_t * samples)
+{
+    uint32_t sumSq = 0;
+    uint32_t meanSq;
+    uint16_t peak = 0;
+    uint16_t absX;
+    uint16_t i;
+    uint8_t gain = agcGain[txRxId];
+    int16_t x;
+
+    if (!agcEnabled)
+        return;
+
+    for (i = 0; i < US_FRAME_NUM_SAMPLES; i++)
+    {
+        x = *samples++;
+        absX = (x < 0) ? (uint16_t)(0 - (uint16_t)x) : (uint16_t)x;
+        if (absX > peak)
+            peak = absX;
+        sumSq += (uint32_t)absX * absX;
+    }
+    meanSq = sumSq / US_FRAME_NUM_SAMPLES;
+
+    if (peak >= AGC_CLIP_LEVEL)
+    {
+        // Clipped: back off quickly
+        gain = (gain > agcMinGain + AGC_CLIP_STEP) ? (gain - AGC_CLIP_STEP) : agcMinGain;
+    }
+    else
+    {
+        // Smooth the mean square over the frames of the config (1/4 new)
+        if (agcMeanSqValid[txRxId])
+            meanSq = (agcMeanSq[txRxId] * 3 + meanSq) >> 2;
+        agcMeanSq[txRxId] = meanSq;
+        agcMeanSqValid[txRxId] = true;
+
+        if ((meanSq > agcUpperMeanSq) && (gain > agcMinGain))
+            gain--;
+        else if ((meanSq < agcLowerMeanSq) && (peak < AGC_PEAK_HEADROOM) && (gain < agcMaxGain))
+            gain++;
+    }
+
+    if (gain != agcGain[txRxId])
+    {
+        // The smoothed level belongs to the old gain
+        agcGain[txRxId] = gain;
+        agcMeanSqValid[txRxId] = false;
+    }
+    return;
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2024 ETH Zurich. All rights reserved.
+ *
+ * Author: Sergei Vostrikov, ETH Zurich
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * 
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef US_AGC_H_
+#define US_AGC_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Peak amplitude at which a frame is considered clipped (12-bit ADC)
+#define AGC_CLIP_LEVEL        2040
+// Gain is only raised while the peak stays below this amplitude
+#define AGC_PEAK_HEADROOM     1700
+// Gain codes removed at once after a clipped frame (about 6 dB)
+#define AGC_CLIP_STEP         8
+
+// Start the AGC of all TX/RX configs at the given gain
+// A target RMS of 0 disables the AGC, the initial gain is kept
+void agcInit(uint8_t gain, uint8_t minGain, uint8_t maxGain, uint16_t targetRms);
+
+// Get the PGA gain (SDHSCTL6) to be applied for the next shot of a config
+uint8_t agcGetGain(uint8_t txRxId);
+
+// Track the peak and RMS of a frame and adjust the gain of its config
+// A clipped frame drops the gain immediately, otherwise the gain is
+// stepped by one code when the smoothed RMS leaves the +/- 2 dB
+// band around the target.
+void agcUpdate(uint8_t txRxId, const int16_t * samples);
+
+#endif /* US_AGC_H_ */
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2024 ETH Zurich. All rights reserved.
+ *
+ * Author: Sergei Vostrikov, ETH Zurich
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * 
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+
+#include "us_fram_ring.h"
+#include "us_spi.h"
+
+// Frames are kept in FRAM, so they survive long outages without using RAM
+#pragma PERSISTENT(framRingBuf)
+static uint8_t framRingBuf[FRAM_RING_LEN][BYTES_PR_XFER_TX] = {{0}};
+
+static uint8_t framRingHead = 0;
+static uint8_t framRingTail = 0;
+static uint8_t framRingCount = 0;
+
+void framRingReset(void)
+{
+    framRingHead = 0;
+    framRingTail = 0;
+    framRingCount = 0;
+    return;
+}
+
+void framRingPush(const uint8_t * frame)
+{
+    memcpy(framRingBuf[framRingHead], frame, BYTES_PR_XFER_TX);
+
+    framRingHead = (framRingHead + 1) % FRAM_RING_LEN;
+
+    if (framRingCount == FRAM_RING_LEN)
+    {
+        // Ring is full, drop the oldest frame
+        // (the gap is visible in the frame numbers)
+        framRingTail = (framRingTail + 1) % FRAM_RING_LEN;
+    }
+    else
+    {
+        framRingCount++;
+    }
+    return;
+}
+
+const uint8_t * framRingPeek(void)
+{
+    return framRingBuf[framRingTail];
+}
+
+void framRingPop(void)
+{
+    if (framRingCount == 0)
+        return;
+
+    framRingTail = (framRingTail + 1) % FRAM_RING_LEN;
+    framRingCount--;
+    return;
+}
+
+bool framRingIsEmpty(void)
+{
+    return (framRingCount == 0);
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2024 ETH Zurich. All rights reserved.
+ *
+ * Author: Sergei Vostrikov, ETH Zurich
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * 
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef US_FRAM_RING_H_
+#define US_FRAM_RING_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Number of US frames kept in FRAM while the BLE link is not ready
+#define FRAM_RING_LEN    12
+
+// Forget all stored frames
+void framRingReset(void);
+
+// Store a US frame (BYTES_PR_XFER_TX bytes)
+// Overwrites the oldest frame if the ring is full
+void framRingPush(const uint8_t * frame);
+
+// Get the oldest stored frame (only valid if the ring is not empty)
+const uint8_t * framRingPeek(void);
+
+// Remove the oldest stored frame
+void framRingPop(void);
+
+bool framRingIsEmpty(void);
+
+#endif /* US_FRAM_RING_H_ */
@@ -21,6 +21,9 @@
 #include "us_hv_mux.h"
 #include "us_spi.h"
 
+// Latching is done in the fast timer CC0 ISR, run it from RAM
+#pragma CODE_SECTION(hvMuxLatchOutput, ".TI.ramfunc")
+
 void hvMuxInit(void)
 {
     // Configure SPI pins
@@ -96,12 +99,13 @@ void hvMuxConfRx(uint16_t rx_config)
 void hvMuxLatchOutput(void)
 {
     // Pull ~LE Low to latch the signal
-    GPIO_setOutputLowOnPin(LE_PIN_PORT, LE_PIN);
+    // (LE_PIN on P5, written directly instead of through the driverlib)
+    P5OUT &= ~LE_PIN;
 
     // Wait
     __delay_cycles(DELAY_CYCLES);
 
     // Pull ~LE High
-    GPIO_setOutputHighOnPin(LE_PIN_PORT, LE_PIN);
+    P5OUT |= LE_PIN;
 
 }
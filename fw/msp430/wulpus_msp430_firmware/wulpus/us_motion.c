@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2024 ETH Zurich. All rights reserved.
+ *
+ * Author: Sergei Vostrikov, ETH Zurich
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * 
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+
+#include "us_motion.h"
+#include "uslib.h"
+
+#define MOTION_BIN_LEN    (US_FRAME_NUM_SAMPLES / MOTION_NUM_BINS)
+
+// Amplitude profile of the last frame of every TX/RX config
+static uint16_t motionProfile[TX_RX_CONF_LEN_MAX][MOTION_NUM_BINS];
+static bool motionProfileValid[TX_RX_CONF_LEN_MAX];
+
+void motionReset(void)
+{
+    memset(motionProfileValid, 0, sizeof(motionProfileValid));
+    return;
+}
+
+uint16_t motionGetEnergy(uint8_t txRxId, const int16_t * samples)
+{
+    uint16_t * profile = motionProfile[txRxId];
+    uint32_t energy = 0;
+    uint32_t sum;
+    uint16_t level;
+    uint8_t bin, i;
+    int16_t x;
+
+    for (bin = 0; bin < MOTION_NUM_BINS; bin++)
+    {
+        sum = 0;
+        for (i = 0; i < MOTION_BIN_LEN; i++)
+        {
+            x = *samples++;
+            sum += (x < 0) ? (uint16_t)(0 - (uint16_t)x) : (uint16_t)x;
+        }
+
+        // Mean absolute amplitude (approximated with a shift)
+        level = (uint16_t) (sum >> 4);
+
+        if (motionProfileValid[txRxId])
+        {
+            energy += (level > profile[bin]) ? (level - profile[bin]) : (profile[bin] - level);
+        }
+
+        profile[bin] = level;
+    }
+
+    motionProfileValid[txRxId] = true;
+
+    return (energy > 0xFFFF) ? 0xFFFF : (uint16_t) energy;
+}
+
+uint16_t motionAdaptPeriod(uint16_t period,
+                           uint16_t energy,
+                           uint16_t threshold,
+                           uint16_t minPeriod,
+                           uint16_t maxPeriod)
+{
+    uint32_t newPeriod;
+
+    if (energy > threshold)
+    {
+        // Motion: halve the period to catch up quickly
+        newPeriod = period >> 1;
+    }
+    else
+    {
+        // Static scene: slowly stretch the period (+1/16 per frame)
+        newPeriod = (uint32_t)period + (period >> 4) + 1;
+    }
+
+    if (newPeriod < minPeriod)
+        newPeriod = minPeriod;
+    if (newPeriod > maxPeriod)
+        newPeriod = maxPeriod;
+
+    return (uint16_t) newPeriod;
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2024 ETH Zurich. All rights reserved.
+ *
+ * Author: Sergei Vostrikov, ETH Zurich
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * 
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef US_MOTION_H_
+#define US_MOTION_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Number of bins of the amplitude profile
+#define MOTION_NUM_BINS       16
+
+// Forget the amplitude profiles of all TX/RX configs
+void motionReset(void);
+
+// Compute the frame-difference energy of a frame
+// The energy is the sum over all bins of the absolute change of the
+// mean absolute amplitude (sum |x| / 16) since the last frame with the
+// same TX/RX config. Returns 0 for the first frame of a config.
+uint16_t motionGetEnergy(uint8_t txRxId, const int16_t * samples);
+
+// Ramp the measurement period down on motion and back up when static
+// Returns the new period clamped to [minPeriod, maxPeriod]
+uint16_t motionAdaptPeriod(uint16_t period,
+                           uint16_t energy,
+                           uint16_t threshold,
+                           uint16_t minPeriod,
+                           uint16_t maxPeriod);
+
+#endif /* US_MOTION_H_ */
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2024 ETH Zurich. All rights reserved.
+ *
+ * Author: Sergei Vostrikov, ETH Zurich
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * 
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+
+#include "us_ref_frame.h"
+#include "uslib.h"
+
+// Reference frames are kept in FRAM, so they can be reused after a power cycle
+#pragma PERSISTENT(refFrames)
+static int16_t refFrames[REF_FRAME_MAX_CONFIGS][US_FRAME_NUM_SAMPLES] = {{0}};
+#pragma PERSISTENT(refFramesValid)
+static uint16_t refFramesValid = 0;
+
+static uint8_t refMode = REF_MODE_OFF;
+static uint8_t refAvgShift = 0;
+// Number of frames summed up per TX/RX config during the capture
+static uint8_t refCaptCount[REF_FRAME_MAX_CONFIGS];
+
+void refFrameInit(uint8_t mode, uint8_t avgShift)
+{
+    refMode = mode;
+    refAvgShift = (avgShift > REF_FRAME_AVG_SHIFT_MAX) ? REF_FRAME_AVG_SHIFT_MAX : avgShift;
+
+    if (refMode == REF_MODE_CAPTURE)
+    {
+        // Start a new capture for all TX/RX configs
+        refFramesValid = 0;
+        memset(refCaptCount, 0, sizeof(refCaptCount));
+    }
+    return;
+}
+
+bool refFrameProcess(uint8_t txRxId, int16_t * samples)
+{
+    int16_t * ref;
+    uint16_t i;
+
+    if ((refMode == REF_MODE_OFF) || (txRxId >= REF_FRAME_MAX_CONFIGS))
+        return false;
+
+    ref = refFrames[txRxId];
+
+    if (refFramesValid & (1U << txRxId))
+    {
+        // Remove ringdown and crosstalk
+        for (i = 0; i < US_FRAME_NUM_SAMPLES; i++)
+        {
+            samples[i] -= ref[i];
+        }
+        return true;
+    }
+
+    if (refMode != REF_MODE_CAPTURE)
+        return false;
+
+    // Sum up the frames of the capture, they are sent unmodified
+    if (refCaptCount[txRxId] == 0)
+    {
+        memcpy(ref, samples, sizeof(refFrames[0]));
+    }
+    else
+    {
+        for (i = 0; i < US_FRAME_NUM_SAMPLES; i++)
+        {
+            ref[i] += samples[i];
+        }
+    }
+    refCaptCount[txRxId]++;
+
+    if (refCaptCount[txRxId] == (1U << refAvgShift))
+    {
+        // Average with rounding (arithmetic shift)
+        if (refAvgShift != 0)
+        {
+            for (i = 0; i < US_FRAME_NUM_SAMPLES; i++)
+            {
+                ref[i] = (int16_t) (((int32_t)ref[i] + (1 << (refAvgShift - 1))) >> refAvgShift);
+            }
+        }
+        refFramesValid |= (1U << txRxId);
+    }
+
+    return false;
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2024 ETH Zurich. All rights reserved.
+ *
+ * Author: Sergei Vostrikov, ETH Zurich
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * 
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef US_REF_FRAME_H_
+#define US_REF_FRAME_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Number of TX/RX configs with a reference frame (limited by FRAM)
+#define REF_FRAME_MAX_CONFIGS    8
+// Up to 2^4 frames are averaged (the sum of 12-bit samples fits into 16 bits)
+#define REF_FRAME_AVG_SHIFT_MAX  4
+
+// Reference subtraction modes
+// Capture: average the first frames of every TX/RX config, then subtract
+// Stored: subtract the reference kept in FRAM from a previous capture
+#define REF_MODE_OFF             0
+#define REF_MODE_CAPTURE         1
+#define REF_MODE_STORED          2
+
+// Prepare the reference frames for a new acquisition session
+void refFrameInit(uint8_t mode, uint8_t avgShift);
+
+// Capture or subtract the reference of the TX/RX config in place
+// Returns true if the reference was subtracted from the samples
+bool refFrameProcess(uint8_t txRxId, int16_t * samples);
+
+#endif /* US_REF_FRAME_H_ */
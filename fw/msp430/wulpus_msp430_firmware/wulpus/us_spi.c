@@ -23,10 +23,18 @@
 #include "us_spi.h"
 
 // Buffers for US data
+// Word aligned to allow direct word access to register-level config packages
+#pragma DATA_ALIGN(s_rx_buf_1, 2)
 uint8_t s_rx_buf_1[BYTES_PR_XFER_TX] = {0};
 
 static uint8_t dmaRxIsrFlag = 0;
 
+// Re-arming the DMA after every frame is part of the per-frame path,
+// run it from RAM with direct register access (see uslib_timers_isrs.c)
+#pragma CODE_SECTION(ISR_DMA, ".TI.ramfunc")
+#pragma CODE_SECTION(usStartSPI, ".TI.ramfunc")
+#pragma CODE_SECTION(usStartSPIFrom, ".TI.ramfunc")
+#pragma CODE_SECTION(usSpiEnableDmaRxIsr, ".TI.ramfunc")
 
 // DMA interrupt service routine
 #pragma vector=DMA_VECTOR
@@ -34,7 +42,7 @@ __interrupt void ISR_DMA (void)
 {
     // Exit LPM0 state
     __bic_SR_register_on_exit(LPM0_bits);
-    DMA_clearInterrupt(DMA_CHANNEL_1);
+    DMA1CTL &= ~DMAIFG;
     dmaRxIsrFlag = 1;
 }
 
@@ -46,29 +54,40 @@ __interrupt void ISR_DMA (void)
 void usStartSPI(void)
 {
     // Double buffering not yet implemented
+    usStartSPIFrom(0x4000);
 
+    return;
+}
+
+// Function to start SPI transaction of a frame stored at srcAddr
+// Used to flush the frames kept in FRAM while the BLE link was not ready.
+void usStartSPIFrom(uint32_t srcAddr)
+{
     // Fill in first byte to SPI TX buffer to be ready when the transaction starts
-    uint8_t first_byte;
-    memcpy(&first_byte, (uint16_t *) 0x4000, 1);
-    UCA1TXBUF = first_byte;
+    UCA1TXBUF = *((uint8_t *) srcAddr);
 
     // Set Source address of DMA channel 0 to US data, start at second byte
-    DMA_disableTransfers(DMA_CHANNEL_0);
-    DMA_setSrcAddress(DMA_CHANNEL_0,
-                      (uint32_t) 0x4001,
-                      DMA_DIRECTION_INCREMENT);
-    DMA_enableTransfers(DMA_CHANNEL_0);
+    // (same register sequence as DMA_setSrcAddress with DMA_DIRECTION_INCREMENT)
+    DMA0CTL &= ~DMAEN;
+    __data16_write_addr((unsigned short) &DMA0SA, srcAddr + 1);
+    DMA0CTL |= DMASRCINCR_3;
+    DMA0CTL |= DMAEN;
 
     // Set Destination address of DMA channel 1 to s_rx_buf_1
-    DMA_disableTransfers(DMA_CHANNEL_1);
-    DMA_setDstAddress(DMA_CHANNEL_1,
-                      (uint32_t) s_rx_buf_1,
-                      DMA_DIRECTION_INCREMENT);
-    DMA_enableTransfers(DMA_CHANNEL_1);
+    DMA1CTL &= ~DMAEN;
+    __data16_write_addr((unsigned short) &DMA1DA, (uint32_t) s_rx_buf_1);
+    DMA1CTL |= DMADSTINCR_3;
+    DMA1CTL |= DMAEN;
 
     return;
 }
 
+// Raise "Data ready" signal for SPI master to initiate the SPI transfer
+void usSpiSetDataReady(void)
+{
+    GPIO_setOutputHighOnPin(GPIO_PORT_DATA_READY, GPIO_PIN_DATA_READY);
+}
+
 // Wait for interrupt that indicates DMA RX complete
 void usWaitForSpiDmaRx(void)
 {
@@ -109,7 +128,7 @@ uint8_t * usSpiGetRxPtr(void)
 
 void usSpiEnableDmaRxIsr(void)
 {
-    DMA_enableInterrupt(DMA_CHANNEL_1);
+    DMA1CTL |= DMAIE;
     return;
 }
 
@@ -22,8 +22,8 @@
 #define US_SPI_H_
 
 // Number of bytes in one SPI transfer
-// 4 Bytes Header + 800 Bytes US frame
-#define BYTES_PR_XFER_TX 804
+// 12 Bytes Header + 800 Bytes US frame
+#define BYTES_PR_XFER_TX 812
 
 // Defines for data ready signal
 #define GPIO_PORT_DATA_READY GPIO_PORT_P4
@@ -45,6 +45,14 @@ void usSpiInit(void);
 // the DMA.
 void usStartSPI(void);
 
+// Function to start SPI transaction of a frame stored at srcAddr
+// Used to flush the frames kept in FRAM while the BLE link was not ready.
+void usStartSPIFrom(uint32_t srcAddr);
+
+// Raise "Data ready" signal for the SPI master
+// Lets the CPU work while the frame is drained (also raised by usWaitForSpiDmaRx)
+void usSpiSetDataReady(void);
+
 // Wait for interrupt that indicates DMA RX complete
 void usWaitForSpiDmaRx(void);
 
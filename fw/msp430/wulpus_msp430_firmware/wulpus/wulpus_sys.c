@@ -20,6 +20,23 @@
 
 #include "wulpus_sys.h"
 
+static bool isAgcConfigValid(const msp_config_t * msp_config);
+static bool isFullFrameConfig(const msp_config_t * msp_config);
+static bool isProfileConfig(const msp_config_t * msp_config);
+
+// Power switches toggled on every frame run from RAM and write the
+// port registers directly (see uslib_timers_isrs.c)
+#pragma CODE_SECTION(enableOpAmp, ".TI.ramfunc")
+#pragma CODE_SECTION(disableOpAmp, ".TI.ramfunc")
+#pragma CODE_SECTION(enableHvPcbDcDc, ".TI.ramfunc")
+#pragma CODE_SECTION(disableHvPcbDcDc, ".TI.ramfunc")
+#pragma CODE_SECTION(disableHvDcDc, ".TI.ramfunc")
+
+#if US_PROFILE_FIXED
+// TX/RX table of the compile-time profile
+const uint16_t profileTxConfigs[PROFILE_TX_RX_CONF_LEN] = PROFILE_TX_CONFIGS;
+const uint16_t profileRxConfigs[PROFILE_TX_RX_CONF_LEN] = PROFILE_RX_CONFIGS;
+#endif
 
 void getDefaultUsConfig(msp_config_t * msp_config)
 {
@@ -68,6 +85,22 @@ void getDefaultUsConfig(msp_config_t * msp_config)
     msp_config->pulsesDutyCycle = 50; // 50 %
     msp_config->numPulses = 2;
     msp_config->numStopPulses = 0;
+    msp_config->pulseCode = PPG_CODE_NONE;
+    msp_config->ppgRegsValid = false;
+
+    // Adaptive measurement period disabled
+    msp_config->adaptMinPeriod = 0;
+    msp_config->adaptMaxPeriod = 0;
+    msp_config->motionThreshold = 0;
+
+    // No reference frame subtraction
+    msp_config->refMode = REF_MODE_OFF;
+    msp_config->refAvgShift = 0;
+
+    // Static RX gain
+    msp_config->agcTargetRms = 0;
+    msp_config->agcMinGain = PGA_GAIN_MINUS_6_5_DB;
+    msp_config->agcMaxGain = PGA_GAIN_30_8_DB;
     msp_config->pulserPolarity = PPG_POLARITY_START_WITH_HIGH;
     msp_config->pulserPauseState = PPG_PAUSE_STATE_LOW;
 
@@ -78,10 +111,17 @@ void getDefaultUsConfig(msp_config_t * msp_config)
 // Return 1 if config is valid
 bool extractUsConfig(uint8_t * spi_rx, msp_config_t * msp_config)
 {
+    // Register-level package
+    if (spi_rx[0] == START_BYTE_REG_CONF_PACK)
+        return extractUsRegConfig(spi_rx, msp_config);
+
     // Check start byte
     if (spi_rx[0] != START_BYTE_CONF_PACK)
         return 0;
 
+    // PPG registers are computed by the firmware
+    msp_config->ppgRegsValid = false;
+
     // Note: The MSP430 cannot access 2-byte words at odd addresses, so the CPU just ignores the lowest bit of word addresses.
     //Therefore, we do here some magic
 
@@ -117,6 +157,196 @@ bool extractUsConfig(uint8_t * spi_rx, msp_config_t * msp_config)
     msp_config->restartCaptCnt    = READ_uint16(spi_rx + offset + 10);
     msp_config->captTimeoutCnt    = READ_uint16(spi_rx + offset + 12);
 
+    // Coded excitation (zero for hosts without support)
+    msp_config->pulseCode = (ppg_code_t)READ_uint8(spi_rx + offset + 14);
+
+    if (msp_config->pulseCode > PPG_CODE_GOLAY_8)
+        return 0;
+
+    // Adaptive measurement period (zero for hosts without support)
+    msp_config->adaptMinPeriod  = READ_uint16(spi_rx + offset + 15);
+    msp_config->adaptMaxPeriod  = READ_uint16(spi_rx + offset + 17);
+    msp_config->motionThreshold = READ_uint16(spi_rx + offset + 19);
+
+    if ((msp_config->adaptMaxPeriod != 0) &&
+        (msp_config->adaptMinPeriod > msp_config->adaptMaxPeriod))
+        return 0;
+
+    // Reference frame subtraction (zero for hosts without support)
+    msp_config->refMode     = READ_uint8(spi_rx + offset + 21);
+    msp_config->refAvgShift = READ_uint8(spi_rx + offset + 22);
+
+    if ((msp_config->refMode > REF_MODE_STORED) ||
+        (msp_config->refAvgShift > REF_FRAME_AVG_SHIFT_MAX))
+        return 0;
+
+    // Automatic gain control (zero for hosts without support)
+    msp_config->agcTargetRms = READ_uint16(spi_rx + offset + 23);
+    msp_config->agcMinGain   = READ_uint8(spi_rx + offset + 25);
+    msp_config->agcMaxGain   = READ_uint8(spi_rx + offset + 26);
+
+    return isAgcConfigValid(msp_config) && isFullFrameConfig(msp_config) &&
+           isProfileConfig(msp_config);
+}
+
+// Extract Uss config from a register-level package
+// All values are final register values (computed by the host), so
+// they are only range-checked and copied.
+// The package is word aligned (s_rx_buf_1), so words are accessed directly.
+bool extractUsRegConfig(uint8_t * spi_rx, msp_config_t * msp_config)
+{
+    const uint16_t * words = (const uint16_t *) spi_rx;
+    uint8_t txRxConfLen = spi_rx[1];
+    uint8_t i;
+
+    // Check start byte
+    if (spi_rx[0] != START_BYTE_REG_CONF_PACK)
+        return 0;
+
+    // Range checks
+    if (txRxConfLen > TX_RX_CONF_LEN_MAX)
+        return 0;
+    if ((words[REG_CONF_APGLPER] > 255) || (words[REG_CONF_APGHPER] > 255))
+        return 0;
+    if (words[REG_CONF_SDHSCTL1] > SDHS_OVER_SAMPL_RATE_160)
+        return 0;
+    // Sample size is twice the number of samples, which must fit into the frame
+    if (words[REG_CONF_SDHSCTL2] >= 2 * US_FRAME_NUM_SAMPLES)
+        return 0;
+    if ((words[REG_CONF_SDHSCTL6] < PGA_GAIN_MINUS_6_5_DB) ||
+        (words[REG_CONF_SDHSCTL6] > PGA_GAIN_30_8_DB))
+        return 0;
+    if (words[REG_CONF_PULSE_CODE] > PPG_CODE_GOLAY_8)
+        return 0;
+    if ((words[REG_CONF_ADAPT_MAX_PERIOD] != 0) &&
+        (words[REG_CONF_ADAPT_MIN_PERIOD] > words[REG_CONF_ADAPT_MAX_PERIOD]))
+        return 0;
+    if (((words[REG_CONF_REF_FRAME] & 0xFF) > REF_MODE_STORED) ||
+        ((words[REG_CONF_REF_FRAME] >> 8) > REF_FRAME_AVG_SHIFT_MAX))
+        return 0;
+
+    msp_config->dcDcTurnOnTime = words[REG_CONF_DCDC_TURN_ON];
+    msp_config->measPeriod     = words[REG_CONF_MEAS_PERIOD];
+
+    // PPG registers
+    msp_config->ppgRegsValid  = true;
+    msp_config->ppgLper       = words[REG_CONF_APGLPER];
+    msp_config->ppgHper       = words[REG_CONF_APGHPER];
+    msp_config->numPulses     = (uint8_t) (words[REG_CONF_APGC] & 0xFF);
+    msp_config->numStopPulses = (uint8_t) (words[REG_CONF_APGC] >> 8);
+    msp_config->pulseCode     = (ppg_code_t) words[REG_CONF_PULSE_CODE];
+
+    // SDHS registers
+    msp_config->overSamplRate = (sdhs_over_sampl_rate_t) words[REG_CONF_SDHSCTL1];
+    msp_config->sampleSize    = words[REG_CONF_SDHSCTL2] + 1;
+    msp_config->rxGain        = (uint8_t) words[REG_CONF_SDHSCTL6];
+
+    // SAPH time marks A-F
+    msp_config->startPpgCnt       = words[REG_CONF_AATM_A];
+    msp_config->turnOnAdcCnt      = words[REG_CONF_AATM_A + 1];
+    msp_config->startPgaInBiasCnt = words[REG_CONF_AATM_A + 2];
+    msp_config->startAdcSamplCnt  = words[REG_CONF_AATM_A + 3];
+    msp_config->restartCaptCnt    = words[REG_CONF_AATM_A + 4];
+    msp_config->captTimeoutCnt    = words[REG_CONF_AATM_A + 5];
+
+    msp_config->startHvMuxRxCnt = words[REG_CONF_START_HVMUX_RX];
+
+    // Adaptive measurement period
+    msp_config->adaptMinPeriod  = words[REG_CONF_ADAPT_MIN_PERIOD];
+    msp_config->adaptMaxPeriod  = words[REG_CONF_ADAPT_MAX_PERIOD];
+    msp_config->motionThreshold = words[REG_CONF_MOTION_THRESHOLD];
+
+    // Reference frame subtraction
+    msp_config->refMode     = (uint8_t) (words[REG_CONF_REF_FRAME] & 0xFF);
+    msp_config->refAvgShift = (uint8_t) (words[REG_CONF_REF_FRAME] >> 8);
+
+    // Automatic gain control
+    msp_config->agcTargetRms = words[REG_CONF_AGC_TARGET_RMS];
+    msp_config->agcMinGain   = (uint8_t) (words[REG_CONF_AGC_GAINS] & 0xFF);
+    msp_config->agcMaxGain   = (uint8_t) (words[REG_CONF_AGC_GAINS] >> 8);
+
+    if (!isAgcConfigValid(msp_config) || !isFullFrameConfig(msp_config))
+        return 0;
+
+    // TX/RX configs
+    msp_config->txRxConfLen = txRxConfLen;
+    for (i = 0; i < txRxConfLen; i++)
+    {
+        msp_config->txConfigs[i] = words[REG_CONF_TX_RX_CONFIGS + 2*i];
+        msp_config->rxConfigs[i] = words[REG_CONF_TX_RX_CONFIGS + 2*i + 1];
+    }
+
+    return isProfileConfig(msp_config);
+}
+
+// Check the AGC settings of a config
+// The reference frames are only valid for the gain they were captured with,
+// so the AGC cannot be combined with the reference frame subtraction.
+static bool isAgcConfigValid(const msp_config_t * msp_config)
+{
+    if (msp_config->agcTargetRms == 0)
+        return 1;
+
+    if (msp_config->agcTargetRms >= AGC_CLIP_LEVEL)
+        return 0;
+    if ((msp_config->agcMinGain < PGA_GAIN_MINUS_6_5_DB) ||
+        (msp_config->agcMaxGain > PGA_GAIN_30_8_DB) ||
+        (msp_config->agcMinGain > msp_config->agcMaxGain))
+        return 0;
+    if (msp_config->refMode != REF_MODE_OFF)
+        return 0;
+
+    return 1;
+}
+
+// Check that the frame-wide processing sees a full frame
+// The motion energy, the reference subtraction and the AGC run over all
+// US_FRAME_NUM_SAMPLES samples, a shorter acquisition would leave stale
+// samples in the frame.
+static bool isFullFrameConfig(const msp_config_t * msp_config)
+{
+    if ((msp_config->adaptMaxPeriod == 0) &&
+        (msp_config->refMode == REF_MODE_OFF) &&
+        (msp_config->agcTargetRms == 0))
+        return 1;
+
+    // Sample size as sent by the host (2 x number of samples)
+    return (msp_config->sampleSize == 2 * US_FRAME_NUM_SAMPLES);
+}
+
+// Check that a config describes the protocol of the compile-time profile
+// (always true for the generic firmware)
+static bool isProfileConfig(const msp_config_t * msp_config)
+{
+#if US_PROFILE_FIXED
+    uint8_t i;
+
+    if ((msp_config->overSamplRate != PROFILE_OVER_SAMPL_RATE) ||
+        (msp_config->sampleSize != PROFILE_SAMPLE_SIZE) ||
+        (msp_config->numPulses != PROFILE_NUM_PULSES) ||
+        (msp_config->pulseCode != PROFILE_PULSE_CODE) ||
+        (msp_config->txRxConfLen != PROFILE_TX_RX_CONF_LEN))
+        return 0;
+
+    if (msp_config->ppgRegsValid)
+    {
+        if ((msp_config->ppgLper != PROFILE_PPG_LPER) ||
+            (msp_config->ppgHper != PROFILE_PPG_HPER))
+            return 0;
+    }
+    else if (msp_config->pulseFreq != PROFILE_PULSE_FREQ)
+    {
+        return 0;
+    }
+
+    for (i = 0; i < PROFILE_TX_RX_CONF_LEN; i++)
+    {
+        if ((msp_config->txConfigs[i] != profileTxConfigs[i]) ||
+            (msp_config->rxConfigs[i] != profileRxConfigs[i]))
+            return 0;
+    }
+#endif
+
     return 1;
 }
 
@@ -192,7 +422,7 @@ void enableOpAmp(void)
 {
     // Enable RX OPA836
     // Set Pin 0 "RxEn" to high
-    GPIO_setOutputHighOnPin(GPIO_PORT_P6, GPIO_PIN0);
+    P6OUT |= BIT0;
 
     return;
 }
@@ -202,7 +432,7 @@ void disableOpAmp(void)
 {
     // Disable RX OPA836
     // Set Pin 0 "RxEn" to low
-    GPIO_setOutputLowOnPin(GPIO_PORT_P6, GPIO_PIN0);
+    P6OUT &= ~BIT0;
 
     return;
 }
@@ -233,7 +463,7 @@ void enableHvPcbDcDc(void)
     // Enable HV and +5 V
     // Set Pin 4 "SW_EN" to high (enables the DC/DC TPS61222)
     // Set Pin 5 "HV1_EN" to high (enables the HV DC/DC LT1945)
-    GPIO_setOutputHighOnPin(GPIO_PORT_P6, GPIO_PIN4+GPIO_PIN5);
+    P6OUT |= BIT4 + BIT5;
 
     return;
 }
@@ -244,7 +474,7 @@ void disableHvPcbDcDc(void)
     // Disable HV and +5 V
     // Set Pin 4 "SW_EN" to low (disables the DC/DC TPS61222)
     // Set Pin 5 "HV1_EN" to low (disables the HV DC/DC LT1945)
-    GPIO_setOutputLowOnPin(GPIO_PORT_P6, GPIO_PIN4 + GPIO_PIN5);
+    P6OUT &= ~(BIT4 + BIT5);
 
     return;
 }
@@ -253,7 +483,7 @@ void disableHvPcbDcDc(void)
 void disableHvDcDc(void)
 {
     // Set Pin 5 "HV1_EN" to low (disables the HV DC/DC LT1945)
-    GPIO_setOutputLowOnPin(GPIO_PORT_P6, GPIO_PIN5);
+    P6OUT &= ~BIT5;
 }
 
 
@@ -25,6 +25,10 @@
 
 #include "us_spi.h"
 #include "us_hv_mux.h"
+#include "us_motion.h"
+#include "us_fram_ring.h"
+#include "us_ref_frame.h"
+#include "us_agc.h"
 #include "uslib.h"
 
 // Defines for LED on Acquisition PCB
@@ -50,12 +54,37 @@
 // Commands for indicating the configuration package or restart command
 #define START_BYTE_CONF_PACK    (0xFA)
 #define START_BYTE_RESTART      (0xFB)
+#define START_BYTE_REG_CONF_PACK (0xFC)
+
+// Word offsets in the register-level configuration package
+// Byte 0 is the start byte, byte 1 the number of TX/RX configs
+#define REG_CONF_DCDC_TURN_ON    (1)
+#define REG_CONF_MEAS_PERIOD     (2)
+#define REG_CONF_APGLPER         (3)
+#define REG_CONF_APGHPER         (4)
+#define REG_CONF_APGC            (5)
+#define REG_CONF_SDHSCTL1        (6)
+#define REG_CONF_SDHSCTL2        (7)
+#define REG_CONF_SDHSCTL6        (8)
+#define REG_CONF_AATM_A          (9)
+#define REG_CONF_START_HVMUX_RX  (15)
+#define REG_CONF_PULSE_CODE      (16)
+#define REG_CONF_ADAPT_MIN_PERIOD (17)
+#define REG_CONF_ADAPT_MAX_PERIOD (18)
+#define REG_CONF_MOTION_THRESHOLD (19)
+#define REG_CONF_REF_FRAME       (20)
+#define REG_CONF_AGC_TARGET_RMS  (21)
+#define REG_CONF_AGC_GAINS       (22)
+#define REG_CONF_TX_RX_CONFIGS   (23)
 
 void getDefaultUsConfig(msp_config_t * msp_config);
 
 // Extract Uss config from the spi RX buffer
 // Return 1 if config is valid
 bool extractUsConfig(uint8_t * spi_rx, msp_config_t * msp_config);
+// Extract Uss config from a register-level package (precomputed on the host)
+// Return 1 if config is valid
+bool extractUsRegConfig(uint8_t * spi_rx, msp_config_t * msp_config);
 
 //// Extra functions ////
 
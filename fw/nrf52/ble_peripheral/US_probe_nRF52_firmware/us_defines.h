@@ -33,9 +33,9 @@
     #endif
 
     // Number of bytes per transfer to send to SPI slave
-    #define BYTES_PR_XFER_TX   201
+    #define BYTES_PR_XFER_TX   203
     // Number of bytes per transfer to receive from SPI slave
-    #define BYTES_PR_XFER_RX   201
+    #define BYTES_PR_XFER_RX   203
 
     // Number of SPI transfers to complete for one US frame
     #define NUMBER_OF_XFERS 4
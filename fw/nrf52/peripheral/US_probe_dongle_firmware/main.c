@@ -60,8 +60,6 @@
 #include "nrf_ble_gatt.h"
 #include "nrf_pwr_mgmt.h"
 #include "app_timer.h"
-#include "ble_nus.h"
-#include "ble_nus_c.h"
 #include "bsp_btn_ble.h"
 #include "nrf_drv_clock.h"
 #include "app_usbd_cdc_acm.h"
@@ -97,6 +95,8 @@ volatile bool flag_use_buf_1 = true;
 
 // Flag to indicate that an US frame is ready to be sent to python
 bool send_us_frame_to_vcom = false;
+// Length of the frame ready to be sent
+uint16_t us_frame_length = 0;
 
 //static bool m_usb_connected = false;
 bool m_usb_connected = false;
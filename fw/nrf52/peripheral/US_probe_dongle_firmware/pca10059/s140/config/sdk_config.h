@@ -671,7 +671,7 @@
  
 
 #ifndef BLE_NUS_C_ENABLED
-#define BLE_NUS_C_ENABLED 1
+#define BLE_NUS_C_ENABLED 0
 #endif
 
 // <e> BLE_NUS_ENABLED - ble_nus - Nordic UART Service
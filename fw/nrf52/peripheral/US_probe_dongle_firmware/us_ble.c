@@ -60,16 +60,15 @@
 #include "nrf_ble_gatt.h"
 #include "nrf_ble_scan.h"
 #include "app_timer.h"
-#include "ble_nus.h"
-#include "ble_nus_c.h"
 #include "bsp_btn_ble.h"
 #include "us_defines.h"
 #include "us_ble.h"
+#include "us_wulpus_c.h"
 
 APP_TIMER_DEF(m_blink_ble);
 APP_TIMER_DEF(m_blink_cdc);
 
-BLE_NUS_C_DEF(m_ble_nus_c);                                             /**< BLE Nordic UART Service (NUS) client instance. */
+US_WULPUS_C_DEF(m_wulpus_c);                                            /**< Client instance of the WULPUS service of the probe. */
 NRF_BLE_GATT_DEF(m_gatt);                                               /**< GATT module instance. */
 BLE_DB_DISCOVERY_DEF(m_db_disc);                                        /**< Database discovery module instance. */
 NRF_BLE_SCAN_DEF(m_scan);                                               /**< Scanning Module instance. */
@@ -84,7 +83,6 @@ NRF_BLE_GQ_DEF(m_ble_gatt_queue,                                        /**< BLE
 #ifndef DEVICE_NAME_TO_CONNECT
 #define DEVICE_NAME_TO_CONNECT          "WULPUS_PROBE_0"                            /**< Name of device to get connected to. */
 #endif
-#define NUS_SERVICE_UUID_TYPE           BLE_UUID_TYPE_VENDOR_BEGIN                  /**< UUID type for the Nordic UART Service (vendor specific). */
 #define APP_BLE_OBSERVER_PRIO           3                                           /**< Application's BLE observer priority. You shouldn't need to modify this value. */
 #define MIN_CONN_INTERVAL               MSEC_TO_UNITS(7.5, UNIT_1_25_MS)             /**< Minimum acceptable connection interval (20 ms). Connection interval uses 1.25 ms units. */
 #define MAX_CONN_INTERVAL               MSEC_TO_UNITS(7.5, UNIT_1_25_MS)             /**< Maximum acceptable connection interval (75 ms). Connection interval uses 1.25 ms units. */
@@ -96,18 +94,12 @@ NRF_BLE_GQ_DEF(m_ble_gatt_queue,                                        /**< BLE
 #define BLE_LED_ID (0)
  
 
-static uint16_t m_ble_nus_max_data_len = BLE_GATT_ATT_MTU_DEFAULT - OPCODE_LENGTH - HANDLE_LENGTH; /**< Maximum length of data (in bytes) that can be transmitted to the peer by the Nordic UART service module. */
-
-/**@brief NUS UUID. */
-static ble_uuid_t const m_nus_uuid =
-{
-    .uuid = BLE_UUID_NUS_SERVICE,
-    .type = NUS_SERVICE_UUID_TYPE
-};
+static uint16_t m_ble_max_data_len = BLE_GATT_ATT_MTU_DEFAULT - OPCODE_LENGTH - HANDLE_LENGTH; /**< Maximum length of data (in bytes) that can be transmitted to the peer. */
 
 
 extern bool send_us_frame_to_vcom;
 extern volatile bool flag_use_buf_1;
+extern uint16_t us_frame_length;
 
 
 // Buffers to store US dataD
@@ -115,6 +107,18 @@ extern ArrayList_type p_rx_data_1[NUMBER_OF_XFERS];
 extern ArrayList_type p_rx_data_2[NUMBER_OF_XFERS];
 
 
+// Reassembly of the frames from the stream of the probe
+static uint16_t rx_frame_received = 0;
+static bool     rx_stream_synced  = false;
+static uint8_t  rx_stream_next_seq = 0;
+
+#if US_L2CAP_ENABLED
+// L2CAP channel to the probe, every SDU is one frame
+static uint16_t m_l2cap_cid = BLE_L2CAP_CID_INVALID;
+static uint8_t  m_l2cap_rx_buf[US_L2CAP_RX_QUEUE_SIZE][US_FRAME_MAX_LEN];
+#endif
+
+
 
 /**@brief Function to start scanning. */
 static void scan_start(void)
@@ -177,7 +181,7 @@ static void scan_init(void)
     APP_ERROR_CHECK(err_code);
     
     // Set UUID based scan filter
-    //err_code = nrf_ble_scan_filter_set(&m_scan, SCAN_UUID_FILTER, &m_nus_uuid);
+    //err_code = nrf_ble_scan_filter_set(&m_scan, SCAN_UUID_FILTER, &m_wulpus_uuid);
     //APP_ERROR_CHECK(err_code);
     
     // Set name-based scan filter
@@ -208,84 +212,262 @@ static void scan_init(void)
  */
 static void db_disc_handler(ble_db_discovery_evt_t * p_evt)
 {
-    ble_nus_c_on_db_disc_evt(&m_ble_nus_c, p_evt);
+    us_wulpus_c_on_db_disc_evt(&m_wulpus_c, p_evt);
+}
+
+/**@brief Function returning the length of a (possibly delta encoded or compressed) US frame.
+ *
+ * @details Compressed frames tell their length behind the header, until it is received
+ *          the length of the extended header is returned.
+ *
+ * @param[in]   p_frame   Frame with at least US_FRAME_HEADER_LEN bytes.
+ * @param[in]   received  Number of bytes of the frame received so far.
+ */
+static uint16_t us_frame_get_length(uint8_t const * p_frame, uint16_t received)
+{
+    if ((p_frame[US_FRAME_IDX_FLAGS] & US_FRAME_FLAG_COMPRESSED) == US_FRAME_FLAG_COMPRESSED)
+    {
+        if (received < US_FRAME_COMPRESSED_HEADER_LEN)
+        {
+            return US_FRAME_COMPRESSED_HEADER_LEN;
+        }
+        // The probe only sends compressed frames shorter than the full frame
+        return MIN(US_FRAME_MAX_LEN, US_FRAME_COMPRESSED_HEADER_LEN +
+                   (p_frame[US_FRAME_HEADER_LEN] | (p_frame[US_FRAME_HEADER_LEN + 1] << 8)));
+    }
+    else if (p_frame[US_FRAME_IDX_FLAGS] & US_FRAME_FLAG_UNCHANGED)
+    {
+        return US_FRAME_HEADER_LEN;
+    }
+    else if (p_frame[US_FRAME_IDX_FLAGS] & US_FRAME_FLAG_DELTA)
+    {
+        return US_FRAME_HEADER_LEN + US_FRAME_NUM_SAMPLES;
+    }
+    return US_FRAME_HEADER_LEN + 2 * US_FRAME_NUM_SAMPLES;
+}
+
+/**@brief Function for handing a complete US frame in the active buffer to the virtual COM port.
+ *
+ * @param[in]   frame_len   Length of the frame.
+ */
+static void us_frame_complete(uint16_t frame_len)
+{
+    // Invert LED 1 (Green)
+    bsp_board_led_invert(BLE_LED_ID);
+
+    // Ready to send entire frame to python through virtual COM,
+    // the next frame goes to the other buffer
+    us_frame_length   = frame_len;
+    rx_frame_received = 0;
+    flag_use_buf_1    = !flag_use_buf_1;
+    send_us_frame_to_vcom = true;
 }
 
-/**@brief Callback handling Nordic UART Service (NUS) client events.
+/**@brief Function for reassembling the US frames from the notifications of the probe.
  *
- * @details This function is called to notify the application of NUS client events.
+ * @details The probe packs the frames back to back into notifications of the
+ *          negotiated MTU, a frame may span several notifications. After a lost
+ *          notification the incomplete frame is dropped and the next frame start
+ *          is awaited. Complete frames are handed to the virtual COM port.
  *
- * @param[in]   p_ble_nus_c   NUS client handle. This identifies the NUS client.
- * @param[in]   p_ble_nus_evt Pointer to the NUS client event.
+ * @param[in]   p_data    Notification of the probe.
+ * @param[in]   data_len  Length of the notification.
  */
+static void us_stream_process(uint8_t const * p_data, uint16_t data_len)
+{
+    if (data_len < US_STREAM_HEADER_LEN)
+    {
+        return;
+    }
 
-/**@snippet [Handling events from the ble_nus_c module] */
-static void ble_nus_c_evt_handler(ble_nus_c_t * p_ble_nus_c, ble_nus_c_evt_t const * p_ble_nus_evt)
+    uint8_t const * p_payload   = p_data + US_STREAM_HEADER_LEN;
+    uint16_t        payload_len = data_len - US_STREAM_HEADER_LEN;
+    uint8_t         record_start = p_data[1];
+
+    if (p_data[0] != rx_stream_next_seq)
+    {
+        rx_stream_synced = false;
+    }
+    rx_stream_next_seq = p_data[0] + 1;
+
+    if (!rx_stream_synced)
+    {
+        // Also covers US_STREAM_NO_RECORD_START
+        if (record_start >= payload_len)
+        {
+            return;
+        }
+        p_payload   += record_start;
+        payload_len -= record_start;
+        rx_frame_received = 0;
+        rx_stream_synced  = true;
+    }
+
+    while (payload_len > 0)
+    {
+        uint8_t * p_frame = flag_use_buf_1 ? (uint8_t *) p_rx_data_1 : (uint8_t *) p_rx_data_2;
+
+        // The header tells the length of the frame
+        uint16_t frame_len = (rx_frame_received < US_FRAME_HEADER_LEN) ? US_FRAME_HEADER_LEN : us_frame_get_length(p_frame, rx_frame_received);
+        uint16_t chunk     = MIN(payload_len, frame_len - rx_frame_received);
+
+        memcpy(p_frame + rx_frame_received, p_payload, chunk);
+        rx_frame_received += chunk;
+        p_payload         += chunk;
+        payload_len       -= chunk;
+
+        if (rx_frame_received < US_FRAME_HEADER_LEN)
+        {
+            continue;
+        }
+
+        if (p_frame[0] != MEAS_START_OF_FRAME_MASK)
+        {
+            // Corrupted stream, wait for the next frame start
+            rx_stream_synced = false;
+            return;
+        }
+
+        if (rx_frame_received == us_frame_get_length(p_frame, rx_frame_received))
+        {
+            us_frame_complete(rx_frame_received);
+        }
+    }
+}
+
+#if US_L2CAP_ENABLED
+/**@brief Function for handing a US frame received as SDU of the L2CAP channel to the virtual COM port.
+ *
+ * @param[in]   p_data    SDU of the probe (one frame).
+ * @param[in]   data_len  Length of the SDU.
+ */
+static void us_l2cap_frame_process(uint8_t const * p_data, uint16_t data_len)
+{
+    if ((data_len < US_FRAME_HEADER_LEN) ||
+        (p_data[0] != MEAS_START_OF_FRAME_MASK) ||
+        (data_len != us_frame_get_length(p_data, data_len)))
+    {
+        return;
+    }
+
+    // A frame partly received from the notifications is discarded
+    rx_stream_synced = false;
+
+    uint8_t * p_frame = flag_use_buf_1 ? (uint8_t *) p_rx_data_1 : (uint8_t *) p_rx_data_2;
+    memcpy(p_frame, p_data, data_len);
+
+    us_frame_complete(data_len);
+}
+
+/**@brief Function for opening the L2CAP channel to the probe.
+ *
+ * @details Probes without the channel refuse it, the frames keep arriving as notifications.
+ *
+ * @param[in]   conn_handle   Connection to the probe.
+ */
+static void us_l2cap_setup(uint16_t conn_handle)
+{
+    ret_code_t                  err_code;
+    ble_l2cap_ch_setup_params_t params;
+
+    memset(&params, 0, sizeof(params));
+
+    params.le_psm                   = US_L2CAP_PSM;
+    params.rx_params.rx_mtu         = US_FRAME_MAX_LEN;
+    params.rx_params.rx_mps         = US_L2CAP_MPS;
+    params.rx_params.sdu_buf.p_data = m_l2cap_rx_buf[0];
+    params.rx_params.sdu_buf.len    = US_FRAME_MAX_LEN;
+
+    m_l2cap_cid = BLE_L2CAP_CID_INVALID;
+    err_code = sd_ble_l2cap_ch_setup(conn_handle, &m_l2cap_cid, &params);
+    APP_ERROR_CHECK(err_code);
+}
+
+/**@brief Function for handling the events of the L2CAP channel.
+ *
+ * @param[in]   p_ble_evt   Bluetooth stack event.
+ */
+static void us_l2cap_on_ble_evt(ble_evt_t const * p_ble_evt)
+{
+    ret_code_t              err_code;
+    ble_l2cap_evt_t const * p_evt = &p_ble_evt->evt.l2cap_evt;
+
+    switch (p_ble_evt->header.evt_id)
+    {
+        case BLE_L2CAP_EVT_CH_SETUP:
+            // The second buffer is received into while the first one is processed
+            {
+                ble_data_t sdu_buf = {.p_data = m_l2cap_rx_buf[1], .len = US_FRAME_MAX_LEN};
+                err_code = sd_ble_l2cap_ch_rx(p_evt->conn_handle, p_evt->local_cid, &sdu_buf);
+                APP_ERROR_CHECK(err_code);
+            }
+            break;
+
+        case BLE_L2CAP_EVT_CH_SETUP_REFUSED:
+        case BLE_L2CAP_EVT_CH_RELEASED:
+            m_l2cap_cid = BLE_L2CAP_CID_INVALID;
+            break;
+
+        case BLE_L2CAP_EVT_CH_RX:
+            us_l2cap_frame_process(p_evt->params.rx.sdu_buf.p_data, p_evt->params.rx.sdu_len);
+
+            // Give the buffer back, the probe gets new credits
+            err_code = sd_ble_l2cap_ch_rx(p_evt->conn_handle, p_evt->local_cid, &p_evt->params.rx.sdu_buf);
+            if ((err_code != NRF_SUCCESS) && (err_code != NRF_ERROR_INVALID_STATE))
+            {
+                APP_ERROR_CHECK(err_code);
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+#endif
+
+/**@brief Callback handling the events of the WULPUS service client.
+ *
+ * @details This function is called to notify the application of WULPUS client events.
+ *
+ * @param[in]   p_wulpus_c       WULPUS client handle.
+ * @param[in]   p_wulpus_c_evt   Pointer to the WULPUS client event.
+ */
+static void wulpus_c_evt_handler(us_wulpus_c_t * p_wulpus_c, us_wulpus_c_evt_t const * p_wulpus_c_evt)
 {
     ret_code_t err_code;
 
-    switch (p_ble_nus_evt->evt_type)
+    switch (p_wulpus_c_evt->evt_type)
     {
-        case BLE_NUS_C_EVT_DISCOVERY_COMPLETE:
-            err_code = ble_nus_c_handles_assign(p_ble_nus_c, p_ble_nus_evt->conn_handle, &p_ble_nus_evt->handles);
+        case US_WULPUS_C_EVT_DISCOVERY_COMPLETE:
+            err_code = us_wulpus_c_handles_assign(p_wulpus_c, p_wulpus_c_evt->conn_handle, &p_wulpus_c_evt->handles);
             APP_ERROR_CHECK(err_code);
 
-            err_code = ble_nus_c_tx_notif_enable(p_ble_nus_c);
+            err_code = us_wulpus_c_data_notif_enable(p_wulpus_c);
             APP_ERROR_CHECK(err_code);
+
+#if US_L2CAP_ENABLED
+            // Frames move to the channel once the probe accepted it
+            us_l2cap_setup(p_wulpus_c_evt->conn_handle);
+#endif
             break;
 
-        case BLE_NUS_C_EVT_NUS_TX_EVT:;
-            static uint8_t count_packets = 0;
-            // Check if it is the first (of the four) BLE packets
-            if((p_ble_nus_evt->p_data[0] == MEAS_START_OF_FRAME_MASK) && (p_ble_nus_evt->data_len == 202))
-            {
-                // Invert LED 1 (Green)
-                bsp_board_led_invert(BLE_LED_ID);
-                // First BLE packet of this frame
-                count_packets = 0;
-                if(flag_use_buf_1)
-                {
-                    memcpy(&p_rx_data_1[count_packets], p_ble_nus_evt->p_data, p_ble_nus_evt->data_len);
-                }
-                else
-                {
-                    memcpy(&p_rx_data_2[count_packets], p_ble_nus_evt->p_data, p_ble_nus_evt->data_len);
-                }
-                count_packets++;
-            }
-            else if (count_packets < NUMBER_OF_XFERS)
-            {   
-                // More BLE packets of the same frame
-                if(flag_use_buf_1)
-                {
-                    memcpy(&p_rx_data_1[count_packets], p_ble_nus_evt->p_data, p_ble_nus_evt->data_len);
-                }
-                else
-                {
-                    memcpy(&p_rx_data_2[count_packets], p_ble_nus_evt->p_data, p_ble_nus_evt->data_len);
-                }
-                count_packets++;
-                if(count_packets == NUMBER_OF_XFERS)
-                {
-                    // Ready to send entire frame to python through virtual COM
-                    send_us_frame_to_vcom = true;
-                }
-            }
-            
+        case US_WULPUS_C_EVT_DATA:
+            us_stream_process(p_wulpus_c_evt->p_data, p_wulpus_c_evt->data_len);
             break;
 
-        case BLE_NUS_C_EVT_DISCONNECTED:
+        case US_WULPUS_C_EVT_DISCONNECTED:
+            rx_stream_synced = false;
             scan_start();
             break;
     }
 }
 
 
-/**@brief Function for handling the Nordic UART Service Client errors.
+/**@brief Function for handling the WULPUS service client errors.
  *
  * @param[in]   nrf_error   Error code containing information about what went wrong.
  */
-static void nus_error_handler(uint32_t nrf_error)
+static void wulpus_c_error_handler(uint32_t nrf_error)
 {
     APP_ERROR_HANDLER(nrf_error);
 }
@@ -359,16 +541,20 @@ static void ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_context)
     ret_code_t            err_code;
     ble_gap_evt_t const * p_gap_evt = &p_ble_evt->evt.gap_evt;
 
+#if US_L2CAP_ENABLED
+    us_l2cap_on_ble_evt(p_ble_evt);
+#endif
+
     switch (p_ble_evt->header.evt_id)
     {
         case BLE_GAP_EVT_CONNECTED:
-            err_code = ble_nus_c_handles_assign(&m_ble_nus_c, p_ble_evt->evt.gap_evt.conn_handle, NULL);
+            err_code = us_wulpus_c_handles_assign(&m_wulpus_c, p_ble_evt->evt.gap_evt.conn_handle, NULL);
             APP_ERROR_CHECK(err_code);
 
             err_code = bsp_indication_set(BSP_INDICATE_CONNECTED);
             APP_ERROR_CHECK(err_code);
 
-            // start discovery of services. The NUS Client waits for a discovery result
+            // start discovery of services. The WULPUS client waits for a discovery result
             err_code = ble_db_discovery_start(&m_db_disc, p_ble_evt->evt.gap_evt.conn_handle);
             APP_ERROR_CHECK(err_code);
 
@@ -378,6 +564,9 @@ static void ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_context)
 
         case BLE_GAP_EVT_DISCONNECTED:
             bsp_board_led_off(BLE_LED_ID);
+#if US_L2CAP_ENABLED
+            m_l2cap_cid = BLE_L2CAP_CID_INVALID;
+#endif
 
             break;
 
@@ -453,6 +642,20 @@ static void ble_stack_init(void)
     err_code = nrf_sdh_ble_default_cfg_set(APP_BLE_CONN_CFG_TAG, &ram_start);
     APP_ERROR_CHECK(err_code);
 
+#if US_L2CAP_ENABLED
+    // One channel receiving the frames of the probe
+    ble_cfg_t ble_cfg;
+    memset(&ble_cfg, 0, sizeof(ble_cfg));
+    ble_cfg.conn_cfg.conn_cfg_tag                        = APP_BLE_CONN_CFG_TAG;
+    ble_cfg.conn_cfg.params.l2cap_conn_cfg.rx_mps        = US_L2CAP_MPS;
+    ble_cfg.conn_cfg.params.l2cap_conn_cfg.tx_mps        = BLE_L2CAP_MPS_MIN;
+    ble_cfg.conn_cfg.params.l2cap_conn_cfg.rx_queue_size = US_L2CAP_RX_QUEUE_SIZE;
+    ble_cfg.conn_cfg.params.l2cap_conn_cfg.tx_queue_size = 1;
+    ble_cfg.conn_cfg.params.l2cap_conn_cfg.ch_count      = 1;
+    err_code = sd_ble_cfg_set(BLE_CONN_CFG_L2CAP, &ble_cfg, ram_start);
+    APP_ERROR_CHECK(err_code);
+#endif
+
     // Enable BLE stack.
     err_code = nrf_sdh_ble_enable(&ram_start);
     APP_ERROR_CHECK(err_code);
@@ -467,7 +670,7 @@ void gatt_evt_handler(nrf_ble_gatt_t * p_gatt, nrf_ble_gatt_evt_t const * p_evt)
 {
     if (p_evt->evt_id == NRF_BLE_GATT_EVT_ATT_MTU_UPDATED)
     {
-        m_ble_nus_max_data_len = p_evt->params.att_mtu_effective - OPCODE_LENGTH - HANDLE_LENGTH;
+        m_ble_max_data_len = p_evt->params.att_mtu_effective - OPCODE_LENGTH - HANDLE_LENGTH;
     }
 }
 
@@ -485,23 +688,23 @@ void gatt_init(void)
 }
 
 
-/**@brief Function for initializing the Nordic UART Service (NUS) client. */
-static void nus_c_init(void)
+/**@brief Function for initializing the client of the WULPUS service. */
+static void wulpus_c_init(void)
 {
-    ret_code_t       err_code;
-    ble_nus_c_init_t init;
+    ret_code_t         err_code;
+    us_wulpus_c_init_t init;
 
-    init.evt_handler   = ble_nus_c_evt_handler;
-    init.error_handler = nus_error_handler;
+    init.evt_handler   = wulpus_c_evt_handler;
+    init.error_handler = wulpus_c_error_handler;
     init.p_gatt_queue  = &m_ble_gatt_queue;
 
-    err_code = ble_nus_c_init(&m_ble_nus_c, &init);
+    err_code = us_wulpus_c_init(&m_wulpus_c, &init);
     APP_ERROR_CHECK(err_code);
 }
 
 uint32_t us_sd_ble_gap_disconnect(uint8_t hci_status_code)
 {
-    return sd_ble_gap_disconnect(m_ble_nus_c.conn_handle, BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION);
+    return sd_ble_gap_disconnect(m_wulpus_c.conn_handle, BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION);
 }
 
 uint32_t send_ble_packet(uint8_t* start_address, uint16_t length)
@@ -512,22 +715,23 @@ uint32_t send_ble_packet(uint8_t* start_address, uint16_t length)
 
     // Send the BLE packet
     // Stop trying to send it if:
-    //    1) It was sent (NRF_ERROR_RESOURCES==false)
+    //    1) It was queued (NRF_ERROR_NO_MEM==false), the GATT queue waits for
+    //       the write response of the probe before sending the next one
     //    2) attemt_nr is too high -> No more time to try sending, have to drop the
     //       packet to keep real time operation
     do
     {
-        err_code = ble_nus_c_string_send(&m_ble_nus_c, start_address, length);
+        err_code = us_wulpus_c_control_send(&m_wulpus_c, start_address, length);
         attemt_nr++;
         if ((err_code != NRF_ERROR_INVALID_STATE) &&
-            (err_code != NRF_ERROR_RESOURCES) &&
+            (err_code != NRF_ERROR_NO_MEM) &&
             (err_code != NRF_ERROR_NOT_FOUND))
         {
             // would trap the code in case of overloaded BLE
             // Left here for future debugging
             //APP_ERROR_CHECK(err_code);
         }
-    } while ((err_code == NRF_ERROR_RESOURCES) && attemt_nr<20);
+    } while ((err_code == NRF_ERROR_NO_MEM) && attemt_nr<20);
 
     return err_code;
 }
@@ -539,7 +743,7 @@ void us_ble_init(void)
     ble_stack_init();
     gap_params_init();
     gatt_init();
-    nus_c_init();
+    wulpus_c_init();
     scan_init();
 
 
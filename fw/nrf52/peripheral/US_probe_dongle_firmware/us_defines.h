@@ -27,11 +27,34 @@
 #ifndef US_DEFINES_H
 #define US_DEFINES_H
 
-    #define BYTES_PR_XFER   201
+    #define BYTES_PR_XFER   203
     // Number of transfers to complete
     #define NUMBER_OF_XFERS 4
     #define MEAS_START_OF_FRAME_MASK 0xFF
 
+    // US frame (see sw/wulpus/connection/frame.py)
+    #define US_FRAME_HEADER_LEN     12
+    #define US_FRAME_NUM_SAMPLES    400
+    #define US_FRAME_MAX_LEN        (NUMBER_OF_XFERS * BYTES_PR_XFER)
+    #define US_FRAME_IDX_FLAGS      7
+    #define US_FRAME_FLAG_DELTA     0x04 // Samples are 8-bit residuals
+    #define US_FRAME_FLAG_UNCHANGED 0x08 // Frame carries no samples
+    #define US_FRAME_FLAG_COMPRESSED (US_FRAME_FLAG_DELTA | US_FRAME_FLAG_UNCHANGED) // Samples are a lossless bit stream
+    #define US_FRAME_COMPRESSED_HEADER_LEN (US_FRAME_HEADER_LEN + 2) // Length of the bit stream follows the header
+
+    // Every notification of the probe starts with the sequence number
+    // and the offset of the first frame starting in the payload
+    #define US_STREAM_HEADER_LEN      2
+    #define US_STREAM_NO_RECORD_START 0xFF
+
+    // L2CAP channel to the probe (see fw/nrf52/probe_fw/wulpus/wulpus_l2cap.h),
+    // one frame per SDU. The notifications are used if the probe refuses it.
+    // Off: the last PDU of every SDU is a runt, the packed notifications are faster
+    #define US_L2CAP_ENABLED          0
+    #define US_L2CAP_PSM              0x0080
+    #define US_L2CAP_MPS              247
+    #define US_L2CAP_RX_QUEUE_SIZE    2
+
 
 
     typedef struct ArrayList
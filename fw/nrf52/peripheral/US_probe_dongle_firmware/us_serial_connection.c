@@ -56,7 +56,7 @@
  */
 
 #include "boards.h"
-#include "ble_nus_c.h"
+#include "nrf_sdh_ble.h"
 #include "nrf_drv_clock.h"
 #include "app_usbd_cdc_acm.h"
 #include "app_usbd_serial_num.h"
@@ -85,11 +85,11 @@ static void cdc_acm_user_ev_handler(app_usbd_class_inst_t const * p_inst,
 
 // Maximum size of the MSP config in bytes
 // According to the Config description
-#define READ_SIZE               68
+#define READ_SIZE               128
 
 
 static char m_rx_buffer[READ_SIZE];
-static char m_cdc_data_array[BLE_NUS_MAX_DATA_LEN];
+static char m_cdc_data_array[NRF_SDH_BLE_GATT_MAX_MTU_SIZE - 3];
 static char start_string[9] = "START\n";
 
 /** @brief CDC_ACM class instance */
@@ -108,6 +108,7 @@ APP_USBD_CDC_ACM_GLOBAL_DEF(m_app_cdc_acm,
 
 extern bool send_us_frame_to_vcom;
 extern volatile bool flag_use_buf_1;
+extern uint16_t us_frame_length;
 
 
 
@@ -146,41 +147,24 @@ void us_virtual_com_port_queue_process(void)
             }
 
         }
-        static int  frame_counter = 0;
-        // Switch between buffers each time
-        if(flag_use_buf_1)
+        static uint16_t sent = 0;
+        // The BLE handler switched to the other buffer when the frame was complete
+        uint8_t const * p_frame = flag_use_buf_1 ? (uint8_t const *) p_rx_data_2 : (uint8_t const *) p_rx_data_1;
+        uint16_t frame_length = us_frame_length;
+
+        // Frames are shorter than US_FRAME_MAX_LEN if the probe delta encodes them
+        while(sent < frame_length)
         {
-            flag_use_buf_1 = false;
-            while(frame_counter<NUMBER_OF_XFERS)
+            app_usbd_event_queue_process();
+
+            uint16_t length = MIN(frame_length - sent, BYTES_PR_XFER);
+            ret = app_usbd_cdc_acm_write(&m_app_cdc_acm, p_frame + sent, length);
+            if (ret == NRF_SUCCESS)
             {
-                app_usbd_event_queue_process();
-                if(frame_counter<NUMBER_OF_XFERS)
-                {      
-                    ret = app_usbd_cdc_acm_write(&m_app_cdc_acm, &p_rx_data_1[frame_counter], BYTES_PR_XFER);
-                    if (ret == NRF_SUCCESS)
-                    {
-                        ++frame_counter;
-                    }
-                }
+                sent += length;
             }
         }
-        else
-        {
-            flag_use_buf_1 = true;
-            while(frame_counter<NUMBER_OF_XFERS)
-            {
-                app_usbd_event_queue_process();
-                if(frame_counter<NUMBER_OF_XFERS)
-                {      
-                    ret = app_usbd_cdc_acm_write(&m_app_cdc_acm, &p_rx_data_2[frame_counter], BYTES_PR_XFER);
-                    if (ret == NRF_SUCCESS)
-                    {
-                        ++frame_counter;
-                    }
-                }
-            }        
-        }
-        frame_counter=0;
+        sent = 0;
         send_us_frame_to_vcom = false;
         started = false;
     }
@@ -254,7 +238,7 @@ static void cdc_acm_user_ev_handler(app_usbd_class_inst_t const * p_inst,
             {
                 if ((m_cdc_data_array[index - 1] == '\n') ||
                     (m_cdc_data_array[index - 1] == '\r') ||
-                    (index >= (m_ble_nus_max_data_len)))
+                    (index >= (m_ble_max_data_len)))
                 {
                     if (index > 1)
                     {
@@ -263,7 +247,7 @@ static void cdc_acm_user_ev_handler(app_usbd_class_inst_t const * p_inst,
                         do
                         {
                             uint16_t length = (uint16_t)index;
-                            if (length + sizeof(ENDLINE_STRING) < BLE_NUS_MAX_DATA_LEN)
+                            if (length + sizeof(ENDLINE_STRING) < (NRF_SDH_BLE_GATT_MAX_MTU_SIZE - 3))
                             {
                                 memcpy(m_cdc_data_array + length, ENDLINE_STRING, sizeof(ENDLINE_STRING));
                                 length += sizeof(ENDLINE_STRING);
@@ -329,7 +313,7 @@ static void cdc_acm_user_ev_handler(app_usbd_class_inst_t const * p_inst,
             ret_code_t ret_val;
             do
             {
-                ret_val = ble_nus_c_string_send(&m_ble_nus_c, m_cdc_data_array, 7);
+                ret_val = send_ble_packet((uint8_t *) m_cdc_data_array, 7);
                 if ((ret_val != NRF_SUCCESS) && (ret_val != NRF_ERROR_BUSY))
                 {
                     APP_ERROR_CHECK(ret_val);
@@ -0,0 +1,268 @@
+/*
+ * Copyright (C) 2023 ETH Zurich. All rights reserved.
+ *
+ * Authors: Sebastian Frey, ETH Zurich
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/** @file us_wulpus_c.c
+ *
+ * @brief    Dongle firmware client of the WULPUS service of the probe
+ *
+ * Structured like the Nordic UART Service client (ble_nus_c) of the SDK,
+ * which it replaces.
+ *
+*/
+
+#include <string.h>
+#include "sdk_common.h"
+#include "ble_gattc.h"
+#include "us_wulpus_c.h"
+
+
+/**@brief Function for intercepting the errors of the GATT queue.
+ *
+ * @param[in] nrf_error   Error code.
+ * @param[in] p_ctx       Parameter from the event handler (client instance).
+ * @param[in] conn_handle Connection handle.
+ */
+static void gatt_error_handler(uint32_t   nrf_error,
+                               void     * p_ctx,
+                               uint16_t   conn_handle)
+{
+    us_wulpus_c_t * p_wulpus_c = (us_wulpus_c_t *)p_ctx;
+
+    if (p_wulpus_c->error_handler != NULL)
+    {
+        p_wulpus_c->error_handler(nrf_error);
+    }
+}
+
+
+void us_wulpus_c_on_db_disc_evt(us_wulpus_c_t * p_wulpus_c, ble_db_discovery_evt_t * p_evt)
+{
+    us_wulpus_c_evt_t wulpus_c_evt;
+    memset(&wulpus_c_evt, 0, sizeof(us_wulpus_c_evt_t));
+
+    ble_gatt_db_char_t * p_chars = p_evt->params.discovered_db.charateristics;
+
+    // Check if the WULPUS service was discovered.
+    if (    (p_evt->evt_type == BLE_DB_DISCOVERY_COMPLETE)
+        &&  (p_evt->params.discovered_db.srv_uuid.uuid == US_WULPUS_SERVICE_UUID)
+        &&  (p_evt->params.discovered_db.srv_uuid.type == p_wulpus_c->uuid_type))
+    {
+        for (uint32_t i = 0; i < p_evt->params.discovered_db.char_count; i++)
+        {
+            switch (p_chars[i].characteristic.uuid.uuid)
+            {
+                case US_WULPUS_DATA_CHAR_UUID:
+                    wulpus_c_evt.handles.data_handle      = p_chars[i].characteristic.handle_value;
+                    wulpus_c_evt.handles.data_cccd_handle = p_chars[i].cccd_handle;
+                    break;
+
+                case US_WULPUS_CONTROL_CHAR_UUID:
+                    wulpus_c_evt.handles.control_handle = p_chars[i].characteristic.handle_value;
+                    break;
+
+                default:
+                    break;
+            }
+        }
+        if (p_wulpus_c->evt_handler != NULL)
+        {
+            wulpus_c_evt.conn_handle = p_evt->conn_handle;
+            wulpus_c_evt.evt_type    = US_WULPUS_C_EVT_DISCOVERY_COMPLETE;
+            p_wulpus_c->evt_handler(p_wulpus_c, &wulpus_c_evt);
+        }
+    }
+}
+
+
+/**@brief Function for handling the notifications of the probe.
+ *
+ * @param[in] p_wulpus_c  Pointer to the client instance.
+ * @param[in] p_ble_evt   Pointer to the BLE event.
+ */
+static void on_hvx(us_wulpus_c_t * p_wulpus_c, ble_evt_t const * p_ble_evt)
+{
+    // Only the data characteristic is subscribed
+    if (   (p_wulpus_c->handles.data_handle != BLE_GATT_HANDLE_INVALID)
+        && (p_ble_evt->evt.gattc_evt.params.hvx.handle == p_wulpus_c->handles.data_handle)
+        && (p_wulpus_c->evt_handler != NULL))
+    {
+        us_wulpus_c_evt_t wulpus_c_evt;
+
+        wulpus_c_evt.evt_type    = US_WULPUS_C_EVT_DATA;
+        wulpus_c_evt.conn_handle = p_wulpus_c->conn_handle;
+        wulpus_c_evt.p_data      = (uint8_t *)p_ble_evt->evt.gattc_evt.params.hvx.data;
+        wulpus_c_evt.data_len    = p_ble_evt->evt.gattc_evt.params.hvx.len;
+
+        p_wulpus_c->evt_handler(p_wulpus_c, &wulpus_c_evt);
+    }
+}
+
+
+uint32_t us_wulpus_c_init(us_wulpus_c_t * p_wulpus_c, us_wulpus_c_init_t * p_init)
+{
+    uint32_t      err_code;
+    ble_uuid_t    wulpus_uuid;
+    ble_uuid128_t wulpus_base_uuid = US_WULPUS_BASE_UUID;
+
+    VERIFY_PARAM_NOT_NULL(p_wulpus_c);
+    VERIFY_PARAM_NOT_NULL(p_init);
+    VERIFY_PARAM_NOT_NULL(p_init->p_gatt_queue);
+
+    err_code = sd_ble_uuid_vs_add(&wulpus_base_uuid, &p_wulpus_c->uuid_type);
+    VERIFY_SUCCESS(err_code);
+
+    wulpus_uuid.type = p_wulpus_c->uuid_type;
+    wulpus_uuid.uuid = US_WULPUS_SERVICE_UUID;
+
+    p_wulpus_c->conn_handle              = BLE_CONN_HANDLE_INVALID;
+    p_wulpus_c->evt_handler              = p_init->evt_handler;
+    p_wulpus_c->error_handler            = p_init->error_handler;
+    p_wulpus_c->handles.data_handle      = BLE_GATT_HANDLE_INVALID;
+    p_wulpus_c->handles.data_cccd_handle = BLE_GATT_HANDLE_INVALID;
+    p_wulpus_c->handles.control_handle   = BLE_GATT_HANDLE_INVALID;
+    p_wulpus_c->p_gatt_queue             = p_init->p_gatt_queue;
+
+    return ble_db_discovery_evt_register(&wulpus_uuid);
+}
+
+
+void us_wulpus_c_on_ble_evt(ble_evt_t const * p_ble_evt, void * p_context)
+{
+    us_wulpus_c_t * p_wulpus_c = (us_wulpus_c_t *)p_context;
+
+    if ((p_wulpus_c == NULL) || (p_ble_evt == NULL))
+    {
+        return;
+    }
+
+    if (   (p_wulpus_c->conn_handle == BLE_CONN_HANDLE_INVALID)
+        || (p_wulpus_c->conn_handle != p_ble_evt->evt.gap_evt.conn_handle))
+    {
+        return;
+    }
+
+    switch (p_ble_evt->header.evt_id)
+    {
+        case BLE_GATTC_EVT_HVX:
+            on_hvx(p_wulpus_c, p_ble_evt);
+            break;
+
+        case BLE_GAP_EVT_DISCONNECTED:
+            if (p_wulpus_c->evt_handler != NULL)
+            {
+                us_wulpus_c_evt_t wulpus_c_evt;
+
+                wulpus_c_evt.evt_type    = US_WULPUS_C_EVT_DISCONNECTED;
+                wulpus_c_evt.conn_handle = p_wulpus_c->conn_handle;
+
+                p_wulpus_c->conn_handle = BLE_CONN_HANDLE_INVALID;
+                p_wulpus_c->evt_handler(p_wulpus_c, &wulpus_c_evt);
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+
+uint32_t us_wulpus_c_data_notif_enable(us_wulpus_c_t * p_wulpus_c)
+{
+    VERIFY_PARAM_NOT_NULL(p_wulpus_c);
+
+    if (   (p_wulpus_c->conn_handle == BLE_CONN_HANDLE_INVALID)
+        || (p_wulpus_c->handles.data_cccd_handle == BLE_GATT_HANDLE_INVALID))
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+
+    nrf_ble_gq_req_t cccd_req;
+    uint8_t          cccd[BLE_CCCD_VALUE_LEN];
+    uint16_t         cccd_val = BLE_GATT_HVX_NOTIFICATION;
+
+    cccd[0] = LSB_16(cccd_val);
+    cccd[1] = MSB_16(cccd_val);
+
+    memset(&cccd_req, 0, sizeof(nrf_ble_gq_req_t));
+
+    cccd_req.type                        = NRF_BLE_GQ_REQ_GATTC_WRITE;
+    cccd_req.error_handler.cb            = gatt_error_handler;
+    cccd_req.error_handler.p_ctx         = p_wulpus_c;
+    cccd_req.params.gattc_write.handle   = p_wulpus_c->handles.data_cccd_handle;
+    cccd_req.params.gattc_write.len      = BLE_CCCD_VALUE_LEN;
+    cccd_req.params.gattc_write.offset   = 0;
+    cccd_req.params.gattc_write.p_value  = cccd;
+    cccd_req.params.gattc_write.write_op = BLE_GATT_OP_WRITE_REQ;
+    cccd_req.params.gattc_write.flags    = BLE_GATT_EXEC_WRITE_FLAG_PREPARED_WRITE;
+
+    return nrf_ble_gq_item_add(p_wulpus_c->p_gatt_queue, &cccd_req, p_wulpus_c->conn_handle);
+}
+
+
+uint32_t us_wulpus_c_control_send(us_wulpus_c_t * p_wulpus_c, uint8_t * p_data, uint16_t length)
+{
+    VERIFY_PARAM_NOT_NULL(p_wulpus_c);
+
+    nrf_ble_gq_req_t write_req;
+
+    memset(&write_req, 0, sizeof(nrf_ble_gq_req_t));
+
+    if (length > NRF_SDH_BLE_GATT_MAX_MTU_SIZE - 3)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    if (   (p_wulpus_c->conn_handle == BLE_CONN_HANDLE_INVALID)
+        || (p_wulpus_c->handles.control_handle == BLE_GATT_HANDLE_INVALID))
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+
+    // Write request: the probe acknowledges every configuration,
+    // the GATT queue sends the next one once the response arrived
+    write_req.type                        = NRF_BLE_GQ_REQ_GATTC_WRITE;
+    write_req.error_handler.cb            = gatt_error_handler;
+    write_req.error_handler.p_ctx         = p_wulpus_c;
+    write_req.params.gattc_write.handle   = p_wulpus_c->handles.control_handle;
+    write_req.params.gattc_write.len      = length;
+    write_req.params.gattc_write.offset   = 0;
+    write_req.params.gattc_write.p_value  = p_data;
+    write_req.params.gattc_write.write_op = BLE_GATT_OP_WRITE_REQ;
+    write_req.params.gattc_write.flags    = BLE_GATT_EXEC_WRITE_FLAG_PREPARED_WRITE;
+
+    return nrf_ble_gq_item_add(p_wulpus_c->p_gatt_queue, &write_req, p_wulpus_c->conn_handle);
+}
+
+
+uint32_t us_wulpus_c_handles_assign(us_wulpus_c_t               * p_wulpus_c,
+                                    uint16_t                      conn_handle,
+                                    us_wulpus_c_handles_t const * p_handles)
+{
+    VERIFY_PARAM_NOT_NULL(p_wulpus_c);
+
+    p_wulpus_c->conn_handle = conn_handle;
+    if (p_handles != NULL)
+    {
+        p_wulpus_c->handles.data_handle      = p_handles->data_handle;
+        p_wulpus_c->handles.data_cccd_handle = p_handles->data_cccd_handle;
+        p_wulpus_c->handles.control_handle   = p_handles->control_handle;
+    }
+    return nrf_ble_gq_conn_handle_register(p_wulpus_c->p_gatt_queue, conn_handle);
+}
@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2023 ETH Zurich. All rights reserved.
+ *
+ * Authors: Sebastian Frey, ETH Zurich
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/** @file us_wulpus_c.h
+ *
+ * @brief    Dongle firmware client of the WULPUS service of the probe
+ *
+ * The probe exposes a data characteristic (notify) carrying the stream of
+ * the US frames, a control characteristic (write with response) for the
+ * configurations and a telemetry characteristic (read, notify) which is
+ * only used by direct connections to a PC.
+ *
+*/
+
+#ifndef US_WULPUS_C_H
+#define US_WULPUS_C_H
+
+#include <stdint.h>
+#include "ble.h"
+#include "ble_gatt.h"
+#include "ble_srv_common.h"
+#include "ble_db_discovery.h"
+#include "nrf_ble_gq.h"
+#include "nrf_sdh_ble.h"
+
+    // WULPUS service 57550001-4C50-5553-A1B2-C3D4E5F60718 (see fw/nrf52/probe_fw/wulpus/wulpus_ble.c)
+    #define US_WULPUS_BASE_UUID {{0x18, 0x07, 0xF6, 0xE5, 0xD4, 0xC3, 0xB2, 0xA1, 0x53, 0x55, 0x50, 0x4C, 0x00, 0x00, 0x55, 0x57}}
+    #define US_WULPUS_SERVICE_UUID          0x0001
+    #define US_WULPUS_DATA_CHAR_UUID        0x0002
+    #define US_WULPUS_CONTROL_CHAR_UUID     0x0003
+    #define US_WULPUS_TELEMETRY_CHAR_UUID   0x0004
+
+    #define US_WULPUS_C_BLE_OBSERVER_PRIO   2
+
+    /**@brief Macro for defining a us_wulpus_c instance.
+     *
+     * @param   _name   Name of the instance.
+     */
+    #define US_WULPUS_C_DEF(_name)                                  \
+    static us_wulpus_c_t _name;                                     \
+    NRF_SDH_BLE_OBSERVER(_name ## _obs,                             \
+                         US_WULPUS_C_BLE_OBSERVER_PRIO,             \
+                         us_wulpus_c_on_ble_evt, &_name)
+
+    typedef enum
+    {
+        US_WULPUS_C_EVT_DISCOVERY_COMPLETE, /**< The WULPUS service and its characteristics were found on the probe. */
+        US_WULPUS_C_EVT_DATA,               /**< Notification of the data characteristic. */
+        US_WULPUS_C_EVT_DISCONNECTED        /**< The probe disconnected. */
+    } us_wulpus_c_evt_type_t;
+
+    /**@brief Handles of the WULPUS service on the probe. */
+    typedef struct
+    {
+        uint16_t data_handle;
+        uint16_t data_cccd_handle;
+        uint16_t control_handle;
+    } us_wulpus_c_handles_t;
+
+    typedef struct
+    {
+        us_wulpus_c_evt_type_t evt_type;
+        uint16_t               conn_handle;
+        uint8_t const        * p_data;
+        uint16_t               data_len;
+        us_wulpus_c_handles_t  handles;     /**< Valid for US_WULPUS_C_EVT_DISCOVERY_COMPLETE. */
+    } us_wulpus_c_evt_t;
+
+    typedef struct us_wulpus_c_s us_wulpus_c_t;
+
+    typedef void (* us_wulpus_c_evt_handler_t)(us_wulpus_c_t * p_wulpus_c, us_wulpus_c_evt_t const * p_evt);
+
+    struct us_wulpus_c_s
+    {
+        uint8_t                   uuid_type;
+        uint16_t                  conn_handle;
+        us_wulpus_c_handles_t     handles;
+        us_wulpus_c_evt_handler_t evt_handler;
+        ble_srv_error_handler_t   error_handler;
+        nrf_ble_gq_t            * p_gatt_queue;
+    };
+
+    typedef struct
+    {
+        us_wulpus_c_evt_handler_t evt_handler;
+        ble_srv_error_handler_t   error_handler;
+        nrf_ble_gq_t            * p_gatt_queue;
+    } us_wulpus_c_init_t;
+
+    /**@brief Function to initialize the client (registers the base UUID and the service for the discovery)
+     */
+    uint32_t us_wulpus_c_init(us_wulpus_c_t * p_wulpus_c, us_wulpus_c_init_t * p_init);
+
+    /**@brief Function to forward the events of the database discovery module
+     */
+    void us_wulpus_c_on_db_disc_evt(us_wulpus_c_t * p_wulpus_c, ble_db_discovery_evt_t * p_evt);
+
+    /**@brief Function to handle the BLE events (registered by US_WULPUS_C_DEF)
+     */
+    void us_wulpus_c_on_ble_evt(ble_evt_t const * p_ble_evt, void * p_context);
+
+    /**@brief Function to assign the connection and the discovered handles (NULL to clear them)
+     */
+    uint32_t us_wulpus_c_handles_assign(us_wulpus_c_t * p_wulpus_c, uint16_t conn_handle, us_wulpus_c_handles_t const * p_handles);
+
+    /**@brief Function to enable the notifications of the data characteristic
+     */
+    uint32_t us_wulpus_c_data_notif_enable(us_wulpus_c_t * p_wulpus_c);
+
+    /**@brief Function to write a configuration or command to the control characteristic (acknowledged by the probe)
+     */
+    uint32_t us_wulpus_c_control_send(us_wulpus_c_t * p_wulpus_c, uint8_t * p_data, uint16_t length);
+
+
+#endif
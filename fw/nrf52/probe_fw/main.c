@@ -27,6 +27,15 @@
 #include "wulpus_spi.h"
 #include "wulpus_ppi.h"
 #include "wulpus_ble.h"
+#include "wulpus_delta.h"
+#include "wulpus_compress.h"
+#include "wulpus_feature.h"
+#include "wulpus_stream.h"
+#include "wulpus_bench.h"
+#include "wulpus_buffer.h"
+#include "wulpus_l2cap.h"
+#include "wulpus_retx.h"
+#include "wulpus_link.h"
 #include "wulpus_config.h"
 
 static void handle_idle_state(void);
@@ -34,40 +43,100 @@ static void handle_idle_state(void);
 #define FRAME_SIZE (WULPUS_NUMBER_OF_XFERS * WULPUS_BYTES_PER_XFER)
 
 uint8_t tx_buffer[WULPUS_BYTES_PER_XFER];
-uint8_t rx_buffer[FRAME_SIZE * WULPUS_NUM_BUFFERED_FRAMES];
+// The slot after the ring is a guard: the SPI RX pointer is incremented after every frame
+// (NRF_DRV_SPI_FLAG_RX_POSTINC) and only moved back by ppi_end_handler(), a late interrupt
+// lets the next frame land behind the last slot
+uint8_t rx_buffer[FRAME_SIZE * (WULPUS_NUM_BUFFERED_FRAMES + 1)];
+
+volatile size_t rx_buffer_head = 0;
+volatile size_t rx_buffer_tail = 0;
+// The main loop reads the frame at the tail, it must not be dropped (WP_BUFFER_DROP_OLDEST)
+volatile bool rx_buffer_busy = false;
+// wp_buffer_drop_count() when the delta encoding was last restarted
+uint32_t rx_buffer_drops = 0;
+// Slots right behind the tail holding frames of the current configuration (sent or dropped),
+// they can be sent again until the head overwrites them
+volatile size_t rx_buffer_retained = 0;
+// A new configuration was sent, the buffers are reset by the main loop
+volatile bool stream_reset = false;
+// The SPI reception is prepared and data ready starts it through PPI
+volatile bool stream_armed = false;
+
+// Streaming is active after a configuration was received
+bool stream_active = false;
+// Ready line is held low because the frame buffer is nearly full
+bool stream_throttled = false;
+// Frames are sent as SDUs of the L2CAP channel instead of notifications
+bool stream_l2cap = false;
+
+// Feature records are sent from here, used in turn: a record is released by the SoftDevice
+// before it is overwritten, at most WULPUS_L2CAP_TX_QUEUE_LEN SDUs are queued
+uint8_t feature_records[WULPUS_L2CAP_TX_QUEUE_LEN][WP_FEATURE_MAX_LEN];
+size_t feature_record_idx = 0;
+
+// Number of frames waiting to be sent via BLE
+static size_t rx_buffer_pending(void)
+{
+  return (rx_buffer_head + WULPUS_NUM_BUFFERED_FRAMES - rx_buffer_tail) % WULPUS_NUM_BUFFERED_FRAMES;
+}
 
-size_t rx_buffer_head = 0;
-size_t rx_buffer_tail = 0;
+// Slots which can't take a new frame: the pending frames and the frames in flight on the L2CAP channel
+static size_t rx_buffer_occupied(void)
+{
+  return rx_buffer_pending() + wp_l2cap_tx_pending();
+}
 
-// Called when data ready signal is received from MSP430 (main/in_pin_handler)
-void gpio_data_ready_handler(nrfx_gpiote_pin_t pin, nrf_gpiote_polarity_t action)
+// Frame behind the tail which is not overwritten yet, NULL if it is not buffered anymore
+// The slot after the head is skipped: the next frame may be received into it meanwhile
+static uint8_t const *rx_buffer_find_retained(uint16_t frame_number)
 {
-  uint32_t polarity = nrf_gpio_pin_read(pin);
+  size_t head = rx_buffer_head;
+  size_t tail = rx_buffer_tail;
+  size_t pending = (head + WULPUS_NUM_BUFFERED_FRAMES - tail) % WULPUS_NUM_BUFFERED_FRAMES;
+  size_t behind = (pending + 2 < WULPUS_NUM_BUFFERED_FRAMES) ? (WULPUS_NUM_BUFFERED_FRAMES - 2 - pending) : 0;
 
-  switch (action)
+  // Newest first, the host requests the frames soon after the gap
+  for (size_t i = 1; i <= MIN(rx_buffer_retained, behind); i++)
   {
-    case NRF_GPIOTE_POLARITY_LOTOHI:
-      // NRF_LOG_DEBUG("LOTOHI on pin %lu (%lu)", pin, polarity);
-      break;
-    case NRF_GPIOTE_POLARITY_HITOLO:
-      // NRF_LOG_DEBUG("HITOLO on pin %lu (%lu)", pin, polarity);
-      break;
-    case NRF_GPIOTE_POLARITY_TOGGLE:
-      NRF_LOG_DEBUG("TOGGLE on pin %lu (%lu)", pin, polarity);
+    uint8_t const *frame = rx_buffer + ((tail + WULPUS_NUM_BUFFERED_FRAMES - i) % WULPUS_NUM_BUFFERED_FRAMES) * FRAME_SIZE;
 
-      if (polarity == 1)
-      {
-        NRF_LOG_DEBUG("Data ready");
-        // Set new RX buffer
-        wp_spi_set_buffer(rx_buffer + rx_buffer_head * FRAME_SIZE);
+    if (!wp_bench_is_frame(frame) && (wp_retx_frame_number(frame) == frame_number)) return frame;
+  }
 
-        // Start the four SPI transactions
-        wp_spi_init_reception();
-        wp_ppi_start_transfer();
-      }
+  return NULL;
+}
 
-      break;
+// Commits the frame at the head of the buffer according to the overflow policy
+// (called from interrupt context once the frame was received or generated)
+static void rx_buffer_commit(void)
+{
+  size_t pending = rx_buffer_pending();
+  // Frames sent over L2CAP stay in their slots behind the tail until the SoftDevice released them
+  size_t in_flight = wp_l2cap_tx_pending();
+
+  if (!wp_buffer_keep(rx_buffer + rx_buffer_head * FRAME_SIZE, pending)) return;
+
+  // Two slots stay empty: the next frame is received into the head, and into the slot after it
+  // if this one is dropped and ppi_end_handler() runs only after the next data ready
+  if (pending + in_flight >= WULPUS_NUM_BUFFERED_FRAMES - 2)
+  {
+    wp_buffer_count_drop();
+
+    // Dropping the oldest pending frame frees no slot while frames are in flight
+    if ((wp_buffer_policy() != WP_BUFFER_DROP_OLDEST) || rx_buffer_busy || (in_flight > 0))
+    {
+      // The next frame overwrites this one
+      NRF_LOG_WARNING("RX Buffer overflow, dropped newest frame");
+      return;
+    }
+
+    NRF_LOG_WARNING("RX Buffer overflow, dropped oldest frame");
+    rx_buffer_tail = (rx_buffer_tail + 1) % WULPUS_NUM_BUFFERED_FRAMES;
+    rx_buffer_retained = MIN(rx_buffer_retained + 1, WULPUS_NUM_BUFFERED_FRAMES);
   }
+
+  rx_buffer_head = (rx_buffer_head + 1) % WULPUS_NUM_BUFFERED_FRAMES;
+  wp_buffer_update_level(rx_buffer_pending());
 }
 
 // Called when all SPI transfers for one packet are done (us_spi/counter_cc0_event_handler)
@@ -75,19 +144,36 @@ void ppi_end_handler(void)
 {
   NRF_LOG_DEBUG("SPI transfer done");
 
-  rx_buffer_head = (rx_buffer_head + 1) % WULPUS_NUM_BUFFERED_FRAMES;
-  if (rx_buffer_head == rx_buffer_tail)
+  rx_buffer_commit();
+
+  // Receive the next frame into the (new) head, the RX pointer only moves at the end of the buffer
+  // or if the frame was dropped. Until then it points at the guard slot or at the free slot after the head
+  wp_spi_set_buffer(rx_buffer + rx_buffer_head * FRAME_SIZE);
+
+  // BLE can't keep up, let the MSP430 keep the frames in its FRAM until the buffer drained
+  if (stream_active && !stream_throttled && (rx_buffer_occupied() >= WULPUS_BUFFER_HIGH_WATERMARK))
   {
-    NRF_LOG_WARNING("RX Buffer overflow!");
+    stream_throttled = true;
+    wp_gpio_ble_conn_indicate(false);
   }
 }
 
+// Called at the frame rate of the benchmark (wulpus_bench/_wp_bench_timer_handler)
+void bench_tick_handler(void)
+{
+  // Same path as the frames of the MSP430, dropped frames leave a gap in the sequence numbers
+  wp_bench_generate(rx_buffer + rx_buffer_head * FRAME_SIZE);
+  rx_buffer_commit();
+}
+
 // Called when connection status of the bluetooth connection changes (new)
 void ble_conn_handler(bool connected)
 {
   NRF_LOG_DEBUG("BLE connection status changed to %d", connected);
 
   // Connection alone is not sufficient to start the MSP430.
+  stream_active = false;
+  stream_throttled = false;
   wp_gpio_ble_conn_indicate(false);
 
   if (!connected)
@@ -95,21 +181,90 @@ void ble_conn_handler(bool connected)
     // Stop any running transfers
     wp_ppi_stop_transfer();
     wp_spi_stop_reception();
+    stream_armed = false;
 
     // Send restart packet to MSP430
     const uint8_t restart_packet[WULPUS_BYTES_PER_PACKET] = WULPUS_RESTART_PACKET;
     wp_spi_send_config(restart_packet, WULPUS_BYTES_PER_PACKET);
+
+    // Delta encoding, compression, features and the benchmark have to be requested again by the next host
+    wp_delta_disable();
+    wp_compress_disable();
+    wp_feature_disable();
+    wp_bench_disable();
+    wp_retx_reset();
   }
+
+  // A new connection starts at the preferred (shortest) interval
+  wp_link_reset();
 }
 
-// Called when data is received via NUS (us_ble/nus_data_handler)
+// Called when data is written to the control characteristic (wulpus_ble)
 void ble_data_handler(uint8_t const *data, uint16_t length)
 {
   NRF_LOG_DEBUG("Received %d bytes of data", length);
 
+  // Retransmission requests are served by the main loop
+  if (wp_retx_is_nack_packet(data, length))
+  {
+    if (wp_retx_request(data, length) != NRF_SUCCESS)
+    {
+      NRF_LOG_WARNING("Invalid or dropped retransmission request");
+    }
+    return;
+  }
+
+  // Delta encoding, overflow, compression and feature settings are meant for the nRF52 only
+  if (wp_delta_is_conf_packet(data, length))
+  {
+    if (wp_delta_configure(data, length) != NRF_SUCCESS)
+    {
+      NRF_LOG_WARNING("Invalid delta encoding settings");
+    }
+    if (wp_buffer_configure(data, length) != NRF_SUCCESS)
+    {
+      NRF_LOG_WARNING("Invalid overflow settings");
+    }
+    if (wp_compress_configure(data, length) != NRF_SUCCESS)
+    {
+      NRF_LOG_WARNING("Invalid compression settings");
+    }
+    if (wp_feature_configure(data, length) != NRF_SUCCESS)
+    {
+      NRF_LOG_WARNING("Invalid feature settings");
+    }
+    return;
+  }
+
+  // Benchmark settings are meant for the nRF52 only, the MSP430 stays idle
+  if (wp_bench_is_conf_packet(data, length))
+  {
+    wp_ppi_stop_transfer();
+    wp_spi_stop_reception();
+    stream_armed = false;
+
+    if (wp_bench_configure(data, length) != NRF_SUCCESS)
+    {
+      NRF_LOG_WARNING("Invalid benchmark settings");
+      return;
+    }
+
+    // The benchmark is started by the main loop once the buffers are reset
+    stream_reset = true;
+
+    stream_active = false;
+    stream_throttled = false;
+    wp_gpio_ble_conn_indicate(false);
+    return;
+  }
+
+  // A new configuration ends the benchmark
+  wp_bench_disable();
+
   // Stop any running transfers
   wp_ppi_stop_transfer();
   wp_spi_stop_reception();
+  stream_armed = false;
 
   // // Copy received command from python to the SPI transmit buffer
   // memcpy(tx_buffer, data, length);
@@ -117,27 +272,195 @@ void ble_data_handler(uint8_t const *data, uint16_t length)
   NRF_LOG_DEBUG("Sending config of length %u", length);
 
   // Clear the BLE buffers to send US data with the received configuration
-  rx_buffer_head = 0;
-  rx_buffer_tail = 0;
+  // (done in the main loop, which owns the BLE TX queue)
+  stream_reset = true;
 
+  stream_active = true;
+  stream_throttled = false;
   wp_gpio_ble_conn_indicate(true);
 }
 
-// Checks if there are any frames queued to be processed and processes them
+// Room for the next frame and its feature record (WP_FEATURE_ALONGSIDE)
+static bool stream_has_room(wp_feature_mode_t feature_mode)
+{
+  bool record = (feature_mode == WP_FEATURE_ALONGSIDE);
+
+  if (stream_l2cap) return wp_l2cap_tx_free() > (record ? 1 : 0);
+  return wp_stream_free() >= FRAME_SIZE + (record ? WP_FEATURE_MAX_LEN : 0);
+}
+
+static void stream_transmit(uint8_t const *data, uint16_t length)
+{
+  if (stream_l2cap)
+  {
+    APP_ERROR_CHECK(wp_l2cap_transmit(data, length));
+  }
+  else
+  {
+    APP_ERROR_CHECK(wp_stream_write(data, length));
+  }
+
+  wp_link_count(length);
+}
+
+// Packs the received frames into the BLE stream (or the L2CAP channel) and releases them once they are copied
+// Never blocks, the main loop sleeps until the next SPI or BLE event
 void handle_pending_frames(void)
 {
-  if (rx_buffer_tail != rx_buffer_head)
+  if (stream_reset)
   {
-    NRF_LOG_DEBUG("Processing frame %d", rx_buffer_tail);
+    stream_reset = false;
 
-    APP_ERROR_CHECK(wp_ble_transmit(rx_buffer + rx_buffer_tail * FRAME_SIZE + 0 * WULPUS_BYTES_PER_XFER, WULPUS_BYTES_PER_XFER + 1));
-    APP_ERROR_CHECK(wp_ble_transmit(rx_buffer + rx_buffer_tail * FRAME_SIZE + 1 * WULPUS_BYTES_PER_XFER, WULPUS_BYTES_PER_XFER));
-    APP_ERROR_CHECK(wp_ble_transmit(rx_buffer + rx_buffer_tail * FRAME_SIZE + 2 * WULPUS_BYTES_PER_XFER, WULPUS_BYTES_PER_XFER));
-    APP_ERROR_CHECK(wp_ble_transmit(rx_buffer + rx_buffer_tail * FRAME_SIZE + 3 * WULPUS_BYTES_PER_XFER, WULPUS_BYTES_PER_XFER));
+    wp_ble_tx_flush();
+    wp_stream_reset();
+    // Discard the pending frames by rewinding the head, the reception and the benchmark are stopped.
+    // The frames in flight on the L2CAP channel stay in their slots right behind the tail
+    rx_buffer_head = rx_buffer_tail;
 
-    NRF_LOG_DEBUG("Sent frame %d", rx_buffer_tail);
+    // Frames of the last configuration are not sent again
+    rx_buffer_retained = 0;
+    wp_retx_reset();
 
-    rx_buffer_tail = (rx_buffer_tail + 1) % WULPUS_NUM_BUFFERED_FRAMES;
+    // Statistics are counted per configuration
+    wp_buffer_reset();
+    rx_buffer_drops = 0;
+
+    // Start every TX/RX config with a keyframe
+    wp_delta_reset();
+
+    // The data rate of the new configuration is measured from the shortest interval
+    wp_link_restart();
+
+    // Only if the benchmark was requested
+    APP_ERROR_CHECK(wp_bench_start());
+  }
+
+  // Arm the reception once the configuration was sent to the MSP430, every data ready then
+  // starts the four SPI transactions of a frame through PPI without an interrupt
+  if (stream_active && !stream_armed && !wp_spi_is_busy())
+  {
+    // A new configuration must not stop the transfers while they are armed
+    CRITICAL_REGION_ENTER();
+    if (stream_active && !stream_armed && !wp_spi_is_busy())
+    {
+      wp_spi_set_buffer(rx_buffer + rx_buffer_head * FRAME_SIZE);
+      APP_ERROR_CHECK(wp_spi_init_reception());
+      wp_ppi_start_transfer();
+      stream_armed = true;
+    }
+    CRITICAL_REGION_EXIT();
+  }
+
+  // Refill the SoftDevice queue (after BLE_GATTS_EVT_HVN_TX_COMPLETE)
+  wp_ble_tx_process();
+
+  // Dropped frames leave a gap in the frame numbers and the host forgets its references
+  if (wp_buffer_drop_count() != rx_buffer_drops)
+  {
+    rx_buffer_drops = wp_buffer_drop_count();
+    wp_delta_reset();
+  }
+
+  // Switch to the L2CAP channel once the dongle opened it, back to notifications once it is released
+  if (wp_l2cap_is_active() != stream_l2cap)
+  {
+    stream_l2cap = !stream_l2cap;
+    NRF_LOG_INFO("Streaming over %s", stream_l2cap ? "L2CAP" : "notifications");
+
+    // The two paths are not ordered with respect to each other, restart with a keyframe
+    wp_stream_flush();
+    wp_delta_reset();
+  }
+
+  // Frames requested again by the host go in front of the new ones (notifications only,
+  // the L2CAP channel sends from the slots, which are not protected behind the frames in flight)
+  if (stream_l2cap) wp_retx_reset();
+
+  uint16_t frame_number;
+  while ((wp_stream_free() >= FRAME_SIZE) && wp_retx_next(&frame_number))
+  {
+    uint8_t const *frame = rx_buffer_find_retained(frame_number);
+
+    if (frame != NULL)
+    {
+      stream_transmit(frame, wp_retx_frame_length(frame));
+    }
+    else
+    {
+      uint8_t record[WP_RETX_LOST_LEN];
+      wp_retx_lost_record(frame_number, record);
+      stream_transmit(record, WP_RETX_LOST_LEN);
+    }
+  }
+
+  // Pack the next frames while the longest possible frame fits into the stream
+  // (one SDU per frame on the L2CAP channel, sent from its slot, the credits of the dongle throttle it)
+  while (rx_buffer_tail != rx_buffer_head)
+  {
+    // The settings may change from the BLE handler, the mode is read once per frame
+    wp_feature_mode_t feature_mode = wp_feature_mode();
+    if (!stream_has_room(feature_mode)) break;
+
+    // Protect the frame at the tail from WP_BUFFER_DROP_OLDEST
+    rx_buffer_busy = true;
+    __DMB();
+
+    // Re-read, a frame may have been dropped before the flag was set
+    size_t tail = rx_buffer_tail;
+    if (tail == rx_buffer_head)
+    {
+      rx_buffer_busy = false;
+      break;
+    }
+
+    NRF_LOG_DEBUG("Processing frame %d", tail);
+
+    uint8_t *frame = rx_buffer + tail * FRAME_SIZE;
+    bool bench_frame = wp_bench_is_frame(frame);
+
+    // Peaks of the envelope (if enabled), taken from the samples before they are encoded
+    if (!bench_frame && (feature_mode != WP_FEATURE_OFF))
+    {
+      uint8_t *record = feature_records[feature_record_idx];
+      feature_record_idx = (feature_record_idx + 1) % WULPUS_L2CAP_TX_QUEUE_LEN;
+
+      stream_transmit(record, wp_feature_extract(frame, record));
+    }
+
+    // Replace the samples with the residual to the last frame of the same TX/RX config (if enabled)
+    // and compress the full frames (if enabled), synthetic frames are sent as generated.
+    // With WP_FEATURE_ONLY the frame is released without being sent
+    if (bench_frame)
+    {
+      stream_transmit(frame, wp_bench_frame_length(frame));
+    }
+    else if (feature_mode != WP_FEATURE_ONLY)
+    {
+      stream_transmit(frame, wp_compress_encode(frame, wp_delta_encode(frame)));
+    }
+    wp_buffer_count_sent();
+
+    rx_buffer_tail = (tail + 1) % WULPUS_NUM_BUFFERED_FRAMES;
+    rx_buffer_retained = MIN(rx_buffer_retained + 1, WULPUS_NUM_BUFFERED_FRAMES);
+    rx_buffer_busy = false;
+    wp_buffer_update_level(rx_buffer_pending());
+
+    // Buffer drained, the MSP430 can flush its backlog
+    if (stream_active && stream_throttled && (rx_buffer_occupied() <= WULPUS_BUFFER_LOW_WATERMARK))
+    {
+      stream_throttled = false;
+      wp_gpio_ble_conn_indicate(true);
+    }
+  }
+
+  // Connection interval from the data rate, the shortest one while frames wait in the buffer
+  wp_link_process(rx_buffer_pending() >= WULPUS_BUFFER_LOW_WATERMARK);
+
+  // Partly filled notifications are sent once their deadline passed (WULPUS_STREAM_FLUSH_DEADLINE),
+  // short frames arriving at a high rate are packed into full notifications meanwhile
+  if ((rx_buffer_tail == rx_buffer_head) && wp_stream_flush_due())
+  {
+    wp_stream_flush();
   }
 }
 
@@ -155,7 +478,6 @@ int main(void)
   
   // Initialize GPIO
   APP_ERROR_CHECK(wp_gpio_init());
-  APP_ERROR_CHECK(wp_gpio_add_data_handler(gpio_data_ready_handler));
   
   // Initialize SPI
   APP_ERROR_CHECK(wp_spi_init(tx_buffer, WULPUS_BYTES_PER_XFER, rx_buffer, WULPUS_BYTES_PER_XFER));
@@ -170,6 +492,12 @@ int main(void)
   APP_ERROR_CHECK(wp_ble_add_conn_handler(ble_conn_handler));
   APP_ERROR_CHECK(wp_ble_add_data_handler(ble_data_handler));
 
+  // Initialize the stream, the benchmark, the statistics and the connection interval (need the app timer of the BLE module)
+  APP_ERROR_CHECK(wp_stream_init());
+  APP_ERROR_CHECK(wp_bench_init(bench_tick_handler));
+  APP_ERROR_CHECK(wp_buffer_init(WULPUS_NUM_BUFFERED_FRAMES - 2));
+  APP_ERROR_CHECK(wp_link_init());
+
   // Start advertising
   APP_ERROR_CHECK(wp_ble_advertising_start());
   NRF_LOG_INFO("Advertising started");
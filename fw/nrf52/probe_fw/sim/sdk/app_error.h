@@ -0,0 +1,20 @@
+#ifndef APP_ERROR_H__
+#define APP_ERROR_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sdk_errors.h"
+
+// Reports the error and ends the simulation (sim_sd.c)
+void app_error_handler(ret_code_t error_code, uint32_t line_num, uint8_t const *p_file_name);
+
+#define APP_ERROR_HANDLER(ERR_CODE) app_error_handler((ERR_CODE), __LINE__, (uint8_t const *)__FILE__)
+
+#define APP_ERROR_CHECK(ERR_CODE) \
+  do { \
+    ret_code_t const LOCAL_ERR_CODE = (ERR_CODE); \
+    if (LOCAL_ERR_CODE != NRF_SUCCESS) APP_ERROR_HANDLER(LOCAL_ERR_CODE); \
+  } while (0)
+
+#endif // APP_ERROR_H__
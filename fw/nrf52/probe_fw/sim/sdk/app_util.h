@@ -0,0 +1,46 @@
+#ifndef APP_UTIL_H__
+#define APP_UTIL_H__
+
+#include <stdint.h>
+
+#include "nordic_common.h"
+
+#define STATIC_ASSERT(EXPR) _Static_assert((EXPR), "static assertion failed")
+
+#define ROUNDED_DIV(A, B) (((A) + ((B) / 2)) / (B))
+#define CEIL_DIV(A, B)    (((A) + (B) - 1) / (B))
+
+enum
+{
+  UNIT_0_625_MS = 625,
+  UNIT_1_25_MS  = 1250,
+  UNIT_10_MS    = 10000,
+};
+
+#define MSEC_TO_UNITS(TIME, RESOLUTION) (((TIME) * 1000) / (RESOLUTION))
+
+static inline uint8_t uint16_encode(uint16_t value, uint8_t *p_encoded_data)
+{
+  p_encoded_data[0] = (uint8_t)value;
+  p_encoded_data[1] = (uint8_t)(value >> 8);
+  return sizeof(uint16_t);
+}
+
+static inline uint16_t uint16_decode(uint8_t const *p_encoded_data)
+{
+  return (uint16_t)(p_encoded_data[0] | ((uint16_t)p_encoded_data[1] << 8));
+}
+
+static inline uint8_t uint32_encode(uint32_t value, uint8_t *p_encoded_data)
+{
+  uint16_encode((uint16_t)value, p_encoded_data);
+  uint16_encode((uint16_t)(value >> 16), p_encoded_data + 2);
+  return sizeof(uint32_t);
+}
+
+static inline uint32_t uint32_decode(uint8_t const *p_encoded_data)
+{
+  return uint16_decode(p_encoded_data) | ((uint32_t)uint16_decode(p_encoded_data + 2) << 16);
+}
+
+#endif // APP_UTIL_H__
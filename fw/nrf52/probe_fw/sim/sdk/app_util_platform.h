@@ -0,0 +1,11 @@
+#ifndef APP_UTIL_PLATFORM_H__
+#define APP_UTIL_PLATFORM_H__
+
+#include "nrf.h"
+#include "app_util.h"
+
+// The simulated interrupts never preempt the main loop, they run while it sleeps
+#define CRITICAL_REGION_ENTER() {
+#define CRITICAL_REGION_EXIT()  }
+
+#endif // APP_UTIL_PLATFORM_H__
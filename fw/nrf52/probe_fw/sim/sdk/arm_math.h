@@ -0,0 +1,73 @@
+#ifndef ARM_MATH_H__
+#define ARM_MATH_H__
+
+// Host build: reference implementations of the CMSIS-DSP functions used by wulpus_feature,
+// bit exact with the library for the sizes it accepts
+
+#include <stdint.h>
+#include <string.h>
+
+typedef int16_t q15_t;
+typedef int32_t q31_t;
+typedef int64_t q63_t;
+typedef float float32_t;
+
+typedef enum
+{
+  ARM_MATH_SUCCESS = 0,
+} arm_status;
+
+typedef struct
+{
+  uint16_t numTaps;
+  q15_t *pState;          // numTaps + blockSize - 1 samples
+  q15_t const *pCoeffs;   // Time reversed
+} arm_fir_instance_q15;
+
+static inline q15_t __arm_ssat_q15(q63_t value)
+{
+  return (q15_t)((value > INT16_MAX) ? INT16_MAX : ((value < INT16_MIN) ? INT16_MIN : value));
+}
+
+static inline arm_status arm_fir_init_q15(arm_fir_instance_q15 *S, uint16_t numTaps, q15_t const *pCoeffs,
+                                          q15_t *pState, uint32_t blockSize)
+{
+  S->numTaps = numTaps;
+  S->pCoeffs = pCoeffs;
+  S->pState = pState;
+  memset(pState, 0, (numTaps + blockSize - 1) * sizeof(q15_t));
+
+  return ARM_MATH_SUCCESS;
+}
+
+static inline void arm_fir_q15(arm_fir_instance_q15 const *S, q15_t const *pSrc, q15_t *pDst, uint32_t blockSize)
+{
+  uint16_t num_taps = S->numTaps;
+  q15_t *state = S->pState;
+
+  memcpy(state + num_taps - 1, pSrc, blockSize * sizeof(q15_t));
+
+  for (uint32_t i = 0; i < blockSize; i++)
+  {
+    q63_t acc = 0;
+    for (uint16_t k = 0; k < num_taps; k++) acc += (q31_t)S->pCoeffs[k] * state[i + k];
+    pDst[i] = __arm_ssat_q15(acc >> 15);
+  }
+
+  memmove(state, state + blockSize, (num_taps - 1) * sizeof(q15_t));
+}
+
+static inline void arm_abs_q15(q15_t const *pSrc, q15_t *pDst, uint32_t blockSize)
+{
+  for (uint32_t i = 0; i < blockSize; i++) pDst[i] = __arm_ssat_q15((pSrc[i] < 0) ? -(q31_t)pSrc[i] : pSrc[i]);
+}
+
+static inline void arm_mean_q15(q15_t const *pSrc, uint32_t blockSize, q15_t *pResult)
+{
+  q31_t sum = 0;
+
+  for (uint32_t i = 0; i < blockSize; i++) sum += pSrc[i];
+  *pResult = (q15_t)(sum / (q31_t)blockSize);
+}
+
+#endif // ARM_MATH_H__
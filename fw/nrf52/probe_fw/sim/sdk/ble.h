@@ -0,0 +1,285 @@
+#ifndef BLE_H__
+#define BLE_H__
+
+// Host build: the part of the S132 API used by the WULPUS modules, served by the link model (sim_sd.c)
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "app_util.h"
+#include "sdk_errors.h"
+
+#define BLE_CONN_HANDLE_INVALID     0xFFFF
+#define BLE_GATT_HANDLE_INVALID     0x0000
+#define BLE_GATT_ATT_MTU_DEFAULT    23
+#define BLE_GATT_HVX_NOTIFICATION   0x01
+#define BLE_GATTS_SRVC_TYPE_PRIMARY 0x01
+
+#define BLE_GAP_PHY_AUTO            0x00
+#define BLE_GAP_PHY_1MBPS           0x01
+#define BLE_GAP_PHY_2MBPS           0x02
+
+#define BLE_GAP_SEC_STATUS_PAIRING_NOT_SUPP         0x85
+#define BLE_GAP_ADV_FLAGS_LE_ONLY_LIMITED_DISC_MODE 0x05
+
+#define BLE_L2CAP_CID_INVALID       0x0000
+#define BLE_L2CAP_MTU_MIN           23
+#define BLE_L2CAP_MPS_MIN           23
+
+#define BLE_L2CAP_CH_STATUS_CODE_SUCCESS              0x0000
+#define BLE_L2CAP_CH_STATUS_CODE_LE_PSM_NOT_SUPPORTED 0x0002
+#define BLE_L2CAP_CH_STATUS_CODE_UNACCEPTABLE_PARAMS  0x000B
+
+enum
+{
+  BLE_GAP_EVT_CONNECTED = 0x10,
+  BLE_GAP_EVT_DISCONNECTED,
+  BLE_GAP_EVT_CONN_PARAM_UPDATE,
+  BLE_GAP_EVT_SEC_PARAMS_REQUEST,
+  BLE_GAP_EVT_PHY_UPDATE_REQUEST,
+  BLE_GAP_EVT_PHY_UPDATE,
+  BLE_GATTC_EVT_TIMEOUT = 0x30,
+  BLE_GATTS_EVT_WRITE = 0x50,
+  BLE_GATTS_EVT_SYS_ATTR_MISSING,
+  BLE_GATTS_EVT_TIMEOUT,
+  BLE_GATTS_EVT_HVN_TX_COMPLETE,
+  BLE_L2CAP_EVT_CH_SETUP_REQUEST = 0x70,
+  BLE_L2CAP_EVT_CH_SETUP,
+  BLE_L2CAP_EVT_CH_RELEASED,
+  BLE_L2CAP_EVT_CH_TX,
+};
+
+enum
+{
+  BLE_CONN_CFG_GATTS = 0x20,
+  BLE_CONN_CFG_L2CAP,
+};
+
+typedef struct
+{
+  uint8_t *p_data;
+  uint16_t len;
+} ble_data_t;
+
+typedef struct
+{
+  uint16_t uuid;
+  uint8_t type;
+} ble_uuid_t;
+
+typedef struct
+{
+  uint8_t uuid128[16];
+} ble_uuid128_t;
+
+// GAP
+// ------------------------------------------------------
+typedef struct
+{
+  uint16_t min_conn_interval; // 1.25 ms units
+  uint16_t max_conn_interval; // 1.25 ms units
+  uint16_t slave_latency;
+  uint16_t conn_sup_timeout;  // 10 ms units
+} ble_gap_conn_params_t;
+
+typedef struct
+{
+  uint8_t sm : 4;
+  uint8_t lv : 4;
+} ble_gap_conn_sec_mode_t;
+
+#define BLE_GAP_CONN_SEC_MODE_SET_OPEN(ptr) do { (ptr)->sm = 1; (ptr)->lv = 1; } while (0)
+
+typedef struct
+{
+  uint8_t tx_phys;
+  uint8_t rx_phys;
+} ble_gap_phys_t;
+
+typedef struct
+{
+  uint16_t conn_handle;
+  union
+  {
+    struct
+    {
+      ble_gap_conn_params_t conn_params;
+    } connected;
+    struct
+    {
+      uint8_t reason;
+    } disconnected;
+    struct
+    {
+      ble_gap_conn_params_t conn_params;
+    } conn_param_update;
+    ble_gap_phys_t phy_update_request;
+  } params;
+} ble_gap_evt_t;
+
+// GATT server
+// ------------------------------------------------------
+typedef struct
+{
+  uint16_t value_handle;
+  uint16_t user_desc_handle;
+  uint16_t cccd_handle;
+  uint16_t sccd_handle;
+} ble_gatts_char_handles_t;
+
+typedef struct
+{
+  uint16_t len;
+  uint16_t offset;
+  uint8_t *p_value;
+} ble_gatts_value_t;
+
+typedef struct
+{
+  uint16_t handle;
+  uint8_t type;
+  uint16_t offset;
+  uint16_t *p_len;
+  uint8_t const *p_data;
+} ble_gatts_hvx_params_t;
+
+typedef struct
+{
+  uint16_t handle;
+  uint16_t offset;
+  uint16_t len;
+  uint8_t data[1];  // The event buffer holds the rest of the data
+} ble_gatts_evt_write_t;
+
+typedef struct
+{
+  uint16_t conn_handle;
+  union
+  {
+    ble_gatts_evt_write_t write;
+    struct
+    {
+      uint8_t count;
+    } hvn_tx_complete;
+  } params;
+} ble_gatts_evt_t;
+
+typedef struct
+{
+  uint16_t conn_handle;
+} ble_gattc_evt_t;
+
+// L2CAP
+// ------------------------------------------------------
+typedef struct
+{
+  uint16_t tx_mtu;
+  uint16_t peer_mps;
+  uint16_t tx_mps;
+  uint16_t credits;
+} ble_l2cap_ch_tx_params_t;
+
+typedef struct
+{
+  uint16_t rx_mtu;
+  uint16_t rx_mps;
+  ble_data_t sdu_buf;
+} ble_l2cap_ch_rx_params_t;
+
+typedef struct
+{
+  ble_l2cap_ch_rx_params_t rx_params;
+  uint16_t le_psm;
+  uint16_t status;
+} ble_l2cap_ch_setup_params_t;
+
+typedef struct
+{
+  uint16_t conn_handle;
+  uint16_t local_cid;
+  union
+  {
+    struct
+    {
+      ble_l2cap_ch_tx_params_t tx_params;
+      uint16_t le_psm;
+    } ch_setup_request;
+    struct
+    {
+      ble_l2cap_ch_tx_params_t tx_params;
+    } ch_setup;
+    struct
+    {
+      ble_data_t sdu_buf;
+    } tx;
+  } params;
+} ble_l2cap_evt_t;
+
+// Events and configuration
+// ------------------------------------------------------
+typedef struct
+{
+  uint16_t evt_id;
+  uint16_t evt_len;
+} ble_evt_hdr_t;
+
+typedef struct
+{
+  ble_evt_hdr_t header;
+  union
+  {
+    ble_gap_evt_t gap_evt;
+    ble_gatts_evt_t gatts_evt;
+    ble_gattc_evt_t gattc_evt;
+    ble_l2cap_evt_t l2cap_evt;
+  } evt;
+} ble_evt_t;
+
+typedef struct
+{
+  struct
+  {
+    uint8_t conn_cfg_tag;
+    union
+    {
+      struct
+      {
+        uint8_t hvn_tx_queue_size;
+      } gatts_conn_cfg;
+      struct
+      {
+        uint16_t rx_mps;
+        uint16_t tx_mps;
+        uint8_t rx_queue_size;
+        uint8_t tx_queue_size;
+        uint8_t ch_count;
+      } l2cap_conn_cfg;
+    } params;
+  } conn_cfg;
+} ble_cfg_t;
+
+ret_code_t sd_ble_cfg_set(uint32_t cfg_id, ble_cfg_t const *p_cfg, uint32_t app_ram_base);
+ret_code_t sd_ble_uuid_vs_add(ble_uuid128_t const *p_vs_uuid, uint8_t *p_uuid_type);
+ret_code_t sd_power_system_off(void);
+
+ret_code_t sd_ble_gap_device_name_set(ble_gap_conn_sec_mode_t const *p_write_perm, uint8_t const *p_dev_name,
+                                      uint16_t len);
+ret_code_t sd_ble_gap_ppcp_set(ble_gap_conn_params_t const *p_conn_params);
+ret_code_t sd_ble_gap_conn_param_update(uint16_t conn_handle, ble_gap_conn_params_t const *p_conn_params);
+ret_code_t sd_ble_gap_phy_update(uint16_t conn_handle, ble_gap_phys_t const *p_gap_phys);
+ret_code_t sd_ble_gap_disconnect(uint16_t conn_handle, uint8_t hci_status_code);
+ret_code_t sd_ble_gap_sec_params_reply(uint16_t conn_handle, uint8_t sec_status, void const *p_sec_params,
+                                       void const *p_sec_keyset);
+
+ret_code_t sd_ble_gatts_service_add(uint8_t type, ble_uuid_t const *p_uuid, uint16_t *p_handle);
+ret_code_t sd_ble_gatts_hvx(uint16_t conn_handle, ble_gatts_hvx_params_t const *p_hvx_params);
+ret_code_t sd_ble_gatts_value_set(uint16_t conn_handle, uint16_t handle, ble_gatts_value_t *p_value);
+ret_code_t sd_ble_gatts_sys_attr_set(uint16_t conn_handle, uint8_t const *p_sys_attr_data, uint16_t len,
+                                     uint32_t flags);
+
+ret_code_t sd_ble_l2cap_ch_setup(uint16_t conn_handle, uint16_t *p_local_cid,
+                                 ble_l2cap_ch_setup_params_t const *p_params);
+ret_code_t sd_ble_l2cap_ch_tx(uint16_t conn_handle, uint16_t local_cid, ble_data_t const *p_sdu_buf);
+
+#endif // BLE_H__
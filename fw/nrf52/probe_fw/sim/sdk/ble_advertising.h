@@ -0,0 +1,51 @@
+#ifndef BLE_ADVERTISING_H__
+#define BLE_ADVERTISING_H__
+
+#include "ble_advdata.h"
+
+typedef enum
+{
+  BLE_ADV_MODE_IDLE,
+  BLE_ADV_MODE_FAST,
+} ble_adv_mode_t;
+
+typedef enum
+{
+  BLE_ADV_EVT_IDLE,
+  BLE_ADV_EVT_FAST,
+} ble_adv_evt_t;
+
+typedef void (*ble_adv_evt_handler_t)(ble_adv_evt_t adv_evt);
+typedef void (*ble_adv_error_handler_t)(uint32_t nrf_error);
+
+typedef struct
+{
+  bool ble_adv_fast_enabled;
+  uint32_t ble_adv_fast_interval;
+  uint32_t ble_adv_fast_timeout;
+} ble_adv_modes_config_t;
+
+typedef struct
+{
+  ble_advdata_t advdata;
+  ble_advdata_t srdata;
+  ble_adv_modes_config_t config;
+  ble_adv_evt_handler_t evt_handler;
+  ble_adv_error_handler_t error_handler;
+} ble_advertising_init_t;
+
+typedef struct
+{
+  ble_adv_evt_handler_t evt_handler;
+  uint8_t conn_cfg_tag;
+  bool advertising;
+} ble_advertising_t;
+
+#define BLE_ADVERTISING_DEF(_name) static ble_advertising_t _name
+
+// The host model connects once advertising started
+ret_code_t ble_advertising_init(ble_advertising_t *p_advertising, ble_advertising_init_t const *p_init);
+void ble_advertising_conn_cfg_tag_set(ble_advertising_t *p_advertising, uint8_t ble_cfg_tag);
+ret_code_t ble_advertising_start(ble_advertising_t *p_advertising, ble_adv_mode_t advertising_mode);
+
+#endif // BLE_ADVERTISING_H__
@@ -0,0 +1,43 @@
+#ifndef BLE_SRV_COMMON_H__
+#define BLE_SRV_COMMON_H__
+
+#include "ble.h"
+
+#define OPCODE_LENGTH 1
+#define HANDLE_LENGTH 2
+
+typedef enum
+{
+  SEC_NO_ACCESS,
+  SEC_OPEN,
+} security_req_t;
+
+typedef struct
+{
+  uint8_t broadcast : 1;
+  uint8_t read : 1;
+  uint8_t write_wo_resp : 1;
+  uint8_t write : 1;
+  uint8_t notify : 1;
+  uint8_t indicate : 1;
+  uint8_t auth_signed_wr : 1;
+} ble_gatt_char_props_t;
+
+typedef struct
+{
+  uint16_t uuid;
+  uint8_t uuid_type;
+  uint16_t max_len;
+  uint16_t init_len;
+  uint8_t *p_init_value;
+  bool is_var_len;
+  ble_gatt_char_props_t char_props;
+  security_req_t read_access;
+  security_req_t write_access;
+  security_req_t cccd_write_access;
+} ble_add_char_params_t;
+
+ret_code_t characteristic_add(uint16_t service_handle, ble_add_char_params_t *p_char_props,
+                              ble_gatts_char_handles_t *p_char_handle);
+
+#endif // BLE_SRV_COMMON_H__
@@ -0,0 +1,35 @@
+#ifndef NRF_H__
+#define NRF_H__
+
+// Host build: the Cortex-M4 intrinsics used by the WULPUS modules, computed in C
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+// Interrupts of the simulation only run while the main loop sleeps (nrf_pwr_mgmt_run())
+#define __DMB() __asm__ volatile ("" ::: "memory")
+
+static inline uint32_t __UNALIGNED_UINT32_READ(void const *addr)
+{
+  uint32_t value;
+  memcpy(&value, addr, sizeof(value));
+  return value;
+}
+
+// Both halfwords subtracted, wrapping around (no saturation)
+static inline uint32_t __SSUB16(uint32_t a, uint32_t b)
+{
+  uint16_t lo = (uint16_t)((uint16_t)a - (uint16_t)b);
+  uint16_t hi = (uint16_t)((uint16_t)(a >> 16) - (uint16_t)(b >> 16));
+
+  return ((uint32_t)hi << 16) | lo;
+}
+
+// Top halfword of a, bottom halfword of b shifted right arithmetically
+static inline uint32_t __PKHTB(uint32_t a, uint32_t b, uint32_t shift)
+{
+  return (a & 0xFFFF0000UL) | ((uint32_t)((int32_t)b >> shift) & 0x0000FFFFUL);
+}
+
+#endif // NRF_H__
@@ -0,0 +1,39 @@
+#ifndef NRF_BLE_GATT_H__
+#define NRF_BLE_GATT_H__
+
+#include "ble.h"
+
+typedef enum
+{
+  NRF_BLE_GATT_EVT_ATT_MTU_UPDATED,
+  NRF_BLE_GATT_EVT_DATA_LENGTH_UPDATED,
+} nrf_ble_gatt_evt_id_t;
+
+typedef struct
+{
+  nrf_ble_gatt_evt_id_t evt_id;
+  uint16_t conn_handle;
+  union
+  {
+    uint16_t att_mtu_effective;
+    uint8_t data_length;
+  } params;
+} nrf_ble_gatt_evt_t;
+
+typedef struct nrf_ble_gatt_s nrf_ble_gatt_t;
+typedef void (*nrf_ble_gatt_evt_handler_t)(nrf_ble_gatt_t *p_gatt, nrf_ble_gatt_evt_t const *p_evt);
+
+struct nrf_ble_gatt_s
+{
+  uint16_t att_mtu_desired_periph;
+  uint16_t att_mtu_desired_central;
+  nrf_ble_gatt_evt_handler_t evt_handler;
+};
+
+#define NRF_BLE_GATT_DEF(_name) static nrf_ble_gatt_t _name
+
+// The link model exchanges the ATT MTU after the connection was established
+ret_code_t nrf_ble_gatt_init(nrf_ble_gatt_t *p_gatt, nrf_ble_gatt_evt_handler_t evt_handler);
+ret_code_t nrf_ble_gatt_att_mtu_periph_set(nrf_ble_gatt_t *p_gatt, uint16_t desired_mtu);
+
+#endif // NRF_BLE_GATT_H__
@@ -0,0 +1,14 @@
+#ifndef NRF_DRV_SPI_H__
+#define NRF_DRV_SPI_H__
+
+#include <stdint.h>
+
+#include "sdk_errors.h"
+
+// The SPI master is modelled at the level of wulpus_spi (sim_hw.c)
+typedef struct
+{
+  uint8_t inst_idx;
+} nrf_drv_spi_t;
+
+#endif // NRF_DRV_SPI_H__
@@ -0,0 +1,25 @@
+#ifndef NRF_LOG_H__
+#define NRF_LOG_H__
+
+#include "nordic_common.h"
+#include "nrf.h"
+
+// Printed to stderr up to the level selected on the command line (sim_sd.c)
+
+#ifndef NRF_LOG_MODULE_NAME
+#define NRF_LOG_MODULE_NAME app
+#endif
+
+void sim_log(int level, char const *module, char const *format, ...);
+
+#define NRF_LOG_ERROR(...)   sim_log(1, STRINGIFY(NRF_LOG_MODULE_NAME), __VA_ARGS__)
+#define NRF_LOG_WARNING(...) sim_log(2, STRINGIFY(NRF_LOG_MODULE_NAME), __VA_ARGS__)
+#define NRF_LOG_INFO(...)    sim_log(3, STRINGIFY(NRF_LOG_MODULE_NAME), __VA_ARGS__)
+#define NRF_LOG_DEBUG(...)   sim_log(4, STRINGIFY(NRF_LOG_MODULE_NAME), __VA_ARGS__)
+
+#define NRF_LOG_HEXDUMP_INFO(p_data, len)  ((void)(p_data), (void)(len))
+#define NRF_LOG_HEXDUMP_DEBUG(p_data, len) ((void)(p_data), (void)(len))
+
+#define NRF_LOG_MODULE_REGISTER() extern int sim_log_level
+
+#endif // NRF_LOG_H__
@@ -0,0 +1,13 @@
+#ifndef NRF_LOG_CTRL_H__
+#define NRF_LOG_CTRL_H__
+
+#include <stdbool.h>
+
+#include "sdk_errors.h"
+
+// Messages are printed right away, nothing is deferred
+#define NRF_LOG_INIT(timestamp_func) ((void)(timestamp_func), NRF_SUCCESS)
+#define NRF_LOG_PROCESS()            false
+#define NRF_LOG_FLUSH()              ((void)0)
+
+#endif // NRF_LOG_CTRL_H__
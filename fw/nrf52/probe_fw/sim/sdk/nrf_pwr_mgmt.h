@@ -0,0 +1,12 @@
+#ifndef NRF_PWR_MGMT_H__
+#define NRF_PWR_MGMT_H__
+
+#include "sdk_errors.h"
+
+ret_code_t nrf_pwr_mgmt_init(void);
+
+// Sleeps until the next simulated event and runs its handlers (sim_main.c),
+// ends the process once the simulated time is over
+void nrf_pwr_mgmt_run(void);
+
+#endif // NRF_PWR_MGMT_H__
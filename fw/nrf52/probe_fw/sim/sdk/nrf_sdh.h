@@ -0,0 +1,8 @@
+#ifndef NRF_SDH_H__
+#define NRF_SDH_H__
+
+#include "sdk_errors.h"
+
+ret_code_t nrf_sdh_enable_request(void);
+
+#endif // NRF_SDH_H__
@@ -0,0 +1,26 @@
+#ifndef NRF_SDH_BLE_H__
+#define NRF_SDH_BLE_H__
+
+#include "ble.h"
+#include "nrf_sdh.h"
+#include "sdk_config.h"
+
+typedef void (*nrf_sdh_ble_evt_handler_t)(ble_evt_t const *p_ble_evt, void *p_context);
+
+typedef struct
+{
+  nrf_sdh_ble_evt_handler_t handler;
+  void *p_context;
+} nrf_sdh_ble_evt_observer_t;
+
+// Like the SDK, the observers are collected in a section (at file or function scope),
+// the link model passes every event to all of them (the priority is not used)
+#define NRF_SDH_BLE_OBSERVER(_name, _prio, _handler, _context) \
+  static nrf_sdh_ble_evt_observer_t const _name \
+    __attribute__((section("sim_sdh_ble_observers"), used, aligned(sizeof(void *)))) = \
+    { .handler = (_handler), .p_context = (_context) }
+
+ret_code_t nrf_sdh_ble_default_cfg_set(uint8_t conn_cfg_tag, uint32_t *p_ram_start);
+ret_code_t nrf_sdh_ble_enable(uint32_t *p_app_ram_start);
+
+#endif // NRF_SDH_BLE_H__
@@ -0,0 +1,6 @@
+#ifndef NRF_SDH_SOC_H__
+#define NRF_SDH_SOC_H__
+
+#include "nrf_sdh.h"
+
+#endif // NRF_SDH_SOC_H__
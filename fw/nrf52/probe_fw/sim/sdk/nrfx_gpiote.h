@@ -0,0 +1,7 @@
+#ifndef NRFX_GPIOTE_H__
+#define NRFX_GPIOTE_H__
+
+// The GPIOs are modelled at the level of wulpus_gpio (sim_hw.c)
+#include "nrf.h"
+
+#endif // NRFX_GPIOTE_H__
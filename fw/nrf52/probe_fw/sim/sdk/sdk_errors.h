@@ -0,0 +1,27 @@
+#ifndef SDK_ERRORS_H__
+#define SDK_ERRORS_H__
+
+#include <stdint.h>
+
+typedef uint32_t ret_code_t;
+
+// Values of nrf_error.h and ble_err.h
+#define NRF_SUCCESS                      0
+#define NRF_ERROR_INTERNAL               3
+#define NRF_ERROR_NO_MEM                 4
+#define NRF_ERROR_NOT_FOUND              5
+#define NRF_ERROR_NOT_SUPPORTED          6
+#define NRF_ERROR_INVALID_PARAM          7
+#define NRF_ERROR_INVALID_STATE          8
+#define NRF_ERROR_INVALID_LENGTH         9
+#define NRF_ERROR_DATA_SIZE              12
+#define NRF_ERROR_TIMEOUT                13
+#define NRF_ERROR_NULL                   14
+#define NRF_ERROR_BUSY                   17
+#define NRF_ERROR_CONN_COUNT             18
+#define NRF_ERROR_RESOURCES              19
+
+#define BLE_ERROR_INVALID_CONN_HANDLE    0x3002
+#define BLE_ERROR_GATTS_SYS_ATTR_MISSING 0x3401
+
+#endif // SDK_ERRORS_H__
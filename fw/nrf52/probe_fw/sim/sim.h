@@ -0,0 +1,163 @@
+#ifndef __WULPUS_SIM__
+#define __WULPUS_SIM__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "wulpus_buffer.h"
+
+// Host build of the probe firmware: main.c and the wulpus modules run unchanged against
+// models of the SoftDevice (sim_sd.c), of the MSP430 and the SPI/PPI drivers (sim_hw.c)
+// and of the host PC (sim_host.c). The interrupts of the models run while the main loop sleeps
+// in nrf_pwr_mgmt_run(), which advances the simulated time to the next event (sim_main.c)
+
+#define SIM_NS_PER_US 1000ULL
+#define SIM_NS_PER_MS 1000000ULL
+#define SIM_NS_PER_S  1000000000ULL
+#define SIM_NEVER     UINT64_MAX
+
+// Characteristics of the WULPUS service (wulpus_ble.c)
+#define SIM_DATA_CHAR_UUID      0x0002
+#define SIM_CONTROL_CHAR_UUID   0x0003
+#define SIM_TELEMETRY_CHAR_UUID 0x0004
+
+typedef enum
+{
+  SIM_FEATURE_OFF       = 0,
+  SIM_FEATURE_ALONGSIDE = 1,
+  SIM_FEATURE_ONLY      = 2,
+} sim_feature_mode_t;
+
+// Command line parameters (sim_main.c)
+typedef struct
+{
+  uint32_t duration_ms;
+  uint32_t seed;
+  int log_level;
+  bool csv;
+  bool check;                  // Exit with an error if the stream was not received intact
+  bool allow_drops;            // Frames may be lost in FRAM, on SPI or in the nRF52 (overflow policies)
+
+  // MSP430 (or the benchmark generator of the nRF52 if bench_len is set)
+  uint32_t period_us;
+  uint8_t configs;
+  uint16_t noise;
+  uint16_t bench_len;
+  uint32_t isr_latency_us;     // End of the last transfer of a frame until the end handlers of the nRF52 run
+
+  // Link, as the central sets it up
+  double interval_ms;          // Connection interval chosen when connecting
+  double central_min_ms;       // Shortest interval the central accepts in an update
+  uint8_t phy;                 // Fastest PHY of the central (Mbit/s)
+  uint16_t att_mtu;
+  uint8_t data_len;            // Link layer payload
+  uint16_t per_event;          // Packets the central takes per connection event (0: until the interval ends)
+  uint16_t hvn_queue;          // Overrides the SoftDevice queue of the firmware (0: WULPUS_BLE_HVN_TX_QUEUE_SIZE)
+  double loss;                 // Probability that a packet is received with a CRC error
+  uint32_t fade_start_ms;      // No connection event in the fade (0 length: none)
+  uint32_t fade_len_ms;
+  bool l2cap;                  // The host opens the L2CAP channel like the dongle
+
+  // nRF52 settings packet
+  bool delta;
+  uint8_t delta_shift;
+  uint16_t delta_threshold;
+  uint16_t keyframe;
+  wp_buffer_policy_t policy;
+  uint8_t decimation;
+  bool compress;
+  sim_feature_mode_t features;
+  uint8_t peaks;
+} sim_params_t;
+
+// Mean and maximum of a level, sampled at every connection event
+typedef struct
+{
+  uint64_t sum;
+  uint64_t samples;
+  uint32_t max;
+} sim_level_t;
+
+typedef struct
+{
+  // MSP430
+  uint32_t acquired;
+  uint32_t fram_overwritten;  // Kept in FRAM while the ready line was low and overwritten
+  uint32_t spi_missed;        // Data ready without an armed reception
+  uint32_t spi_frames;
+  uint32_t spi_overwrites;    // Transfers into a pending frame, a frame in flight or outside the RX buffer
+
+  // Link
+  uint32_t conn_events;
+  uint32_t ll_packets;
+  uint32_t ll_crc_errors;
+  uint32_t notifications;
+  uint32_t sdus;
+  uint64_t air_bytes;
+  uint32_t conn_updates;
+  double interval_ms;
+  bool disconnected;
+
+  sim_level_t frame_buffer;
+  sim_level_t ble_tx_queue;
+  sim_level_t hvn_queue;
+  sim_level_t l2cap_queue;
+  sim_level_t packets_per_event;
+
+  // Host
+  uint64_t start_ns;          // First configuration written, the rates are counted from here
+  uint32_t frames;            // Distinct frame numbers received (frames or feature records)
+  uint32_t frames_missing;    // Gaps in the frame numbers
+  uint32_t us_full;
+  uint32_t us_delta;
+  uint32_t us_unchanged;
+  uint32_t us_compressed;
+  uint32_t bench;
+  uint32_t features;
+  uint32_t lost;
+  uint32_t stream_errors;     // Notifications out of sequence or records which could not be parsed
+  uint32_t payload_checked;   // US frames decoded and compared with the acquired frame
+  uint32_t payload_mismatches;
+  uint64_t payload_bytes;
+  uint64_t latency_sum_ns;
+  uint64_t latency_max_ns;
+  uint32_t latency_count;
+  uint8_t telemetry[WP_BUFFER_STATS_LEN];
+  bool telemetry_valid;
+} sim_stats_t;
+
+extern sim_params_t sim_params;
+extern sim_stats_t sim_stats;
+
+uint64_t sim_now(void);
+void sim_level_add(sim_level_t *level, uint32_t value);
+// Levels of the firmware, sampled by the link model at every connection event
+void sim_sample_levels(void);
+
+// SoftDevice and link (sim_sd.c)
+uint64_t sim_sd_next_event(void);
+void sim_sd_run(void);
+bool sim_sd_is_advertising(void);
+void sim_sd_connect(void);
+// Written to the control characteristic in the next connection event
+void sim_sd_write(uint8_t const *data, uint16_t length);
+void sim_sd_l2cap_request(void);
+size_t sim_sd_hvn_queued(void);
+size_t sim_sd_l2cap_queued(void);
+
+// MSP430, SPI and PPI (sim_hw.c)
+uint64_t sim_hw_next_event(void);
+void sim_hw_run(void);
+// Time the US frame was acquired by the MSP430
+uint64_t sim_hw_frame_time(uint16_t frame_number);
+// US frame as acquired by the MSP430, kept for the last SIM_FRAME_HISTORY frames
+uint8_t const *sim_hw_frame(uint16_t frame_number);
+
+// Host PC (sim_host.c)
+uint64_t sim_host_next_event(void);
+void sim_host_run(void);
+void sim_host_notification(uint16_t char_uuid, uint8_t const *data, uint16_t length);
+void sim_host_sdu(uint8_t const *data, uint16_t length);
+
+#endif // __WULPUS_SIM__
@@ -0,0 +1,495 @@
+#include "sim.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "app_timer.h"
+#include "app_util.h"
+
+#include "wulpus_bench.h"
+#include "wulpus_compress.h"
+#include "wulpus_delta.h"
+#include "wulpus_feature.h"
+#include "wulpus_retx.h"
+#include "wulpus_stream.h"
+#include "wulpus_config.h"
+
+#define NRF_LOG_MODULE_NAME sim_host
+#include "nrf_log.h"
+NRF_LOG_MODULE_REGISTER();
+
+// Host PC behind the dongle (wulpus/connection of the Python package): connects once the probe
+// advertises, opens the L2CAP channel (if requested), writes the nRF52 settings and the configuration,
+// then reassembles the stream and counts the records it receives. The US frames are decoded
+// and compared with the frames the MSP430 acquired
+
+#define SIM_CONNECT_NS      (50 * SIM_NS_PER_MS)   // Advertising started until the connection
+#define SIM_L2CAP_NS        (100 * SIM_NS_PER_MS)  // Connected until the channel is requested
+#define SIM_SETTINGS_NS     (200 * SIM_NS_PER_MS)  // Connected until the settings are written
+#define SIM_CONFIG_NS       (250 * SIM_NS_PER_MS)  // Connected until the configuration is written
+#define SIM_US_CONFIG_LEN   WULPUS_BYTES_PER_PACKET  // Package length of the host
+#define SIM_US_CONFIG_START 0xFA  // START_BYTE_CONF_PACK
+#define SIM_NUM_TAPS        16
+#define SIM_BAND_LOW        0.15  // Bandpass of the feature extraction in cycles per sample
+#define SIM_BAND_HIGH       0.35
+#define SIM_MAX_RECORD_LEN  (WULPUS_FRAME_HEADER_LEN + 2 * WULPUS_FRAME_NUM_SAMPLES)
+#define SIM_FRAME_IDX_FLAGS 7
+#define SIM_DELTA_SHIFT_MAX 0x07
+#define SIM_TICKS_PER_S     (APP_TIMER_CLOCK_FREQ / (APP_TIMER_CONFIG_RTC_FREQUENCY + 1))
+
+typedef enum
+{
+  SIM_HOST_CONNECT,
+  SIM_HOST_L2CAP,
+  SIM_HOST_SETTINGS,
+  SIM_HOST_CONFIG,
+  SIM_HOST_STREAMING,
+} _sim_host_step_t;
+
+_sim_host_step_t _sim_host_step = SIM_HOST_CONNECT;
+uint64_t _sim_host_next = SIM_CONNECT_NS;
+uint64_t _sim_host_connected = 0;
+
+// Reassembly of the notifications
+bool _sim_host_synced = false;
+uint8_t _sim_host_seq = 0;
+uint8_t _sim_host_record[SIM_MAX_RECORD_LEN];
+uint16_t _sim_host_record_fill = 0;
+
+// Frame numbers seen, a feature record and its frame (WP_FEATURE_ALONGSIDE) count once
+bool _sim_host_numbered = false;
+uint16_t _sim_host_last_number = 0;
+
+// Reference frame per TX/RX config of the delta encoding, the last keyframe plus the residuals since
+int16_t _sim_host_ref[WULPUS_DELTA_MAX_CONFIGS][WULPUS_FRAME_NUM_SAMPLES];
+bool _sim_host_ref_valid[WULPUS_DELTA_MAX_CONFIGS];
+
+// Bit stream of a compressed frame, MSB first
+typedef struct
+{
+  uint8_t const *src;
+  uint8_t const *end;
+  uint32_t acc;
+  uint32_t acc_len;
+  bool overrun;
+} _sim_host_reader_t;
+
+
+static void _sim_host_settings(void)
+{
+  uint8_t packet[WP_FEATURE_CONF_PACKET_LEN + 2 * SIM_NUM_TAPS];
+
+  packet[0] = WULPUS_DELTA_CONF_PACKET;
+  packet[1] = sim_params.delta;
+  packet[2] = sim_params.delta_shift;
+  uint16_encode(sim_params.delta_threshold, &packet[3]);
+  uint16_encode(sim_params.keyframe, &packet[5]);
+  packet[7] = (uint8_t)sim_params.policy;
+  packet[8] = sim_params.decimation;
+  packet[9] = sim_params.compress ? WP_COMPRESS_LOSSLESS : WP_COMPRESS_OFF;
+  packet[10] = (uint8_t)sim_params.features;
+  packet[11] = 4;   // Envelope decimation
+  uint16_encode(0, &packet[12]);
+  packet[14] = sim_params.peaks;
+  packet[15] = SIM_NUM_TAPS;
+
+  // Windowed sinc bandpass around the echo (Hamming)
+  for (int i = 0; i < SIM_NUM_TAPS; i++)
+  {
+    double t = i - 0.5 * (SIM_NUM_TAPS - 1);
+    double h = 2.0 * (SIM_BAND_HIGH * sin(2.0 * M_PI * SIM_BAND_HIGH * t) / (2.0 * M_PI * SIM_BAND_HIGH * t) -
+                      SIM_BAND_LOW * sin(2.0 * M_PI * SIM_BAND_LOW * t) / (2.0 * M_PI * SIM_BAND_LOW * t));
+    h *= 0.54 - 0.46 * cos(2.0 * M_PI * i / (SIM_NUM_TAPS - 1));
+
+    uint16_encode((uint16_t)(int16_t)lround(h * 32767.0), &packet[WP_FEATURE_CONF_PACKET_LEN + 2 * i]);
+  }
+
+  sim_sd_write(packet, sizeof(packet));
+}
+
+static void _sim_host_config(void)
+{
+  if (sim_params.bench_len != 0)
+  {
+    uint8_t packet[WP_BENCH_CONF_PACKET_LEN];
+
+    packet[0] = WULPUS_BENCH_CONF_PACKET;
+    packet[1] = 1;
+    uint32_encode(sim_params.period_us, &packet[2]);
+    uint16_encode(sim_params.bench_len, &packet[6]);
+    uint32_encode(0, &packet[8]);
+
+    sim_sd_write(packet, sizeof(packet));
+  }
+  else
+  {
+    uint8_t packet[SIM_US_CONFIG_LEN] = { SIM_US_CONFIG_START };
+
+    sim_sd_write(packet, sizeof(packet));
+  }
+
+  sim_stats.start_ns = sim_now();
+}
+
+uint64_t sim_host_next_event(void)
+{
+  return _sim_host_next;
+}
+
+void sim_host_run(void)
+{
+  if (sim_now() < _sim_host_next) return;
+
+  switch (_sim_host_step)
+  {
+    case SIM_HOST_CONNECT:
+      if (!sim_sd_is_advertising())
+      {
+        _sim_host_next = sim_now() + SIM_CONNECT_NS;
+        return;
+      }
+      sim_sd_connect();
+      _sim_host_connected = sim_now();
+      _sim_host_step = sim_params.l2cap ? SIM_HOST_L2CAP : SIM_HOST_SETTINGS;
+      _sim_host_next = _sim_host_connected + (sim_params.l2cap ? SIM_L2CAP_NS : SIM_SETTINGS_NS);
+      break;
+
+    case SIM_HOST_L2CAP:
+      sim_sd_l2cap_request();
+      _sim_host_step = SIM_HOST_SETTINGS;
+      _sim_host_next = _sim_host_connected + SIM_SETTINGS_NS;
+      break;
+
+    case SIM_HOST_SETTINGS:
+      _sim_host_settings();
+      _sim_host_step = SIM_HOST_CONFIG;
+      _sim_host_next = _sim_host_connected + SIM_CONFIG_NS;
+      break;
+
+    case SIM_HOST_CONFIG:
+      _sim_host_config();
+      _sim_host_step = SIM_HOST_STREAMING;
+      _sim_host_next = SIM_NEVER;
+      break;
+
+    default:
+      _sim_host_next = SIM_NEVER;
+      break;
+  }
+}
+
+static uint32_t _sim_host_get(_sim_host_reader_t *r, uint32_t len)
+{
+  while (r->acc_len < len)
+  {
+    r->overrun |= (r->src == r->end);
+    r->acc = (r->acc << 8) | ((r->src < r->end) ? *r->src++ : 0);
+    r->acc_len += 8;
+  }
+
+  r->acc_len -= len;
+  return (r->acc >> r->acc_len) & ((1UL << len) - 1);
+}
+
+// Decoder of wulpus_compress.h, false if the bit stream does not hold the samples of a frame
+static bool _sim_host_decompress(uint8_t const *record, uint16_t length, int16_t *samples)
+{
+  uint16_t stream_len = uint16_decode(&record[WULPUS_FRAME_HEADER_LEN]);
+  if (WULPUS_FRAME_HEADER_LEN + WP_COMPRESS_HEADER_LEN + stream_len != length) return false;
+
+  _sim_host_reader_t r =
+  {
+    .src = &record[WULPUS_FRAME_HEADER_LEN + WP_COMPRESS_HEADER_LEN],
+    .end = &record[length],
+  };
+  uint16_t x_last = 0;
+  uint16_t d_last = 0;
+  uint8_t order = 0;
+  uint8_t k = 0;
+
+  for (size_t i = 0; i < WULPUS_FRAME_NUM_SAMPLES; i++)
+  {
+    if ((i % WP_COMPRESS_BLOCK_LEN) == 0)
+    {
+      order = (uint8_t)_sim_host_get(&r, 2);
+      k = (uint8_t)_sim_host_get(&r, 4);
+      if (order > 2) return false;
+    }
+
+    uint32_t q = 0;
+    while ((q < WP_COMPRESS_ESCAPE) && _sim_host_get(&r, 1)) q++;
+
+    uint16_t u = (q < WP_COMPRESS_ESCAPE) ? (uint16_t)((q << k) | _sim_host_get(&r, k)) : (uint16_t)_sim_host_get(&r, 16);
+    uint16_t v = (uint16_t)((u >> 1) ^ (uint16_t)-(u & 1));
+    uint16_t x = (order == 0) ? v : (order == 1) ? (uint16_t)(x_last + v) : (uint16_t)(x_last + d_last + v);
+
+    d_last = (uint16_t)(x - x_last);
+    x_last = x;
+    samples[i] = (int16_t)x;
+  }
+
+  return !r.overrun;
+}
+
+// Reconstructs the samples of a US frame like the host and compares them with the acquired frame,
+// within the error the quantisation shift and the unchanged threshold allow
+static void _sim_host_verify(uint8_t const *record, uint16_t length)
+{
+  uint8_t flags = record[SIM_FRAME_IDX_FLAGS] & WP_COMPRESS_FLAGS;
+  uint8_t tx_rx_id = record[WULPUS_FRAME_IDX_TX_RX_ID] & WULPUS_FRAME_TX_RX_ID_MASK;
+  uint16_t number = wp_retx_frame_number(record);
+  uint8_t const *acquired = sim_hw_frame(number);
+  bool has_ref = (tx_rx_id < WULPUS_DELTA_MAX_CONFIGS);
+  int16_t samples[WULPUS_FRAME_NUM_SAMPLES];
+  int32_t tolerance = 0;
+  bool valid;
+
+  if (flags == WP_COMPRESS_FLAGS)
+  {
+    valid = _sim_host_decompress(record, length, samples);
+  }
+  else if (flags == 0)
+  {
+    valid = (length == SIM_MAX_RECORD_LEN);
+    for (size_t i = 0; valid && (i < WULPUS_FRAME_NUM_SAMPLES); i++)
+    {
+      samples[i] = (int16_t)uint16_decode(&record[WULPUS_FRAME_HEADER_LEN + 2 * i]);
+    }
+  }
+  else if (flags == WP_DELTA_FLAG_UNCHANGED)
+  {
+    valid = has_ref && _sim_host_ref_valid[tx_rx_id] && (length == WULPUS_FRAME_HEADER_LEN);
+    if (valid) memcpy(samples, _sim_host_ref[tx_rx_id], sizeof(samples));
+    tolerance = sim_params.delta_threshold;
+  }
+  else
+  {
+    uint8_t shift = (record[SIM_FRAME_IDX_FLAGS] >> WP_DELTA_FLAG_SHIFT_POS) & SIM_DELTA_SHIFT_MAX;
+
+    valid = has_ref && _sim_host_ref_valid[tx_rx_id] &&
+            (length == WULPUS_FRAME_HEADER_LEN + WULPUS_FRAME_NUM_SAMPLES);
+    for (size_t i = 0; valid && (i < WULPUS_FRAME_NUM_SAMPLES); i++)
+    {
+      int32_t recon = _sim_host_ref[tx_rx_id][i] + (int8_t)record[WULPUS_FRAME_HEADER_LEN + i] * (1 << shift);
+      samples[i] = (int16_t)MIN(MAX(recon, INT16_MIN), INT16_MAX);
+    }
+    tolerance = (shift > 0) ? (1 << (shift - 1)) : 0;
+  }
+
+  // Every full frame is a keyframe while the delta encoding is on
+  if (valid && sim_params.delta && has_ref)
+  {
+    memcpy(_sim_host_ref[tx_rx_id], samples, sizeof(samples));
+    _sim_host_ref_valid[tx_rx_id] = true;
+  }
+
+  // The nRF52 sets the flags, the rest of the header is passed on
+  valid = valid && (memcmp(record, acquired, SIM_FRAME_IDX_FLAGS) == 0) &&
+          (memcmp(&record[SIM_FRAME_IDX_FLAGS + 1], &acquired[SIM_FRAME_IDX_FLAGS + 1],
+                  WULPUS_FRAME_HEADER_LEN - SIM_FRAME_IDX_FLAGS - 1) == 0);
+
+  for (size_t i = 0; valid && (i < WULPUS_FRAME_NUM_SAMPLES); i++)
+  {
+    int32_t expected = (int16_t)uint16_decode(&acquired[WULPUS_FRAME_HEADER_LEN + 2 * i]);
+    valid = (abs(samples[i] - expected) <= tolerance);
+  }
+
+  sim_stats.payload_checked++;
+  if (!valid)
+  {
+    NRF_LOG_WARNING("Frame %u (flags 0x%02X, %u bytes) differs from the acquired frame", number, flags, length);
+    sim_stats.payload_mismatches++;
+  }
+}
+
+static void _sim_host_latency(uint64_t latency_ns)
+{
+  sim_stats.latency_sum_ns += latency_ns;
+  sim_stats.latency_max_ns = MAX(sim_stats.latency_max_ns, latency_ns);
+  sim_stats.latency_count++;
+}
+
+// Counts the frames missing since the last one, an older frame number is out of order
+static void _sim_host_sequence(uint16_t number)
+{
+  uint16_t gap = (uint16_t)(number - _sim_host_last_number - 1);
+
+  if (_sim_host_numbered && (gap >= INT16_MAX))
+  {
+    NRF_LOG_WARNING("Frame %u after %u", number, _sim_host_last_number);
+    sim_stats.stream_errors++;
+  }
+  else if (_sim_host_numbered)
+  {
+    sim_stats.frames_missing += gap;
+  }
+
+  _sim_host_numbered = true;
+  _sim_host_last_number = number;
+}
+
+static void _sim_host_frame_number(uint16_t number)
+{
+  if (_sim_host_numbered && (number == _sim_host_last_number)) return;
+
+  _sim_host_sequence(number);
+
+  sim_stats.frames++;
+  _sim_host_latency(sim_now() - sim_hw_frame_time(number));
+}
+
+// Length of the record from its header, 0 while more bytes are needed
+static uint16_t _sim_host_record_length(uint8_t const *record, uint16_t fill)
+{
+  switch (record[0])
+  {
+    case 0xFF:
+      if (fill < WULPUS_FRAME_HEADER_LEN) return 0;
+      if (((record[7] & WP_COMPRESS_FLAGS) == WP_COMPRESS_FLAGS) &&
+          (fill < WULPUS_FRAME_HEADER_LEN + WP_COMPRESS_HEADER_LEN))
+      {
+        return 0;
+      }
+      return wp_retx_frame_length(record);
+
+    case WULPUS_BENCH_START_OF_FRAME:
+      return (fill < WP_BENCH_HEADER_LEN) ? 0 : wp_bench_frame_length(record);
+
+    case WULPUS_FEATURE_START_OF_FRAME:
+      return (fill < WP_FEATURE_HEADER_LEN) ? 0 : WP_FEATURE_HEADER_LEN + WP_FEATURE_PEAK_LEN * record[12];
+
+    case WULPUS_LOST_START_OF_FRAME:
+      return WP_RETX_LOST_LEN;
+
+    default:
+      return UINT16_MAX;
+  }
+}
+
+static void _sim_host_record_done(uint8_t const *record, uint16_t length)
+{
+  sim_stats.payload_bytes += length;
+
+  switch (record[0])
+  {
+    case 0xFF:
+    {
+      uint8_t flags = record[7] & WP_COMPRESS_FLAGS;
+
+      if (flags == WP_COMPRESS_FLAGS) sim_stats.us_compressed++;
+      else if (flags == WP_DELTA_FLAG_UNCHANGED) sim_stats.us_unchanged++;
+      else if (flags == WP_DELTA_FLAG_DELTA) sim_stats.us_delta++;
+      else sim_stats.us_full++;
+
+      _sim_host_verify(record, length);
+      _sim_host_frame_number(wp_retx_frame_number(record));
+      break;
+    }
+
+    case WULPUS_BENCH_START_OF_FRAME:
+    {
+      // Sequence numbers of the synthetic frames, the generation time in app timer ticks (24 bit)
+      uint32_t seq = uint32_decode(&record[4]);
+      uint32_t ticks = (app_timer_cnt_get() - uint32_decode(&record[8])) & APP_TIMER_MAX_CNT_VAL;
+
+      _sim_host_sequence((uint16_t)seq);
+      sim_stats.bench++;
+      sim_stats.frames++;
+      _sim_host_latency(ticks * SIM_NS_PER_S / SIM_TICKS_PER_S);
+      break;
+    }
+
+    case WULPUS_FEATURE_START_OF_FRAME:
+      sim_stats.features++;
+      _sim_host_frame_number(wp_retx_frame_number(record));
+      break;
+
+    case WULPUS_LOST_START_OF_FRAME:
+      sim_stats.lost++;
+      break;
+  }
+}
+
+// Payload of a notification (behind the stream header), starting at a record or in the middle of one
+static void _sim_host_stream(uint8_t const *data, uint16_t length)
+{
+  while (length > 0)
+  {
+    uint16_t take = MIN(length, (uint16_t)(SIM_MAX_RECORD_LEN - _sim_host_record_fill));
+    memcpy(&_sim_host_record[_sim_host_record_fill], data, take);
+
+    uint16_t fill = _sim_host_record_fill + take;
+    uint16_t record_len = _sim_host_record_length(_sim_host_record, fill);
+
+    if ((record_len == UINT16_MAX) || (record_len > SIM_MAX_RECORD_LEN))
+    {
+      NRF_LOG_WARNING("Unknown record 0x%02X, waiting for the next record start", _sim_host_record[0]);
+      sim_stats.stream_errors++;
+      _sim_host_synced = false;
+      _sim_host_record_fill = 0;
+      return;
+    }
+
+    if ((record_len == 0) || (fill < record_len))
+    {
+      _sim_host_record_fill = fill;
+      return;
+    }
+
+    // Bytes behind the end of the record start the next one
+    take = record_len - _sim_host_record_fill;
+    _sim_host_record_done(_sim_host_record, record_len);
+    _sim_host_record_fill = 0;
+    data += take;
+    length -= take;
+  }
+}
+
+void sim_host_notification(uint16_t char_uuid, uint8_t const *data, uint16_t length)
+{
+  // The telemetry is read from the characteristic at the end (sd_ble_gatts_value_set)
+  if ((char_uuid != SIM_DATA_CHAR_UUID) || (length < WP_STREAM_HEADER_LEN)) return;
+
+  uint8_t seq = data[0];
+  uint8_t first = data[1];
+  uint16_t payload_len = length - WP_STREAM_HEADER_LEN;
+  data += WP_STREAM_HEADER_LEN;
+
+  // A notification missing in between leaves the record in progress incomplete
+  if (_sim_host_synced && (seq != (uint8_t)(_sim_host_seq + 1)))
+  {
+    NRF_LOG_WARNING("Notification %u after %u", seq, _sim_host_seq);
+    sim_stats.stream_errors++;
+    _sim_host_synced = false;
+  }
+  _sim_host_seq = seq;
+
+  if (!_sim_host_synced)
+  {
+    if ((first == WP_STREAM_NO_RECORD_START) || (first > payload_len)) return;
+
+    _sim_host_synced = true;
+    _sim_host_record_fill = 0;
+    data += first;
+    payload_len -= first;
+  }
+
+  _sim_host_stream(data, payload_len);
+}
+
+// One record per SDU on the L2CAP channel
+void sim_host_sdu(uint8_t const *data, uint16_t length)
+{
+  uint16_t record_len = _sim_host_record_length(data, length);
+
+  if (record_len != length)
+  {
+    NRF_LOG_WARNING("SDU of %u bytes holds a record of %u bytes", length, record_len);
+    sim_stats.stream_errors++;
+    return;
+  }
+
+  _sim_host_record_done(data, length);
+}
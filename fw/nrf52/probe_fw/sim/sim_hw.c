@@ -0,0 +1,387 @@
+#include "sim.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "app_util.h"
+
+#include "wulpus_gpio.h"
+#include "wulpus_l2cap.h"
+#include "wulpus_spi.h"
+#include "wulpus_ppi.h"
+#include "wulpus_config.h"
+
+#define NRF_LOG_MODULE_NAME sim_msp430
+#include "nrf_log.h"
+NRF_LOG_MODULE_REGISTER();
+
+// MSP430 and the drivers of the SPI master (GPIO, SPIM, PPI): a frame is acquired every measurement period
+// and sent over SPI right away if the ready line is high, otherwise it is kept in FRAM. After a frame
+// was kept, the backlog is flushed back to back while the line is high (main.c of the MSP430)
+// Data ready starts TIMER3, every interval starts a transfer of the SPIM. RXD.PTR is latched at START
+// and incremented at END (NRF_DRV_SPI_FLAG_RX_POSTINC), also if the firmware wrote it during the transfer.
+// TIMER4 raises the end interrupt after the last transfer, the handlers run after the ISR latency
+
+#define SIM_FRAME_LEN       (WULPUS_FRAME_HEADER_LEN + 2 * WULPUS_FRAME_NUM_SAMPLES)
+#define SIM_FRAM_RING_LEN   12    // FRAM_RING_LEN of the MSP430 firmware
+#define SIM_START_NS        (20 * SIM_NS_PER_MS)  // Configuration received until the first acquisition
+#define SIM_FRAME_HISTORY   4096  // Frames kept for the host to compare with, divides the frame numbers
+// Transfers WULPUS_SPI_PACKET_INTERVAL apart at 8 MHz, the first one an interval after data ready
+#define SIM_SPI_INTERVAL_NS (WULPUS_SPI_PACKET_INTERVAL * SIM_NS_PER_US)
+#define SIM_SPI_XFER_NS     (WULPUS_BYTES_PER_XFER * SIM_NS_PER_US)
+// The ring of main.c and its guard slot
+#define SIM_RX_SLOTS        (WULPUS_NUM_BUFFERED_FRAMES + 1)
+#define SIM_ECHO_AMPLITUDE  4000.0
+#define SIM_ECHO_WIDTH      12.0
+#define SIM_ECHO_FREQ       0.25  // Cycles per sample
+#define SIM_ECHO_DEPTH      150.0
+#define SIM_ECHO_SPACING    40.0  // Between the TX/RX configs
+#define SIM_ECHO_MOTION     8.0   // Samples the echo moves back and forth
+#define SIM_MOTION_FRAMES   200   // Frames of one motion cycle
+
+STATIC_ASSERT(SIM_SPI_XFER_NS < SIM_SPI_INTERVAL_NS);
+STATIC_ASSERT(((UINT16_MAX + 1) % SIM_FRAME_HISTORY) == 0);
+
+// Frame buffer of main.c
+extern volatile size_t rx_buffer_head;
+extern volatile size_t rx_buffer_tail;
+
+static nrf_drv_spi_t const _sim_spi_instance = { .inst_idx = 0 };
+
+// nRF52 side
+bool _sim_ready = false;
+bool _sim_ppi_running = false;
+bool _sim_spi_armed = false;
+uint8_t *_sim_spi_rx_base = NULL;     // rx_buffer of main.c
+uint8_t *_sim_spim_rxd_ptr = NULL;    // RXD.PTR
+uint8_t *_sim_spim_dst = NULL;        // Latched at START
+uint64_t _sim_end_irq = SIM_NEVER;    // End handlers pending since the last transfer of a frame
+wp_ppi_end_handler_t _sim_end_handlers[WULPUS_PPI_MAX_END_HANDLERS];
+size_t _sim_end_handlers_num = 0;
+
+// MSP430 side
+bool _sim_acquiring = false;
+uint64_t _sim_next_acquisition = SIM_NEVER;
+uint16_t _sim_frame_number = 0;
+uint64_t _sim_frame_times[UINT16_MAX + 1];
+uint8_t _sim_frames[SIM_FRAME_HISTORY][SIM_FRAME_LEN];
+uint8_t _sim_fram_ring[SIM_FRAM_RING_LEN][SIM_FRAME_LEN];
+size_t _sim_fram_head = 0;
+size_t _sim_fram_count = 0;
+uint8_t _sim_spi_frame[SIM_FRAME_LEN];
+bool _sim_spi_busy = false;            // Frame in progress
+bool _sim_spi_receiving = false;       // Data ready reached the nRF52, the transfers are clocked
+bool _sim_spi_in_xfer = false;
+size_t _sim_spi_xfer = 0;              // Transfer of the frame at the next START or END
+uint64_t _sim_spi_next = SIM_NEVER;    // Next START or END
+bool _sim_flushing = false;            // Sending the backlog while the ready line stays high
+uint32_t _sim_noise_state = 1;
+
+
+static int16_t _sim_noise(void)
+{
+  _sim_noise_state = _sim_noise_state * 1664525UL + 1013904223UL;
+  if (sim_params.noise == 0) return 0;
+  return (int16_t)((int32_t)(_sim_noise_state >> 16) % (2 * sim_params.noise + 1) - sim_params.noise);
+}
+
+// One echo per TX/RX config which moves slowly, and noise
+static void _sim_acquire(uint8_t *frame)
+{
+  uint16_t number = _sim_frame_number++;
+  uint8_t tx_rx_id = number % sim_params.configs;
+  double depth = SIM_ECHO_DEPTH + SIM_ECHO_SPACING * tx_rx_id +
+                 SIM_ECHO_MOTION * sin(2.0 * M_PI * number / SIM_MOTION_FRAMES);
+
+  memset(frame, 0, WULPUS_FRAME_HEADER_LEN);
+  frame[0] = 0xFF;
+  frame[1] = tx_rx_id;
+  frame[2] = (uint8_t)number;
+  frame[3] = (uint8_t)(number >> 8);
+  frame[4] = (uint8_t)(sim_params.period_us / 1000);
+  frame[5] = (uint8_t)((sim_params.period_us / 1000) >> 8);
+
+  for (size_t i = 0; i < WULPUS_FRAME_NUM_SAMPLES; i++)
+  {
+    double x = (i - depth) / SIM_ECHO_WIDTH;
+    int32_t sample = (int32_t)lround(SIM_ECHO_AMPLITUDE * exp(-x * x) * sin(2.0 * M_PI * SIM_ECHO_FREQ * i)) +
+                     _sim_noise();
+
+    frame[WULPUS_FRAME_HEADER_LEN + 2 * i] = (uint8_t)sample;
+    frame[WULPUS_FRAME_HEADER_LEN + 2 * i + 1] = (uint8_t)((uint16_t)sample >> 8);
+  }
+
+  _sim_frame_times[number] = sim_now();
+  memcpy(_sim_frames[number % SIM_FRAME_HISTORY], frame, SIM_FRAME_LEN);
+  sim_stats.acquired++;
+}
+
+static void _sim_spi_start(uint8_t const *frame)
+{
+  memcpy(_sim_spi_frame, frame, SIM_FRAME_LEN);
+  _sim_spi_busy = true;
+  _sim_spi_in_xfer = false;
+  _sim_spi_xfer = 0;
+  _sim_spi_next = sim_now() + SIM_SPI_INTERVAL_NS;
+
+  // Data ready starts the transfers through PPI only while the reception is armed
+  _sim_spi_receiving = _sim_ppi_running && _sim_spi_armed && (_sim_spim_rxd_ptr != NULL);
+  if (!_sim_spi_receiving) sim_stats.spi_missed++;
+}
+
+// A transfer must land in the ring (or its guard slot) and must not hit a pending frame
+// or a frame in flight on the L2CAP channel
+static bool _sim_spi_check_dst(uint8_t const *dst)
+{
+  if ((dst < _sim_spi_rx_base) || (dst + WULPUS_BYTES_PER_XFER > _sim_spi_rx_base + SIM_RX_SLOTS * SIM_FRAME_LEN))
+  {
+    NRF_LOG_ERROR("Transfer %u of a frame outside the RX buffer", _sim_spi_xfer);
+    sim_stats.spi_overwrites++;
+    return false;
+  }
+
+  size_t slot = (size_t)(dst - _sim_spi_rx_base) / SIM_FRAME_LEN;
+  if (slot >= WULPUS_NUM_BUFFERED_FRAMES) return true;
+
+  size_t pending = (rx_buffer_head + WULPUS_NUM_BUFFERED_FRAMES - rx_buffer_tail) % WULPUS_NUM_BUFFERED_FRAMES;
+  size_t ahead = (slot + WULPUS_NUM_BUFFERED_FRAMES - rx_buffer_tail) % WULPUS_NUM_BUFFERED_FRAMES;
+  size_t behind = (rx_buffer_tail + WULPUS_NUM_BUFFERED_FRAMES - slot) % WULPUS_NUM_BUFFERED_FRAMES;
+
+  if ((ahead < pending) || ((behind > 0) && (behind <= wp_l2cap_tx_pending())))
+  {
+    NRF_LOG_ERROR("Transfer %u of a frame into slot %u, head %u, tail %u", _sim_spi_xfer, slot,
+                  rx_buffer_head, rx_buffer_tail);
+    sim_stats.spi_overwrites++;
+  }
+
+  return true;
+}
+
+static void _sim_spi_event(void)
+{
+  if (!_sim_spi_in_xfer)
+  {
+    // START, the reception may have been stopped since data ready
+    if (!_sim_ppi_running || !_sim_spi_armed) _sim_spi_receiving = false;
+
+    _sim_spim_dst = _sim_spim_rxd_ptr;
+    _sim_spi_in_xfer = true;
+    _sim_spi_next = sim_now() + SIM_SPI_XFER_NS;
+    return;
+  }
+
+  // END
+  if (_sim_spi_receiving)
+  {
+    if (_sim_spi_check_dst(_sim_spim_dst))
+    {
+      memcpy(_sim_spim_dst, &_sim_spi_frame[_sim_spi_xfer * WULPUS_BYTES_PER_XFER], WULPUS_BYTES_PER_XFER);
+    }
+    _sim_spim_rxd_ptr += WULPUS_BYTES_PER_XFER;
+  }
+
+  _sim_spi_in_xfer = false;
+  _sim_spi_next = sim_now() + SIM_SPI_INTERVAL_NS - SIM_SPI_XFER_NS;
+
+  if (++_sim_spi_xfer < WULPUS_NUMBER_OF_XFERS) return;
+
+  _sim_spi_busy = false;
+  _sim_spi_next = SIM_NEVER;
+
+  if (!_sim_spi_receiving) return;
+  sim_stats.spi_frames++;
+
+  // A pending interrupt is not raised twice, the firmware misses a frame
+  if (_sim_end_irq == SIM_NEVER) _sim_end_irq = sim_now() + sim_params.isr_latency_us * SIM_NS_PER_US;
+}
+
+static void _sim_fram_push(uint8_t const *frame)
+{
+  // Overwrites the oldest frame if the ring is full
+  if (_sim_fram_count == SIM_FRAM_RING_LEN)
+  {
+    _sim_fram_head = (_sim_fram_head + 1) % SIM_FRAM_RING_LEN;
+    _sim_fram_count--;
+    sim_stats.fram_overwritten++;
+  }
+
+  memcpy(_sim_fram_ring[(_sim_fram_head + _sim_fram_count) % SIM_FRAM_RING_LEN], frame, SIM_FRAME_LEN);
+  _sim_fram_count++;
+}
+
+uint64_t sim_hw_next_event(void)
+{
+  uint64_t next = MIN(MIN(_sim_next_acquisition, _sim_spi_next), _sim_end_irq);
+
+  if (!_sim_spi_busy && _sim_flushing) next = sim_now();
+
+  return next;
+}
+
+void sim_hw_run(void)
+{
+  while (sim_now() >= _sim_spi_next) _sim_spi_event();
+
+  if (sim_now() >= _sim_end_irq)
+  {
+    _sim_end_irq = SIM_NEVER;
+    for (size_t i = 0; i < _sim_end_handlers_num; i++) _sim_end_handlers[i]();
+  }
+
+  if (sim_now() >= _sim_next_acquisition)
+  {
+    uint8_t frame[SIM_FRAME_LEN];
+
+    _sim_next_acquisition += sim_params.period_us * SIM_NS_PER_US;
+    _sim_acquire(frame);
+
+    // Older frames are sent first, the backlog is flushed after the frame was kept
+    if (_sim_ready && (_sim_fram_count == 0) && !_sim_spi_busy)
+    {
+      _sim_spi_start(frame);
+    }
+    else
+    {
+      _sim_fram_push(frame);
+      _sim_flushing = true;
+    }
+  }
+
+  if (_sim_flushing && !_sim_spi_busy)
+  {
+    _sim_flushing = _sim_ready && (_sim_fram_count > 0);
+    if (!_sim_flushing) return;
+
+    _sim_spi_start(_sim_fram_ring[_sim_fram_head]);
+    _sim_fram_head = (_sim_fram_head + 1) % SIM_FRAM_RING_LEN;
+    _sim_fram_count--;
+  }
+}
+
+uint64_t sim_hw_frame_time(uint16_t frame_number)
+{
+  return _sim_frame_times[frame_number];
+}
+
+uint8_t const *sim_hw_frame(uint16_t frame_number)
+{
+  return _sim_frames[frame_number % SIM_FRAME_HISTORY];
+}
+
+// GPIO
+// ------------------------------------------------------
+ret_code_t wp_gpio_init(void)
+{
+  return NRF_SUCCESS;
+}
+
+uint32_t wp_gpio_data_ready_event_addr(void)
+{
+  return 0;
+}
+
+void wp_gpio_led_indicate(bool on)
+{
+  UNUSED_PARAMETER(on);
+}
+
+void wp_gpio_led_toggle(void)
+{
+}
+
+void wp_gpio_ble_conn_indicate(bool ready)
+{
+  if (ready != _sim_ready) NRF_LOG_DEBUG("Ready line %s", ready ? "high" : "low");
+  _sim_ready = ready;
+}
+
+// SPI
+// ------------------------------------------------------
+ret_code_t wp_spi_init(uint8_t *tx_buffer, uint16_t tx_length, uint8_t *rx_buffer, uint16_t rx_length)
+{
+  UNUSED_PARAMETER(tx_buffer);
+  UNUSED_PARAMETER(tx_length);
+  UNUSED_PARAMETER(rx_length);
+
+  _sim_spi_rx_base = rx_buffer;
+  _sim_spim_rxd_ptr = rx_buffer;
+  return NRF_SUCCESS;
+}
+
+const nrf_drv_spi_t *wp_spi_get_instance(void)
+{
+  return &_sim_spi_instance;
+}
+
+void wp_spi_set_buffer(uint8_t *buffer)
+{
+  _sim_spim_rxd_ptr = buffer;
+}
+
+bool wp_spi_is_busy(void)
+{
+  return false;
+}
+
+// The configuration (or the restart command) reaches the MSP430 right away
+ret_code_t wp_spi_send_config(uint8_t const *buffer, uint8_t length)
+{
+  uint8_t const restart_packet[] = WULPUS_RESTART_PACKET;
+
+  if ((length == 0) || (buffer[0] == restart_packet[0]))
+  {
+    _sim_acquiring = false;
+    _sim_next_acquisition = SIM_NEVER;
+    _sim_fram_count = 0;
+    _sim_flushing = false;
+    return NRF_SUCCESS;
+  }
+
+  NRF_LOG_INFO("Configured, a frame every %u us", sim_params.period_us);
+
+  _sim_acquiring = true;
+  _sim_next_acquisition = sim_now() + SIM_START_NS;
+  _sim_fram_count = 0;
+  _sim_flushing = false;
+  _sim_noise_state = sim_params.seed;
+
+  return NRF_SUCCESS;
+}
+
+ret_code_t wp_spi_init_reception(void)
+{
+  _sim_spi_armed = true;
+  return NRF_SUCCESS;
+}
+
+void wp_spi_stop_reception(void)
+{
+  _sim_spi_armed = false;
+}
+
+// PPI
+// ------------------------------------------------------
+ret_code_t wp_ppi_init(const nrf_drv_spi_t *spi_instance)
+{
+  UNUSED_PARAMETER(spi_instance);
+
+  return NRF_SUCCESS;
+}
+
+ret_code_t wp_ppi_add_end_handler(wp_ppi_end_handler_t handler)
+{
+  if (_sim_end_handlers_num >= WULPUS_PPI_MAX_END_HANDLERS) return NRF_ERROR_NO_MEM;
+
+  _sim_end_handlers[_sim_end_handlers_num++] = handler;
+  return NRF_SUCCESS;
+}
+
+void wp_ppi_start_transfer(void)
+{
+  _sim_ppi_running = true;
+}
+
+void wp_ppi_stop_transfer(void)
+{
+  _sim_ppi_running = false;
+}
@@ -0,0 +1,367 @@
+#include "sim.h"
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nordic_common.h"
+#include "nrf_pwr_mgmt.h"
+
+#include "wulpus_ble.h"
+#include "wulpus_config.h"
+
+// Event loop of the simulation and the benchmark report
+// The firmware (main.c, renamed to wulpus_main) runs until its main loop sleeps, the models then
+// advance the time to their next event and run the handlers it triggers, as the interrupts would
+
+// Frame buffer of main.c
+extern volatile size_t rx_buffer_head;
+extern volatile size_t rx_buffer_tail;
+
+int wulpus_main(void);
+
+sim_params_t sim_params =
+{
+  .duration_ms = 10000,
+  .seed = 1,
+  .log_level = 2,
+  .period_us = 10000,
+  .configs = 1,
+  .noise = 20,
+  .interval_ms = WULPUS_BLE_MIN_CONN_INTERVAL,
+  .central_min_ms = 7.5,
+  .phy = 2,
+  .att_mtu = 247,
+  .data_len = 251,
+  .delta_threshold = 0,
+  .policy = WP_BUFFER_DROP_NEWEST,
+  .decimation = WULPUS_BUFFER_DECIMATION,
+  .peaks = 2,
+};
+sim_stats_t sim_stats;
+
+uint64_t _sim_now = 0;
+
+
+uint64_t sim_now(void)
+{
+  return _sim_now;
+}
+
+void sim_level_add(sim_level_t *level, uint32_t value)
+{
+  level->sum += value;
+  level->samples++;
+  level->max = MAX(level->max, value);
+}
+
+void sim_sample_levels(void)
+{
+  size_t pending = (rx_buffer_head + WULPUS_NUM_BUFFERED_FRAMES - rx_buffer_tail) % WULPUS_NUM_BUFFERED_FRAMES;
+
+  sim_level_add(&sim_stats.frame_buffer, pending);
+  sim_level_add(&sim_stats.ble_tx_queue, WULPUS_BLE_TX_QUEUE_LEN - 1 - wp_ble_tx_free());
+  sim_level_add(&sim_stats.hvn_queue, sim_sd_hvn_queued());
+  sim_level_add(&sim_stats.l2cap_queue, sim_sd_l2cap_queued());
+}
+
+static double _sim_mean(sim_level_t const *level)
+{
+  return (level->samples > 0) ? (double)level->sum / level->samples : 0.0;
+}
+
+static uint32_t _sim_telemetry_u32(size_t idx)
+{
+  uint8_t const *p = sim_stats.telemetry + idx;
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Frames received by the nRF52 and dropped by the overflow policy, from the last telemetry update
+static uint32_t _sim_nrf_dropped(void)
+{
+  return sim_stats.telemetry_valid ? _sim_telemetry_u32(8) : 0;
+}
+
+static void _sim_report(void)
+{
+  double seconds = (sim_stats.start_ns < _sim_now) ? (_sim_now - sim_stats.start_ns) / (double)SIM_NS_PER_S : 0.0;
+  double fps = (seconds > 0.0) ? sim_stats.frames / seconds : 0.0;
+  double kbps = (seconds > 0.0) ? sim_stats.payload_bytes / seconds / 1000.0 : 0.0;
+  double latency_ms = (sim_stats.latency_count > 0) ?
+                      sim_stats.latency_sum_ns / (double)sim_stats.latency_count / SIM_NS_PER_MS : 0.0;
+  uint32_t dropped = _sim_nrf_dropped();
+
+  if (sim_params.csv)
+  {
+    printf("seconds,frames_per_s,kB_per_s,frames,missing,acquired,fram_overwritten,spi_missed,nrf_dropped,"
+           "full,delta,unchanged,compressed,bench,features,lost,stream_errors,latency_mean_ms,latency_max_ms,"
+           "interval_ms,conn_updates,conn_events,ll_packets,crc_errors,packets_per_event,"
+           "frame_buffer_mean,frame_buffer_max,ble_tx_queue_mean,ble_tx_queue_max,hvn_queue_mean,hvn_queue_max,"
+           "l2cap_queue_mean,l2cap_queue_max,payload_checked,payload_mismatches,spi_overwrites\n");
+    printf("%.3f,%.2f,%.2f,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%.3f,%.3f,%.2f,%u,%u,%u,%u,%.2f,"
+           "%.2f,%u,%.2f,%u,%.2f,%u,%.2f,%u,%u,%u,%u\n",
+           seconds, fps, kbps, sim_stats.frames, sim_stats.frames_missing, sim_stats.acquired,
+           sim_stats.fram_overwritten, sim_stats.spi_missed, dropped, sim_stats.us_full, sim_stats.us_delta,
+           sim_stats.us_unchanged, sim_stats.us_compressed, sim_stats.bench, sim_stats.features, sim_stats.lost,
+           sim_stats.stream_errors, latency_ms, sim_stats.latency_max_ns / (double)SIM_NS_PER_MS,
+           sim_stats.interval_ms, sim_stats.conn_updates, sim_stats.conn_events, sim_stats.ll_packets,
+           sim_stats.ll_crc_errors, _sim_mean(&sim_stats.packets_per_event),
+           _sim_mean(&sim_stats.frame_buffer), sim_stats.frame_buffer.max,
+           _sim_mean(&sim_stats.ble_tx_queue), sim_stats.ble_tx_queue.max,
+           _sim_mean(&sim_stats.hvn_queue), sim_stats.hvn_queue.max,
+           _sim_mean(&sim_stats.l2cap_queue), sim_stats.l2cap_queue.max,
+           sim_stats.payload_checked, sim_stats.payload_mismatches, sim_stats.spi_overwrites);
+    return;
+  }
+
+  printf("Streamed for %.3f s over %s%s\n", seconds, sim_params.l2cap ? "L2CAP" : "notifications",
+         sim_stats.disconnected ? " (disconnected)" : "");
+  printf("  Host        %u frames (%.2f frames/s), %.2f kB/s payload, %u missing\n",
+         sim_stats.frames, fps, kbps, sim_stats.frames_missing);
+  printf("  Records     %u full, %u delta, %u unchanged, %u compressed, %u bench, %u features, %u lost\n",
+         sim_stats.us_full, sim_stats.us_delta, sim_stats.us_unchanged, sim_stats.us_compressed,
+         sim_stats.bench, sim_stats.features, sim_stats.lost);
+  printf("  Latency     %.3f ms mean, %.3f ms max\n", latency_ms, sim_stats.latency_max_ns / (double)SIM_NS_PER_MS);
+  printf("  Drops       %u overwritten in FRAM, %u missed on SPI, %u dropped by the nRF52, %u stream errors\n",
+         sim_stats.fram_overwritten, sim_stats.spi_missed, dropped, sim_stats.stream_errors);
+  printf("  MSP430      %u frames acquired, %u received over SPI, %u transfers into occupied slots\n",
+         sim_stats.acquired, sim_stats.spi_frames, sim_stats.spi_overwrites);
+  printf("  Payload     %u frames compared with the acquired ones, %u differ\n",
+         sim_stats.payload_checked, sim_stats.payload_mismatches);
+  printf("  Link        %.2f ms interval (%u updates), %u events, %.2f packets/event (max %u), "
+         "%u packets, %u CRC errors\n",
+         sim_stats.interval_ms, sim_stats.conn_updates, sim_stats.conn_events,
+         _sim_mean(&sim_stats.packets_per_event), sim_stats.packets_per_event.max,
+         sim_stats.ll_packets, sim_stats.ll_crc_errors);
+  printf("  Queues      frame buffer %.2f (max %u/%u), BLE TX %.2f (max %u/%u), "
+         "SoftDevice %.2f (max %u), L2CAP %.2f (max %u)\n",
+         _sim_mean(&sim_stats.frame_buffer), sim_stats.frame_buffer.max, WULPUS_NUM_BUFFERED_FRAMES - 2,
+         _sim_mean(&sim_stats.ble_tx_queue), sim_stats.ble_tx_queue.max, WULPUS_BLE_TX_QUEUE_LEN - 1,
+         _sim_mean(&sim_stats.hvn_queue), sim_stats.hvn_queue.max,
+         _sim_mean(&sim_stats.l2cap_queue), sim_stats.l2cap_queue.max);
+}
+
+// Stream received intact: every record parsed and every frame as acquired, losses only where allowed
+static bool _sim_check(void)
+{
+  bool ok = true;
+
+  if ((sim_stats.stream_errors > 0) || (sim_stats.payload_mismatches > 0) || (sim_stats.spi_overwrites > 0))
+  {
+    fprintf(stderr, "FAIL: %u stream errors, %u payload mismatches, %u SPI overwrites\n",
+            sim_stats.stream_errors, sim_stats.payload_mismatches, sim_stats.spi_overwrites);
+    ok = false;
+  }
+
+  if (!sim_params.allow_drops &&
+      ((_sim_nrf_dropped() > 0) || (sim_stats.fram_overwritten > 0) || (sim_stats.spi_missed > 0) ||
+       (sim_stats.frames_missing > 0)))
+  {
+    fprintf(stderr, "FAIL: %u dropped by the nRF52, %u overwritten in FRAM, %u missed on SPI, %u missing\n",
+            _sim_nrf_dropped(), sim_stats.fram_overwritten, sim_stats.spi_missed, sim_stats.frames_missing);
+    ok = false;
+  }
+
+  if (sim_stats.frames == 0)
+  {
+    fprintf(stderr, "FAIL: no frames received\n");
+    ok = false;
+  }
+
+  return ok;
+}
+
+ret_code_t nrf_pwr_mgmt_init(void)
+{
+  return NRF_SUCCESS;
+}
+
+void nrf_pwr_mgmt_run(void)
+{
+  uint64_t next = MIN(MIN(sim_sd_next_event(), sim_hw_next_event()), sim_host_next_event());
+
+  if (next >= sim_params.duration_ms * SIM_NS_PER_MS)
+  {
+    _sim_now = sim_params.duration_ms * SIM_NS_PER_MS;
+    _sim_report();
+    exit((!sim_params.check || _sim_check()) ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
+
+  _sim_now = MAX(_sim_now, next);
+
+  sim_host_run();
+  sim_hw_run();
+  sim_sd_run();
+}
+
+static void _sim_usage(char const *name)
+{
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  --duration MS        simulated time (10000)\n"
+          "  --seed N             noise and link losses (1)\n"
+          "  --log LEVEL          0 none, 1 errors, 2 warnings, 3 info, 4 debug (2)\n"
+          "  --csv                print the report as CSV\n"
+          "  --check              exit with an error on stream errors, payload mismatches, SPI overwrites\n"
+          "                       or lost frames\n"
+          "  --allow-drops        frames may be lost (with --check)\n"
+          "MSP430\n"
+          "  --period US          measurement period (10000)\n"
+          "  --configs N          TX/RX configs in turn (1)\n"
+          "  --noise N            noise amplitude of the samples (20)\n"
+          "  --bench LEN          synthetic frames of the nRF52 of LEN bytes instead\n"
+          "  --isr-latency US     last SPI transfer of a frame until the end handler runs (0)\n"
+          "Link\n"
+          "  --interval MS        connection interval the central chooses (7.5)\n"
+          "  --central-min MS     shortest interval the central accepts in an update (7.5)\n"
+          "  --phy 1|2            fastest PHY of the central (2)\n"
+          "  --mtu N              ATT MTU of the central (247)\n"
+          "  --data-len N         link layer payload (251)\n"
+          "  --per-event N        packets the central takes per event (0: unlimited)\n"
+          "  --hvn-queue N        notifications the SoftDevice queues (WULPUS_BLE_HVN_TX_QUEUE_SIZE)\n"
+          "  --loss P             packet error rate (0)\n"
+          "  --fade START:LEN     no connection events from START for LEN ms\n"
+          "  --l2cap              stream over the L2CAP channel\n"
+          "nRF52 settings\n"
+          "  --delta              delta encoding\n"
+          "  --shift N            quantisation shift of the residuals (0)\n"
+          "  --threshold N        unchanged threshold (0)\n"
+          "  --keyframe N         keyframe interval (0)\n"
+          "  --policy newest|oldest|decimate\n"
+          "  --decimation N       decimation factor (WULPUS_BUFFER_DECIMATION)\n"
+          "  --compress           lossless compression\n"
+          "  --features alongside|only\n"
+          "  --peaks N            peaks per feature record (2)\n",
+          name);
+}
+
+static void _sim_parse(int argc, char **argv)
+{
+  enum
+  {
+    OPT_DURATION = 256, OPT_SEED, OPT_LOG, OPT_CSV, OPT_CHECK, OPT_ALLOW_DROPS, OPT_PERIOD, OPT_CONFIGS,
+    OPT_NOISE, OPT_BENCH, OPT_ISR_LATENCY,
+    OPT_INTERVAL, OPT_CENTRAL_MIN, OPT_PHY, OPT_MTU, OPT_DATA_LEN, OPT_PER_EVENT, OPT_HVN_QUEUE,
+    OPT_LOSS, OPT_FADE, OPT_L2CAP, OPT_DELTA, OPT_SHIFT, OPT_THRESHOLD, OPT_KEYFRAME, OPT_POLICY,
+    OPT_DECIMATION, OPT_COMPRESS, OPT_FEATURES, OPT_PEAKS,
+  };
+
+  static struct option const options[] =
+  {
+    { "duration", required_argument, NULL, OPT_DURATION },
+    { "seed", required_argument, NULL, OPT_SEED },
+    { "log", required_argument, NULL, OPT_LOG },
+    { "csv", no_argument, NULL, OPT_CSV },
+    { "check", no_argument, NULL, OPT_CHECK },
+    { "allow-drops", no_argument, NULL, OPT_ALLOW_DROPS },
+    { "period", required_argument, NULL, OPT_PERIOD },
+    { "configs", required_argument, NULL, OPT_CONFIGS },
+    { "noise", required_argument, NULL, OPT_NOISE },
+    { "bench", required_argument, NULL, OPT_BENCH },
+    { "isr-latency", required_argument, NULL, OPT_ISR_LATENCY },
+    { "interval", required_argument, NULL, OPT_INTERVAL },
+    { "central-min", required_argument, NULL, OPT_CENTRAL_MIN },
+    { "phy", required_argument, NULL, OPT_PHY },
+    { "mtu", required_argument, NULL, OPT_MTU },
+    { "data-len", required_argument, NULL, OPT_DATA_LEN },
+    { "per-event", required_argument, NULL, OPT_PER_EVENT },
+    { "hvn-queue", required_argument, NULL, OPT_HVN_QUEUE },
+    { "loss", required_argument, NULL, OPT_LOSS },
+    { "fade", required_argument, NULL, OPT_FADE },
+    { "l2cap", no_argument, NULL, OPT_L2CAP },
+    { "delta", no_argument, NULL, OPT_DELTA },
+    { "shift", required_argument, NULL, OPT_SHIFT },
+    { "threshold", required_argument, NULL, OPT_THRESHOLD },
+    { "keyframe", required_argument, NULL, OPT_KEYFRAME },
+    { "policy", required_argument, NULL, OPT_POLICY },
+    { "decimation", required_argument, NULL, OPT_DECIMATION },
+    { "compress", no_argument, NULL, OPT_COMPRESS },
+    { "features", required_argument, NULL, OPT_FEATURES },
+    { "peaks", required_argument, NULL, OPT_PEAKS },
+    { "help", no_argument, NULL, 'h' },
+    { NULL, 0, NULL, 0 },
+  };
+
+  int opt;
+  while ((opt = getopt_long(argc, argv, "h", options, NULL)) != -1)
+  {
+    switch (opt)
+    {
+      case OPT_DURATION:    sim_params.duration_ms = strtoul(optarg, NULL, 0); break;
+      case OPT_SEED:        sim_params.seed = strtoul(optarg, NULL, 0); break;
+      case OPT_LOG:         sim_params.log_level = atoi(optarg); break;
+      case OPT_CSV:         sim_params.csv = true; break;
+      case OPT_CHECK:       sim_params.check = true; break;
+      case OPT_ALLOW_DROPS: sim_params.allow_drops = true; break;
+      case OPT_PERIOD:      sim_params.period_us = strtoul(optarg, NULL, 0); break;
+      case OPT_CONFIGS:     sim_params.configs = (uint8_t)atoi(optarg); break;
+      case OPT_NOISE:       sim_params.noise = (uint16_t)atoi(optarg); break;
+      case OPT_BENCH:       sim_params.bench_len = (uint16_t)atoi(optarg); break;
+      case OPT_ISR_LATENCY: sim_params.isr_latency_us = strtoul(optarg, NULL, 0); break;
+      case OPT_INTERVAL:    sim_params.interval_ms = atof(optarg); break;
+      case OPT_CENTRAL_MIN: sim_params.central_min_ms = atof(optarg); break;
+      case OPT_PHY:         sim_params.phy = (uint8_t)atoi(optarg); break;
+      case OPT_MTU:         sim_params.att_mtu = (uint16_t)atoi(optarg); break;
+      case OPT_DATA_LEN:    sim_params.data_len = (uint8_t)atoi(optarg); break;
+      case OPT_PER_EVENT:   sim_params.per_event = (uint16_t)atoi(optarg); break;
+      case OPT_HVN_QUEUE:   sim_params.hvn_queue = (uint16_t)atoi(optarg); break;
+      case OPT_LOSS:        sim_params.loss = atof(optarg); break;
+      case OPT_FADE:
+        if (sscanf(optarg, "%u:%u", &sim_params.fade_start_ms, &sim_params.fade_len_ms) != 2)
+        {
+          _sim_usage(argv[0]);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case OPT_L2CAP:       sim_params.l2cap = true; break;
+      case OPT_DELTA:       sim_params.delta = true; break;
+      case OPT_SHIFT:       sim_params.delta_shift = (uint8_t)atoi(optarg); break;
+      case OPT_THRESHOLD:   sim_params.delta_threshold = (uint16_t)atoi(optarg); break;
+      case OPT_KEYFRAME:    sim_params.keyframe = (uint16_t)atoi(optarg); break;
+      case OPT_POLICY:
+        if (strcmp(optarg, "newest") == 0) sim_params.policy = WP_BUFFER_DROP_NEWEST;
+        else if (strcmp(optarg, "oldest") == 0) sim_params.policy = WP_BUFFER_DROP_OLDEST;
+        else if (strcmp(optarg, "decimate") == 0) sim_params.policy = WP_BUFFER_DECIMATE;
+        else
+        {
+          _sim_usage(argv[0]);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case OPT_DECIMATION:  sim_params.decimation = (uint8_t)atoi(optarg); break;
+      case OPT_COMPRESS:    sim_params.compress = true; break;
+      case OPT_FEATURES:
+        if (strcmp(optarg, "alongside") == 0) sim_params.features = SIM_FEATURE_ALONGSIDE;
+        else if (strcmp(optarg, "only") == 0) sim_params.features = SIM_FEATURE_ONLY;
+        else
+        {
+          _sim_usage(argv[0]);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case OPT_PEAKS:       sim_params.peaks = (uint8_t)atoi(optarg); break;
+      default:
+        _sim_usage(argv[0]);
+        exit((opt == 'h') ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+  }
+
+  if ((sim_params.period_us == 0) || (sim_params.configs == 0) || (sim_params.interval_ms < 7.5) ||
+      (sim_params.data_len < 27) || (sim_params.att_mtu < 23) || (sim_params.loss < 0.0) || (sim_params.loss >= 1.0))
+  {
+    fprintf(stderr, "%s: invalid parameters\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  extern int sim_log_level;
+
+  _sim_parse(argc, argv);
+  sim_log_level = sim_params.log_level;
+
+  // Returns only through exit()
+  return wulpus_main();
+}
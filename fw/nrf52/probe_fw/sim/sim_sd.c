@@ -0,0 +1,929 @@
+#include "sim.h"
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "app_timer.h"
+#include "app_error.h"
+#include "nrf_log.h"
+#include "nrf_sdh_ble.h"
+#include "nrf_ble_gatt.h"
+#include "nrf_ble_qwr.h"
+#include "ble_advertising.h"
+#include "ble_conn_params.h"
+#include "ble_srv_common.h"
+
+#include "wulpus_config.h"
+
+// SoftDevice, SDK libraries and link layer as seen by the firmware: the notifications and SDUs are
+// queued like in the S132 and leave in connection events, the packets of an event are limited by the
+// interval, the air time at the PHY and the central. The host model gets them once they were acknowledged
+
+#define SIM_TICKS_PER_S        (APP_TIMER_CLOCK_FREQ / (APP_TIMER_CONFIG_RTC_FREQUENCY + 1))
+#define SIM_CONN_HANDLE        0
+#define SIM_L2CAP_CID          0x0040
+#define SIM_L2CAP_HOST_MTU     1024   // SDUs the host accepts, the firmware requires the longest frame
+#define SIM_L2CAP_HOST_MPS     247
+#define SIM_L2CAP_CREDITS      32
+#define SIM_MAX_HVN_QUEUE      64
+#define SIM_MAX_L2CAP_QUEUE    16
+#define SIM_MAX_WRITES         8
+#define SIM_MAX_CHARS          8
+#define SIM_CONNECT_EVENTS     1      // Connection events until the ATT MTU exchange completed
+#define SIM_CONN_UPDATE_EVENTS 6      // Connection events until a parameter update takes effect
+#define SIM_T_IFS_NS           150000
+#define SIM_EVENT_MARGIN_NS    (500 * SIM_NS_PER_US)  // End of the event before the next anchor point
+#define SIM_ATT_HEADER_LEN     3
+#define SIM_L2CAP_HEADER_LEN   4
+#define SIM_L2CAP_SDU_LEN_LEN  2
+
+typedef struct
+{
+  uint16_t char_uuid;
+  uint16_t length;
+  uint8_t data[WULPUS_BLE_MAX_DATA_LEN];
+} _sim_hvn_t;
+
+typedef struct
+{
+  uint8_t const *data;
+  uint16_t length;
+} _sim_sdu_t;
+
+typedef struct
+{
+  uint16_t length;
+  uint8_t data[WULPUS_BLE_MAX_DATA_LEN];
+} _sim_write_t;
+
+typedef struct
+{
+  uint16_t value_handle;
+  uint16_t uuid;
+} _sim_char_t;
+
+// Events passed to the observers may carry a write of up to WULPUS_BLE_MAX_DATA_LEN bytes
+typedef union
+{
+  ble_evt_t evt;
+  uint8_t raw[sizeof(ble_evt_t) + WULPUS_BLE_MAX_DATA_LEN];
+} _sim_evt_buf_t;
+
+extern nrf_sdh_ble_evt_observer_t const __start_sim_sdh_ble_observers[];
+extern nrf_sdh_ble_evt_observer_t const __stop_sim_sdh_ble_observers[];
+
+int sim_log_level = 2;
+
+// App timer
+app_timer_t *_sim_timers = NULL;
+
+// GATT server
+_sim_char_t _sim_chars[SIM_MAX_CHARS];
+size_t _sim_chars_num = 0;
+uint16_t _sim_next_handle = 0x0010;
+uint8_t _sim_hvn_queue_size = 1;
+
+// SDK libraries
+nrf_ble_gatt_t *_sim_gatt = NULL;
+ble_conn_params_init_t _sim_conn_params_init;
+ble_gap_conn_params_t _sim_ppcp;
+ble_advertising_t *_sim_advertising = NULL;
+
+// Connection
+uint16_t _sim_conn_handle = BLE_CONN_HANDLE_INVALID;
+uint64_t _sim_connected_at = 0;
+uint64_t _sim_next_conn_event = SIM_NEVER;
+uint64_t _sim_interval_ns = 0;
+uint32_t _sim_conn_event_count = 0;
+uint8_t _sim_phy = 1;
+bool _sim_mtu_exchanged = false;
+uint64_t _sim_conn_params_check_at = SIM_NEVER;
+uint32_t _sim_conn_update_event = 0;         // Connection event at which the update takes effect
+uint16_t _sim_conn_update_interval = 0;      // 1.25 ms units, 0: no update pending
+uint64_t _sim_rand_state = 1;
+
+// Queues of the SoftDevice
+_sim_hvn_t _sim_hvn[SIM_MAX_HVN_QUEUE];
+size_t _sim_hvn_head = 0;
+size_t _sim_hvn_count = 0;
+
+_sim_write_t _sim_writes[SIM_MAX_WRITES];
+size_t _sim_writes_head = 0;
+size_t _sim_writes_count = 0;
+
+// L2CAP channel
+uint16_t _sim_l2cap_tx_mps = BLE_L2CAP_MPS_MIN;
+uint8_t _sim_l2cap_tx_queue_size = 0;
+bool _sim_l2cap_setup_pending = false;
+bool _sim_l2cap_open = false;
+_sim_sdu_t _sim_l2cap_sdus[SIM_MAX_L2CAP_QUEUE];
+size_t _sim_l2cap_head = 0;
+size_t _sim_l2cap_count = 0;
+uint16_t _sim_l2cap_offset = 0;   // Bytes of the SDU at the head which were sent
+
+
+static void _sim_sd_dispatch(ble_evt_t const *p_ble_evt)
+{
+  for (nrf_sdh_ble_evt_observer_t const *obs = __start_sim_sdh_ble_observers; obs < __stop_sim_sdh_ble_observers; obs++)
+  {
+    obs->handler(p_ble_evt, obs->p_context);
+  }
+}
+
+static uint64_t _sim_ticks_to_ns(uint64_t ticks)
+{
+  return (ticks * SIM_NS_PER_S + SIM_TICKS_PER_S - 1) / SIM_TICKS_PER_S;
+}
+
+static uint64_t _sim_now_ticks(void)
+{
+  return sim_now() * SIM_TICKS_PER_S / SIM_NS_PER_S;
+}
+
+// Uniform in [0, 1), the same sequence for the same seed
+static double _sim_rand(void)
+{
+  _sim_rand_state ^= _sim_rand_state << 13;
+  _sim_rand_state ^= _sim_rand_state >> 7;
+  _sim_rand_state ^= _sim_rand_state << 17;
+  return (double)(_sim_rand_state >> 11) / (double)(1ULL << 53);
+}
+
+// Air time of one packet of the peripheral and the empty packet of the central it answers
+static uint64_t _sim_packet_ns(uint16_t payload_len)
+{
+  uint32_t overhead = ((_sim_phy == 2) ? 2 : 1) + 4 + 2 + 3; // Preamble, access address, header, CRC
+  uint64_t data_ns = (overhead + payload_len) * 8 * SIM_NS_PER_US / _sim_phy;
+  uint64_t empty_ns = overhead * 8 * SIM_NS_PER_US / _sim_phy;
+
+  return empty_ns + SIM_T_IFS_NS + data_ns + SIM_T_IFS_NS;
+}
+
+static uint16_t _sim_char_uuid(uint16_t value_handle)
+{
+  for (size_t i = 0; i < _sim_chars_num; i++)
+  {
+    if (_sim_chars[i].value_handle == value_handle) return _sim_chars[i].uuid;
+  }
+  return 0;
+}
+
+// Interval the central settles on for a request: the shortest it accepts within the range
+static uint16_t _sim_central_interval(uint16_t min_interval, uint16_t max_interval)
+{
+  uint16_t central_min = (uint16_t)(sim_params.central_min_ms * 1000.0 / UNIT_1_25_MS + 0.5);
+
+  if (max_interval < central_min) return central_min;
+  return MAX(min_interval, central_min);
+}
+
+static uint16_t _sim_interval_units(void)
+{
+  return (uint16_t)(_sim_interval_ns / (UNIT_1_25_MS * SIM_NS_PER_US));
+}
+
+static void _sim_sd_disconnect(uint8_t reason)
+{
+  _sim_evt_buf_t buf;
+
+  _sim_conn_handle = BLE_CONN_HANDLE_INVALID;
+  _sim_next_conn_event = SIM_NEVER;
+  _sim_conn_params_check_at = SIM_NEVER;
+  _sim_hvn_count = 0;
+  _sim_writes_count = 0;
+  _sim_l2cap_open = false;
+  _sim_l2cap_count = 0;
+  _sim_l2cap_offset = 0;
+  sim_stats.disconnected = true;
+
+  memset(&buf, 0, sizeof(buf));
+  buf.evt.header.evt_id = BLE_GAP_EVT_DISCONNECTED;
+  buf.evt.evt.gap_evt.conn_handle = SIM_CONN_HANDLE;
+  buf.evt.evt.gap_evt.params.disconnected.reason = reason;
+  _sim_sd_dispatch(&buf.evt);
+}
+
+static void _sim_sd_conn_param_update(void)
+{
+  _sim_evt_buf_t buf;
+  ble_gap_conn_params_t params = _sim_ppcp;
+
+  _sim_interval_ns = (uint64_t)_sim_conn_update_interval * UNIT_1_25_MS * SIM_NS_PER_US;
+  _sim_conn_update_interval = 0;
+
+  sim_stats.conn_updates++;
+  sim_stats.interval_ms = _sim_interval_ns / (double)SIM_NS_PER_MS;
+  NRF_LOG_INFO("Connection interval %u.%02u ms", (unsigned)(_sim_interval_ns / SIM_NS_PER_MS),
+               (unsigned)(_sim_interval_ns % SIM_NS_PER_MS / 10000));
+
+  params.min_conn_interval = _sim_interval_units();
+  params.max_conn_interval = _sim_interval_units();
+
+  memset(&buf, 0, sizeof(buf));
+  buf.evt.header.evt_id = BLE_GAP_EVT_CONN_PARAM_UPDATE;
+  buf.evt.evt.gap_evt.conn_handle = SIM_CONN_HANDLE;
+  buf.evt.evt.gap_evt.params.conn_param_update.conn_params = params;
+  _sim_sd_dispatch(&buf.evt);
+
+  if (_sim_conn_params_init.evt_handler != NULL)
+  {
+    ble_conn_params_evt_t evt = { .evt_type = BLE_CONN_PARAMS_EVT_SUCCEEDED, .conn_handle = SIM_CONN_HANDLE };
+    _sim_conn_params_init.evt_handler(&evt);
+  }
+}
+
+// Central to peripheral: control writes, the ATT MTU exchange and the L2CAP setup
+static void _sim_sd_central_requests(void)
+{
+  _sim_evt_buf_t buf;
+
+  if (!_sim_mtu_exchanged && (_sim_conn_event_count >= SIM_CONNECT_EVENTS) && (_sim_gatt != NULL))
+  {
+    nrf_ble_gatt_evt_t evt =
+    {
+      .evt_id = NRF_BLE_GATT_EVT_ATT_MTU_UPDATED,
+      .conn_handle = SIM_CONN_HANDLE,
+      .params.att_mtu_effective = MIN(_sim_gatt->att_mtu_desired_periph, sim_params.att_mtu),
+    };
+
+    _sim_mtu_exchanged = true;
+    _sim_gatt->att_mtu_desired_central = sim_params.att_mtu;
+    if (_sim_gatt->evt_handler != NULL) _sim_gatt->evt_handler(_sim_gatt, &evt);
+  }
+
+  if (_sim_l2cap_setup_pending)
+  {
+    _sim_l2cap_setup_pending = false;
+    _sim_l2cap_open = true;
+
+    memset(&buf, 0, sizeof(buf));
+    buf.evt.header.evt_id = BLE_L2CAP_EVT_CH_SETUP;
+    buf.evt.evt.l2cap_evt.conn_handle = SIM_CONN_HANDLE;
+    buf.evt.evt.l2cap_evt.local_cid = SIM_L2CAP_CID;
+    buf.evt.evt.l2cap_evt.params.ch_setup.tx_params.tx_mtu = SIM_L2CAP_HOST_MTU;
+    buf.evt.evt.l2cap_evt.params.ch_setup.tx_params.peer_mps = SIM_L2CAP_HOST_MPS;
+    buf.evt.evt.l2cap_evt.params.ch_setup.tx_params.tx_mps = MIN(_sim_l2cap_tx_mps, SIM_L2CAP_HOST_MPS);
+    buf.evt.evt.l2cap_evt.params.ch_setup.tx_params.credits = SIM_L2CAP_CREDITS;
+    _sim_sd_dispatch(&buf.evt);
+  }
+
+  // One write per connection event (write with response)
+  if (_sim_writes_count > 0)
+  {
+    _sim_write_t const *write = &_sim_writes[_sim_writes_head];
+    size_t data_offset = offsetof(ble_evt_t, evt.gatts_evt.params.write.data);
+
+    memset(&buf, 0, sizeof(buf));
+    buf.evt.header.evt_id = BLE_GATTS_EVT_WRITE;
+    buf.evt.evt.gatts_evt.conn_handle = SIM_CONN_HANDLE;
+    buf.evt.evt.gatts_evt.params.write.handle = 0;
+    for (size_t i = 0; i < _sim_chars_num; i++)
+    {
+      if (_sim_chars[i].uuid == SIM_CONTROL_CHAR_UUID) buf.evt.evt.gatts_evt.params.write.handle = _sim_chars[i].value_handle;
+    }
+    buf.evt.evt.gatts_evt.params.write.len = write->length;
+    memcpy(buf.raw + data_offset, write->data, write->length);
+
+    _sim_writes_head = (_sim_writes_head + 1) % SIM_MAX_WRITES;
+    _sim_writes_count--;
+
+    _sim_sd_dispatch(&buf.evt);
+  }
+}
+
+// Sends the next notification or L2CAP PDU if it fits into the event, false once the event ends
+static bool _sim_sd_send_packet(uint64_t *budget_ns, uint32_t *packets, uint8_t *hvn_done, uint16_t *sdus_done)
+{
+  if ((sim_params.per_event != 0) && (*packets >= sim_params.per_event)) return false;
+
+  bool notification = (_sim_hvn_count > 0);
+  uint16_t pdu_len;
+
+  if (notification)
+  {
+    pdu_len = SIM_L2CAP_HEADER_LEN + SIM_ATT_HEADER_LEN + _sim_hvn[_sim_hvn_head].length;
+  }
+  else if (_sim_l2cap_count > *sdus_done)
+  {
+    // SDUs sent in this event are released once it ended
+    _sim_sdu_t const *sdu = &_sim_l2cap_sdus[(_sim_l2cap_head + *sdus_done) % SIM_MAX_L2CAP_QUEUE];
+    uint16_t sdu_len_len = (_sim_l2cap_offset == 0) ? SIM_L2CAP_SDU_LEN_LEN : 0;
+    uint16_t mps = MIN(_sim_l2cap_tx_mps, SIM_L2CAP_HOST_MPS);
+
+    pdu_len = SIM_L2CAP_HEADER_LEN + MIN(mps, sdu_len_len + sdu->length - _sim_l2cap_offset);
+  }
+  else
+  {
+    return false;
+  }
+
+  // PDUs longer than the data length are fragmented into several packets
+  uint32_t num_packets = (pdu_len + sim_params.data_len - 1) / sim_params.data_len;
+  uint64_t air_ns = (num_packets - 1) * _sim_packet_ns(sim_params.data_len) +
+                    _sim_packet_ns(pdu_len - (num_packets - 1) * sim_params.data_len);
+
+  if (air_ns > *budget_ns) return false;
+  *budget_ns -= air_ns;
+  *packets += num_packets;
+  sim_stats.ll_packets += num_packets;
+  sim_stats.air_bytes += pdu_len;
+
+  // The central closes the event after a CRC error, the packet is sent again in the next one
+  if ((sim_params.loss > 0.0) && (_sim_rand() < sim_params.loss))
+  {
+    sim_stats.ll_crc_errors++;
+    return false;
+  }
+
+  if (notification)
+  {
+    _sim_hvn_t const *hvn = &_sim_hvn[_sim_hvn_head];
+
+    sim_host_notification(hvn->char_uuid, hvn->data, hvn->length);
+    sim_stats.notifications++;
+    (*hvn_done)++;
+
+    _sim_hvn_head = (_sim_hvn_head + 1) % SIM_MAX_HVN_QUEUE;
+    _sim_hvn_count--;
+    return true;
+  }
+
+  _sim_sdu_t const *sdu = &_sim_l2cap_sdus[(_sim_l2cap_head + *sdus_done) % SIM_MAX_L2CAP_QUEUE];
+  uint16_t sdu_len_len = (_sim_l2cap_offset == 0) ? SIM_L2CAP_SDU_LEN_LEN : 0;
+
+  _sim_l2cap_offset += pdu_len - SIM_L2CAP_HEADER_LEN - sdu_len_len;
+  if (_sim_l2cap_offset < sdu->length) return true;
+
+  // The SDU is read from the buffer of the firmware when its last PDU was acknowledged
+  sim_host_sdu(sdu->data, sdu->length);
+  sim_stats.sdus++;
+  (*sdus_done)++;
+
+  _sim_l2cap_offset = 0;
+  return true;
+}
+
+static void _sim_sd_conn_event(void)
+{
+  uint64_t now = sim_now();
+  uint64_t fade_start = sim_params.fade_start_ms * SIM_NS_PER_MS;
+  uint64_t fade_end = fade_start + sim_params.fade_len_ms * SIM_NS_PER_MS;
+
+  _sim_next_conn_event = now + _sim_interval_ns;
+  _sim_conn_event_count++;
+
+  if ((_sim_conn_update_interval != 0) && (_sim_conn_event_count >= _sim_conn_update_event))
+  {
+    _sim_sd_conn_param_update();
+    _sim_next_conn_event = now + _sim_interval_ns;
+  }
+
+  // The central is out of range, the event is missed
+  if ((sim_params.fade_len_ms > 0) && (now >= fade_start) && (now < fade_end)) return;
+
+  sim_stats.conn_events++;
+  sim_sample_levels();
+
+  _sim_sd_central_requests();
+  if (_sim_conn_handle == BLE_CONN_HANDLE_INVALID) return;
+
+  uint64_t event_ns = MIN(_sim_interval_ns, (uint64_t)NRF_SDH_BLE_GAP_EVENT_LENGTH * UNIT_1_25_MS * SIM_NS_PER_US);
+  uint64_t budget_ns = (event_ns > SIM_EVENT_MARGIN_NS) ? (event_ns - SIM_EVENT_MARGIN_NS) : 0;
+  uint32_t packets = 0;
+  uint8_t hvn_done = 0;
+  uint16_t sdus_done = 0;
+
+  while (_sim_sd_send_packet(&budget_ns, &packets, &hvn_done, &sdus_done));
+
+  sim_level_add(&sim_stats.packets_per_event, packets);
+
+  if (hvn_done > 0)
+  {
+    _sim_evt_buf_t buf;
+
+    memset(&buf, 0, sizeof(buf));
+    buf.evt.header.evt_id = BLE_GATTS_EVT_HVN_TX_COMPLETE;
+    buf.evt.evt.gatts_evt.conn_handle = SIM_CONN_HANDLE;
+    buf.evt.evt.gatts_evt.params.hvn_tx_complete.count = hvn_done;
+    _sim_sd_dispatch(&buf.evt);
+  }
+
+  // Released in order, one event per SDU
+  for (uint16_t i = 0; i < sdus_done; i++)
+  {
+    _sim_evt_buf_t buf;
+    _sim_sdu_t const *sdu = &_sim_l2cap_sdus[_sim_l2cap_head];
+
+    memset(&buf, 0, sizeof(buf));
+    buf.evt.header.evt_id = BLE_L2CAP_EVT_CH_TX;
+    buf.evt.evt.l2cap_evt.conn_handle = SIM_CONN_HANDLE;
+    buf.evt.evt.l2cap_evt.local_cid = SIM_L2CAP_CID;
+    buf.evt.evt.l2cap_evt.params.tx.sdu_buf.p_data = (uint8_t *)sdu->data;
+    buf.evt.evt.l2cap_evt.params.tx.sdu_buf.len = sdu->length;
+
+    _sim_l2cap_head = (_sim_l2cap_head + 1) % SIM_MAX_L2CAP_QUEUE;
+    _sim_l2cap_count--;
+
+    _sim_sd_dispatch(&buf.evt);
+  }
+}
+
+static void _sim_sd_run_timers(void)
+{
+  bool fired = true;
+
+  // In the order they expire, a handler may start or stop timers
+  while (fired)
+  {
+    app_timer_t *next = NULL;
+
+    for (app_timer_t *timer = _sim_timers; timer != NULL; timer = timer->next)
+    {
+      if (timer->active && ((next == NULL) || (timer->expiry < next->expiry))) next = timer;
+    }
+
+    fired = (next != NULL) && (_sim_ticks_to_ns(next->expiry) <= sim_now());
+    if (!fired) break;
+
+    if (next->mode == APP_TIMER_MODE_REPEATED) next->expiry += next->period;
+    else next->active = false;
+
+    next->handler(next->p_context);
+  }
+}
+
+uint64_t sim_sd_next_event(void)
+{
+  uint64_t next = _sim_next_conn_event;
+
+  for (app_timer_t *timer = _sim_timers; timer != NULL; timer = timer->next)
+  {
+    if (timer->active) next = MIN(next, _sim_ticks_to_ns(timer->expiry));
+  }
+
+  return MIN(next, _sim_conn_params_check_at);
+}
+
+void sim_sd_run(void)
+{
+  _sim_sd_run_timers();
+
+  // The preferred connection parameters are requested if the central chose others
+  if (sim_now() >= _sim_conn_params_check_at)
+  {
+    _sim_conn_params_check_at = SIM_NEVER;
+
+    uint16_t interval = _sim_interval_units();
+    if ((interval < _sim_ppcp.min_conn_interval) || (interval > _sim_ppcp.max_conn_interval))
+    {
+      APP_ERROR_CHECK(sd_ble_gap_conn_param_update(SIM_CONN_HANDLE, &_sim_ppcp));
+    }
+  }
+
+  if (sim_now() >= _sim_next_conn_event) _sim_sd_conn_event();
+}
+
+bool sim_sd_is_advertising(void)
+{
+  return (_sim_advertising != NULL) && _sim_advertising->advertising;
+}
+
+void sim_sd_connect(void)
+{
+  _sim_evt_buf_t buf;
+
+  _sim_advertising->advertising = false;
+  _sim_rand_state = ((uint64_t)sim_params.seed << 1) | 1;
+
+  _sim_conn_handle = SIM_CONN_HANDLE;
+  _sim_connected_at = sim_now();
+  _sim_interval_ns = (uint64_t)(sim_params.interval_ms * 1000.0 / UNIT_1_25_MS + 0.5) * UNIT_1_25_MS * SIM_NS_PER_US;
+  _sim_next_conn_event = sim_now() + _sim_interval_ns;
+  _sim_conn_event_count = 0;
+  _sim_phy = 1;
+  _sim_mtu_exchanged = false;
+  sim_stats.interval_ms = _sim_interval_ns / (double)SIM_NS_PER_MS;
+
+  if (_sim_conn_params_init.first_conn_params_update_delay > 0)
+  {
+    _sim_conn_params_check_at = sim_now() + _sim_ticks_to_ns(_sim_conn_params_init.first_conn_params_update_delay);
+  }
+
+  memset(&buf, 0, sizeof(buf));
+  buf.evt.header.evt_id = BLE_GAP_EVT_CONNECTED;
+  buf.evt.evt.gap_evt.conn_handle = SIM_CONN_HANDLE;
+  buf.evt.evt.gap_evt.params.connected.conn_params.min_conn_interval = _sim_interval_units();
+  buf.evt.evt.gap_evt.params.connected.conn_params.max_conn_interval = _sim_interval_units();
+  _sim_sd_dispatch(&buf.evt);
+}
+
+void sim_sd_write(uint8_t const *data, uint16_t length)
+{
+  if ((_sim_writes_count >= SIM_MAX_WRITES) || (length > WULPUS_BLE_MAX_DATA_LEN))
+  {
+    fprintf(stderr, "sim: control write of %u bytes dropped\n", length);
+    return;
+  }
+
+  _sim_write_t *write = &_sim_writes[(_sim_writes_head + _sim_writes_count) % SIM_MAX_WRITES];
+  memcpy(write->data, data, length);
+  write->length = length;
+  _sim_writes_count++;
+}
+
+void sim_sd_l2cap_request(void)
+{
+  _sim_evt_buf_t buf;
+
+  memset(&buf, 0, sizeof(buf));
+  buf.evt.header.evt_id = BLE_L2CAP_EVT_CH_SETUP_REQUEST;
+  buf.evt.evt.l2cap_evt.conn_handle = SIM_CONN_HANDLE;
+  buf.evt.evt.l2cap_evt.local_cid = SIM_L2CAP_CID;
+  buf.evt.evt.l2cap_evt.params.ch_setup_request.le_psm = WULPUS_L2CAP_PSM;
+  buf.evt.evt.l2cap_evt.params.ch_setup_request.tx_params.tx_mtu = SIM_L2CAP_HOST_MTU;
+  buf.evt.evt.l2cap_evt.params.ch_setup_request.tx_params.peer_mps = SIM_L2CAP_HOST_MPS;
+  buf.evt.evt.l2cap_evt.params.ch_setup_request.tx_params.credits = SIM_L2CAP_CREDITS;
+  _sim_sd_dispatch(&buf.evt);
+}
+
+size_t sim_sd_hvn_queued(void)
+{
+  return _sim_hvn_count;
+}
+
+size_t sim_sd_l2cap_queued(void)
+{
+  return _sim_l2cap_count;
+}
+
+// SoftDevice
+// ------------------------------------------------------
+ret_code_t sd_ble_cfg_set(uint32_t cfg_id, ble_cfg_t const *p_cfg, uint32_t app_ram_base)
+{
+  UNUSED_PARAMETER(app_ram_base);
+
+  if (cfg_id == BLE_CONN_CFG_GATTS)
+  {
+    _sim_hvn_queue_size = p_cfg->conn_cfg.params.gatts_conn_cfg.hvn_tx_queue_size;
+    if (sim_params.hvn_queue != 0) _sim_hvn_queue_size = (uint8_t)sim_params.hvn_queue;
+    if (_sim_hvn_queue_size > SIM_MAX_HVN_QUEUE) return NRF_ERROR_NO_MEM;
+  }
+  else if (cfg_id == BLE_CONN_CFG_L2CAP)
+  {
+    _sim_l2cap_tx_mps = p_cfg->conn_cfg.params.l2cap_conn_cfg.tx_mps;
+    _sim_l2cap_tx_queue_size = p_cfg->conn_cfg.params.l2cap_conn_cfg.tx_queue_size;
+    if (_sim_l2cap_tx_queue_size > SIM_MAX_L2CAP_QUEUE) return NRF_ERROR_NO_MEM;
+  }
+
+  return NRF_SUCCESS;
+}
+
+ret_code_t sd_ble_uuid_vs_add(ble_uuid128_t const *p_vs_uuid, uint8_t *p_uuid_type)
+{
+  UNUSED_PARAMETER(p_vs_uuid);
+
+  *p_uuid_type = 2;  // BLE_UUID_TYPE_VENDOR_BEGIN
+  return NRF_SUCCESS;
+}
+
+ret_code_t sd_power_system_off(void)
+{
+  fprintf(stderr, "sim: advertising timed out, system off\n");
+  exit(EXIT_FAILURE);
+}
+
+ret_code_t sd_ble_gap_device_name_set(ble_gap_conn_sec_mode_t const *p_write_perm, uint8_t const *p_dev_name,
+                                      uint16_t len)
+{
+  UNUSED_PARAMETER(p_write_perm);
+  UNUSED_PARAMETER(p_dev_name);
+  UNUSED_PARAMETER(len);
+
+  return NRF_SUCCESS;
+}
+
+ret_code_t sd_ble_gap_ppcp_set(ble_gap_conn_params_t const *p_conn_params)
+{
+  _sim_ppcp = *p_conn_params;
+  return NRF_SUCCESS;
+}
+
+ret_code_t sd_ble_gap_conn_param_update(uint16_t conn_handle, ble_gap_conn_params_t const *p_conn_params)
+{
+  if (conn_handle != _sim_conn_handle) return BLE_ERROR_INVALID_CONN_HANDLE;
+  if ((p_conn_params == NULL) || (p_conn_params->min_conn_interval > p_conn_params->max_conn_interval))
+  {
+    return NRF_ERROR_INVALID_PARAM;
+  }
+  if (_sim_conn_update_interval != 0) return NRF_ERROR_BUSY;
+
+  uint16_t interval = _sim_central_interval(p_conn_params->min_conn_interval, p_conn_params->max_conn_interval);
+  if (interval == _sim_interval_units()) return NRF_SUCCESS;
+
+  // Takes effect at an instant a few connection events ahead
+  _sim_conn_update_interval = interval;
+  _sim_conn_update_event = _sim_conn_event_count + SIM_CONN_UPDATE_EVENTS;
+
+  return NRF_SUCCESS;
+}
+
+ret_code_t sd_ble_gap_phy_update(uint16_t conn_handle, ble_gap_phys_t const *p_gap_phys)
+{
+  if (conn_handle != _sim_conn_handle) return BLE_ERROR_INVALID_CONN_HANDLE;
+
+  bool phy_2m = (p_gap_phys->tx_phys == BLE_GAP_PHY_AUTO) || (p_gap_phys->tx_phys & BLE_GAP_PHY_2MBPS);
+  _sim_phy = (phy_2m && (sim_params.phy == 2)) ? 2 : 1;
+
+  return NRF_SUCCESS;
+}
+
+ret_code_t sd_ble_gap_disconnect(uint16_t conn_handle, uint8_t hci_status_code)
+{
+  if (conn_handle != _sim_conn_handle) return BLE_ERROR_INVALID_CONN_HANDLE;
+
+  fprintf(stderr, "sim: disconnected by the firmware (0x%02X)\n", hci_status_code);
+  _sim_sd_disconnect(hci_status_code);
+
+  return NRF_SUCCESS;
+}
+
+ret_code_t sd_ble_gap_sec_params_reply(uint16_t conn_handle, uint8_t sec_status, void const *p_sec_params,
+                                       void const *p_sec_keyset)
+{
+  UNUSED_PARAMETER(conn_handle);
+  UNUSED_PARAMETER(sec_status);
+  UNUSED_PARAMETER(p_sec_params);
+  UNUSED_PARAMETER(p_sec_keyset);
+
+  return NRF_SUCCESS;
+}
+
+ret_code_t sd_ble_gatts_service_add(uint8_t type, ble_uuid_t const *p_uuid, uint16_t *p_handle)
+{
+  UNUSED_PARAMETER(type);
+  UNUSED_PARAMETER(p_uuid);
+
+  *p_handle = _sim_next_handle++;
+  return NRF_SUCCESS;
+}
+
+ret_code_t sd_ble_gatts_hvx(uint16_t conn_handle, ble_gatts_hvx_params_t const *p_hvx_params)
+{
+  if ((conn_handle == BLE_CONN_HANDLE_INVALID) || (conn_handle != _sim_conn_handle))
+  {
+    return BLE_ERROR_INVALID_CONN_HANDLE;
+  }
+
+  uint16_t max_len = (_sim_mtu_exchanged ? MIN(_sim_gatt->att_mtu_desired_periph, sim_params.att_mtu)
+                                         : BLE_GATT_ATT_MTU_DEFAULT) - SIM_ATT_HEADER_LEN;
+  if (*p_hvx_params->p_len > max_len) return NRF_ERROR_DATA_SIZE;
+  if (_sim_hvn_count >= _sim_hvn_queue_size) return NRF_ERROR_RESOURCES;
+
+  // The SoftDevice copies the data
+  _sim_hvn_t *hvn = &_sim_hvn[(_sim_hvn_head + _sim_hvn_count) % SIM_MAX_HVN_QUEUE];
+  hvn->char_uuid = _sim_char_uuid(p_hvx_params->handle);
+  hvn->length = *p_hvx_params->p_len;
+  memcpy(hvn->data, p_hvx_params->p_data, hvn->length);
+  _sim_hvn_count++;
+
+  return NRF_SUCCESS;
+}
+
+// The report reads the telemetry like the host, the notifications may not find room in the queue
+ret_code_t sd_ble_gatts_value_set(uint16_t conn_handle, uint16_t handle, ble_gatts_value_t *p_value)
+{
+  UNUSED_PARAMETER(conn_handle);
+
+  if ((_sim_char_uuid(handle) == SIM_TELEMETRY_CHAR_UUID) && (p_value->offset == 0))
+  {
+    memcpy(sim_stats.telemetry, p_value->p_value, MIN(p_value->len, (uint16_t)WP_BUFFER_STATS_LEN));
+    sim_stats.telemetry_valid = true;
+  }
+
+  return NRF_SUCCESS;
+}
+
+ret_code_t sd_ble_gatts_sys_attr_set(uint16_t conn_handle, uint8_t const *p_sys_attr_data, uint16_t len,
+                                     uint32_t flags)
+{
+  UNUSED_PARAMETER(conn_handle);
+  UNUSED_PARAMETER(p_sys_attr_data);
+  UNUSED_PARAMETER(len);
+  UNUSED_PARAMETER(flags);
+
+  return NRF_SUCCESS;
+}
+
+ret_code_t sd_ble_l2cap_ch_setup(uint16_t conn_handle, uint16_t *p_local_cid,
+                                 ble_l2cap_ch_setup_params_t const *p_params)
+{
+  if (conn_handle != _sim_conn_handle) return BLE_ERROR_INVALID_CONN_HANDLE;
+  if (_sim_l2cap_tx_queue_size == 0) return NRF_ERROR_NO_MEM;
+
+  if (p_params->status == BLE_L2CAP_CH_STATUS_CODE_SUCCESS)
+  {
+    *p_local_cid = SIM_L2CAP_CID;
+    _sim_l2cap_setup_pending = true;
+  }
+  else
+  {
+    fprintf(stderr, "sim: L2CAP channel refused (0x%04X)\n", p_params->status);
+  }
+
+  return NRF_SUCCESS;
+}
+
+ret_code_t sd_ble_l2cap_ch_tx(uint16_t conn_handle, uint16_t local_cid, ble_data_t const *p_sdu_buf)
+{
+  if (conn_handle != _sim_conn_handle) return BLE_ERROR_INVALID_CONN_HANDLE;
+  if (!_sim_l2cap_open || (local_cid != SIM_L2CAP_CID)) return NRF_ERROR_INVALID_STATE;
+  if (p_sdu_buf->len > SIM_L2CAP_HOST_MTU) return NRF_ERROR_INVALID_PARAM;
+  if (_sim_l2cap_count >= _sim_l2cap_tx_queue_size) return NRF_ERROR_RESOURCES;
+
+  // Not copied, the firmware keeps the buffer until BLE_L2CAP_EVT_CH_TX
+  _sim_sdu_t *sdu = &_sim_l2cap_sdus[(_sim_l2cap_head + _sim_l2cap_count) % SIM_MAX_L2CAP_QUEUE];
+  sdu->data = p_sdu_buf->p_data;
+  sdu->length = p_sdu_buf->len;
+  _sim_l2cap_count++;
+
+  return NRF_SUCCESS;
+}
+
+// SDK libraries
+// ------------------------------------------------------
+ret_code_t nrf_sdh_enable_request(void)
+{
+  return NRF_SUCCESS;
+}
+
+ret_code_t nrf_sdh_ble_default_cfg_set(uint8_t conn_cfg_tag, uint32_t *p_ram_start)
+{
+  UNUSED_PARAMETER(conn_cfg_tag);
+
+  *p_ram_start = 0x20000000;
+  return NRF_SUCCESS;
+}
+
+ret_code_t nrf_sdh_ble_enable(uint32_t *p_app_ram_start)
+{
+  UNUSED_PARAMETER(p_app_ram_start);
+
+  return NRF_SUCCESS;
+}
+
+ret_code_t nrf_ble_gatt_init(nrf_ble_gatt_t *p_gatt, nrf_ble_gatt_evt_handler_t evt_handler)
+{
+  p_gatt->att_mtu_desired_periph = BLE_GATT_ATT_MTU_DEFAULT;
+  p_gatt->att_mtu_desired_central = BLE_GATT_ATT_MTU_DEFAULT;
+  p_gatt->evt_handler = evt_handler;
+  _sim_gatt = p_gatt;
+
+  return NRF_SUCCESS;
+}
+
+ret_code_t nrf_ble_gatt_att_mtu_periph_set(nrf_ble_gatt_t *p_gatt, uint16_t desired_mtu)
+{
+  p_gatt->att_mtu_desired_periph = desired_mtu;
+  return NRF_SUCCESS;
+}
+
+ret_code_t nrf_ble_qwr_init(nrf_ble_qwr_t *p_qwr, nrf_ble_qwr_init_t const *p_qwr_init)
+{
+  p_qwr->conn_handle = BLE_CONN_HANDLE_INVALID;
+  p_qwr->error_handler = p_qwr_init->error_handler;
+
+  return NRF_SUCCESS;
+}
+
+ret_code_t nrf_ble_qwr_conn_handle_assign(nrf_ble_qwr_t *p_qwr, uint16_t conn_handle)
+{
+  p_qwr->conn_handle = conn_handle;
+  return NRF_SUCCESS;
+}
+
+ret_code_t characteristic_add(uint16_t service_handle, ble_add_char_params_t *p_char_props,
+                              ble_gatts_char_handles_t *p_char_handle)
+{
+  UNUSED_PARAMETER(service_handle);
+
+  if (_sim_chars_num >= SIM_MAX_CHARS) return NRF_ERROR_NO_MEM;
+
+  memset(p_char_handle, 0, sizeof(*p_char_handle));
+  _sim_next_handle++;  // Declaration
+  p_char_handle->value_handle = _sim_next_handle++;
+  if (p_char_props->char_props.notify) p_char_handle->cccd_handle = _sim_next_handle++;
+
+  _sim_chars[_sim_chars_num].value_handle = p_char_handle->value_handle;
+  _sim_chars[_sim_chars_num].uuid = p_char_props->uuid;
+  _sim_chars_num++;
+
+  return NRF_SUCCESS;
+}
+
+ret_code_t ble_advertising_init(ble_advertising_t *p_advertising, ble_advertising_init_t const *p_init)
+{
+  p_advertising->evt_handler = p_init->evt_handler;
+  p_advertising->advertising = false;
+  _sim_advertising = p_advertising;
+
+  return NRF_SUCCESS;
+}
+
+void ble_advertising_conn_cfg_tag_set(ble_advertising_t *p_advertising, uint8_t ble_cfg_tag)
+{
+  p_advertising->conn_cfg_tag = ble_cfg_tag;
+}
+
+ret_code_t ble_advertising_start(ble_advertising_t *p_advertising, ble_adv_mode_t advertising_mode)
+{
+  p_advertising->advertising = (advertising_mode != BLE_ADV_MODE_IDLE);
+  if (p_advertising->advertising && (p_advertising->evt_handler != NULL)) p_advertising->evt_handler(BLE_ADV_EVT_FAST);
+
+  return NRF_SUCCESS;
+}
+
+ret_code_t ble_conn_params_init(ble_conn_params_init_t const *p_init)
+{
+  _sim_conn_params_init = *p_init;
+  if (p_init->p_conn_params != NULL) _sim_ppcp = *p_init->p_conn_params;
+
+  return NRF_SUCCESS;
+}
+
+ret_code_t ble_conn_params_change_conn_params(uint16_t conn_handle, ble_gap_conn_params_t *p_new_params)
+{
+  _sim_ppcp = *p_new_params;
+  return sd_ble_gap_conn_param_update(conn_handle, p_new_params);
+}
+
+// App timer (RTC1)
+// ------------------------------------------------------
+ret_code_t app_timer_init(void)
+{
+  return NRF_SUCCESS;
+}
+
+ret_code_t app_timer_create(app_timer_id_t const *p_timer_id, app_timer_mode_t mode,
+                            app_timer_timeout_handler_t timeout_handler)
+{
+  app_timer_t *timer = *p_timer_id;
+
+  if (timeout_handler == NULL) return NRF_ERROR_INVALID_PARAM;
+
+  memset(timer, 0, sizeof(*timer));
+  timer->handler = timeout_handler;
+  timer->mode = mode;
+  timer->next = _sim_timers;
+  _sim_timers = timer;
+
+  return NRF_SUCCESS;
+}
+
+ret_code_t app_timer_start(app_timer_id_t timer_id, uint32_t timeout_ticks, void *p_context)
+{
+  if ((timeout_ticks < APP_TIMER_MIN_TIMEOUT_TICKS) || (timer_id->handler == NULL)) return NRF_ERROR_INVALID_PARAM;
+
+  timer_id->p_context = p_context;
+  timer_id->period = timeout_ticks;
+  timer_id->expiry = _sim_now_ticks() + timeout_ticks;
+  timer_id->active = true;
+
+  return NRF_SUCCESS;
+}
+
+ret_code_t app_timer_stop(app_timer_id_t timer_id)
+{
+  timer_id->active = false;
+  return NRF_SUCCESS;
+}
+
+uint32_t app_timer_cnt_get(void)
+{
+  return (uint32_t)(_sim_now_ticks() & APP_TIMER_MAX_CNT_VAL);
+}
+
+// Logging and errors
+// ------------------------------------------------------
+void sim_log(int level, char const *module, char const *format, ...)
+{
+  static char const *const levels[] = { "", "error", "warning", "info", "debug" };
+  va_list args;
+
+  if (level > sim_log_level) return;
+
+  fprintf(stderr, "%10.3f ms <%s> %s: ", sim_now() / (double)SIM_NS_PER_MS, levels[level], module);
+  va_start(args, format);
+  vfprintf(stderr, format, args);
+  va_end(args);
+  fputc('\n', stderr);
+}
+
+void app_error_handler(ret_code_t error_code, uint32_t line_num, uint8_t const *p_file_name)
+{
+  fprintf(stderr, "sim: fatal error 0x%04X at %s:%u (%.3f ms)\n", error_code, (char const *)p_file_name, line_num,
+          sim_now() / (double)SIM_NS_PER_MS);
+  exit(EXIT_FAILURE);
+}
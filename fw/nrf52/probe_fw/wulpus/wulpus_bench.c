@@ -0,0 +1,169 @@
+#include "wulpus_bench.h"
+
+#include <string.h>
+
+#include "nordic_common.h"
+#include "app_timer.h"
+
+#include "wulpus_config.h"
+
+#define NRF_LOG_MODULE_NAME wp_bench
+#define NRF_LOG_LEVEL       4
+#define NRF_LOG_INFO_COLOR  0
+#define NRF_LOG_DEBUG_COLOR 5
+#include "nrf_log.h"
+NRF_LOG_MODULE_REGISTER();
+
+
+#define BENCH_MAX_FRAME_LEN   (WULPUS_FRAME_HEADER_LEN + 2 * WULPUS_FRAME_NUM_SAMPLES)
+#define BENCH_IDX_LENGTH      2
+#define BENCH_IDX_SEQ         4
+#define BENCH_IDX_TIME        8
+
+APP_TIMER_DEF(_wp_bench_timer);
+
+wp_bench_tick_handler_t _wp_bench_tick_handler = NULL;
+
+// Settings received from the host
+bool _wp_bench_enabled = false;
+uint32_t _wp_bench_period_ticks = 0;
+uint16_t _wp_bench_frame_len = 0;
+uint32_t _wp_bench_num_frames = 0;
+
+// Written from the app timer interrupt only
+uint32_t _wp_bench_seq = 0;
+bool _wp_bench_running = false;
+
+
+static inline void _wp_bench_put_u16(uint8_t *dst, uint16_t value)
+{
+  dst[0] = (uint8_t)value;
+  dst[1] = (uint8_t)(value >> 8);
+}
+
+static inline void _wp_bench_put_u32(uint8_t *dst, uint32_t value)
+{
+  _wp_bench_put_u16(dst, (uint16_t)value);
+  _wp_bench_put_u16(dst + 2, (uint16_t)(value >> 16));
+}
+
+static inline uint32_t _wp_bench_get_u32(uint8_t const *src)
+{
+  return (uint32_t)src[0] | ((uint32_t)src[1] << 8) | ((uint32_t)src[2] << 16) | ((uint32_t)src[3] << 24);
+}
+
+static void _wp_bench_stop(void)
+{
+  if (!_wp_bench_running) return;
+
+  APP_ERROR_CHECK(app_timer_stop(_wp_bench_timer));
+  _wp_bench_running = false;
+
+  NRF_LOG_INFO("Stopped after %u frames", _wp_bench_seq);
+}
+
+static void _wp_bench_timer_handler(void *p_context)
+{
+  UNUSED_PARAMETER(p_context);
+
+  if ((_wp_bench_num_frames != 0) && (_wp_bench_seq >= _wp_bench_num_frames))
+  {
+    _wp_bench_stop();
+    return;
+  }
+
+  // Calls wp_bench_generate()
+  if (_wp_bench_tick_handler != NULL) _wp_bench_tick_handler();
+}
+
+ret_code_t wp_bench_init(wp_bench_tick_handler_t handler)
+{
+  _wp_bench_tick_handler = handler;
+
+  return app_timer_create(&_wp_bench_timer, APP_TIMER_MODE_REPEATED, _wp_bench_timer_handler);
+}
+
+bool wp_bench_is_conf_packet(uint8_t const *data, uint16_t length)
+{
+  return (length >= WP_BENCH_CONF_PACKET_LEN) && (data[0] == WULPUS_BENCH_CONF_PACKET);
+}
+
+ret_code_t wp_bench_configure(uint8_t const *data, uint16_t length)
+{
+  if (!wp_bench_is_conf_packet(data, length)) return NRF_ERROR_INVALID_PARAM;
+
+  uint32_t period_us = _wp_bench_get_u32(data + 2);
+  uint16_t frame_len = (uint16_t)(data[6] | (data[7] << 8));
+
+  // Period in app timer ticks (RTC1 with the prescaler of the SDK config)
+  uint64_t period_ticks = ROUNDED_DIV((uint64_t)period_us * APP_TIMER_CLOCK_FREQ,
+                                      1000000ull * (APP_TIMER_CONFIG_RTC_FREQUENCY + 1));
+
+  if ((frame_len < WP_BENCH_HEADER_LEN) || (frame_len > BENCH_MAX_FRAME_LEN)) return NRF_ERROR_INVALID_PARAM;
+  if ((period_ticks < APP_TIMER_MIN_TIMEOUT_TICKS) || (period_ticks > UINT32_MAX)) return NRF_ERROR_INVALID_PARAM;
+
+  // The next benchmark is started by the main loop once the buffers are reset
+  _wp_bench_stop();
+
+  _wp_bench_enabled = (data[1] != 0);
+  _wp_bench_period_ticks = (uint32_t)period_ticks;
+  _wp_bench_frame_len = frame_len;
+  _wp_bench_num_frames = _wp_bench_get_u32(data + 8);
+
+  NRF_LOG_INFO("Configured: enabled %u, period %u ticks, frame length %u, frames %u",
+               _wp_bench_enabled, _wp_bench_period_ticks, _wp_bench_frame_len, _wp_bench_num_frames);
+
+  return NRF_SUCCESS;
+}
+
+void wp_bench_disable(void)
+{
+  _wp_bench_enabled = false;
+  _wp_bench_stop();
+}
+
+bool wp_bench_is_enabled(void)
+{
+  return _wp_bench_enabled;
+}
+
+ret_code_t wp_bench_start(void)
+{
+  if (!_wp_bench_enabled || _wp_bench_running) return NRF_SUCCESS;
+
+  _wp_bench_seq = 0;
+
+  WP_ERR_RET(app_timer_start(_wp_bench_timer, _wp_bench_period_ticks, NULL));
+  _wp_bench_running = true;
+
+  return NRF_SUCCESS;
+}
+
+uint16_t wp_bench_generate(uint8_t *frame)
+{
+  uint32_t seq = _wp_bench_seq++;
+
+  frame[0] = WULPUS_BENCH_START_OF_FRAME;
+  frame[1] = 0;
+  _wp_bench_put_u16(frame + BENCH_IDX_LENGTH, _wp_bench_frame_len);
+  _wp_bench_put_u32(frame + BENCH_IDX_SEQ, seq);
+  _wp_bench_put_u32(frame + BENCH_IDX_TIME, app_timer_cnt_get());
+
+  // Known pattern, lets the host detect corrupted frames
+  for (uint16_t i = WP_BENCH_HEADER_LEN; i < _wp_bench_frame_len; i++)
+  {
+    frame[i] = (uint8_t)(seq + i);
+  }
+
+  return _wp_bench_frame_len;
+}
+
+bool wp_bench_is_frame(uint8_t const *frame)
+{
+  return frame[0] == WULPUS_BENCH_START_OF_FRAME;
+}
+
+uint16_t wp_bench_frame_length(uint8_t const *frame)
+{
+  return (uint16_t)(frame[BENCH_IDX_LENGTH] | (frame[BENCH_IDX_LENGTH + 1] << 8));
+}
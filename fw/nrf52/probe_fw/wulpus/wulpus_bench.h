@@ -0,0 +1,34 @@
+#ifndef __WULPUS_BENCH__
+#define __WULPUS_BENCH__
+
+#include <stdint.h>
+
+#include "wulpus_common.h"
+
+// Benchmark settings packet (sent by the host, consumed by the nRF52)
+// [0] WULPUS_BENCH_CONF_PACKET, [1] enable, [2-5] frame period in us,
+// [6-7] frame length in bytes (header included), [8-11] number of frames (0: until disabled)
+#define WP_BENCH_CONF_PACKET_LEN 12
+
+// Synthetic frame, replaces the US frame of the MSP430 while the benchmark runs
+// [0] WULPUS_BENCH_START_OF_FRAME, [1] reserved, [2-3] frame length,
+// [4-7] sequence number, [8-11] generation time in app timer ticks (24 bit)
+// Byte i of the payload (i counted from the start of the frame) is (sequence number + i) & 0xFF
+#define WP_BENCH_HEADER_LEN      12
+
+typedef void (*wp_bench_tick_handler_t)(void);
+
+ret_code_t wp_bench_init(wp_bench_tick_handler_t handler);
+
+bool wp_bench_is_conf_packet(uint8_t const *data, uint16_t length);
+ret_code_t wp_bench_configure(uint8_t const *data, uint16_t length);
+void wp_bench_disable(void);
+bool wp_bench_is_enabled(void);
+ret_code_t wp_bench_start(void);
+
+uint16_t wp_bench_generate(uint8_t *frame);
+
+bool wp_bench_is_frame(uint8_t const *frame);
+uint16_t wp_bench_frame_length(uint8_t const *frame);
+
+#endif // __WULPUS_BENCH__
@@ -9,10 +9,11 @@
 #include "nrf_sdh_ble.h"
 #include "nrf_ble_gatt.h"
 #include "nrf_ble_qwr.h"
-#include "ble_nus.h"
+#include "ble_srv_common.h"
 #include "app_timer.h"
 
 #include "wulpus_config.h"
+#include "wulpus_l2cap.h"
 
 #define NRF_LOG_MODULE_NAME wp_ble
 #define NRF_LOG_LEVEL       4
@@ -23,12 +24,16 @@ NRF_LOG_MODULE_REGISTER();
 
 #define APP_BLE_CONN_CFG_TAG            1                                                         /**< A tag identifying the SoftDevice BLE configuration. */
 
-#define NUS_SERVICE_UUID_TYPE           BLE_UUID_TYPE_VENDOR_BEGIN                                /**< UUID type for the Nordic UART Service (vendor specific). */
+// WULPUS service 57550001-4C50-5553-A1B2-C3D4E5F60718 (little endian, bytes 12-13 hold the 16-bit UUIDs)
+#define WULPUS_BASE_UUID                {{0x18, 0x07, 0xF6, 0xE5, 0xD4, 0xC3, 0xB2, 0xA1, 0x53, 0x55, 0x50, 0x4C, 0x00, 0x00, 0x55, 0x57}}
+#define WULPUS_SERVICE_UUID             0x0001                                                    /**< UUID of the WULPUS service. */
+#define WULPUS_DATA_CHAR_UUID           0x0002                                                    /**< Bulk data (notify): stream of the frames. */
+#define WULPUS_CONTROL_CHAR_UUID        0x0003                                                    /**< Commands and configurations (write with response). */
+#define WULPUS_TELEMETRY_CHAR_UUID      0x0004                                                    /**< Frame buffer statistics (read, notify). */
 
 #define APP_BLE_OBSERVER_PRIO           3                                                         /**< Application's BLE observer priority. You shouldn't need to modify this value. */
 
-#define MIN_CONN_INTERVAL               MSEC_TO_UNITS(WULPUS_BLE_MIN_CONN_INTERVAL, UNIT_1_25_MS) /**< Minimum acceptable connection interval (7.5 ms), Connection interval uses 1.25 ms units. */
-#define MAX_CONN_INTERVAL               MSEC_TO_UNITS(WULPUS_BLE_MAX_CONN_INTERVAL, UNIT_1_25_MS) /**< Maximum acceptable connection interval (7.5 ms), Connection interval uses 1.25 ms units. */
+#define MIN_CONN_INTERVAL               MSEC_TO_UNITS(WULPUS_BLE_MIN_CONN_INTERVAL, UNIT_1_25_MS) /**< Connection interval until the data rate is known (7.5 ms), Connection interval uses 1.25 ms units. */
 #define SLAVE_LATENCY                   WULPUS_BLE_SLAVE_LATENCY                                  /**< Slave latency. */
 #define CONN_SUP_TIMEOUT                MSEC_TO_UNITS(4000, UNIT_10_MS)                           /**< Connection supervisory timeout (4 seconds), Supervision Timeout uses 10 ms units. */
 #define FIRST_CONN_PARAMS_UPDATE_DELAY  APP_TIMER_TICKS(400)                                      /**< Time from initiating event to the first connection parameter update (400 ms). */
@@ -41,40 +46,112 @@ size_t _wp_ble_data_handlers_num = 0;
 wp_ble_conn_handler_t _wp_ble_conn_handlers[WULPUS_BLE_MAX_CONN_HANDLERS];
 size_t _wp_ble_conn_handlers_num = 0;
 
-BLE_NUS_DEF(m_nus, NRF_SDH_BLE_TOTAL_LINK_COUNT);                                   /**< BLE NUS service instance. */
+// Notifications waiting for room in the SoftDevice queue (only accessed from the main loop)
+typedef struct
+{
+  uint8_t *data;
+  uint16_t length;
+} _wp_ble_tx_item_t;
+
+_wp_ble_tx_item_t _wp_ble_tx_queue[WULPUS_BLE_TX_QUEUE_LEN];
+size_t _wp_ble_tx_head = 0;
+size_t _wp_ble_tx_tail = 0;
+volatile uint32_t _wp_ble_tx_rdy_count = 0; // BLE_GATTS_EVT_HVN_TX_COMPLETE events (and connection changes)
+uint32_t _wp_ble_tx_blocked_at = 0;         // _wp_ble_tx_rdy_count when the SoftDevice queue was full
+bool _wp_ble_tx_blocked = false;
+
 NRF_BLE_GATT_DEF(m_gatt);                                                           /**< GATT module instance. */
 NRF_BLE_QWR_DEF(m_qwr);                                                             /**< Context for the Queued Write module.*/
 BLE_ADVERTISING_DEF(m_advertising);                                                 /**< Advertising module instance. */
 
 static uint16_t   m_conn_handle          = BLE_CONN_HANDLE_INVALID;                 /**< Handle of the current connection. */
-static uint16_t   m_ble_nus_max_data_len = BLE_GATT_ATT_MTU_DEFAULT - 3;            /**< Maximum length of data (in bytes) that can be transmitted to the peer by the Nordic UART service module. */
-static ble_uuid_t m_adv_uuids[]          =                                          /**< Universally unique service identifier. */
-{
-    {BLE_UUID_NUS_SERVICE, NUS_SERVICE_UUID_TYPE}
-};
+static uint16_t   m_ble_max_data_len     = BLE_GATT_ATT_MTU_DEFAULT - 3;            /**< Maximum length of data (in bytes) that can be notified to the peer. */
+static uint8_t    m_wulpus_uuid_type;                                               /**< UUID type of the WULPUS base UUID (vendor specific). */
+static uint16_t   m_wulpus_service_handle;                                          /**< Handle of the WULPUS service. */
+static ble_gatts_char_handles_t m_data_handles;                                     /**< Handles of the data characteristic. */
+static ble_gatts_char_handles_t m_control_handles;                                  /**< Handles of the control characteristic. */
+static ble_gatts_char_handles_t m_telemetry_handles;                                /**< Handles of the telemetry characteristic. */
+static ble_uuid_t m_adv_uuids[1];                                                   /**< Universally unique service identifier (set once the base UUID is registered). */
 
 
-static void _wp_ble_nus_handler(ble_nus_evt_t *p_evt)
+static void _wp_ble_on_write(ble_gatts_evt_write_t const *p_evt_write)
 {
+    // Writes to the CCCDs are handled by the SoftDevice
+    if (p_evt_write->handle != m_control_handles.value_handle) return;
 
-    if (p_evt->type == BLE_NUS_EVT_RX_DATA)
-    {
-        NRF_LOG_INFO("Received %u bytes from NUS", p_evt->params.rx_data.length);
-        // NRF_LOG_HEXDUMP_INFO(p_evt->params.rx_data.p_data, p_evt->params.rx_data.length);
+    NRF_LOG_INFO("Received %u bytes on the control characteristic", p_evt_write->len);
+    // NRF_LOG_HEXDUMP_INFO(p_evt_write->data, p_evt_write->len);
 
-        for (size_t i = 0; i < _wp_ble_data_handlers_num; i++)
-        {
-          _wp_ble_data_handlers[i](p_evt->params.rx_data.p_data, p_evt->params.rx_data.length);
-        }
+    for (size_t i = 0; i < _wp_ble_data_handlers_num; i++)
+    {
+      _wp_ble_data_handlers[i](p_evt_write->data, p_evt_write->len);
     }
+}
 
+static ret_code_t _wp_ble_service_init(void)
+{
+  ble_uuid128_t base_uuid = WULPUS_BASE_UUID;
+  ble_uuid_t    service_uuid;
+
+  WP_ERR_RET(sd_ble_uuid_vs_add(&base_uuid, &m_wulpus_uuid_type));
+
+  service_uuid.type = m_wulpus_uuid_type;
+  service_uuid.uuid = WULPUS_SERVICE_UUID;
+
+  WP_ERR_RET(sd_ble_gatts_service_add(BLE_GATTS_SRVC_TYPE_PRIMARY, &service_uuid, &m_wulpus_service_handle));
+
+  m_adv_uuids[0] = service_uuid;
+
+  ble_add_char_params_t char_params;
+
+  // Data: notifications only, filled up to the MTU by wulpus_stream
+  memset(&char_params, 0, sizeof(char_params));
+  char_params.uuid              = WULPUS_DATA_CHAR_UUID;
+  char_params.uuid_type         = m_wulpus_uuid_type;
+  char_params.max_len           = WULPUS_BLE_MAX_DATA_LEN;
+  char_params.init_len          = 0;
+  char_params.is_var_len        = true;
+  char_params.char_props.notify = 1;
+  char_params.cccd_write_access = SEC_OPEN;
+
+  WP_ERR_RET(characteristic_add(m_wulpus_service_handle, &char_params, &m_data_handles));
+
+  // Control: acknowledged writes, never queued behind the data
+  memset(&char_params, 0, sizeof(char_params));
+  char_params.uuid             = WULPUS_CONTROL_CHAR_UUID;
+  char_params.uuid_type        = m_wulpus_uuid_type;
+  char_params.max_len          = WULPUS_BLE_MAX_DATA_LEN;
+  char_params.init_len         = 0;
+  char_params.is_var_len       = true;
+  char_params.char_props.write = 1;
+  char_params.write_access     = SEC_OPEN;
+
+  WP_ERR_RET(characteristic_add(m_wulpus_service_handle, &char_params, &m_control_handles));
+
+  // Telemetry: readable at any time, notified if the host subscribed
+  memset(&char_params, 0, sizeof(char_params));
+  char_params.uuid              = WULPUS_TELEMETRY_CHAR_UUID;
+  char_params.uuid_type         = m_wulpus_uuid_type;
+  char_params.max_len           = WULPUS_BLE_MAX_TELEMETRY_LEN;
+  char_params.init_len          = 0;
+  char_params.is_var_len        = true;
+  char_params.char_props.read   = 1;
+  char_params.char_props.notify = 1;
+  char_params.read_access       = SEC_OPEN;
+  char_params.cccd_write_access = SEC_OPEN;
+
+  WP_ERR_RET(characteristic_add(m_wulpus_service_handle, &char_params, &m_telemetry_handles));
+
+  return NRF_SUCCESS;
 }
 
 static void _wp_ble_conn_params_handler(ble_conn_params_evt_t *p_evt)
 {
+    // The frames are streamed at any interval (wulpus_link only requests longer ones if the rate allows),
+    // the connection is kept with the parameters of the central
     if (p_evt->evt_type == BLE_CONN_PARAMS_EVT_FAILED)
     {
-        APP_ERROR_CHECK(sd_ble_gap_disconnect(m_conn_handle, BLE_HCI_CONN_INTERVAL_UNACCEPTABLE));
+        NRF_LOG_WARNING("Connection parameters refused by the central");
     }
 }
 
@@ -99,12 +176,17 @@ static void _wp_ble_adv_evt_handler(ble_adv_evt_t ble_adv_evt)
 
 static void _wp_ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_context)
 {
+    UNUSED_PARAMETER(p_context);
+
     switch (p_ble_evt->header.evt_id)
     {
         case BLE_GAP_EVT_CONNECTED:
             NRF_LOG_INFO("Connected");
             m_conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
+            // Until the ATT MTU exchange of this connection completed
+            m_ble_max_data_len = BLE_GATT_ATT_MTU_DEFAULT - 3;
             APP_ERROR_CHECK(nrf_ble_qwr_conn_handle_assign(&m_qwr, m_conn_handle));
+            _wp_ble_tx_rdy_count++;
 
             ble_gap_phys_t const phys =
             {
@@ -124,6 +206,8 @@ static void _wp_ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_context)
             NRF_LOG_INFO("Disconnected");
             // LED indication will be changed when advertising starts.
             m_conn_handle = BLE_CONN_HANDLE_INVALID;
+            // No BLE_GATTS_EVT_HVN_TX_COMPLETE follows, the queued notifications are dropped
+            _wp_ble_tx_rdy_count++;
 
             for (size_t i = 0; i < _wp_ble_conn_handlers_num; i++)
             {
@@ -132,6 +216,13 @@ static void _wp_ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_context)
 
             break;
 
+        case BLE_GAP_EVT_CONN_PARAM_UPDATE:
+        {
+            ble_gap_conn_params_t const *p_params = &p_ble_evt->evt.gap_evt.params.conn_param_update.conn_params;
+            NRF_LOG_INFO("Connection interval %u x 1.25 ms, slave latency %u",
+                         p_params->max_conn_interval, p_params->slave_latency);
+        } break;
+
         case BLE_GAP_EVT_PHY_UPDATE_REQUEST:
         {
             NRF_LOG_DEBUG("PHY update request.");
@@ -148,6 +239,15 @@ static void _wp_ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_context)
             APP_ERROR_CHECK(sd_ble_gap_sec_params_reply(m_conn_handle, BLE_GAP_SEC_STATUS_PAIRING_NOT_SUPP, NULL, NULL));
             break;
 
+        case BLE_GATTS_EVT_WRITE:
+            _wp_ble_on_write(&p_ble_evt->evt.gatts_evt.params.write);
+            break;
+
+        case BLE_GATTS_EVT_HVN_TX_COMPLETE:
+            // The SoftDevice has room again, the main loop refills it (wp_ble_tx_process)
+            _wp_ble_tx_rdy_count++;
+            break;
+
         case BLE_GATTS_EVT_SYS_ATTR_MISSING:
             // No system attributes have been stored.
             APP_ERROR_CHECK(sd_ble_gatts_sys_attr_set(m_conn_handle, NULL, 0, 0));
@@ -175,8 +275,8 @@ void _wp_ble_gatt_evt_handler(nrf_ble_gatt_t *p_gatt, nrf_ble_gatt_evt_t const *
 {
     if ((m_conn_handle == p_evt->conn_handle) && (p_evt->evt_id == NRF_BLE_GATT_EVT_ATT_MTU_UPDATED))
     {
-        m_ble_nus_max_data_len = p_evt->params.att_mtu_effective - OPCODE_LENGTH - HANDLE_LENGTH;
-        NRF_LOG_DEBUG("Data len is set to 0x%X(%d)", m_ble_nus_max_data_len, m_ble_nus_max_data_len);
+        m_ble_max_data_len = p_evt->params.att_mtu_effective - OPCODE_LENGTH - HANDLE_LENGTH;
+        NRF_LOG_DEBUG("Data len is set to 0x%X(%d)", m_ble_max_data_len, m_ble_max_data_len);
     }
     NRF_LOG_DEBUG("ATT MTU exchange completed. central 0x%x peripheral 0x%x",
                   p_gatt->att_mtu_desired_central,
@@ -200,6 +300,16 @@ ret_code_t wp_ble_init(void)
   uint32_t ram_start = 0;
   WP_ERR_RET(nrf_sdh_ble_default_cfg_set(APP_BLE_CONN_CFG_TAG, &ram_start));
 
+  // Room for the notifications of several connection events in the SoftDevice
+  ble_cfg_t ble_cfg;
+  memset(&ble_cfg, 0, sizeof(ble_cfg));
+  ble_cfg.conn_cfg.conn_cfg_tag                            = APP_BLE_CONN_CFG_TAG;
+  ble_cfg.conn_cfg.params.gatts_conn_cfg.hvn_tx_queue_size = WULPUS_BLE_HVN_TX_QUEUE_SIZE;
+  WP_ERR_RET(sd_ble_cfg_set(BLE_CONN_CFG_GATTS, &ble_cfg, ram_start));
+
+  // Connection-oriented channel for the frames (if enabled)
+  WP_ERR_RET(wp_l2cap_cfg_set(APP_BLE_CONN_CFG_TAG, ram_start));
+
   // Enable BLE stack.
   WP_ERR_RET(nrf_sdh_ble_enable(&ram_start));
 
@@ -221,8 +331,9 @@ ret_code_t wp_ble_init(void)
 
   memset(&gap_conn_params, 0, sizeof(gap_conn_params));
 
+  // Shortest interval for the setup of the stream, wulpus_link relaxes it to the data rate
   gap_conn_params.min_conn_interval = MIN_CONN_INTERVAL;
-  gap_conn_params.max_conn_interval = MAX_CONN_INTERVAL;
+  gap_conn_params.max_conn_interval = MIN_CONN_INTERVAL;
   gap_conn_params.slave_latency     = SLAVE_LATENCY;
   gap_conn_params.conn_sup_timeout  = CONN_SUP_TIMEOUT;
 
@@ -240,7 +351,6 @@ ret_code_t wp_ble_init(void)
 
   // Initialize BLE Services
   // ------------------------------------------------------
-  ble_nus_init_t     nus_init;
   nrf_ble_qwr_init_t qwr_init = {0};
 
   // Initialize Queued Write Module.
@@ -248,12 +358,8 @@ ret_code_t wp_ble_init(void)
 
   WP_ERR_RET(nrf_ble_qwr_init(&m_qwr, &qwr_init));
 
-  // Initialize NUS.
-  memset(&nus_init, 0, sizeof(nus_init));
-
-  nus_init.data_handler = _wp_ble_nus_handler;
-
-  WP_ERR_RET(ble_nus_init(&m_nus, &nus_init));
+  // Initialize the WULPUS service (data, control and telemetry characteristics).
+  WP_ERR_RET(_wp_ble_service_init());
 
   NRF_LOG_DEBUG("Initialized BLE services");
 
@@ -341,25 +447,129 @@ ret_code_t wp_ble_advertising_stop(void)
   return NRF_SUCCESS;
 }
 
+uint16_t wp_ble_max_data_len(void)
+{
+  return m_ble_max_data_len;
+}
+
+ret_code_t wp_ble_conn_interval_request(uint16_t min_interval, uint16_t max_interval)
+{
+  if (m_conn_handle == BLE_CONN_HANDLE_INVALID) return NRF_ERROR_INVALID_STATE;
+
+  ble_gap_conn_params_t conn_params =
+  {
+    .min_conn_interval = min_interval,
+    .max_conn_interval = max_interval,
+    .slave_latency     = SLAVE_LATENCY,
+    .conn_sup_timeout  = CONN_SUP_TIMEOUT,
+  };
+
+  // Negotiated by the connection parameters module like the preferred parameters after connecting
+  return ble_conn_params_change_conn_params(m_conn_handle, &conn_params);
+}
+
 ret_code_t wp_ble_transmit(uint8_t *data, uint16_t length)
 {
-  NRF_LOG_DEBUG("Sending %u bytes", length);
+  size_t next = (_wp_ble_tx_head + 1) % WULPUS_BLE_TX_QUEUE_LEN;
+
+  if (next == _wp_ble_tx_tail) return NRF_ERROR_NO_MEM;
+
+  NRF_LOG_DEBUG("Queueing %u bytes", length);
+
+  _wp_ble_tx_queue[_wp_ble_tx_head].data = data;
+  _wp_ble_tx_queue[_wp_ble_tx_head].length = length;
+  _wp_ble_tx_head = next;
+
+  wp_ble_tx_process();
+
+  return NRF_SUCCESS;
+}
+
+void wp_ble_tx_process(void)
+{
   ret_code_t err_code;
-  do
+  uint32_t rdy_count;
+  uint16_t length;
+
+  while (_wp_ble_tx_tail != _wp_ble_tx_head)
   {
-    err_code = ble_nus_data_send(&m_nus, data, &length, m_conn_handle);
-    if (!((err_code == NRF_ERROR_INVALID_STATE) || (err_code == NRF_ERROR_RESOURCES) || (err_code == NRF_ERROR_NOT_FOUND)))
+    // Wait for BLE_GATTS_EVT_HVN_TX_COMPLETE after the SoftDevice queue was full
+    rdy_count = _wp_ble_tx_rdy_count;
+    if (_wp_ble_tx_blocked && (rdy_count == _wp_ble_tx_blocked_at)) return;
+
+    length = _wp_ble_tx_queue[_wp_ble_tx_tail].length;
+
+    ble_gatts_hvx_params_t hvx =
+    {
+      .handle = m_data_handles.value_handle,
+      .type   = BLE_GATT_HVX_NOTIFICATION,
+      .offset = 0,
+      .p_len  = &length,
+      .p_data = _wp_ble_tx_queue[_wp_ble_tx_tail].data,
+    };
+    err_code = sd_ble_gatts_hvx(m_conn_handle, &hvx);
+
+    if (err_code == NRF_ERROR_RESOURCES)
+    {
+      // Retried immediately if the event came in the meantime
+      _wp_ble_tx_blocked = true;
+      _wp_ble_tx_blocked_at = rdy_count;
+      continue;
+    }
+
+    if (!((err_code == NRF_SUCCESS) || (err_code == NRF_ERROR_INVALID_STATE) ||
+          (err_code == BLE_ERROR_INVALID_CONN_HANDLE) || (err_code == BLE_ERROR_GATTS_SYS_ATTR_MISSING)))
     {
       APP_ERROR_CHECK(err_code);
     }
 
-  } while (err_code == NRF_ERROR_RESOURCES);
-  // NRF_LOG_INFO("Sent %u bytes via BLE", length);
+    // Sent, or dropped without connection / enabled notifications (not fatal)
+    _wp_ble_tx_blocked = false;
+    _wp_ble_tx_tail = (_wp_ble_tx_tail + 1) % WULPUS_BLE_TX_QUEUE_LEN;
+  }
+}
+
+ret_code_t wp_ble_telemetry_update(uint8_t const *data, uint16_t length)
+{
+  ble_gatts_value_t value =
+  {
+    .len     = length,
+    .offset  = 0,
+    .p_value = (uint8_t *)data,
+  };
+
+  WP_ERR_RET(sd_ble_gatts_value_set(BLE_CONN_HANDLE_INVALID, m_telemetry_handles.value_handle, &value));
 
-  if ((err_code == NRF_ERROR_INVALID_STATE) ||
-      (err_code == NRF_ERROR_NOT_FOUND)) {
-    return NRF_SUCCESS; // Packet was dropped, but this is not fatal.
+  if (m_conn_handle == BLE_CONN_HANDLE_INVALID) return NRF_SUCCESS;
+
+  ble_gatts_hvx_params_t hvx =
+  {
+    .handle = m_telemetry_handles.value_handle,
+    .type   = BLE_GATT_HVX_NOTIFICATION,
+    .offset = 0,
+    .p_len  = &length,
+    .p_data = data,
+  };
+
+  ret_code_t err_code = sd_ble_gatts_hvx(m_conn_handle, &hvx);
+
+  // Not subscribed, or the SoftDevice queue is full of data: the value can still be read
+  if ((err_code == NRF_ERROR_INVALID_STATE) || (err_code == NRF_ERROR_RESOURCES) ||
+      (err_code == BLE_ERROR_GATTS_SYS_ATTR_MISSING))
+  {
+    return NRF_SUCCESS;
   }
 
   return err_code;
 }
+
+size_t wp_ble_tx_free(void)
+{
+  return (_wp_ble_tx_tail + WULPUS_BLE_TX_QUEUE_LEN - _wp_ble_tx_head - 1) % WULPUS_BLE_TX_QUEUE_LEN;
+}
+
+void wp_ble_tx_flush(void)
+{
+  _wp_ble_tx_tail = _wp_ble_tx_head;
+  _wp_ble_tx_blocked = false;
+}
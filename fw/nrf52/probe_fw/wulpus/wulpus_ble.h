@@ -1,6 +1,8 @@
 #ifndef __WULPUS_BLE__
 #define __WULPUS_BLE__
 
+#include <stddef.h>
+
 #include "wulpus_common.h"
 
 typedef void (*wp_ble_data_handler_t)(uint8_t const *, uint16_t);
@@ -14,6 +16,21 @@ ret_code_t wp_ble_add_conn_handler(wp_ble_conn_handler_t handler);
 ret_code_t wp_ble_advertising_start(void);
 ret_code_t wp_ble_advertising_stop(void);
 
+// Largest notification at the negotiated ATT MTU
+uint16_t wp_ble_max_data_len(void);
+
+// Requests a connection interval from min to max (1.25 ms units) with WULPUS_BLE_SLAVE_LATENCY,
+// NRF_ERROR_BUSY while the last request is negotiated, NRF_ERROR_INVALID_STATE if not connected
+ret_code_t wp_ble_conn_interval_request(uint16_t min_interval, uint16_t max_interval);
+
+// Non-blocking: the notification of the data characteristic is queued and sent as soon as the SoftDevice has room
+// (the data must stay valid until the notification left the queue, see wp_ble_tx_free())
 ret_code_t wp_ble_transmit(uint8_t *data, uint16_t length);
+void wp_ble_tx_process(void);
+size_t wp_ble_tx_free(void);
+void wp_ble_tx_flush(void);
+
+// Sets the value of the telemetry characteristic and notifies it if the host subscribed
+ret_code_t wp_ble_telemetry_update(uint8_t const *data, uint16_t length);
 
 #endif // __WULPUS_BLE__
\ No newline at end of file
@@ -0,0 +1,151 @@
+#include "wulpus_buffer.h"
+
+#include <string.h>
+
+#include "nordic_common.h"
+#include "app_timer.h"
+
+#include "wulpus_ble.h"
+#include "wulpus_config.h"
+
+#define NRF_LOG_MODULE_NAME wp_buffer
+#define NRF_LOG_LEVEL       4
+#define NRF_LOG_INFO_COLOR  0
+#define NRF_LOG_DEBUG_COLOR 5
+#include "nrf_log.h"
+NRF_LOG_MODULE_REGISTER();
+
+
+#define BUFFER_NUM_CONFIGS  16
+
+APP_TIMER_DEF(_wp_buffer_stats_timer);
+
+size_t _wp_buffer_capacity = 0;
+
+// Settings received from the host
+wp_buffer_policy_t _wp_buffer_policy = WULPUS_BUFFER_OVERFLOW_POLICY;
+uint8_t _wp_buffer_decimation = WULPUS_BUFFER_DECIMATION;
+
+// Counters since the last configuration (written from interrupt context and the main loop)
+volatile uint32_t _wp_buffer_frames_in = 0;
+volatile uint32_t _wp_buffer_frames_sent = 0;
+volatile uint32_t _wp_buffer_frames_dropped = 0;
+volatile uint16_t _wp_buffer_high_water = 0;
+volatile uint16_t _wp_buffer_pending = 0;
+uint8_t _wp_buffer_decimation_count[BUFFER_NUM_CONFIGS];
+
+
+static inline void _wp_buffer_put_u16(uint8_t *dst, uint16_t value)
+{
+  dst[0] = (uint8_t)value;
+  dst[1] = (uint8_t)(value >> 8);
+}
+
+static inline void _wp_buffer_put_u32(uint8_t *dst, uint32_t value)
+{
+  _wp_buffer_put_u16(dst, (uint16_t)value);
+  _wp_buffer_put_u16(dst + 2, (uint16_t)(value >> 16));
+}
+
+static void _wp_buffer_stats_timer_handler(void *p_context)
+{
+  UNUSED_PARAMETER(p_context);
+
+  uint8_t stats[WP_BUFFER_STATS_LEN];
+
+  _wp_buffer_put_u32(stats + 0, _wp_buffer_frames_in);
+  _wp_buffer_put_u32(stats + 4, _wp_buffer_frames_sent);
+  _wp_buffer_put_u32(stats + 8, _wp_buffer_frames_dropped);
+  _wp_buffer_put_u16(stats + 12, _wp_buffer_high_water);
+  _wp_buffer_put_u16(stats + 14, _wp_buffer_pending);
+  stats[16] = (uint8_t)_wp_buffer_policy;
+  stats[17] = _wp_buffer_decimation;
+  _wp_buffer_put_u16(stats + 18, (uint16_t)_wp_buffer_capacity);
+
+  // Readable at any time, notified if the host subscribed
+  APP_ERROR_CHECK(wp_ble_telemetry_update(stats, WP_BUFFER_STATS_LEN));
+}
+
+ret_code_t wp_buffer_init(size_t capacity)
+{
+  _wp_buffer_capacity = capacity;
+
+  WP_ERR_RET(app_timer_create(&_wp_buffer_stats_timer, APP_TIMER_MODE_REPEATED, _wp_buffer_stats_timer_handler));
+  WP_ERR_RET(app_timer_start(_wp_buffer_stats_timer, APP_TIMER_TICKS(WULPUS_BUFFER_STATS_INTERVAL), NULL));
+
+  return NRF_SUCCESS;
+}
+
+ret_code_t wp_buffer_configure(uint8_t const *data, uint16_t length)
+{
+  // Packet of an older host, keep the current settings
+  if (length < WP_BUFFER_CONF_PACKET_LEN) return NRF_SUCCESS;
+
+  uint8_t policy = data[WP_BUFFER_CONF_IDX];
+  uint8_t decimation = data[WP_BUFFER_CONF_IDX + 1];
+
+  if (policy > WP_BUFFER_DECIMATE) return NRF_ERROR_INVALID_PARAM;
+  if (decimation == 0) return NRF_ERROR_INVALID_PARAM;
+
+  _wp_buffer_policy = (wp_buffer_policy_t)policy;
+  _wp_buffer_decimation = decimation;
+
+  NRF_LOG_INFO("Configured: policy %u, decimation %u", _wp_buffer_policy, _wp_buffer_decimation);
+
+  return NRF_SUCCESS;
+}
+
+wp_buffer_policy_t wp_buffer_policy(void)
+{
+  return _wp_buffer_policy;
+}
+
+void wp_buffer_reset(void)
+{
+  _wp_buffer_frames_in = 0;
+  _wp_buffer_frames_sent = 0;
+  _wp_buffer_frames_dropped = 0;
+  _wp_buffer_high_water = 0;
+  _wp_buffer_pending = 0;
+  memset(_wp_buffer_decimation_count, 0, sizeof(_wp_buffer_decimation_count));
+}
+
+bool wp_buffer_keep(uint8_t const *frame, size_t pending)
+{
+  _wp_buffer_frames_in++;
+
+  if ((_wp_buffer_policy != WP_BUFFER_DECIMATE) || (pending < WULPUS_BUFFER_HIGH_WATERMARK)) return true;
+
+  // Counted per TX/RX config, so that every config keeps its share of the frames
+  uint8_t tx_rx_id = frame[WULPUS_FRAME_IDX_TX_RX_ID] & WULPUS_FRAME_TX_RX_ID_MASK;
+
+  if (++_wp_buffer_decimation_count[tx_rx_id] >= _wp_buffer_decimation)
+  {
+    _wp_buffer_decimation_count[tx_rx_id] = 0;
+    return true;
+  }
+
+  _wp_buffer_frames_dropped++;
+  return false;
+}
+
+void wp_buffer_count_drop(void)
+{
+  _wp_buffer_frames_dropped++;
+}
+
+void wp_buffer_count_sent(void)
+{
+  _wp_buffer_frames_sent++;
+}
+
+void wp_buffer_update_level(size_t pending)
+{
+  _wp_buffer_pending = (uint16_t)pending;
+  if (pending > _wp_buffer_high_water) _wp_buffer_high_water = (uint16_t)pending;
+}
+
+uint32_t wp_buffer_drop_count(void)
+{
+  return _wp_buffer_frames_dropped;
+}
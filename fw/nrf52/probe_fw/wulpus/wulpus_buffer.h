@@ -0,0 +1,41 @@
+#ifndef __WULPUS_BUFFER__
+#define __WULPUS_BUFFER__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "wulpus_common.h"
+
+// Overflow settings, appended to the nRF52 settings packet (WULPUS_DELTA_CONF_PACKET)
+// [7] overflow policy, [8] decimation factor (WP_BUFFER_DECIMATE only)
+// Older hosts send the packet without them, the defaults of wulpus_config.h apply
+#define WP_BUFFER_CONF_IDX        7
+#define WP_BUFFER_CONF_PACKET_LEN 9
+
+// Value of the telemetry characteristic (little endian, counted since the last configuration)
+// [0-3] frames received (SPI or benchmark), [4-7] frames sent, [8-11] frames dropped,
+// [12-13] high-water mark, [14-15] pending frames, [16] overflow policy,
+// [17] decimation factor, [18-19] capacity of the frame buffer
+#define WP_BUFFER_STATS_LEN       20
+
+typedef enum
+{
+  WP_BUFFER_DROP_NEWEST = 0, /**< A full buffer discards the received frame. */
+  WP_BUFFER_DROP_OLDEST = 1, /**< A full buffer discards the oldest pending frame. */
+  WP_BUFFER_DECIMATE    = 2, /**< Above the high watermark only every n-th frame of a TX/RX config is kept. */
+} wp_buffer_policy_t;
+
+ret_code_t wp_buffer_init(size_t capacity);
+
+ret_code_t wp_buffer_configure(uint8_t const *data, uint16_t length);
+wp_buffer_policy_t wp_buffer_policy(void);
+void wp_buffer_reset(void);
+
+// Counters, the frames are received in interrupt context and sent from the main loop
+bool wp_buffer_keep(uint8_t const *frame, size_t pending);
+void wp_buffer_count_drop(void);
+void wp_buffer_count_sent(void);
+void wp_buffer_update_level(size_t pending);
+uint32_t wp_buffer_drop_count(void);
+
+#endif // __WULPUS_BUFFER__
@@ -0,0 +1,197 @@
+#include "wulpus_compress.h"
+
+#include "nrf.h"
+#include "app_util.h"
+
+#include "wulpus_config.h"
+
+#define NRF_LOG_MODULE_NAME wp_compress
+#define NRF_LOG_LEVEL       4
+#define NRF_LOG_INFO_COLOR  0
+#define NRF_LOG_DEBUG_COLOR 5
+#include "nrf_log.h"
+NRF_LOG_MODULE_REGISTER();
+
+
+#define FRAME_LEN           (WULPUS_FRAME_HEADER_LEN + 2 * WULPUS_FRAME_NUM_SAMPLES)
+#define FRAME_IDX_FLAGS     7
+
+#define COMPRESS_NUM_BLOCKS (WULPUS_FRAME_NUM_SAMPLES / WP_COMPRESS_BLOCK_LEN)
+#define COMPRESS_NUM_ORDERS 3
+#define COMPRESS_MAX_K      15
+#define COMPRESS_PARAMS_LEN 6   // Bits of the order and the Rice parameter in front of every block
+
+STATIC_ASSERT((WULPUS_FRAME_NUM_SAMPLES % WP_COMPRESS_BLOCK_LEN) == 0);
+
+typedef struct
+{
+  uint8_t *dst;
+  uint32_t acc;     // Bits not yet written are the lowest acc_len bits
+  uint32_t acc_len;
+} _wp_compress_writer_t;
+
+// Settings received from the host
+wp_compress_mode_t _wp_compress_mode = WP_COMPRESS_OFF;
+
+
+static inline uint16_t _wp_compress_zigzag(uint32_t halfword)
+{
+  // 0, -1, 1, -2, ... to 0, 1, 2, 3, ...
+  int16_t v = (int16_t)halfword;
+  return (uint16_t)(((uint16_t)v << 1) ^ (uint16_t)(v >> 15));
+}
+
+static void _wp_compress_residuals(uint8_t const *samples, uint32_t *x_last, uint32_t *d_last,
+                                   uint16_t u[COMPRESS_NUM_ORDERS][WP_COMPRESS_BLOCK_LEN])
+{
+  // Two samples per word (little endian, the older one in the lower half),
+  // the DSP instructions subtract both halves at once and wrap around like the decoder
+  for (size_t i = 0; i < WP_COMPRESS_BLOCK_LEN; i += 2)
+  {
+    uint32_t x = __UNALIGNED_UINT32_READ(samples + 2 * i);
+    uint32_t d = __SSUB16(x, __PKHTB(x << 16, *x_last, 16));
+    uint32_t e = __SSUB16(d, __PKHTB(d << 16, *d_last, 16));
+
+    *x_last = x;
+    *d_last = d;
+
+    u[0][i] = _wp_compress_zigzag(x);
+    u[0][i + 1] = _wp_compress_zigzag(x >> 16);
+    u[1][i] = _wp_compress_zigzag(d);
+    u[1][i + 1] = _wp_compress_zigzag(d >> 16);
+    u[2][i] = _wp_compress_zigzag(e);
+    u[2][i + 1] = _wp_compress_zigzag(e >> 16);
+  }
+}
+
+static inline uint32_t _wp_compress_code_len(uint16_t u, uint8_t k)
+{
+  uint32_t q = u >> k;
+  return (q < WP_COMPRESS_ESCAPE) ? (q + 1 + k) : (WP_COMPRESS_ESCAPE + 16);
+}
+
+// Returns the order and Rice parameter of the block ((order << 4) | k) and adds its length in bits
+static uint8_t _wp_compress_choose(uint16_t u[COMPRESS_NUM_ORDERS][WP_COMPRESS_BLOCK_LEN], uint32_t *bits)
+{
+  uint32_t sum[COMPRESS_NUM_ORDERS] = {0};
+  uint8_t order = 0;
+  uint8_t k = 0;
+
+  for (size_t o = 0; o < COMPRESS_NUM_ORDERS; o++)
+  {
+    for (size_t i = 0; i < WP_COMPRESS_BLOCK_LEN; i++) sum[o] += u[o][i];
+    if (sum[o] < sum[order]) order = o;
+  }
+
+  // Smallest k with the mean of u at most 2^k (LOCO-I)
+  while ((k < COMPRESS_MAX_K) && (((uint32_t)WP_COMPRESS_BLOCK_LEN << k) < sum[order])) k++;
+
+  *bits += COMPRESS_PARAMS_LEN;
+  for (size_t i = 0; i < WP_COMPRESS_BLOCK_LEN; i++) *bits += _wp_compress_code_len(u[order][i], k);
+
+  return (uint8_t)((order << 4) | k);
+}
+
+static void _wp_compress_put(_wp_compress_writer_t *w, uint32_t value, uint32_t len)
+{
+  // At most 7 bits are pending, len is at most 24
+  w->acc = (w->acc << len) | value;
+  w->acc_len += len;
+
+  while (w->acc_len >= 8)
+  {
+    w->acc_len -= 8;
+    *w->dst++ = (uint8_t)(w->acc >> w->acc_len);
+  }
+}
+
+static void _wp_compress_put_code(_wp_compress_writer_t *w, uint16_t u, uint8_t k)
+{
+  uint32_t q = u >> k;
+
+  if (q < WP_COMPRESS_ESCAPE)
+  {
+    // q ones and the terminating zero, then the lower bits
+    _wp_compress_put(w, ((1UL << q) - 1) << 1, q + 1);
+    _wp_compress_put(w, u & ((1UL << k) - 1), k);
+  }
+  else
+  {
+    _wp_compress_put(w, (1UL << WP_COMPRESS_ESCAPE) - 1, WP_COMPRESS_ESCAPE);
+    _wp_compress_put(w, u, 16);
+  }
+}
+
+ret_code_t wp_compress_configure(uint8_t const *data, uint16_t length)
+{
+  // Packet of an older host, which can't decode the compressed frames
+  if (length < WP_COMPRESS_CONF_PACKET_LEN)
+  {
+    _wp_compress_mode = WP_COMPRESS_OFF;
+    return NRF_SUCCESS;
+  }
+
+  if (data[WP_COMPRESS_CONF_IDX] > WP_COMPRESS_LOSSLESS) return NRF_ERROR_INVALID_PARAM;
+
+  _wp_compress_mode = (wp_compress_mode_t)data[WP_COMPRESS_CONF_IDX];
+
+  NRF_LOG_INFO("Configured: mode %u", _wp_compress_mode);
+
+  return NRF_SUCCESS;
+}
+
+void wp_compress_disable(void)
+{
+  _wp_compress_mode = WP_COMPRESS_OFF;
+}
+
+uint16_t wp_compress_encode(uint8_t *frame, uint16_t length)
+{
+  // Delta encoded and unchanged frames are left to wulpus_delta
+  if ((_wp_compress_mode == WP_COMPRESS_OFF) || (length != FRAME_LEN)) return length;
+
+  uint8_t *samples = frame + WULPUS_FRAME_HEADER_LEN;
+  uint16_t u[COMPRESS_NUM_ORDERS][WP_COMPRESS_BLOCK_LEN];
+  uint8_t params[COMPRESS_NUM_BLOCKS];
+  uint32_t x_last = 0;
+  uint32_t d_last = 0;
+  uint32_t bits = 0;
+
+  // First pass: choose the predictor and the Rice parameter of every block and count the bits
+  for (size_t b = 0; b < COMPRESS_NUM_BLOCKS; b++)
+  {
+    // The bit stream is written in place behind its length,
+    // the bytes written before a block is read must not reach its samples
+    if ((bits >= 8) && ((WP_COMPRESS_HEADER_LEN + bits / 8) > (2 * WP_COMPRESS_BLOCK_LEN * b))) return length;
+
+    _wp_compress_residuals(samples + 2 * WP_COMPRESS_BLOCK_LEN * b, &x_last, &d_last, u);
+    params[b] = _wp_compress_choose(u, &bits);
+  }
+
+  uint16_t stream_len = (uint16_t)((bits + 7) / 8);
+  if ((WULPUS_FRAME_HEADER_LEN + WP_COMPRESS_HEADER_LEN + stream_len) >= FRAME_LEN) return length;
+
+  // Second pass: write the bit stream over the samples
+  _wp_compress_writer_t w = { .dst = samples + WP_COMPRESS_HEADER_LEN, .acc = 0, .acc_len = 0 };
+  x_last = 0;
+  d_last = 0;
+
+  for (size_t b = 0; b < COMPRESS_NUM_BLOCKS; b++)
+  {
+    uint8_t order = params[b] >> 4;
+    uint8_t k = params[b] & 0x0F;
+
+    _wp_compress_residuals(samples + 2 * WP_COMPRESS_BLOCK_LEN * b, &x_last, &d_last, u);
+
+    _wp_compress_put(&w, params[b], COMPRESS_PARAMS_LEN);
+    for (size_t i = 0; i < WP_COMPRESS_BLOCK_LEN; i++) _wp_compress_put_code(&w, u[order][i], k);
+  }
+
+  if (w.acc_len > 0) *w.dst = (uint8_t)(w.acc << (8 - w.acc_len));
+
+  samples[0] = (uint8_t)stream_len;
+  samples[1] = (uint8_t)(stream_len >> 8);
+  frame[FRAME_IDX_FLAGS] |= WP_COMPRESS_FLAGS;
+
+  return WULPUS_FRAME_HEADER_LEN + WP_COMPRESS_HEADER_LEN + stream_len;
+}
@@ -0,0 +1,40 @@
+#ifndef __WULPUS_COMPRESS__
+#define __WULPUS_COMPRESS__
+
+#include <stdint.h>
+
+#include "wulpus_common.h"
+
+// Compression settings, appended to the nRF52 settings packet (WULPUS_DELTA_CONF_PACKET)
+// [9] compression mode (wp_compress_mode_t)
+// Older hosts send the packet without it, the frames are not compressed
+#define WP_COMPRESS_CONF_IDX        9
+#define WP_COMPRESS_CONF_PACKET_LEN 10
+
+// Bits 2-3 of the frame flags both set (otherwise WP_DELTA_FLAG_DELTA and WP_DELTA_FLAG_UNCHANGED
+// exclude each other): the samples are replaced by a lossless bit stream
+// [12-13] length of the bit stream in bytes, [14-] bit stream (MSB first)
+// Blocks of WP_COMPRESS_BLOCK_LEN samples: [2 bits] predictor order (0-2), [4 bits] Rice parameter k,
+// then one code per residual of the block. The residual of order 1/2 is the first/second difference
+// of the samples in 16-bit two's complement (samples before the frame are 0), it is zigzag mapped to u.
+// u >> k below WP_COMPRESS_ESCAPE: u >> k ones, a zero and the k lower bits of u,
+// otherwise WP_COMPRESS_ESCAPE ones and the 16 bits of u
+// Frames which would not get shorter are sent as they are
+#define WP_COMPRESS_FLAGS           (3 << 2)
+#define WP_COMPRESS_HEADER_LEN      2
+#define WP_COMPRESS_BLOCK_LEN       16
+#define WP_COMPRESS_ESCAPE          16
+
+typedef enum
+{
+  WP_COMPRESS_OFF      = 0,
+  WP_COMPRESS_LOSSLESS = 1, /**< Fixed linear prediction per block and Rice coding of the residuals. */
+} wp_compress_mode_t;
+
+ret_code_t wp_compress_configure(uint8_t const *data, uint16_t length);
+void wp_compress_disable(void);
+
+// Compresses a full frame in place (keyframes and frames without delta encoding), returns the new length
+uint16_t wp_compress_encode(uint8_t *frame, uint16_t length);
+
+#endif // __WULPUS_COMPRESS__
@@ -11,23 +11,38 @@
 #define WULPUS_BLE_DEVICE_NAME        "WULPUS_PROBE_19"     /**< Name of device. Will be included in the advertising data. */
 #define WULPUS_BLE_ADV_INTERVAL       64                    /**< The advertising interval (in units of 0.625 ms. This value corresponds to 40 ms). */
 #define WULPUS_BLE_ADV_DURATION       18000                 /**< The advertising duration (180 seconds) in units of 10 milliseconds. */
-#define WULPUS_BLE_MIN_CONN_INTERVAL  7.5                   /**< Minimum acceptable connection interval (7.5 ms), Connection interval uses 1.25 ms units. */
-#define WULPUS_BLE_MAX_CONN_INTERVAL  7.5                   /**< Maximum acceptable connection interval (7.5 ms), Connection interval uses 1.25 ms units. */
+#define WULPUS_BLE_MIN_CONN_INTERVAL  7.5                   /**< Shortest connection interval (7.5 ms), requested until the data rate is known and at high rates. */
+#define WULPUS_BLE_MAX_CONN_INTERVAL  120                   /**< Longest connection interval (120 ms), requested at low data rates (top of the 7.5/15/30/60/120 ms ladder). */
 #define WULPUS_BLE_MAX_DATA_HANDLERS  2                     /**< Maximum amount of data handlers. */
 #define WULPUS_BLE_MAX_CONN_HANDLERS  2                     /**< Maximum amount of connection handlers. */
-#define WULPUS_BLE_SLAVE_LATENCY      5                     /**< Slave latency. */
+#define WULPUS_BLE_SLAVE_LATENCY      5                     /**< Slave latency, connection events the probe may skip while idle: host commands may wait up to (1 + 5) x 120 ms = 720 ms at WULPUS_BLE_MAX_CONN_INTERVAL. */
+#define WULPUS_BLE_LINK_UPDATE_INTERVAL   2000              /**< Window in ms over which the data rate is measured to choose the connection interval. */
+#define WULPUS_BLE_LINK_PACKETS_PER_EVENT 4                 /**< Packets per connection event the connection interval is chosen for. */
+#define WULPUS_BLE_LINK_HEADROOM          2                 /**< Throughput of the chosen connection interval relative to the measured data rate. */
+#define WULPUS_BLE_TX_QUEUE_LEN       16                    /**< Notifications waiting for room in the SoftDevice queue (one slot stays empty). */
+#define WULPUS_BLE_MAX_DATA_LEN       244                   /**< Largest notification of the stream (NRF_SDH_BLE_GATT_MAX_MTU_SIZE - 3). */
+#define WULPUS_STREAM_FLUSH_DEADLINE  20                    /**< Longest time in ms a partly filled notification waits for further records. */
+#define WULPUS_BLE_MAX_TELEMETRY_LEN  20                    /**< Length of the telemetry characteristic. */
+#define WULPUS_BLE_HVN_TX_QUEUE_SIZE  20                    /**< Notifications the SoftDevice queues per connection (nrf_sdh_ble_enable() logs the RAM start it needs). */
+#ifndef WULPUS_L2CAP_ENABLED
+#define WULPUS_L2CAP_ENABLED          0                     /**< If the dongle may stream the frames over an L2CAP channel (notifications else), off as one frame per SDU is slower than packed notifications. */
+#endif
+#define WULPUS_L2CAP_PSM              0x0080                /**< LE PSM of the channel (dynamic range). */
+#define WULPUS_L2CAP_MPS              247                   /**< Largest PDU payload sent on the channel (one PDU per packet with 251 byte data length). */
+#define WULPUS_L2CAP_TX_QUEUE_LEN     4                     /**< Frames (SDUs) queued on the channel. */
 
 
-//     ____ ____ ___ ___  
-//    / ___|  _ \_ _/ _ \ 
-//   | |  _| |_) | | | | |
-//   | |_| |  __/| | |_| |
-//    \____|_|  |___\___/ 
-//                        
+/*
+       ____ ____ ___ ___  
+      / ___|  _ \_ _/ _ \ 
+     | |  _| |_) | | | | |
+     | |_| |  __/| | |_| |
+      \____|_|  |___\___/ 
+                          
+*/
 #define WULPUS_GPIO_NUM_LED           23 /**< GPIO number of the on-board LED. */
 #define WULPUS_GPIO_NUM_BLE_CONN      25 /**< GPIO number of the BLE connected output. */
 #define WULPUS_GPIO_NUM_DATA_READY    29 /**< GPIO number of the data ready input. */
-#define WULPUS_GPIO_MAX_DATA_HANDLERS 2  /**< Maximum amount of data ready handlers. */
 #define WULPUS_GPIO_LED_ENABLE        1  /**< If LED is enabled. */
 #define WULPUS_GPIO_LED_INVERT        0  /**< If LED is inverted (nRF52DK): 1, 0 (WULPUS) else. */
 
@@ -60,9 +75,28 @@
 //   |_|  |_/_/   \_\___|_| \_|
 //                             
 #define WULPUS_NUMBER_OF_XFERS      4
-#define WULPUS_BYTES_PER_XFER       201
+#define WULPUS_BYTES_PER_XFER       203
 #define WULPUS_NUM_BUFFERED_FRAMES  35
-#define WULPUS_RESTART_PACKET       {0xFB, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}
-#define WULPUS_BYTES_PER_PACKET     68
+#define WULPUS_BUFFER_HIGH_WATERMARK (WULPUS_NUM_BUFFERED_FRAMES - 4) /**< Pending frames at which the MSP430 is told to keep frames in FRAM. */
+#define WULPUS_BUFFER_LOW_WATERMARK  (WULPUS_NUM_BUFFERED_FRAMES / 2) /**< Pending frames at which the MSP430 may flush its FRAM backlog. */
+#define WULPUS_BUFFER_OVERFLOW_POLICY WP_BUFFER_DROP_NEWEST /**< Overflow policy until the host selects one (see wp_buffer_policy_t). */
+#define WULPUS_BUFFER_DECIMATION     2    /**< Decimation factor of WP_BUFFER_DECIMATE until the host selects one. */
+#define WULPUS_BUFFER_STATS_INTERVAL 1000 /**< Update interval of the statistics characteristic in ms. */
+#define WULPUS_RESTART_PACKET       {0xFB}
+#define WULPUS_BYTES_PER_PACKET     128
+#define WULPUS_FRAME_HEADER_LEN     12
+#define WULPUS_FRAME_NUM_SAMPLES    400
+#define WULPUS_FRAME_IDX_TX_RX_ID   1    /**< Header byte of the TX/RX config ID. */
+#define WULPUS_FRAME_TX_RX_ID_MASK  0x0F /**< TX/RX config ID in that byte, the upper nibble holds the PLL recovery counters of the MSP430. */
+#define WULPUS_DELTA_CONF_PACKET    0xF9 /**< Start byte of the delta encoding settings (not forwarded to the MSP430). */
+#define WULPUS_DELTA_MAX_CONFIGS    16   /**< Maximum amount of TX/RX configs with a reference frame. */
+#define WULPUS_BENCH_CONF_PACKET    0xF8 /**< Start byte of the benchmark settings (not forwarded to the MSP430). */
+#define WULPUS_BENCH_START_OF_FRAME 0xFE /**< Start byte of the synthetic benchmark frames. */
+#define WULPUS_FEATURE_START_OF_FRAME 0xFD /**< Start byte of the feature records (peaks of the envelope). */
+#define WULPUS_FEATURE_MAX_TAPS     32   /**< Longest bandpass of the feature extraction (even). */
+#define WULPUS_FEATURE_MAX_PEAKS    4    /**< Most peaks in a feature record. */
+#define WULPUS_NACK_PACKET          0xF7 /**< Start byte of the retransmission requests (not forwarded to the MSP430). */
+#define WULPUS_NACK_MAX_FRAMES      8    /**< Most frames in a retransmission request. */
+#define WULPUS_LOST_START_OF_FRAME  0xF6 /**< Start byte of the reports of requested frames which are not buffered anymore. */
 
 #endif // __WULPUS_CONFIG__
@@ -0,0 +1,155 @@
+#include "wulpus_delta.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "wulpus_config.h"
+
+#define NRF_LOG_MODULE_NAME wp_delta
+#define NRF_LOG_LEVEL       4
+#define NRF_LOG_INFO_COLOR  0
+#define NRF_LOG_DEBUG_COLOR 5
+#include "nrf_log.h"
+NRF_LOG_MODULE_REGISTER();
+
+
+#define FRAME_LEN           (WULPUS_FRAME_HEADER_LEN + 2 * WULPUS_FRAME_NUM_SAMPLES)
+#define FRAME_IDX_FLAGS     7
+
+#define DELTA_MAX_SHIFT     7
+
+// Settings received from the host
+bool _wp_delta_enabled = false;
+uint8_t _wp_delta_shift = 0;
+uint16_t _wp_delta_threshold = 0;
+uint16_t _wp_delta_keyframe_interval = 0;
+
+// Reference frame per TX/RX config, i.e. the frame as reconstructed by the host
+int16_t _wp_delta_ref[WULPUS_DELTA_MAX_CONFIGS][WULPUS_FRAME_NUM_SAMPLES];
+bool _wp_delta_ref_valid[WULPUS_DELTA_MAX_CONFIGS];
+uint16_t _wp_delta_frames_since_key[WULPUS_DELTA_MAX_CONFIGS];
+
+
+static inline int16_t _wp_delta_get_sample(uint8_t const *samples, size_t i)
+{
+  // Samples are little endian and not necessarily aligned in the RX buffer
+  return (int16_t)(samples[2 * i] | (samples[2 * i + 1] << 8));
+}
+
+static inline int32_t _wp_delta_quantise(int32_t residual)
+{
+  // Round to nearest, arithmetic shift
+  if (_wp_delta_shift == 0) return residual;
+  return (residual + (1 << (_wp_delta_shift - 1))) >> _wp_delta_shift;
+}
+
+static uint16_t _wp_delta_keyframe(uint8_t const *samples, uint8_t tx_rx_id)
+{
+  int16_t *ref = _wp_delta_ref[tx_rx_id];
+
+  for (size_t i = 0; i < WULPUS_FRAME_NUM_SAMPLES; i++)
+  {
+    ref[i] = _wp_delta_get_sample(samples, i);
+  }
+
+  _wp_delta_ref_valid[tx_rx_id] = true;
+  _wp_delta_frames_since_key[tx_rx_id] = 0;
+
+  return FRAME_LEN;
+}
+
+bool wp_delta_is_conf_packet(uint8_t const *data, uint16_t length)
+{
+  return (length >= WP_DELTA_CONF_PACKET_LEN) && (data[0] == WULPUS_DELTA_CONF_PACKET);
+}
+
+ret_code_t wp_delta_configure(uint8_t const *data, uint16_t length)
+{
+  if (!wp_delta_is_conf_packet(data, length)) return NRF_ERROR_INVALID_PARAM;
+  if (data[2] > DELTA_MAX_SHIFT) return NRF_ERROR_INVALID_PARAM;
+
+  _wp_delta_enabled = (data[1] != 0);
+  _wp_delta_shift = data[2];
+  _wp_delta_threshold = (uint16_t)(data[3] | (data[4] << 8));
+  _wp_delta_keyframe_interval = (uint16_t)(data[5] | (data[6] << 8));
+
+  wp_delta_reset();
+
+  NRF_LOG_INFO("Configured: enabled %u, shift %u, threshold %u, keyframe interval %u",
+               _wp_delta_enabled, _wp_delta_shift, _wp_delta_threshold, _wp_delta_keyframe_interval);
+
+  return NRF_SUCCESS;
+}
+
+void wp_delta_disable(void)
+{
+  _wp_delta_enabled = false;
+  wp_delta_reset();
+}
+
+void wp_delta_reset(void)
+{
+  // Forget all reference frames, the next frame of every config is a keyframe
+  memset(_wp_delta_ref_valid, 0, sizeof(_wp_delta_ref_valid));
+}
+
+uint16_t wp_delta_encode(uint8_t *frame)
+{
+  uint8_t *samples = frame + WULPUS_FRAME_HEADER_LEN;
+  uint8_t tx_rx_id = frame[WULPUS_FRAME_IDX_TX_RX_ID] & WULPUS_FRAME_TX_RX_ID_MASK;
+
+  if (!_wp_delta_enabled || (tx_rx_id >= WULPUS_DELTA_MAX_CONFIGS)) return FRAME_LEN;
+
+  // Send a keyframe for the first frame of a config and after every keyframe interval
+  if (!_wp_delta_ref_valid[tx_rx_id] ||
+      ((_wp_delta_keyframe_interval != 0) && (_wp_delta_frames_since_key[tx_rx_id] >= _wp_delta_keyframe_interval)))
+  {
+    return _wp_delta_keyframe(samples, tx_rx_id);
+  }
+
+  int16_t *ref = _wp_delta_ref[tx_rx_id];
+  int32_t residual, quantised, recon;
+  uint32_t max_residual = 0;
+
+  // First pass: check if the residual fits into 8 bits or can be dropped entirely
+  for (size_t i = 0; i < WULPUS_FRAME_NUM_SAMPLES; i++)
+  {
+    residual = (int32_t)_wp_delta_get_sample(samples, i) - ref[i];
+    quantised = _wp_delta_quantise(residual);
+
+    if ((quantised > INT8_MAX) || (quantised < INT8_MIN))
+    {
+      // Too much has changed, resynchronise with a keyframe
+      return _wp_delta_keyframe(samples, tx_rx_id);
+    }
+
+    if ((uint32_t)abs(residual) > max_residual) max_residual = (uint32_t)abs(residual);
+  }
+
+  _wp_delta_frames_since_key[tx_rx_id]++;
+
+  if (max_residual <= _wp_delta_threshold)
+  {
+    // Host repeats its reference frame, which stays unchanged here as well
+    frame[FRAME_IDX_FLAGS] |= WP_DELTA_FLAG_UNCHANGED;
+    return WULPUS_FRAME_HEADER_LEN;
+  }
+
+  // Second pass: write the residuals in place and track the reconstruction of the host
+  // (sample i is read before residual i overwrites its first byte)
+  for (size_t i = 0; i < WULPUS_FRAME_NUM_SAMPLES; i++)
+  {
+    quantised = _wp_delta_quantise((int32_t)_wp_delta_get_sample(samples, i) - ref[i]);
+
+    recon = (int32_t)ref[i] + (quantised * (1 << _wp_delta_shift));
+    if (recon > INT16_MAX) recon = INT16_MAX;
+    if (recon < INT16_MIN) recon = INT16_MIN;
+    ref[i] = (int16_t)recon;
+
+    samples[i] = (uint8_t)(int8_t)quantised;
+  }
+
+  frame[FRAME_IDX_FLAGS] |= WP_DELTA_FLAG_DELTA | (_wp_delta_shift << WP_DELTA_FLAG_SHIFT_POS);
+
+  return WULPUS_FRAME_HEADER_LEN + WULPUS_FRAME_NUM_SAMPLES;
+}
@@ -0,0 +1,25 @@
+#ifndef __WULPUS_DELTA__
+#define __WULPUS_DELTA__
+
+#include <stdint.h>
+
+#include "wulpus_common.h"
+
+// Delta encoding settings packet (sent by the host, consumed by the nRF52)
+// [0] WULPUS_DELTA_CONF_PACKET, [1] enable, [2] quantisation shift (0-7),
+// [3-4] unchanged threshold, [5-6] keyframe interval (frames per TX/RX config, 0: never)
+#define WP_DELTA_CONF_PACKET_LEN 7
+
+// Flags in byte 7 of the frame header (bits 0-1 and 7 are set by the MSP430)
+#define WP_DELTA_FLAG_DELTA      (1 << 2) /**< Samples are replaced by 8-bit residuals to the reference frame. */
+#define WP_DELTA_FLAG_UNCHANGED  (1 << 3) /**< Residual below threshold, the frame carries no samples. */
+#define WP_DELTA_FLAG_SHIFT_POS  4        /**< Position of the quantisation shift of the residuals (3 bits). */
+
+bool wp_delta_is_conf_packet(uint8_t const *data, uint16_t length);
+ret_code_t wp_delta_configure(uint8_t const *data, uint16_t length);
+void wp_delta_disable(void);
+void wp_delta_reset(void);
+
+uint16_t wp_delta_encode(uint8_t *frame);
+
+#endif // __WULPUS_DELTA__
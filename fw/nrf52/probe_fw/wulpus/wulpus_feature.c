@@ -0,0 +1,215 @@
+#include "wulpus_feature.h"
+
+#include <string.h>
+
+#include "nrf.h"
+#include "app_util.h"
+#include "app_util_platform.h"
+#include "arm_math.h"
+
+#include "wulpus_config.h"
+
+#define NRF_LOG_MODULE_NAME wp_feature
+#define NRF_LOG_LEVEL       4
+#define NRF_LOG_INFO_COLOR  0
+#define NRF_LOG_DEBUG_COLOR 5
+#include "nrf_log.h"
+NRF_LOG_MODULE_REGISTER();
+
+
+#define FEATURE_NUM_BLOCKS (WULPUS_FRAME_NUM_SAMPLES / WP_FEATURE_BLOCK_LEN)
+#define FEATURE_MIN_TAPS   4    // Smallest filter of arm_fir_q15()
+#define FEATURE_POS_SCALE  16.0f
+
+STATIC_ASSERT((WULPUS_FRAME_NUM_SAMPLES % WP_FEATURE_BLOCK_LEN) == 0);
+STATIC_ASSERT((WULPUS_FEATURE_MAX_TAPS % 2) == 0);
+
+typedef struct
+{
+  uint16_t position;
+  uint16_t amplitude;
+} _wp_feature_peak_t;
+
+typedef struct
+{
+  uint8_t decimation;
+  uint16_t min_sample;
+  uint8_t num_peaks;
+  uint16_t num_taps;
+  q15_t taps[WULPUS_FEATURE_MAX_TAPS];
+} _wp_feature_settings_t;
+
+// Settings received from the host (BLE handler), taken over by the main loop between two frames
+wp_feature_mode_t _wp_feature_mode = WP_FEATURE_OFF;
+_wp_feature_settings_t _wp_feature_received;
+volatile bool _wp_feature_received_new = false;
+
+// Settings of the extraction, only changed by the main loop
+_wp_feature_settings_t _wp_feature_settings = { .decimation = 1, .num_peaks = 1, .num_taps = FEATURE_MIN_TAPS };
+
+// Restarted for every frame, the samples before the frame are 0
+arm_fir_instance_q15 _wp_feature_fir;
+q15_t _wp_feature_fir_state[WULPUS_FEATURE_MAX_TAPS + WP_FEATURE_BLOCK_LEN];
+
+
+// Keeps the peaks sorted by descending amplitude, the weakest one is replaced
+static void _wp_feature_add_peak(_wp_feature_peak_t *peaks, uint8_t *count, _wp_feature_peak_t peak)
+{
+  size_t i = *count;
+
+  if (*count < _wp_feature_settings.num_peaks) (*count)++;
+  else if (peak.amplitude <= peaks[i - 1].amplitude) return;
+  else i--;
+
+  for (; (i > 0) && (peaks[i - 1].amplitude < peak.amplitude); i--) peaks[i] = peaks[i - 1];
+  peaks[i] = peak;
+}
+
+// Parabola through the envelope around its local maximum c at envelope index idx
+static bool _wp_feature_interpolate(q15_t l, q15_t c, q15_t r, size_t idx, uint8_t decimation,
+                                    _wp_feature_peak_t *peak)
+{
+  float32_t curvature = (float32_t)l - 2.0f * c + r;
+  float32_t offset = (curvature < 0.0f) ? 0.5f * (l - r) / curvature : 0.0f;
+
+  // Envelope sample idx is the mean of the rectified output idx * D to idx * D + D - 1,
+  // the bandpass delays the output by (n - 1) / 2 samples
+  float32_t position = (idx + offset) * decimation + 0.5f * (decimation - 1) -
+                       0.5f * (_wp_feature_settings.num_taps - 1);
+  if (position < _wp_feature_settings.min_sample) return false;
+
+  float32_t amplitude = c - 0.25f * (l - r) * offset;
+
+  peak->position = (uint16_t)(position * FEATURE_POS_SCALE + 0.5f);
+  peak->amplitude = (uint16_t)MIN(amplitude + 0.5f, (float32_t)UINT16_MAX);
+
+  return true;
+}
+
+ret_code_t wp_feature_configure(uint8_t const *data, uint16_t length)
+{
+  // Packet of an older host, which doesn't expect feature records
+  if (length < WP_FEATURE_CONF_PACKET_LEN)
+  {
+    _wp_feature_mode = WP_FEATURE_OFF;
+    return NRF_SUCCESS;
+  }
+
+  uint8_t const *conf = data + WP_FEATURE_CONF_IDX;
+  uint8_t mode = conf[0];
+  uint8_t decimation = conf[1];
+  uint8_t num_peaks = conf[4];
+  uint8_t num_taps = conf[5];
+
+  if (mode > WP_FEATURE_ONLY) return NRF_ERROR_INVALID_PARAM;
+  if (mode == WP_FEATURE_OFF)
+  {
+    _wp_feature_mode = WP_FEATURE_OFF;
+    return NRF_SUCCESS;
+  }
+
+  if ((decimation == 0) || ((WP_FEATURE_BLOCK_LEN % decimation) != 0)) return NRF_ERROR_INVALID_PARAM;
+  if ((num_peaks == 0) || (num_peaks > WULPUS_FEATURE_MAX_PEAKS)) return NRF_ERROR_INVALID_PARAM;
+  if ((num_taps < FEATURE_MIN_TAPS) || (num_taps > WULPUS_FEATURE_MAX_TAPS) || ((num_taps % 2) != 0))
+  {
+    return NRF_ERROR_INVALID_PARAM;
+  }
+  if (length < WP_FEATURE_CONF_PACKET_LEN + 2 * num_taps) return NRF_ERROR_INVALID_LENGTH;
+
+  // An extraction running in the main loop keeps its settings, the new ones apply from the next frame
+  // (the main loop takes them over in a critical region, this handler can't interrupt it)
+  _wp_feature_received.decimation = decimation;
+  _wp_feature_received.min_sample = uint16_decode(&conf[2]);
+  _wp_feature_received.num_peaks = num_peaks;
+  _wp_feature_received.num_taps = num_taps;
+  for (size_t i = 0; i < num_taps; i++)
+  {
+    _wp_feature_received.taps[i] = (q15_t)uint16_decode(&data[WP_FEATURE_CONF_PACKET_LEN + 2 * i]);
+  }
+
+  _wp_feature_received_new = true;
+  _wp_feature_mode = (wp_feature_mode_t)mode;
+
+  NRF_LOG_INFO("Configured: mode %u, %u taps, decimation %u, %u peaks from sample %u", mode, num_taps,
+               decimation, num_peaks, _wp_feature_received.min_sample);
+
+  return NRF_SUCCESS;
+}
+
+void wp_feature_disable(void)
+{
+  _wp_feature_mode = WP_FEATURE_OFF;
+}
+
+wp_feature_mode_t wp_feature_mode(void)
+{
+  return _wp_feature_mode;
+}
+
+uint16_t wp_feature_extract(uint8_t const *frame, uint8_t *record)
+{
+  q15_t block[WP_FEATURE_BLOCK_LEN];
+  q15_t filtered[WP_FEATURE_BLOCK_LEN];
+  _wp_feature_peak_t peaks[WULPUS_FEATURE_MAX_PEAKS];
+  uint8_t num_peaks = 0;
+
+  // Last two envelope samples, a local maximum is found one sample late
+  q15_t env_prev = 0;
+  q15_t env_last = 0;
+  size_t env_idx = 0;
+
+  // Settings received since the last frame
+  if (_wp_feature_received_new)
+  {
+    CRITICAL_REGION_ENTER();
+    _wp_feature_settings = _wp_feature_received;
+    _wp_feature_received_new = false;
+    CRITICAL_REGION_EXIT();
+  }
+
+  uint8_t decimation = _wp_feature_settings.decimation;
+
+  // Number of taps validated by wp_feature_configure()
+  arm_fir_init_q15(&_wp_feature_fir, _wp_feature_settings.num_taps, _wp_feature_settings.taps,
+                   _wp_feature_fir_state, WP_FEATURE_BLOCK_LEN);
+
+  for (size_t b = 0; b < FEATURE_NUM_BLOCKS; b++)
+  {
+    // The samples of the frame are not aligned to halfwords
+    memcpy(block, frame + WULPUS_FRAME_HEADER_LEN + 2 * WP_FEATURE_BLOCK_LEN * b, sizeof(block));
+
+    // Bandpass, then the envelope as mean of the rectified output over D samples
+    arm_fir_q15(&_wp_feature_fir, block, filtered, WP_FEATURE_BLOCK_LEN);
+    arm_abs_q15(filtered, filtered, WP_FEATURE_BLOCK_LEN);
+
+    for (size_t i = 0; i < WP_FEATURE_BLOCK_LEN; i += decimation, env_idx++)
+    {
+      q15_t env;
+      arm_mean_q15(filtered + i, decimation, &env);
+
+      // Plateaus count once, at their first sample
+      _wp_feature_peak_t peak;
+      if ((env_idx >= 2) && (env_last > env_prev) && (env_last >= env) &&
+          _wp_feature_interpolate(env_prev, env_last, env, env_idx - 1, decimation, &peak))
+      {
+        _wp_feature_add_peak(peaks, &num_peaks, peak);
+      }
+
+      env_prev = env_last;
+      env_last = env;
+    }
+  }
+
+  record[0] = WULPUS_FEATURE_START_OF_FRAME;
+  memcpy(record + 1, frame + 1, WP_FEATURE_HEADER_LEN - 2);
+  record[WP_FEATURE_HEADER_LEN - 1] = num_peaks;
+
+  uint8_t *dst = record + WP_FEATURE_HEADER_LEN;
+  for (size_t i = 0; i < num_peaks; i++)
+  {
+    dst += uint16_encode(peaks[i].position, dst);
+    dst += uint16_encode(peaks[i].amplitude, dst);
+  }
+
+  return (uint16_t)(dst - record);
+}
@@ -0,0 +1,41 @@
+#ifndef __WULPUS_FEATURE__
+#define __WULPUS_FEATURE__
+
+#include <stdint.h>
+
+#include "wulpus_common.h"
+
+// Feature settings, appended to the nRF52 settings packet (WULPUS_DELTA_CONF_PACKET)
+// [10] feature mode (wp_feature_mode_t), [11] envelope decimation (divides WP_FEATURE_BLOCK_LEN),
+// [12-13] first sample of the peak search, [14] number of peaks (1 to WULPUS_FEATURE_MAX_PEAKS),
+// [15] number of bandpass taps n (even, 4 to WULPUS_FEATURE_MAX_TAPS), [16-] n taps (q15, little endian)
+// Older hosts send the packet without them, no features are extracted
+#define WP_FEATURE_CONF_IDX        10
+#define WP_FEATURE_CONF_PACKET_LEN 16
+
+// Feature record, sent in the stream like a frame
+// [0] WULPUS_FEATURE_START_OF_FRAME, [1-11] header of the US frame, [12] number of peaks n,
+// then n peaks by descending amplitude: [0-1] position in 1/16 samples (group delay of the
+// bandpass removed), [2-3] envelope amplitude (mean of the rectified bandpass output, q15)
+#define WP_FEATURE_HEADER_LEN      13
+#define WP_FEATURE_PEAK_LEN        4
+#define WP_FEATURE_MAX_LEN         (WP_FEATURE_HEADER_LEN + WULPUS_FEATURE_MAX_PEAKS * WP_FEATURE_PEAK_LEN)
+
+// Samples filtered at once
+#define WP_FEATURE_BLOCK_LEN       80
+
+typedef enum
+{
+  WP_FEATURE_OFF       = 0,
+  WP_FEATURE_ALONGSIDE = 1, /**< The feature record is sent in front of its frame. */
+  WP_FEATURE_ONLY      = 2, /**< Only the feature record is sent, the frame is released. */
+} wp_feature_mode_t;
+
+ret_code_t wp_feature_configure(uint8_t const *data, uint16_t length);
+void wp_feature_disable(void);
+wp_feature_mode_t wp_feature_mode(void);
+
+// Bandpass, envelope and peak search of a US frame (not modified), returns the length of the record
+uint16_t wp_feature_extract(uint8_t const *frame, uint8_t *record);
+
+#endif // __WULPUS_FEATURE__
@@ -10,18 +10,11 @@
 NRF_LOG_MODULE_REGISTER();
 
 
-wp_gpio_data_handler_t _wp_gpio_data_handlers[WULPUS_GPIO_MAX_DATA_HANDLERS];
-size_t _wp_gpio_data_handlers_num = 0;
-
-
 void _wp_gpio_data_ready_handler(nrfx_gpiote_pin_t pin, nrf_gpiote_polarity_t action)
 {
-  NRF_LOG_DEBUG("Data ready handler called: %u callbacks", _wp_gpio_data_handlers_num);
-
-  for (size_t i = 0; i < _wp_gpio_data_handlers_num; i++)
-  {
-    _wp_gpio_data_handlers[i](pin, action);
-  }
+  // Handler must be passed to nrfx_gpiote_in_init(),
+  // but is not used since the event only triggers PPI (wulpus_ppi)
+  NRF_LOG_WARNING("Data ready handler called, should not happen");
 }
 
 ret_code_t wp_gpio_init(void)
@@ -44,11 +37,11 @@ ret_code_t wp_gpio_init(void)
 
   NRF_LOG_DEBUG("Initialized BLE connected output");
 
-  // Initialize the data ready input
-  nrfx_gpiote_in_config_t in_config_data_ready = NRFX_GPIOTE_CONFIG_IN_SENSE_TOGGLE(true);
+  // Initialize the data ready input (rising edge, event only without interrupt)
+  nrfx_gpiote_in_config_t in_config_data_ready = NRFX_GPIOTE_CONFIG_IN_SENSE_LOTOHI(true);
   in_config_data_ready.pull = NRF_GPIO_PIN_NOPULL;
   WP_ERR_RET(nrfx_gpiote_in_init(WULPUS_GPIO_NUM_DATA_READY, &in_config_data_ready, _wp_gpio_data_ready_handler));
-  nrfx_gpiote_in_event_enable(WULPUS_GPIO_NUM_DATA_READY, true);
+  nrfx_gpiote_in_event_enable(WULPUS_GPIO_NUM_DATA_READY, false);
 
   NRF_LOG_DEBUG("Initialized data ready input");
 
@@ -57,15 +50,9 @@ ret_code_t wp_gpio_init(void)
   return NRF_SUCCESS;
 }
 
-ret_code_t wp_gpio_add_data_handler(wp_gpio_data_handler_t handler)
+uint32_t wp_gpio_data_ready_event_addr(void)
 {
-  if (_wp_gpio_data_handlers_num >= WULPUS_GPIO_MAX_DATA_HANDLERS) return NRF_ERROR_CONN_COUNT;
-
-  _wp_gpio_data_handlers[_wp_gpio_data_handlers_num++] = handler;
-
-  NRF_LOG_DEBUG("Added data handler: %u/%u", _wp_gpio_data_handlers_num, WULPUS_GPIO_MAX_DATA_HANDLERS);
-
-  return NRF_SUCCESS;
+  return nrfx_gpiote_in_event_addr_get(WULPUS_GPIO_NUM_DATA_READY);
 }
 
 void wp_gpio_led_indicate(bool on)
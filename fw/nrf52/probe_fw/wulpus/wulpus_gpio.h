@@ -5,11 +5,10 @@
 
 #include "nrfx_gpiote.h"
 
-typedef void (*wp_gpio_data_handler_t)(nrfx_gpiote_pin_t pin, nrf_gpiote_polarity_t action);
-
 ret_code_t wp_gpio_init(void);
 
-ret_code_t wp_gpio_add_data_handler(wp_gpio_data_handler_t handler);
+// Rising edge of the data ready input, starts the SPI transfers of a frame through PPI (wulpus_ppi)
+uint32_t wp_gpio_data_ready_event_addr(void);
 
 void wp_gpio_led_indicate(bool on);
 void wp_gpio_led_toggle(void);
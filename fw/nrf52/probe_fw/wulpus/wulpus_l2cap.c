@@ -0,0 +1,179 @@
+#include "wulpus_l2cap.h"
+
+#include <string.h>
+
+#include "nordic_common.h"
+#include "app_util_platform.h"
+#include "nrf_sdh_ble.h"
+
+#include "wulpus_config.h"
+
+#define NRF_LOG_MODULE_NAME wp_l2cap
+#define NRF_LOG_LEVEL       4
+#define NRF_LOG_INFO_COLOR  0
+#define NRF_LOG_DEBUG_COLOR 5
+#include "nrf_log.h"
+NRF_LOG_MODULE_REGISTER();
+
+
+#define L2CAP_OBSERVER_PRIO 3
+#define L2CAP_SDU_LEN       (WULPUS_FRAME_HEADER_LEN + 2 * WULPUS_FRAME_NUM_SAMPLES)
+
+uint16_t _wp_l2cap_conn_handle = BLE_CONN_HANDLE_INVALID;
+uint16_t _wp_l2cap_cid = BLE_L2CAP_CID_INVALID;
+uint16_t _wp_l2cap_tx_mtu = 0;
+
+// SDUs owned by the SoftDevice until BLE_L2CAP_EVT_CH_TX, at most as many as it queues:
+// sd_ble_l2cap_ch_tx() never runs out of room
+volatile size_t _wp_l2cap_sdu_count = 0;
+
+
+static void _wp_l2cap_close(void)
+{
+  _wp_l2cap_cid = BLE_L2CAP_CID_INVALID;
+  _wp_l2cap_tx_mtu = 0;
+
+  // The SoftDevice dropped the queued SDUs
+  _wp_l2cap_sdu_count = 0;
+}
+
+static void _wp_l2cap_on_setup_request(ble_l2cap_evt_t const *p_evt)
+{
+  ble_l2cap_ch_setup_params_t params;
+  uint16_t cid = p_evt->local_cid;
+
+  memset(&params, 0, sizeof(params));
+
+  // Nothing is received on the channel, the dongle gets no credits
+  params.rx_params.rx_mtu = BLE_L2CAP_MTU_MIN;
+  params.rx_params.rx_mps = BLE_L2CAP_MPS_MIN;
+  params.rx_params.sdu_buf.p_data = NULL;
+  params.rx_params.sdu_buf.len = 0;
+
+  if (p_evt->params.ch_setup_request.le_psm != WULPUS_L2CAP_PSM)
+  {
+    params.status = BLE_L2CAP_CH_STATUS_CODE_LE_PSM_NOT_SUPPORTED;
+  }
+  else if ((_wp_l2cap_cid != BLE_L2CAP_CID_INVALID) ||
+           (p_evt->params.ch_setup_request.tx_params.tx_mtu < L2CAP_SDU_LEN))
+  {
+    // One channel only, and it must take the longest frame in one SDU
+    params.status = BLE_L2CAP_CH_STATUS_CODE_UNACCEPTABLE_PARAMS;
+  }
+  else
+  {
+    params.status = BLE_L2CAP_CH_STATUS_CODE_SUCCESS;
+  }
+
+  APP_ERROR_CHECK(sd_ble_l2cap_ch_setup(p_evt->conn_handle, &cid, &params));
+}
+
+static void _wp_l2cap_evt_handler(ble_evt_t const *p_ble_evt, void *p_context)
+{
+  UNUSED_PARAMETER(p_context);
+
+  ble_l2cap_evt_t const *p_evt = &p_ble_evt->evt.l2cap_evt;
+
+  switch (p_ble_evt->header.evt_id)
+  {
+    case BLE_GAP_EVT_CONNECTED:
+      _wp_l2cap_conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
+      break;
+
+    case BLE_GAP_EVT_DISCONNECTED:
+      _wp_l2cap_conn_handle = BLE_CONN_HANDLE_INVALID;
+      _wp_l2cap_close();
+      break;
+
+    case BLE_L2CAP_EVT_CH_SETUP_REQUEST:
+      _wp_l2cap_on_setup_request(p_evt);
+      break;
+
+    case BLE_L2CAP_EVT_CH_SETUP:
+      _wp_l2cap_cid = p_evt->local_cid;
+      _wp_l2cap_tx_mtu = p_evt->params.ch_setup.tx_params.tx_mtu;
+      NRF_LOG_INFO("Channel set up: MTU %u, MPS %u, %u credits", _wp_l2cap_tx_mtu,
+                   p_evt->params.ch_setup.tx_params.tx_mps, p_evt->params.ch_setup.tx_params.credits);
+      break;
+
+    case BLE_L2CAP_EVT_CH_RELEASED:
+      if (p_evt->local_cid != _wp_l2cap_cid) break;
+      NRF_LOG_INFO("Channel released, falling back to notifications");
+      _wp_l2cap_close();
+      break;
+
+    case BLE_L2CAP_EVT_CH_TX:
+      // Released in the order they were queued
+      if ((p_evt->local_cid != _wp_l2cap_cid) || (_wp_l2cap_sdu_count == 0)) break;
+      _wp_l2cap_sdu_count--;
+      break;
+
+    default:
+      break;
+  }
+}
+
+NRF_SDH_BLE_OBSERVER(_wp_l2cap_observer, L2CAP_OBSERVER_PRIO, _wp_l2cap_evt_handler, NULL);
+
+ret_code_t wp_l2cap_cfg_set(uint8_t conn_cfg_tag, uint32_t ram_start)
+{
+#if WULPUS_L2CAP_ENABLED
+  ble_cfg_t ble_cfg;
+  memset(&ble_cfg, 0, sizeof(ble_cfg));
+
+  ble_cfg.conn_cfg.conn_cfg_tag                        = conn_cfg_tag;
+  ble_cfg.conn_cfg.params.l2cap_conn_cfg.rx_mps        = BLE_L2CAP_MPS_MIN;
+  ble_cfg.conn_cfg.params.l2cap_conn_cfg.tx_mps        = WULPUS_L2CAP_MPS;
+  ble_cfg.conn_cfg.params.l2cap_conn_cfg.rx_queue_size = 1;
+  ble_cfg.conn_cfg.params.l2cap_conn_cfg.tx_queue_size = WULPUS_L2CAP_TX_QUEUE_LEN;
+  ble_cfg.conn_cfg.params.l2cap_conn_cfg.ch_count      = 1;
+
+  return sd_ble_cfg_set(BLE_CONN_CFG_L2CAP, &ble_cfg, ram_start);
+#else
+  // Without channels the SoftDevice refuses every setup request
+  UNUSED_PARAMETER(conn_cfg_tag);
+  UNUSED_PARAMETER(ram_start);
+  return NRF_SUCCESS;
+#endif
+}
+
+bool wp_l2cap_is_active(void)
+{
+  return _wp_l2cap_cid != BLE_L2CAP_CID_INVALID;
+}
+
+size_t wp_l2cap_tx_free(void)
+{
+  return WULPUS_L2CAP_TX_QUEUE_LEN - _wp_l2cap_sdu_count;
+}
+
+size_t wp_l2cap_tx_pending(void)
+{
+  return _wp_l2cap_sdu_count;
+}
+
+ret_code_t wp_l2cap_transmit(uint8_t const *frame, uint16_t length)
+{
+  if (length > L2CAP_SDU_LEN) return NRF_ERROR_INVALID_LENGTH;
+  if (wp_l2cap_tx_free() == 0) return NRF_ERROR_NO_MEM;
+
+  // Released since wp_l2cap_is_active(), the frame is lost like a notification after a disconnect
+  uint16_t cid = _wp_l2cap_cid;
+  if (cid == BLE_L2CAP_CID_INVALID) return NRF_SUCCESS;
+
+  ble_data_t sdu_buf =
+  {
+    .p_data = (uint8_t *)frame,
+    .len    = length,
+  };
+
+  ret_code_t err_code = sd_ble_l2cap_ch_tx(_wp_l2cap_conn_handle, cid, &sdu_buf);
+  if ((err_code == NRF_ERROR_INVALID_STATE) || (err_code == BLE_ERROR_INVALID_CONN_HANDLE)) return NRF_SUCCESS;
+  WP_ERR_RET(err_code);
+
+  CRITICAL_REGION_ENTER();
+  _wp_l2cap_sdu_count++;
+  CRITICAL_REGION_EXIT();
+
+  return NRF_SUCCESS;
+}
@@ -0,0 +1,25 @@
+#ifndef __WULPUS_L2CAP__
+#define __WULPUS_L2CAP__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "wulpus_common.h"
+
+// L2CAP connection-oriented channel, opened by the dongle on WULPUS_L2CAP_PSM
+// Every frame is sent as one SDU (no stream header, the SDU length is the frame length),
+// the credits of the dongle throttle the probe. Without a channel the frames are notified (wulpus_stream)
+// The dongle has to accept SDUs of the longest frame (MTU of at least 812 bytes)
+
+// Called by wp_ble_init() before the SoftDevice is enabled
+ret_code_t wp_l2cap_cfg_set(uint8_t conn_cfg_tag, uint32_t ram_start);
+
+bool wp_l2cap_is_active(void);
+
+// Non-blocking: the frame is queued as SDU without a copy, it must stay untouched until the
+// SoftDevice released it (released in order, wp_l2cap_tx_pending() counts the queued frames)
+ret_code_t wp_l2cap_transmit(uint8_t const *frame, uint16_t length);
+size_t wp_l2cap_tx_free(void);
+size_t wp_l2cap_tx_pending(void);
+
+#endif // __WULPUS_L2CAP__
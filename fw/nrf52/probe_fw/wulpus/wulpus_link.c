@@ -0,0 +1,119 @@
+#include "wulpus_link.h"
+
+#include "nordic_common.h"
+#include "app_timer.h"
+#include "app_util.h"
+
+#include "wulpus_ble.h"
+#include "wulpus_stream.h"
+#include "wulpus_config.h"
+
+#define NRF_LOG_MODULE_NAME wp_link
+#define NRF_LOG_LEVEL       4
+#define NRF_LOG_INFO_COLOR  0
+#define NRF_LOG_DEBUG_COLOR 5
+#include "nrf_log.h"
+NRF_LOG_MODULE_REGISTER();
+
+
+// Connection intervals in 1.25 ms units
+#define LINK_MIN_INTERVAL   ((uint16_t)MSEC_TO_UNITS(WULPUS_BLE_MIN_CONN_INTERVAL, UNIT_1_25_MS))
+#define LINK_MAX_INTERVAL   ((uint16_t)MSEC_TO_UNITS(WULPUS_BLE_MAX_CONN_INTERVAL, UNIT_1_25_MS))
+#define LINK_UNITS_PER_SEC  800
+
+STATIC_ASSERT(LINK_MAX_INTERVAL >= LINK_MIN_INTERVAL);
+
+APP_TIMER_DEF(_wp_link_timer);
+
+// Set by the timer, the interval is chosen by the main loop
+volatile bool _wp_link_update_due = false;
+uint32_t _wp_link_bytes = 0;
+// New configuration, its data rate is measured from the shortest interval
+bool _wp_link_restarted = false;
+// Last interval requested (or the preferred one of a new connection)
+uint16_t _wp_link_interval = LINK_MIN_INTERVAL;
+
+
+static void _wp_link_timer_handler(void *p_context)
+{
+  UNUSED_PARAMETER(p_context);
+
+  _wp_link_update_due = true;
+}
+
+// Longest interval of the ladder which carries the data rate with headroom
+static uint16_t _wp_link_choose(uint32_t bytes)
+{
+  uint64_t event_bytes = (uint64_t)WULPUS_BLE_LINK_PACKETS_PER_EVENT * (wp_ble_max_data_len() - WP_STREAM_HEADER_LEN);
+  uint64_t rate = (uint64_t)bytes * 1000 / WULPUS_BLE_LINK_UPDATE_INTERVAL * WULPUS_BLE_LINK_HEADROOM;
+  uint16_t interval = LINK_MIN_INTERVAL;
+
+  // Throughput of the next step: event_bytes per interval
+  while ((2 * interval <= LINK_MAX_INTERVAL) && (rate * 2 * interval <= event_bytes * LINK_UNITS_PER_SEC))
+  {
+    interval *= 2;
+  }
+
+  return interval;
+}
+
+static void _wp_link_request(uint16_t interval)
+{
+  ret_code_t err_code = wp_ble_conn_interval_request(interval, interval);
+
+  // Still negotiating the last request, or not connected: tried again in the next window
+  if ((err_code == NRF_ERROR_BUSY) || (err_code == NRF_ERROR_INVALID_STATE)) return;
+  APP_ERROR_CHECK(err_code);
+
+  NRF_LOG_INFO("Requested connection interval %u x 1.25 ms", interval);
+  _wp_link_interval = interval;
+}
+
+ret_code_t wp_link_init(void)
+{
+  WP_ERR_RET(app_timer_create(&_wp_link_timer, APP_TIMER_MODE_REPEATED, _wp_link_timer_handler));
+  WP_ERR_RET(app_timer_start(_wp_link_timer, APP_TIMER_TICKS(WULPUS_BLE_LINK_UPDATE_INTERVAL), NULL));
+
+  return NRF_SUCCESS;
+}
+
+void wp_link_reset(void)
+{
+  _wp_link_bytes = 0;
+  _wp_link_interval = LINK_MIN_INTERVAL;
+  _wp_link_restarted = false;
+}
+
+void wp_link_restart(void)
+{
+  _wp_link_bytes = 0;
+  _wp_link_restarted = true;
+}
+
+void wp_link_count(uint16_t length)
+{
+  _wp_link_bytes += length;
+}
+
+void wp_link_process(bool backlog)
+{
+  // The link doesn't keep up (or the MSP430 flushes its FRAM backlog), or the stream was restarted
+  bool shortest = backlog || _wp_link_restarted;
+  if (shortest && (_wp_link_interval != LINK_MIN_INTERVAL))
+  {
+    _wp_link_request(LINK_MIN_INTERVAL);
+  }
+  if (_wp_link_interval == LINK_MIN_INTERVAL) _wp_link_restarted = false;
+
+  if (!_wp_link_update_due) return;
+  _wp_link_update_due = false;
+
+  uint16_t interval = _wp_link_choose(_wp_link_bytes);
+  _wp_link_bytes = 0;
+
+  // Relaxed one step per window, a burst of frames is not cut off by a long interval
+  if (shortest) interval = LINK_MIN_INTERVAL;
+  else interval = MIN(interval, 2 * _wp_link_interval);
+
+  if (interval != _wp_link_interval) _wp_link_request(interval);
+}
@@ -0,0 +1,24 @@
+#ifndef __WULPUS_LINK__
+#define __WULPUS_LINK__
+
+#include <stdint.h>
+
+#include "wulpus_common.h"
+
+// Connection interval adapted to the data rate of the stream: the bytes sent are measured over
+// WULPUS_BLE_LINK_UPDATE_INTERVAL and the longest interval from WULPUS_BLE_MIN_CONN_INTERVAL doubled
+// up to WULPUS_BLE_MAX_CONN_INTERVAL is requested which carries WULPUS_BLE_LINK_HEADROOM times that rate.
+// The interval is relaxed by one step per window and shortened right away
+
+ret_code_t wp_link_init(void);
+// Connected or disconnected: a new connection starts at the preferred (shortest) interval
+void wp_link_reset(void);
+// New configuration: the shortest interval is requested until its data rate is measured
+void wp_link_restart(void);
+// Bytes written to the stream (called from the main loop)
+void wp_link_count(uint16_t length);
+// Requests a new interval at the end of the window, or the shortest one right away
+// while frames are waiting in the buffer (called from the main loop)
+void wp_link_process(bool backlog);
+
+#endif // __WULPUS_LINK__
@@ -4,7 +4,7 @@
 #include "nrfx_ppi.h"
 
 #include "wulpus_config.h"
-#include "wulpus_spi.h"
+#include "wulpus_gpio.h"
 
 #define NRF_LOG_MODULE_NAME wp_ppi
 #define NRF_LOG_LEVEL       4
@@ -14,11 +14,14 @@
 NRF_LOG_MODULE_REGISTER();
 
 
-// TIMER3: Used to start SPI transfers at regular intervals
+// TIMER3: Used to start SPI transfers at regular intervals, started by the data ready input
 const nrfx_timer_t tim_timeout = NRFX_TIMER_INSTANCE(3);
-// TIMER4: Used in Counter mode to count number of completed transfers and stop the SPI after certain number of transfers
+// TIMER4: Used in Counter mode to count number of completed transfers and stop TIMER3 after certain number of transfers
 const nrfx_timer_t tim_counter = NRFX_TIMER_INSTANCE(4);
 
+// Rising edge of the data ready input starts TIMER3, only enabled while a reception is armed
+nrf_ppi_channel_t channel_data_ready;
+
 wp_ppi_end_handler_t _wp_ppi_end_handlers[WULPUS_PPI_MAX_END_HANDLERS];
 size_t _wp_ppi_end_handlers_num = 0;
 
@@ -27,6 +30,11 @@ uint32_t task_spi_start_addr;
 uint32_t event_spi_end_addr;
 uint32_t event_timeout_addr;
 uint32_t task_cnt_count_addr;
+uint32_t event_data_ready_addr;
+uint32_t event_cnt_frame_addr;
+uint32_t task_timeout_start_addr;
+uint32_t task_timeout_stop_addr;
+uint32_t task_timeout_clear_addr;
 
 
 void _wp_ppi_tim_timeout_handler(nrf_timer_event_t event_type, void *p_context)
@@ -38,10 +46,7 @@ void _wp_ppi_tim_timeout_handler(nrf_timer_event_t event_type, void *p_context)
 
 void _wp_ppi_tim_counter_handler(nrf_timer_event_t event_type, void *p_context)
 {
-  // Stop timers and thus SPI transfers
-  wp_ppi_stop_transfer();
-  wp_spi_stop_reception();
-
+  // TIMER3 was already stopped and cleared through PPI, the SPI transfer stays armed for the next frame
   NRF_LOG_DEBUG("Counter handler called: %u callbacks", _wp_ppi_end_handlers_num);
 
   for (size_t i = 0; i < _wp_ppi_end_handlers_num; i++)
@@ -71,6 +76,11 @@ ret_code_t wp_ppi_init(const nrf_drv_spi_t *spi_instance)
   nrfx_timer_extended_compare(&tim_counter, NRF_TIMER_CC_CHANNEL0, WULPUS_NUMBER_OF_XFERS, NRF_TIMER_SHORT_COMPARE0_CLEAR_MASK, true);
   
   task_cnt_count_addr = nrfx_timer_task_address_get(&tim_counter, NRF_TIMER_TASK_COUNT);
+  event_cnt_frame_addr = nrfx_timer_event_address_get(&tim_counter, NRF_TIMER_EVENT_COMPARE0);
+
+  task_timeout_start_addr = nrfx_timer_task_address_get(&tim_timeout, NRF_TIMER_TASK_START);
+  task_timeout_stop_addr = nrfx_timer_task_address_get(&tim_timeout, NRF_TIMER_TASK_STOP);
+  task_timeout_clear_addr = nrfx_timer_task_address_get(&tim_timeout, NRF_TIMER_TASK_CLEAR);
 
   NRF_LOG_DEBUG("Initialized timers");
 
@@ -78,9 +88,16 @@ ret_code_t wp_ppi_init(const nrf_drv_spi_t *spi_instance)
   // ------------------------------------------------------
   nrf_ppi_channel_t channel_start_spi;
   nrf_ppi_channel_t channel_end_spi;
+  nrf_ppi_channel_t channel_end_frame;
 
   task_spi_start_addr = nrf_drv_spi_start_task_get(spi_instance);
   event_spi_end_addr = nrf_drv_spi_end_event_get(spi_instance);
+  event_data_ready_addr = wp_gpio_data_ready_event_addr();
+
+  // Data ready starts timer 3, the first transfer follows after one interval
+  WP_ERR_RET(nrfx_ppi_channel_alloc(&channel_data_ready));
+
+  WP_ERR_RET(nrfx_ppi_channel_assign(channel_data_ready, event_data_ready_addr, task_timeout_start_addr));
   
   // Timer 3 CC causes SPI to start
   WP_ERR_RET(nrfx_ppi_channel_alloc(&channel_start_spi));
@@ -92,10 +109,17 @@ ret_code_t wp_ppi_init(const nrf_drv_spi_t *spi_instance)
   WP_ERR_RET(nrfx_ppi_channel_alloc(&channel_end_spi));
   
   WP_ERR_RET(nrfx_ppi_channel_assign(channel_end_spi, event_spi_end_addr, task_cnt_count_addr));
+
+  // Last transfer of a frame stops and clears timer 3 until the next data ready
+  WP_ERR_RET(nrfx_ppi_channel_alloc(&channel_end_frame));
+
+  WP_ERR_RET(nrfx_ppi_channel_assign(channel_end_frame, event_cnt_frame_addr, task_timeout_stop_addr));
+  WP_ERR_RET(nrfx_ppi_channel_fork_assign(channel_end_frame, task_timeout_clear_addr));
   
-  // Enable both configured PPI channels
+  // Enable the configured PPI channels, data ready only once a reception is armed
   WP_ERR_RET(nrfx_ppi_channel_enable(channel_start_spi));
   WP_ERR_RET(nrfx_ppi_channel_enable(channel_end_spi));
+  WP_ERR_RET(nrfx_ppi_channel_enable(channel_end_frame));
 
   NRF_LOG_DEBUG("Initialized channels");
 
@@ -118,20 +142,22 @@ ret_code_t wp_ppi_add_end_handler(wp_ppi_end_handler_t handler)
 void wp_ppi_start_transfer(void)
 {
   // First, reset the timers to get clean situation
+  nrfx_timer_disable(&tim_timeout);
   nrfx_timer_clear(&tim_timeout);
   nrfx_timer_clear(&tim_counter);
 
-  // Then, enable the timers
-  nrfx_timer_enable(&tim_timeout);
+  // Then, enable the counter, timer 3 is started by every data ready
   nrfx_timer_enable(&tim_counter);
+  APP_ERROR_CHECK(nrfx_ppi_channel_enable(channel_data_ready));
 
   NRF_LOG_DEBUG("Enabled transfer");
 }
 
 void wp_ppi_stop_transfer(void)
 {
-  // Disable the timers
+  // Ignore data ready, then disable the timers
   // We don't reset the timers here
+  APP_ERROR_CHECK(nrfx_ppi_channel_disable(channel_data_ready));
   nrfx_timer_disable(&tim_timeout);
   nrfx_timer_disable(&tim_counter);
 
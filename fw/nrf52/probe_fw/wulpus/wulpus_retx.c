@@ -0,0 +1,109 @@
+#include "wulpus_retx.h"
+
+#include <string.h>
+
+#include "nordic_common.h"
+
+#include "wulpus_delta.h"
+#include "wulpus_compress.h"
+#include "wulpus_config.h"
+
+#define NRF_LOG_MODULE_NAME wp_retx
+#define NRF_LOG_LEVEL       4
+#define NRF_LOG_INFO_COLOR  0
+#define NRF_LOG_DEBUG_COLOR 5
+#include "nrf_log.h"
+NRF_LOG_MODULE_REGISTER();
+
+
+#define FRAME_LEN           (WULPUS_FRAME_HEADER_LEN + 2 * WULPUS_FRAME_NUM_SAMPLES)
+#define FRAME_IDX_NUMBER    2
+#define FRAME_IDX_FLAGS     7
+
+// Two requests of the host may wait for the main loop
+#define RETX_QUEUE_LEN      (2 * WULPUS_NACK_MAX_FRAMES + 1)
+
+// Written by the BLE handler (head) and the main loop (tail), one slot stays empty
+uint16_t _wp_retx_queue[RETX_QUEUE_LEN];
+volatile size_t _wp_retx_head = 0;
+volatile size_t _wp_retx_tail = 0;
+
+
+static inline uint16_t _wp_retx_get_u16(uint8_t const *src)
+{
+  return (uint16_t)(src[0] | (src[1] << 8));
+}
+
+bool wp_retx_is_nack_packet(uint8_t const *data, uint16_t length)
+{
+  return (length >= WP_RETX_NACK_HEADER_LEN) && (data[0] == WULPUS_NACK_PACKET);
+}
+
+ret_code_t wp_retx_request(uint8_t const *data, uint16_t length)
+{
+  if (!wp_retx_is_nack_packet(data, length)) return NRF_ERROR_INVALID_PARAM;
+
+  uint8_t count = data[1];
+  if ((count == 0) || (count > WULPUS_NACK_MAX_FRAMES)) return NRF_ERROR_INVALID_PARAM;
+  if (length < WP_RETX_NACK_HEADER_LEN + 2 * count) return NRF_ERROR_INVALID_LENGTH;
+
+  for (size_t i = 0; i < count; i++)
+  {
+    size_t next = (_wp_retx_head + 1) % RETX_QUEUE_LEN;
+
+    // The host times the missing frames out
+    if (next == _wp_retx_tail) return NRF_ERROR_NO_MEM;
+
+    _wp_retx_queue[_wp_retx_head] = _wp_retx_get_u16(data + WP_RETX_NACK_HEADER_LEN + 2 * i);
+    __DMB();
+    _wp_retx_head = next;
+  }
+
+  NRF_LOG_DEBUG("%u frames requested from %u", count, _wp_retx_get_u16(data + WP_RETX_NACK_HEADER_LEN));
+
+  return NRF_SUCCESS;
+}
+
+void wp_retx_reset(void)
+{
+  _wp_retx_tail = _wp_retx_head;
+}
+
+bool wp_retx_next(uint16_t *frame_number)
+{
+  size_t tail = _wp_retx_tail;
+  if (tail == _wp_retx_head) return false;
+
+  *frame_number = _wp_retx_queue[tail];
+  _wp_retx_tail = (tail + 1) % RETX_QUEUE_LEN;
+
+  return true;
+}
+
+uint16_t wp_retx_frame_number(uint8_t const *frame)
+{
+  return _wp_retx_get_u16(frame + FRAME_IDX_NUMBER);
+}
+
+uint16_t wp_retx_frame_length(uint8_t const *frame)
+{
+  uint8_t flags = frame[FRAME_IDX_FLAGS];
+
+  if ((flags & WP_COMPRESS_FLAGS) == WP_COMPRESS_FLAGS)
+  {
+    return WULPUS_FRAME_HEADER_LEN + WP_COMPRESS_HEADER_LEN + _wp_retx_get_u16(frame + WULPUS_FRAME_HEADER_LEN);
+  }
+  if (flags & WP_DELTA_FLAG_UNCHANGED) return WULPUS_FRAME_HEADER_LEN;
+  if (flags & WP_DELTA_FLAG_DELTA) return WULPUS_FRAME_HEADER_LEN + WULPUS_FRAME_NUM_SAMPLES;
+
+  return FRAME_LEN;
+}
+
+void wp_retx_lost_record(uint16_t frame_number, uint8_t *record)
+{
+  memset(record, 0, WP_RETX_LOST_LEN);
+
+  record[0] = WULPUS_LOST_START_OF_FRAME;
+  record[FRAME_IDX_NUMBER] = (uint8_t)frame_number;
+  record[FRAME_IDX_NUMBER + 1] = (uint8_t)(frame_number >> 8);
+}
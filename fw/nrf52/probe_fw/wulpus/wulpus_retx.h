@@ -0,0 +1,31 @@
+#ifndef __WULPUS_RETX__
+#define __WULPUS_RETX__
+
+#include <stdint.h>
+
+#include "wulpus_common.h"
+
+// Retransmission request of the host for frames missing in the stream (consumed by the nRF52)
+// [0] WULPUS_NACK_PACKET, [1] number of frames n (1 to WULPUS_NACK_MAX_FRAMES), [2-] n frame numbers
+// Frames which were sent but are not overwritten in the frame buffer yet are sent again as they were
+// (with their delta encoding or compression), the others are reported lost
+#define WP_RETX_NACK_HEADER_LEN 2
+
+// Lost report, sent in the stream like a frame
+// [0] WULPUS_LOST_START_OF_FRAME, [1] reserved, [2-3] frame number, [4-11] reserved
+#define WP_RETX_LOST_LEN        WULPUS_FRAME_HEADER_LEN
+
+bool wp_retx_is_nack_packet(uint8_t const *data, uint16_t length);
+// Queues the requested frames (called from the BLE handler), requests beyond the queue are dropped
+ret_code_t wp_retx_request(uint8_t const *data, uint16_t length);
+void wp_retx_reset(void);
+// Next requested frame (called from the main loop), false if there is none
+bool wp_retx_next(uint16_t *frame_number);
+
+// Frame number of a US frame in the frame buffer
+uint16_t wp_retx_frame_number(uint8_t const *frame);
+// Length of a US frame as it was sent (after the delta encoding and the compression)
+uint16_t wp_retx_frame_length(uint8_t const *frame);
+void wp_retx_lost_record(uint16_t frame_number, uint8_t *record);
+
+#endif // __WULPUS_RETX__
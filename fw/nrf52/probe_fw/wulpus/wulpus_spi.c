@@ -19,16 +19,19 @@ uint8_t _wp_spi_rx_length = 0;
 uint8_t *_wp_spi_tx_buffer = NULL;
 uint8_t _wp_spi_tx_length = 0;
 
+// A configuration is being sent, the reception can't be armed before it is done
+volatile bool _wp_spi_config_busy = false;
+
 void _wp_spi_evt_handler(nrf_drv_spi_evt_t const *p_event, void *p_context)
 {
-  // Never called since NRF_DRV_SPI_FLAG_NO_XFER_EVT_HANDLER flag is used
-  // NRF_LOG_WARNING("Event handler called, should not happen");
+  // Only called for the configurations, the reception uses the NRF_DRV_SPI_FLAG_NO_XFER_EVT_HANDLER flag
 
   // NRF_LOG_DEBUG("Event handler called");
   switch (p_event->type)
   {
     case NRF_DRV_SPI_EVENT_DONE:
       NRF_LOG_DEBUG("rx/tx length: %u/%u", p_event->data.done.rx_length, p_event->data.done.tx_length);
+      _wp_spi_config_busy = false;
       break;
   }
 }
@@ -66,6 +69,15 @@ const nrf_drv_spi_t *wp_spi_get_instance(void)
 void wp_spi_set_buffer(uint8_t *buffer)
 {
   _wp_spi_rx_buffer = buffer;
+
+  // While armed, the RX pointer is incremented after every transfer (NRF_DRV_SPI_FLAG_RX_POSTINC):
+  // it already points behind the last frame, only a wrap or a dropped frame moves it
+  nrf_spim_rx_buffer_set(spi.u.spim.p_reg, buffer, _wp_spi_rx_length);
+}
+
+bool wp_spi_is_busy(void)
+{
+  return _wp_spi_config_busy;
 }
 
 ret_code_t wp_spi_send_config(uint8_t const *buffer, uint8_t length)
@@ -74,13 +86,20 @@ ret_code_t wp_spi_send_config(uint8_t const *buffer, uint8_t length)
   memset(_wp_spi_tx_buffer, 0, _wp_spi_tx_length);
   memcpy(_wp_spi_tx_buffer, buffer, length);
   nrf_drv_spi_xfer_desc_t send_config_config = NRF_DRV_SPI_XFER_TX(_wp_spi_tx_buffer, _wp_spi_tx_length);
-  WP_ERR_RET(nrf_drv_spi_xfer(&spi, &send_config_config, NULL));
+  _wp_spi_config_busy = true;
+  ret_code_t err_code = nrf_drv_spi_xfer(&spi, &send_config_config, NULL);
+  if (err_code != NRF_SUCCESS) _wp_spi_config_busy = false;
+  WP_ERR_RET(err_code);
 
   return NRF_SUCCESS;
 }
 
 ret_code_t wp_spi_init_reception(void)
 {
+  if (_wp_spi_config_busy) return NRF_ERROR_BUSY;
+
+  // Armed once per configuration: PPI starts the transfers of every frame
+  // and the RX pointer advances through the frame buffer
   nrf_drv_spi_xfer_desc_t xfer = NRF_DRV_SPI_XFER_TRX(_wp_spi_tx_buffer, _wp_spi_tx_length, _wp_spi_rx_buffer, _wp_spi_rx_length);
   uint32_t flags = NRF_DRV_SPI_FLAG_HOLD_XFER | NRF_DRV_SPI_FLAG_RX_POSTINC | NRF_DRV_SPI_FLAG_REPEATED_XFER | NRF_DRV_SPI_FLAG_NO_XFER_EVT_HANDLER;
   WP_ERR_RET(nrf_drv_spi_xfer(&spi, &xfer, flags));
@@ -90,5 +109,7 @@ ret_code_t wp_spi_init_reception(void)
 
 void wp_spi_stop_reception(void)
 {
+  // Also aborts a configuration still being sent
   nrf_drv_spi_abort(&spi);
+  _wp_spi_config_busy = false;
 }
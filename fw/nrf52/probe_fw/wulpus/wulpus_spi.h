@@ -8,7 +8,9 @@
 ret_code_t wp_spi_init(uint8_t *tx_buffer, uint16_t tx_length, uint8_t *rx_buffer, uint16_t rx_length);
 const nrf_drv_spi_t *wp_spi_get_instance(void);
 
+// Also moves the RX pointer of an armed reception, takes effect with the next transfer
 void wp_spi_set_buffer(uint8_t *buffer);
+bool wp_spi_is_busy(void);
 
 ret_code_t wp_spi_send_config(uint8_t const *buffer, uint8_t length);
 
@@ -0,0 +1,152 @@
+#include "wulpus_stream.h"
+
+#include <string.h>
+
+#include "nordic_common.h"
+#include "app_timer.h"
+
+#include "wulpus_ble.h"
+#include "wulpus_config.h"
+
+#define NRF_LOG_MODULE_NAME wp_stream
+#define NRF_LOG_LEVEL       4
+#define NRF_LOG_INFO_COLOR  0
+#define NRF_LOG_DEBUG_COLOR 5
+#include "nrf_log.h"
+NRF_LOG_MODULE_REGISTER();
+
+
+#define STREAM_IDX_SEQ          0
+#define STREAM_IDX_RECORD_START 1
+#define STREAM_NO_DEADLINE      0xFFFF
+
+APP_TIMER_DEF(_wp_stream_deadline_timer);
+
+// One packet more than the BLE TX queue holds: the packet being filled is never queued
+// (only accessed from the main loop)
+uint8_t _wp_stream_packets[WULPUS_BLE_TX_QUEUE_LEN][WULPUS_BLE_MAX_DATA_LEN];
+size_t _wp_stream_packet_idx = 0;
+uint16_t _wp_stream_packet_len = 0;      // Bytes in the packet being filled (0: no packet open)
+uint16_t _wp_stream_packet_max_len = 0;  // Length of the packet being filled once it is full
+uint8_t _wp_stream_seq = 0;
+
+// The deadline timer runs for the packet being filled, it reports the sequence number of its packet:
+// a timer started for a packet which was sent full in the meantime expires without effect
+bool _wp_stream_deadline_armed = false;
+volatile uint16_t _wp_stream_deadline_seq = STREAM_NO_DEADLINE;
+
+
+static void _wp_stream_deadline_handler(void *p_context)
+{
+  _wp_stream_deadline_seq = (uint16_t)(uintptr_t)p_context;
+}
+
+// Payload of a notification at the negotiated MTU
+static uint16_t _wp_stream_payload_len(void)
+{
+  return MIN(wp_ble_max_data_len(), WULPUS_BLE_MAX_DATA_LEN) - WP_STREAM_HEADER_LEN;
+}
+
+static void _wp_stream_open(void)
+{
+  uint8_t *packet = _wp_stream_packets[_wp_stream_packet_idx];
+
+  packet[STREAM_IDX_SEQ] = _wp_stream_seq++;
+  packet[STREAM_IDX_RECORD_START] = WP_STREAM_NO_RECORD_START;
+
+  _wp_stream_packet_len = WP_STREAM_HEADER_LEN;
+  _wp_stream_packet_max_len = WP_STREAM_HEADER_LEN + _wp_stream_payload_len();
+}
+
+static ret_code_t _wp_stream_commit(void)
+{
+  WP_ERR_RET(wp_ble_transmit(_wp_stream_packets[_wp_stream_packet_idx], _wp_stream_packet_len));
+
+  _wp_stream_packet_idx = (_wp_stream_packet_idx + 1) % WULPUS_BLE_TX_QUEUE_LEN;
+  _wp_stream_packet_len = 0;
+  _wp_stream_deadline_armed = false;
+
+  return NRF_SUCCESS;
+}
+
+ret_code_t wp_stream_init(void)
+{
+  return app_timer_create(&_wp_stream_deadline_timer, APP_TIMER_MODE_SINGLE_SHOT, _wp_stream_deadline_handler);
+}
+
+void wp_stream_reset(void)
+{
+  // Drop the packet being filled, the host resynchronises on the next record start
+  _wp_stream_packet_len = 0;
+  _wp_stream_deadline_armed = false;
+}
+
+size_t wp_stream_free(void)
+{
+  // Every packet needs a slot in the BLE TX queue once it is full
+  size_t free = wp_ble_tx_free() * _wp_stream_payload_len();
+  size_t used = (_wp_stream_packet_len > 0) ? (_wp_stream_packet_len - WP_STREAM_HEADER_LEN) : 0;
+
+  return (free > used) ? (free - used) : 0;
+}
+
+ret_code_t wp_stream_write(uint8_t const *record, uint16_t length)
+{
+  if (length > wp_stream_free()) return NRF_ERROR_NO_MEM;
+
+  bool record_start = true;
+
+  while (length > 0)
+  {
+    if (_wp_stream_packet_len == 0) _wp_stream_open();
+
+    uint8_t *packet = _wp_stream_packets[_wp_stream_packet_idx];
+    uint16_t chunk = MIN(length, _wp_stream_packet_max_len - _wp_stream_packet_len);
+
+    if (record_start && (packet[STREAM_IDX_RECORD_START] == WP_STREAM_NO_RECORD_START))
+    {
+      packet[STREAM_IDX_RECORD_START] = (uint8_t)(_wp_stream_packet_len - WP_STREAM_HEADER_LEN);
+    }
+    record_start = false;
+
+    memcpy(packet + _wp_stream_packet_len, record, chunk);
+    _wp_stream_packet_len += chunk;
+    record += chunk;
+    length -= chunk;
+
+    if (_wp_stream_packet_len == _wp_stream_packet_max_len)
+    {
+      WP_ERR_RET(_wp_stream_commit());
+    }
+  }
+
+  // Only a packet left partly filled waits for its deadline, one timer start per packet at most
+  if ((_wp_stream_packet_len > 0) && !_wp_stream_deadline_armed)
+  {
+    uint8_t seq = _wp_stream_packets[_wp_stream_packet_idx][STREAM_IDX_SEQ];
+
+    _wp_stream_deadline_seq = STREAM_NO_DEADLINE;
+    WP_ERR_RET(app_timer_stop(_wp_stream_deadline_timer));
+    WP_ERR_RET(app_timer_start(_wp_stream_deadline_timer, APP_TIMER_TICKS(WULPUS_STREAM_FLUSH_DEADLINE),
+                               (void *)(uintptr_t)seq));
+    _wp_stream_deadline_armed = true;
+  }
+
+  return NRF_SUCCESS;
+}
+
+void wp_stream_flush(void)
+{
+  // Sends the packet being filled without waiting for more records
+  if (_wp_stream_packet_len > 0)
+  {
+    NRF_LOG_DEBUG("Flushing %u bytes", _wp_stream_packet_len);
+    APP_ERROR_CHECK(_wp_stream_commit());
+  }
+}
+
+bool wp_stream_flush_due(void)
+{
+  return (_wp_stream_packet_len > 0) &&
+         (_wp_stream_deadline_seq == _wp_stream_packets[_wp_stream_packet_idx][STREAM_IDX_SEQ]);
+}
@@ -0,0 +1,29 @@
+#ifndef __WULPUS_STREAM__
+#define __WULPUS_STREAM__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "wulpus_common.h"
+
+// Records (US frames) are packed back to back into notifications of the negotiated MTU
+// Every notification starts with a stream header:
+// [0] sequence number (increments per notification, wraps around)
+// [1] offset of the first record starting in the payload, WP_STREAM_NO_RECORD_START if none does
+// A record may span several notifications, its length follows from its frame header
+// A partly filled notification waits for further records until WULPUS_STREAM_FLUSH_DEADLINE passed,
+// short records (unchanged frames, feature records) share the notifications
+#define WP_STREAM_HEADER_LEN      2
+#define WP_STREAM_NO_RECORD_START 0xFF
+
+// Needs the app timer of the BLE module
+ret_code_t wp_stream_init(void);
+
+void wp_stream_reset(void);
+size_t wp_stream_free(void);
+ret_code_t wp_stream_write(uint8_t const *record, uint16_t length);
+void wp_stream_flush(void);
+// If the partly filled notification waited until its deadline
+bool wp_stream_flush_due(void);
+
+#endif // __WULPUS_STREAM__
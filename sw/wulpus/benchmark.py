@@ -0,0 +1,235 @@
+"""
+Copyright (C) 2023 ETH Zurich. All rights reserved.
+Author: Cedric Hirschi, ETH Zurich
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+SPDX-License-Identifier: Apache-2.0
+"""
+
+# BLE throughput benchmark of the nRF52 probe firmware.
+#
+# The nRF52 generates synthetic frames at a fixed rate and size and sends them
+# through the frame buffer and BLE stream used for the US frames, the MSP430
+# and the HV board are not needed. Direct connection only.
+#
+# Usage:
+#     python -m wulpus.benchmark --period-us 10000 --length 812 --duration 10
+
+import argparse
+import asyncio
+import time
+
+import bleak as ble
+import numpy as np
+
+from wulpus.connection.direct import (
+    WULPUS_CONTROL_CHAR_UUID,
+    WULPUS_DATA_CHAR_UUID,
+    WULPUS_SERVICE_UUID,
+)
+from wulpus.connection.frame import (
+    BENCH_START_OF_FRAME,
+    FRAME_HEADER_LEN,
+    FRAME_LEN,
+    StreamReassembler,
+)
+
+# Benchmark settings package (consumed by the nRF52)
+#   [0]    start byte
+#   [1]    enable
+#   [2-5]  frame period in microseconds
+#   [6-7]  frame length in bytes (header included)
+#   [8-11] number of frames (0: until disabled)
+START_BYTE_BENCH_CONF_PACK = 248
+
+# App timer of the probe (RTC1, 32768 Hz with a prescaler of 2), 24 bit counter
+BENCH_CLOCK_FREQ = 16384
+BENCH_CLOCK_MASK = 0xFFFFFF
+
+
+def get_bench_conf_package(
+    period_us: int, frame_len: int, num_frames: int = 0, enable: bool = True
+) -> bytes:
+    """
+    Returns the benchmark settings package.
+
+    Args:
+        period_us (int): Period of the generated frames in microseconds.
+        frame_len (int): Length of the generated frames in bytes (header included).
+        num_frames (int): Number of frames to generate (0: until disabled).
+        enable (bool): Start (True) or stop (False) the benchmark.
+    """
+
+    if not FRAME_HEADER_LEN <= frame_len <= FRAME_LEN:
+        raise ValueError(
+            f"Frame length must be between {FRAME_HEADER_LEN} and {FRAME_LEN} bytes"
+        )
+
+    return (
+        np.array([START_BYTE_BENCH_CONF_PACK, int(enable)]).astype("<u1").tobytes()
+        + np.array([period_us]).astype("<u4").tobytes()
+        + np.array([frame_len]).astype("<u2").tobytes()
+        + np.array([num_frames]).astype("<u4").tobytes()
+    )
+
+
+class BenchmarkStats:
+    """
+    Collects the synthetic frames of the probe and evaluates the link.
+    """
+
+    def __init__(self):
+        self.stream = StreamReassembler()
+        self.seqs = []
+        self.probe_times = []  # Generation time on the probe in seconds (unwrapped)
+        self.host_times = []  # Reception time on the host in seconds
+        self.frame_bytes = 0
+        self.notification_bytes = 0
+        self.notifications = 0
+        self.corrupted = 0
+        self.last_ticks = None
+        self.tick_wraps = 0
+
+    def feed(self, data: bytes):
+        now = time.perf_counter()
+
+        self.notifications += 1
+        self.notification_bytes += len(data)
+
+        for frame in self.stream.feed(data):
+            if frame[0] != BENCH_START_OF_FRAME:
+                continue
+
+            seq = int.from_bytes(frame[4:8], "little")
+            ticks = int.from_bytes(frame[8:12], "little") & BENCH_CLOCK_MASK
+
+            # Known pattern (see wulpus_bench.h)
+            expected = (seq + np.arange(FRAME_HEADER_LEN, len(frame))) & 0xFF
+            if not np.array_equal(
+                np.frombuffer(frame[FRAME_HEADER_LEN:], dtype="<u1"), expected
+            ):
+                self.corrupted += 1
+                continue
+
+            if self.last_ticks is not None and ticks < self.last_ticks:
+                self.tick_wraps += 1
+            self.last_ticks = ticks
+
+            self.seqs.append(seq)
+            self.probe_times.append(
+                (ticks + self.tick_wraps * (BENCH_CLOCK_MASK + 1)) / BENCH_CLOCK_FREQ
+            )
+            self.host_times.append(now)
+            self.frame_bytes += len(frame)
+
+    def report(self) -> dict:
+        """
+        Returns the throughput, loss and latency of the received frames.
+
+        The clocks of the probe and the host are not synchronised, the latency
+        is given relative to the fastest frame (i.e. the queueing delay).
+        """
+
+        if len(self.seqs) < 2:
+            return {"received": len(self.seqs), "corrupted": self.corrupted}
+
+        seqs = np.array(self.seqs)
+        duration = self.host_times[-1] - self.host_times[0]
+        expected = int(seqs[-1] - seqs[0]) + 1
+
+        latency = np.array(self.host_times) - np.array(self.probe_times)
+        latency = (latency - latency.min()) * 1e3
+
+        return {
+            "received": len(seqs),
+            "lost": expected - len(seqs),
+            "loss_percent": 100 * (expected - len(seqs)) / expected,
+            "corrupted": self.corrupted,
+            "duration_s": duration,
+            "frame_rate_hz": (len(seqs) - 1) / duration,
+            "throughput_kbps": 8e-3 * self.frame_bytes / duration,
+            "link_throughput_kbps": 8e-3 * self.notification_bytes / duration,
+            "bytes_per_notification": self.notification_bytes / self.notifications,
+            "latency_median_ms": float(np.median(latency)),
+            "latency_p95_ms": float(np.percentile(latency, 95)),
+            "latency_max_ms": float(latency.max()),
+        }
+
+
+async def run_benchmark(
+    name: str, period_us: int, frame_len: int, duration: float
+) -> dict:
+    """
+    Connects to the probe, runs the benchmark and returns the report.
+    """
+
+    device = await ble.BleakScanner.find_device_by_filter(
+        lambda d, adv: WULPUS_SERVICE_UUID.lower() in adv.service_uuids
+        and (name is None or adv.local_name == name),
+        timeout=10.0,
+    )
+    if device is None:
+        raise RuntimeError("No probe found")
+
+    stats = BenchmarkStats()
+
+    async with ble.BleakClient(device, timeout=20.0) as client:
+        await client.start_notify(
+            WULPUS_DATA_CHAR_UUID, lambda sender, data: stats.feed(data)
+        )
+
+        await client.write_gatt_char(
+            WULPUS_CONTROL_CHAR_UUID,
+            get_bench_conf_package(period_us, frame_len),
+            response=True,
+        )
+        await asyncio.sleep(duration)
+        await client.write_gatt_char(
+            WULPUS_CONTROL_CHAR_UUID,
+            get_bench_conf_package(period_us, frame_len, enable=False),
+            response=True,
+        )
+
+        # Notifications in flight, the probe drops its buffered frames
+        await asyncio.sleep(0.5)
+
+    return stats.report()
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="BLE throughput benchmark of the nRF52 probe firmware"
+    )
+    parser.add_argument("--name", default=None, help="Local name of the probe")
+    parser.add_argument(
+        "--period-us", type=int, default=10000, help="Frame period in microseconds"
+    )
+    parser.add_argument(
+        "--length", type=int, default=FRAME_LEN, help="Frame length in bytes"
+    )
+    parser.add_argument(
+        "--duration", type=float, default=10.0, help="Duration in seconds"
+    )
+    args = parser.parse_args()
+
+    report = asyncio.run(
+        run_benchmark(args.name, args.period_us, args.length, args.duration)
+    )
+
+    for key, value in report.items():
+        if isinstance(value, float):
+            print(f"{key:>24}: {value:.2f}")
+        else:
+            print(f"{key:>24}: {value}")
+
+
+if __name__ == "__main__":
+    main()
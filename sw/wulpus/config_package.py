@@ -79,11 +79,51 @@ PGA_GAIN = (
 # Register value to write to HW
 PGA_GAIN_REG = tuple(np.arange(17, 64))
 
+# Coded excitation
+# Names of the supported codes
+PULSE_CODES = ("none", "barker5", "barker7", "barker11", "barker13", "golay8")
+# Corresponding register values to be sent to HW
+PULSE_CODES_REG = (0, 1, 2, 3, 4, 5)
+
+# Delta encoding of the frames (done by the nRF52)
+DELTA_MODES = ("off", "on")
+# Corresponding values to be sent to the nRF52
+DELTA_MODES_REG = (0, 1)
+
+# Overflow policy of the frame buffer of the nRF52
+BUFFER_POLICIES = ("drop newest", "drop oldest", "decimate")
+# Corresponding values to be sent to the nRF52
+BUFFER_POLICIES_REG = (0, 1, 2)
+
+# Compression of the full frames (done by the nRF52)
+COMPRESS_MODES = ("off", "lossless")
+# Corresponding values to be sent to the nRF52
+COMPRESS_MODES_REG = (0, 1)
+
+# Envelope peaks extracted by the nRF52
+FEATURE_MODES = ("off", "alongside", "only")
+# Corresponding values to be sent to the nRF52
+FEATURE_MODES_REG = (0, 1, 2)
+# Envelope decimation factors (divisors of the 80 sample blocks of the nRF52)
+FEATURE_DECIMATIONS = (1, 2, 4, 5, 8, 10, 16, 20, 40, 80)
+
+# Reference frame subtraction on the probe
+REF_MODES = ("off", "capture", "stored")
+# Corresponding register values to be sent to HW
+REF_MODES_REG = (0, 1, 2)
+
+# Number of frames averaged into the reference frame
+REF_AVG_NUMS = (1, 2, 4, 8, 16)
+# Corresponding register values to be sent to HW (log2)
+REF_AVG_NUMS_REG = (0, 1, 2, 3, 4)
+
 # Lookup table for us to ticks conversion
 # Where HSPLL_CLOCK_FREQ = 80MHz
 us_to_ticks = {
-    "dcdc_turnon": 65535 / 2000000,  # cycles of LFXT (655 - 20ms, 65535 - 2s)
-    "meas_period": 65535 / 2000000,  # same as above
+    "dcdc_turnon": 65535 / 2000000,  # cycles of LFXT before the shot (164 - 5ms, 655 - 20ms)
+    "meas_period": 65535 / 2000000,  # same as above, clamped to the safe minimum on the probe
+    "adapt_period_min": 65535 / 2000000,  # same as above
+    "adapt_period_max": 65535 / 2000000,  # same as above
     "start_hvmuxrx": 8,  # delay in s * 8MHz
     "start_ppg": 5,  # delay in s * (HSPLL_CLOCK_FREQ / 16) = delay in s * (80MHz / 16)
     "turnon_adc": 5,  # same as above
@@ -214,15 +254,16 @@ class _ConfigBytes:
 # The first list contains basic settings
 # The second list contains advanced settings
 # The third list contains GUI settings which are not sent to the HW
+# The fourth list contains nRF52 settings which are sent in a separate package
 # Between the two lists there is a list of TX/RX configurations
 #                     config_name,         friendly_name,                limit_type, min_val,                           max_val,                        format
 configuration_package = [
     [
         _ConfigBytes(
-            "dcdc_turnon", "DC-DC turn on time [us]", "limit", 0, 65535, "<u2"
+            "dcdc_turnon", "DC-DC settle time before shot [us]", "limit", 164, 65535, "<u2"
         ),
         _ConfigBytes(
-            "meas_period", "Acquisition Period [us]", "limit", 655, 65535, "<u2"
+            "meas_period", "Acquisition Period [us]", "limit", 0, 65535, "<u2"
         ),
         _ConfigBytes(
             "trans_freq", "Transmitter frequency [Hz]", "limit", 0, 5000000, "<u4"
@@ -263,6 +304,70 @@ configuration_package = [
         _ConfigBytes(
             "capt_timeout", "Capture timeout time [us]", "limit", 0, 65535, "<u2"
         ),
+        _ConfigBytes(
+            "pulse_code", "Coded excitation", "list", PULSE_CODES_REG, PULSE_CODES, "<u1"
+        ),
+        _ConfigBytes(
+            "adapt_period_min", "Adaptive period min [us]", "limit", 0, 65535, "<u2"
+        ),
+        _ConfigBytes(
+            "adapt_period_max", "Adaptive period max [us]", "limit", 0, 65535, "<u2"
+        ),
+        _ConfigBytes("motion_threshold", "Motion threshold", "limit", 0, 65535, "<u2"),
+        _ConfigBytes("ref_mode", "Reference frame", "list", REF_MODES_REG, REF_MODES, "<u1"),
+        _ConfigBytes(
+            "ref_avg_num", "Reference averages", "list", REF_AVG_NUMS_REG, REF_AVG_NUMS, "<u1"
+        ),
+        _ConfigBytes("agc_target_rms", "AGC target RMS", "limit", 0, 2039, "<u2"),
+        _ConfigBytes(
+            "agc_min_gain", "AGC min gain [dB]", "list", PGA_GAIN_REG, PGA_GAIN, "<u1"
+        ),
+        _ConfigBytes(
+            "agc_max_gain", "AGC max gain [dB]", "list", PGA_GAIN_REG, PGA_GAIN, "<u1"
+        ),
     ],
     [_ConfigBytes("num_acqs", "Number of acquisitions", "limit", 0, 10000000, None)],
+    [
+        _ConfigBytes(
+            "delta_mode", "Delta encoding", "list", DELTA_MODES_REG, DELTA_MODES, "<u1"
+        ),
+        _ConfigBytes("delta_shift", "Delta quantisation shift", "limit", 0, 7, "<u1"),
+        _ConfigBytes(
+            "delta_threshold", "Delta unchanged threshold", "limit", 0, 65535, "<u2"
+        ),
+        _ConfigBytes(
+            "delta_keyframe_interval", "Delta keyframe interval", "limit", 0, 65535, "<u2"
+        ),
+        _ConfigBytes(
+            "buffer_policy",
+            "Buffer overflow policy",
+            "list",
+            BUFFER_POLICIES_REG,
+            BUFFER_POLICIES,
+            "<u1",
+        ),
+        _ConfigBytes("buffer_decimation", "Buffer decimation", "limit", 1, 255, "<u1"),
+        _ConfigBytes(
+            "compress_mode",
+            "Compression",
+            "list",
+            COMPRESS_MODES_REG,
+            COMPRESS_MODES,
+            "<u1",
+        ),
+        _ConfigBytes(
+            "feature_mode", "Feature extraction", "list", FEATURE_MODES_REG, FEATURE_MODES, "<u1"
+        ),
+        _ConfigBytes(
+            "feature_decimation",
+            "Envelope decimation",
+            "list",
+            FEATURE_DECIMATIONS,
+            FEATURE_DECIMATIONS,
+            "<u1",
+        ),
+        _ConfigBytes("feature_min_sample", "Peak search start", "limit", 0, 799, "<u2"),
+        _ConfigBytes("feature_num_peaks", "Number of peaks", "limit", 1, 4, "<u1"),
+        _ConfigBytes("feature_num_taps", "Bandpass taps", "limit", 4, 32, "<u1"),
+    ],
 ]
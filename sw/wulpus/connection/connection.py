@@ -78,6 +78,30 @@ class WulpusConnection:
         )
         return future.result()
 
+    def get_buffer_stats(self) -> dict:
+        # Only the direct connection reaches the nRF52 of the probe
+        if self.type != "direct":
+            return None
+        future = asyncio.run_coroutine_threadsafe(
+            self.__connection__.get_buffer_stats(), self.loop
+        )
+        return future.result()
+
+    def set_retransmission(self, enabled: bool) -> bool:
+        # Missing frames are requested again from the nRF52 of the probe (direct connection only)
+        if self.type != "direct":
+            return False
+        self.loop.call_soon_threadsafe(
+            self.__connection__.set_retransmission, enabled
+        )
+        return True
+
+    def get_features(self) -> list:
+        # Feature records are extracted by the nRF52 of the probe (direct connection only)
+        if self.type != "direct":
+            return []
+        return self.__connection__.get_features()
+
     def __del__(self):
         self.loop.call_soon_threadsafe(self.loop.stop)
         self.thread.join()
@@ -15,25 +15,58 @@ SPDX-License-Identifier: Apache-2.0
 """
 
 import asyncio
+import time
+from collections import deque
 from itertools import count, takewhile
 from typing import Iterator
 
 import bleak as ble
-import numpy as np
 from wulpus.connection.device import _WulpusConnectionDevice
+from wulpus.connection.frame import (
+    BENCH_START_OF_FRAME,
+    FEATURE_START_OF_FRAME,
+    FRAME_NUM_SAMPLES,
+    LOST_START_OF_FRAME,
+    DeltaDecoder,
+    RetransmissionWindow,
+    StreamReassembler,
+    get_nack_packages,
+    parse_features,
+    parse_frame,
+)
+
+WULPUS_SERVICE_UUID = "57550001-4C50-5553-A1B2-C3D4E5F60718"
+# Stream of the frames (notify)
+WULPUS_DATA_CHAR_UUID = "57550002-4C50-5553-A1B2-C3D4E5F60718"
+# Configurations and commands (write with response)
+WULPUS_CONTROL_CHAR_UUID = "57550003-4C50-5553-A1B2-C3D4E5F60718"
+# Frame buffer statistics of the nRF52 (read, notify)
+WULPUS_TELEMETRY_CHAR_UUID = "57550004-4C50-5553-A1B2-C3D4E5F60718"
+
+# Feature records kept until get_features() is called (the oldest ones are dropped)
+FEATURE_QUEUE_LEN = 1024
+# Decoded frames kept until receive_data() is called (the oldest ones are dropped)
+FRAME_QUEUE_LEN = 1024
+
+
+def parse_buffer_stats(data: bytes) -> dict:
+    """
+    Parses the frame buffer statistics of the nRF52 (counted since the last configuration).
 
-NORDIC_UART_SERVICE_UUID = "6E400001-B5A3-F393-E0A9-E50E24DCCA9E"
-NORDIC_UART_RX_CHAR_UUID = "6E400002-B5A3-F393-E0A9-E50E24DCCA9E"
-NORDIC_UART_TX_CHAR_UUID = "6E400003-B5A3-F393-E0A9-E50E24DCCA9E"
-
-BYTES_PER_XFER = 201
-NUMBER_OF_XFERS = 4
-MEAS_START_OF_FRAME_MASK = 0xFF
+    Args:
+        data (bytes): Value of the telemetry characteristic.
+    """
 
-# This is a magic number
-# There is a stray byte at index 197 in the received RF data, which is removed
-# The exact origin of this byte is unknown
-JMP_IDX = 197
+    return {
+        "frames_received": int.from_bytes(data[0:4], "little"),
+        "frames_sent": int.from_bytes(data[4:8], "little"),
+        "frames_dropped": int.from_bytes(data[8:12], "little"),
+        "high_water": int.from_bytes(data[12:14], "little"),
+        "pending": int.from_bytes(data[14:16], "little"),
+        "policy": data[16],
+        "decimation": data[17],
+        "capacity": int.from_bytes(data[18:20], "little"),
+    }
 
 
 def sliced(data: bytes, n: int) -> Iterator[bytes]:
@@ -54,43 +87,46 @@ class WulpusDirect:
 
         self.loop = loop
 
-        self.nus = None
-        self.rx_char = None
+        self.service = None
+        self.control_char = None
 
-        self.frame_buffer = bytearray()  # Hold 804 bytes (1 frame) of data
+        self.stream = StreamReassembler()  # Frames span the notifications of the probe
+        self.frames = deque(maxlen=FRAME_QUEUE_LEN)  # Decoded frames, in order
         self.frame_ready = None
 
-        self.count_packets = (
-            0  # Count the number of packets received (4 packets per frame)
-        )
+        self.decoder = DeltaDecoder()
+
+        self.features = deque(maxlen=FEATURE_QUEUE_LEN)  # Parsed feature records
+
+        self.retransmit = False  # Missing frames are requested again (see set_retransmission)
+        self.window = RetransmissionWindow()
 
     async def init_async(self):
         self.frame_ready = asyncio.Event()
 
     def __notification_handler(self, sender, data):
-        # Check if it is the first (of the four) BLE packets
-        if data[0] == MEAS_START_OF_FRAME_MASK and len(data) == 202:
-            # print("<", end="")
-            self.count_packets = 1
-
-            self.frame_buffer = bytearray()
-            self.frame_buffer.extend(data[1:])
-
-        elif 0 < self.count_packets < NUMBER_OF_XFERS and self.count_packets:
-            self.count_packets += 1
-            # print("-", end="")
-
-            self.frame_buffer.extend(data)
-
-            if self.count_packets == NUMBER_OF_XFERS:
-                # print(">", end=" ")
-                self.frame_ready.set()
-                self.count_packets = 0
+        # Notifications are filled up to the MTU, a frame may start anywhere in them
+        for frame in self.stream.feed(data):
+            # Frames of the benchmark are handled by wulpus.benchmark
+            if frame[0] == BENCH_START_OF_FRAME:
+                continue
+
+            # Feature records of the nRF52, the frame (if sent) follows
+            if frame[0] == FEATURE_START_OF_FRAME:
+                self.features.append(parse_features(frame))
+                continue
+
+            # Frames behind a gap wait for the missing ones (if enabled)
+            if frame[0] == LOST_START_OF_FRAME:
+                released = self.window.lost(int.from_bytes(frame[2:4], "little"))
+            elif self.retransmit:
+                released, requests = self.window.feed(frame, time.monotonic())
+                self.__request_frames(requests)
+            else:
+                released = [frame]
 
-        else:
-            # Not a valid frame, pass
-            # print("?", end=" ")
-            pass
+            for frame in released:
+                self.__decode(frame)
 
         # # Check if data includes the start of an acquisition (0xFF, 0x00, 0x00, 0x00)
         # if not self.frame_ready.is_set() and b"\xff\x00\x00\x00" in data:
@@ -109,6 +145,51 @@ class WulpusDirect:
         # if b'START\n' in self.data_accumulator:
         #     self.data_received_event.set()
 
+    def __decode(self, frame: bytes):
+        # print(">", end=" ")
+        # Decode here so that no frame is missed by the delta decoder
+        frame = self.decoder.decode(frame)
+
+        # A notification or a filled gap may complete several frames at once
+        if frame is not None:
+            self.frames.append(frame)
+            self.frame_ready.set()
+
+    def __request_frames(self, frame_numbers: list):
+        if not frame_numbers:
+            return
+
+        loop = asyncio.get_running_loop()
+        for package in get_nack_packages(frame_numbers):
+            loop.create_task(self.__send_nack(package))
+
+        # Frames which neither arrive nor are reported lost are given up
+        loop.call_later(self.window.timeout, self.__window_timeout)
+
+    async def __send_nack(self, package: bytes):
+        if self.client is None or not self.client.is_connected:
+            return
+
+        try:
+            await self.client.write_gatt_char(self.control_char, package, response=True)
+        except Exception as e:
+            print("Error requesting frames:", e)
+
+    def __window_timeout(self):
+        for frame in self.window.poll(time.monotonic()):
+            self.__decode(frame)
+
+    def set_retransmission(self, enabled: bool):
+        """
+        Enables requesting the frames missing in the stream again from the probe.
+
+        Frames behind a gap are held back until the missing frames arrived,
+        were reported lost by the probe or the timeout of the window passed.
+        """
+
+        self.retransmit = enabled
+        self.window.reset()
+
     async def get_available(self):
         """
         Get a list of available devices. A device needs a .description attribute for the GUI.
@@ -127,7 +208,7 @@ class WulpusDirect:
         devices = [
             device
             for device in devices
-            if NORDIC_UART_SERVICE_UUID.lower() in device[1].service_uuids
+            if WULPUS_SERVICE_UUID.lower() in device[1].service_uuids
         ]
 
         devices = [
@@ -152,20 +233,22 @@ class WulpusDirect:
 
         try:
             await self.client.start_notify(
-                NORDIC_UART_TX_CHAR_UUID, self.__notification_handler
+                WULPUS_DATA_CHAR_UUID, self.__notification_handler
             )
         except Exception as e:
-            print("Error starting TX notifications:", e)
+            print("Error starting data notifications:", e)
             await self.close()
             return False
 
-        self.nus = self.client.services.get_service(NORDIC_UART_SERVICE_UUID)
-        if self.nus is None:
+        self.service = self.client.services.get_service(WULPUS_SERVICE_UUID)
+        if self.service is None:
             await self.close()
             return False
 
-        self.rx_char = self.nus.get_characteristic(NORDIC_UART_RX_CHAR_UUID)
-        if self.rx_char is None:
+        self.control_char = self.service.get_characteristic(
+            WULPUS_CONTROL_CHAR_UUID
+        )
+        if self.control_char is None:
             await self.close()
             return False
 
@@ -178,23 +261,23 @@ class WulpusDirect:
 
         if self.client is None:
             self.device = None
-            self.nus = None
-            self.rx_char = None
+            self.service = None
+            self.control_char = None
             return True
 
         if not self.client.is_connected:
             self.device = None
             self.client = None
-            self.nus = None
-            self.rx_char = None
+            self.service = None
+            self.control_char = None
             return True
 
         try:
             await self.client.disconnect()
             self.device = None
             self.client = None
-            self.nus = None
-            self.rx_char = None
+            self.service = None
+            self.control_char = None
             return True
         except Exception as e:
             print("Error disconnecting:", e)
@@ -210,17 +293,24 @@ class WulpusDirect:
         # print("Sending config...")
 
         # Clear the data accumulator
-        self.frame = bytearray()
+        self.frames.clear()
         self.frame_ready.clear()
 
+        # The probe starts every TX/RX config with a keyframe
+        self.stream.reset()
+        self.decoder.reset()
+        self.features.clear()
+        self.window.reset()
+
         try:
+            # Acknowledged, a lost configuration would go unnoticed otherwise
             await self.client.write_gatt_char(
-                self.rx_char, conf_bytes_pack, response=False
+                self.control_char, conf_bytes_pack, response=True
             )
-            # print('Sending config of size', len(conf_bytes_pack), 'with an MTU of', self.rx_char.max_write_without_response_size)
-            # for s in sliced(conf_bytes_pack, self.rx_char.max_write_without_response_size):
+            # print('Sending config of size', len(conf_bytes_pack), 'with an MTU of', self.control_char.max_write_without_response_size)
+            # for s in sliced(conf_bytes_pack, self.control_char.max_write_without_response_size):
             #     print('  Sending', len(s), 'bytes')
-            #     await self.client.write_gatt_char(self.rx_char, s, response=False)
+            #     await self.client.write_gatt_char(self.control_char, s, response=False)
 
             # print("Config sent")
 
@@ -229,27 +319,34 @@ class WulpusDirect:
             print("Error sending config:", e)
             return False
 
-    def __get_rf_data_and_info__(self, bytes_arr: bytes):
-        # remove stray byte from bytes_arr
-        # bytes_arr = bytes_arr[:105] + bytes_arr[106:]
-
-        tx_rx_id = bytes_arr[0]
-        # print(tx_rx_id, end=" ")
-        acq_nr = np.frombuffer(bytes_arr[1:3], dtype="<u2")[0]
-        # print(acq_nr, end=" ")
+    async def get_buffer_stats(self):
+        """
+        Read the frame buffer statistics of the probe (see parse_buffer_stats).
+        """
+        if self.client is None or not self.client.is_connected:
+            return None
 
-        # print(len(bytes_arr), tx_rx_id, acq_nr, end=" ")
+        try:
+            return parse_buffer_stats(
+                await self.client.read_gatt_char(WULPUS_TELEMETRY_CHAR_UUID)
+            )
+        except Exception as e:
+            print("Error reading buffer statistics:", e)
+            return None
 
-        # rf_arr = np.frombuffer(bytes_arr[3:803], dtype="<i2")
+    def get_features(self) -> list:
+        """
+        Returns the feature records received since the last call (see parse_features).
+        """
 
-        # Remove sample at index 197
-        rf_arr_bytes = bytes([*bytes_arr[3 : 3 + JMP_IDX], *bytes_arr[JMP_IDX + 4 :]])
-        rf_arr = np.frombuffer(rf_arr_bytes, dtype="<i2")
+        features = []
+        while self.features:
+            features.append(self.features.popleft())
 
-        # print(len(rf_arr), np.mean(rf_arr))
-        # rf_arr = rf_arr[:800]
+        return features
 
-        return rf_arr, acq_nr, tx_rx_id
+    def __get_rf_data_and_info__(self, bytes_arr: bytes):
+        return parse_frame(bytes_arr)
 
     async def receive_data(self, acq_length: int):
         if self.client is None or not self.client.is_connected:
@@ -262,10 +359,11 @@ class WulpusDirect:
             # print("w", end=" ")
             # print(self.frame_ready)
 
-            await self.frame_ready.wait()
-            self.frame_ready.clear()
+            while not self.frames:
+                self.frame_ready.clear()
+                await self.frame_ready.wait()
 
-            response = self.frame_buffer
+            response = self.frames.popleft()
 
             # await self.frame_ready.wait()
 
@@ -282,7 +380,7 @@ class WulpusDirect:
 
             result = self.__get_rf_data_and_info__(response)
 
-            if result[0].shape[0] == 400:
+            if result[0].shape[0] == FRAME_NUM_SAMPLES:
                 return result
             else:
                 # print(f"Error: expected length 400, got {result[0].shape[0]}")
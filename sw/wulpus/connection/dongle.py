@@ -15,10 +15,19 @@ limitations under the License.
 SPDX-License-Identifier: Apache-2.0
 """
 
-import numpy as np
 import serial
 from serial.tools.list_ports import comports
 from wulpus.connection.device import _WulpusConnectionDevice
+from wulpus.connection.frame import (
+    FRAME_HEADER_LEN,
+    DeltaDecoder,
+    get_frame_length,
+    get_header_length,
+    parse_frame,
+)
+
+# Padding bytes after the "START\n" line of the dongle
+START_PADDING_LEN = 3
 
 
 class WulpusDongle:
@@ -54,6 +63,9 @@ class WulpusDongle:
         self.__ser__.dsrdtr = False  # disable hardware (DSR/DTR) flow control
         self.__ser__.writeTimeout = timeout_write  # timeout for write
 
+        # The dongle forwards the frames as sent by the probe
+        self.decoder = DeltaDecoder()
+
     async def get_available(self):
         """
         Get a list of available devices.
@@ -122,18 +134,18 @@ class WulpusDongle:
         self.__ser__.flushOutput()  # flush output buffer, aborting current output
         # and discard all that is in buffer
 
+        # The probe starts every TX/RX config with a keyframe
+        self.decoder.reset()
+
         self.__ser__.write(conf_bytes_pack)
 
         return True
 
     def __get_rf_data_and_info__(self, bytes_arr: bytes):
-        print(len(bytes_arr), len(bytes_arr[7:]))
-
-        tx_rx_id = bytes_arr[4]
-        acq_nr = np.frombuffer(bytes_arr[5:7], dtype="<u2")[0]
-        rf_arr = np.frombuffer(bytes_arr[7:], dtype="<i2")
-
-        return rf_arr, acq_nr, tx_rx_id
+        frame = self.decoder.decode(bytes_arr[START_PADDING_LEN:])
+        if frame is None:
+            return None
+        return parse_frame(frame)
 
     async def receive_data(self, acq_length: int):
         """
@@ -149,7 +161,13 @@ class WulpusDongle:
         if len(response_start) == 0:
             return None
         elif response_start[-6:] == b"START\n":
-            response = self.__ser__.read(acq_length * 2 + 7)
+            response = self.__ser__.read(START_PADDING_LEN + FRAME_HEADER_LEN)
+            # Delta encoded and compressed frames are shorter, the header tells the length
+            header_len = get_header_length(response[START_PADDING_LEN:])
+            response += self.__ser__.read(header_len - FRAME_HEADER_LEN)
+            response += self.__ser__.read(
+                get_frame_length(response[START_PADDING_LEN:]) - header_len
+            )
             return self.__get_rf_data_and_info__(response)
         else:
             return None
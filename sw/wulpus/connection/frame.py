@@ -0,0 +1,631 @@
+"""
+Copyright (C) 2023 ETH Zurich. All rights reserved.
+Author: Cedric Hirschi, ETH Zurich
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+SPDX-License-Identifier: Apache-2.0
+"""
+
+import numpy as np
+
+import wulpus.config_package as cfg
+
+# US frame as sent by the MSP430 (header + samples)
+#   [0]   start of frame (0xFF)
+#   [1]   TX/RX config ID (bits 0-3), PLL unlock retries (bits 4-5) and dropped shots (bits 6-7) since the last frame
+#   [2-3] frame number
+#   [4-5] measurement period in ACLK ticks
+#   [6]   applied PGA gain register (SDHSCTL6)
+#   [7]   flags
+#   [8-9] trigger latency after the slow timer tick in SMCLK cycles (0xFFFF: not measured)
+#   [10-11] change of the trigger latency since the last frame (signed, 0x8000: not measured)
+MEAS_START_OF_FRAME_MASK = 0xFF
+FRAME_HEADER_LEN = 12
+FRAME_NUM_SAMPLES = 400
+FRAME_LEN = FRAME_HEADER_LEN + FRAME_NUM_SAMPLES * 2
+
+# Synthetic frame of the nRF52 benchmark (see wulpus.benchmark)
+#   [0]   start of frame (0xFE)
+#   [1]   reserved
+#   [2-3] frame length in bytes (header included)
+#   [4-7] sequence number
+#   [8-11] generation time in app timer ticks of the probe (24 bit)
+BENCH_START_OF_FRAME = 0xFE
+
+# Feature record of the nRF52 (see fw/nrf52/probe_fw/wulpus/wulpus_feature.h)
+#   [0]    start of record (0xFD)
+#   [1-11] header of the US frame the features were extracted from
+#   [12]   number of peaks n
+#   [13-]  n peaks by descending amplitude: position in 1/16 samples (u16),
+#          envelope amplitude (u16, mean of the rectified bandpass output)
+FEATURE_START_OF_FRAME = 0xFD
+FEATURE_HEADER_LEN = FRAME_HEADER_LEN + 1
+FEATURE_PEAK_LEN = 4
+FEATURE_POS_SCALE = 16
+
+# Retransmission request of the host (direct connection only, see wulpus_retx.h of the probe)
+#   [0]   start byte (0xF7)
+#   [1]   number of frames n (1 to NACK_MAX_FRAMES)
+#   [2-]  n frame numbers (u16)
+# Requested frames which are not buffered anymore are reported with a lost record
+#   [0]   start of record (0xF6)
+#   [1]   reserved
+#   [2-3] frame number
+#   [4-11] reserved
+NACK_START_BYTE = 0xF7
+NACK_MAX_FRAMES = 8
+LOST_START_OF_FRAME = 0xF6
+
+# Flags in the frame header
+FRAME_FLAG_CODE_COMPLEMENTARY = 0x01  # Sequence B of a complementary code was transmitted
+FRAME_FLAG_ADAPTIVE_PERIOD = 0x02  # Period is adapted to the motion in the scene
+FRAME_FLAG_DELTA = 0x04  # Samples are 8-bit residuals to the last frame of the config
+FRAME_FLAG_UNCHANGED = 0x08  # Frame equals the last frame of the config (no samples)
+FRAME_FLAG_SHIFT_POS = 4  # Position of the quantisation shift of the residuals (3 bits)
+FRAME_FLAG_REF_SUBTRACTED = 0x80  # Stored reference frame was subtracted on the probe
+# Both delta flags: samples are replaced by a lossless bit stream of the nRF52
+FRAME_FLAG_COMPRESSED = FRAME_FLAG_DELTA | FRAME_FLAG_UNCHANGED
+
+# Compressed frame (see fw/nrf52/probe_fw/wulpus/wulpus_compress.h)
+#   [12-13] length of the bit stream in bytes
+#   [14-]   bit stream (MSB first), per block of COMPRESS_BLOCK_LEN samples:
+#           predictor order (2 bits), Rice parameter k (4 bits), Rice code of every residual
+COMPRESSED_HEADER_LEN = FRAME_HEADER_LEN + 2
+COMPRESS_BLOCK_LEN = 16
+COMPRESS_ESCAPE = 16  # Unary prefix of a residual sent with 16 bits
+
+FRAME_TX_RX_ID_MASK = 0x0F
+FRAME_PLL_RETRIES_POS = 4  # Saturates at 3
+FRAME_PLL_DROPPED_POS = 6  # Saturates at 3
+FRAME_PLL_COUNT_MASK = 0x03
+
+# Trigger timing of the MSP430
+TRIG_CLOCK_FREQ = 8e6  # SMCLK in Hertz
+TRIG_LATENCY_INVALID = 0xFFFF
+TRIG_JITTER_INVALID = -0x8000
+
+
+def is_compressed(header: bytes) -> bool:
+    """
+    Returns whether a US frame carries the compressed bit stream instead of the samples.
+
+    Args:
+        header (bytes): Frame header (at least FRAME_HEADER_LEN bytes).
+    """
+
+    return (
+        header[0] == MEAS_START_OF_FRAME_MASK
+        and header[7] & FRAME_FLAG_COMPRESSED == FRAME_FLAG_COMPRESSED
+    )
+
+
+def get_header_length(header: bytes) -> int:
+    """
+    Returns the number of bytes needed by get_frame_length.
+
+    Args:
+        header (bytes): Frame header (at least FRAME_HEADER_LEN bytes).
+    """
+
+    if header[0] == FEATURE_START_OF_FRAME:
+        return FEATURE_HEADER_LEN
+
+    return COMPRESSED_HEADER_LEN if is_compressed(header) else FRAME_HEADER_LEN
+
+
+def get_frame_length(header: bytes) -> int:
+    """
+    Returns the length of a (possibly delta encoded or compressed) US frame
+    or of a feature record in bytes.
+
+    Args:
+        header (bytes): Frame header (at least get_header_length bytes).
+    """
+
+    if header[0] == BENCH_START_OF_FRAME:
+        return int.from_bytes(header[2:4], "little")
+    elif header[0] == FEATURE_START_OF_FRAME:
+        return FEATURE_HEADER_LEN + header[12] * FEATURE_PEAK_LEN
+    elif header[0] == LOST_START_OF_FRAME:
+        return FRAME_HEADER_LEN
+    elif is_compressed(header):
+        return COMPRESSED_HEADER_LEN + int.from_bytes(header[12:14], "little")
+    elif header[7] & FRAME_FLAG_UNCHANGED:
+        return FRAME_HEADER_LEN
+    elif header[7] & FRAME_FLAG_DELTA:
+        return FRAME_HEADER_LEN + FRAME_NUM_SAMPLES
+    else:
+        return FRAME_LEN
+
+
+def parse_header(frame: bytes) -> dict:
+    """
+    Parses the header of a US frame.
+
+    Args:
+        frame (bytes): Frame starting with the start of frame byte.
+
+    Returns:
+        Dictionary with the header fields.
+    """
+
+    meas_period = int(np.frombuffer(frame[4:6], dtype="<u2")[0])
+    trig_latency = int(np.frombuffer(frame[8:10], dtype="<u2")[0])
+    trig_jitter = int(np.frombuffer(frame[10:12], dtype="<i2")[0])
+    pll_retries = (frame[1] >> FRAME_PLL_RETRIES_POS) & FRAME_PLL_COUNT_MASK
+    pll_dropped = (frame[1] >> FRAME_PLL_DROPPED_POS) & FRAME_PLL_COUNT_MASK
+
+    # Gain register to dB (None for probes which do not report it)
+    try:
+        rx_gain = cfg.PGA_GAIN[cfg.PGA_GAIN_REG.index(frame[6])]
+    except ValueError:
+        rx_gain = None
+
+    return {
+        "tx_rx_id": frame[1] & FRAME_TX_RX_ID_MASK,
+        "acq_nr": np.frombuffer(frame[2:4], dtype="<u2")[0],
+        "meas_period": meas_period,
+        "meas_period_us": meas_period / cfg.us_to_ticks["meas_period"],
+        "rx_gain": rx_gain,
+        # Every PLL unlock ends in a retry of the shot or a dropped shot
+        "pll_retries": pll_retries,
+        "pll_dropped": pll_dropped,
+        "pll_unlocks": pll_retries + pll_dropped,
+        "flags": frame[7],
+        # Trigger timing in microseconds (None if not measured)
+        "trig_latency_us": (
+            None
+            if trig_latency == TRIG_LATENCY_INVALID
+            else trig_latency * 1e6 / TRIG_CLOCK_FREQ
+        ),
+        "trig_jitter_us": (
+            None
+            if trig_jitter == TRIG_JITTER_INVALID
+            else trig_jitter * 1e6 / TRIG_CLOCK_FREQ
+        ),
+    }
+
+
+def parse_frame(frame: bytes):
+    """
+    Parses a US frame.
+
+    Args:
+        frame (bytes): Frame starting with the start of frame byte.
+
+    Returns:
+        Tuple of the RF samples, the acquisition number, the TX/RX config ID
+        and the header dictionary (see parse_header).
+    """
+
+    header = parse_header(frame)
+    rf_arr = np.frombuffer(frame[FRAME_HEADER_LEN:FRAME_LEN], dtype="<i2")
+
+    return rf_arr, header["acq_nr"], header["tx_rx_id"], header
+
+
+def parse_features(record: bytes):
+    """
+    Parses a feature record of the nRF52.
+
+    The positions are corrected for the delay of the bandpass, they compare
+    to the sample indices of the frame (like get_peak() of the waterbath example).
+
+    Args:
+        record (bytes): Record starting with the start of record byte.
+
+    Returns:
+        Tuple of the peak positions in samples, the envelope amplitudes,
+        the acquisition number, the TX/RX config ID and the header dictionary (see parse_header).
+    """
+
+    header = parse_header(record)
+    peaks = np.frombuffer(
+        record[FEATURE_HEADER_LEN : FEATURE_HEADER_LEN + record[12] * FEATURE_PEAK_LEN],
+        dtype="<u2",
+    ).reshape(-1, 2)
+
+    positions = peaks[:, 0] / FEATURE_POS_SCALE
+    amplitudes = peaks[:, 1].astype(int)
+
+    return positions, amplitudes, header["acq_nr"], header["tx_rx_id"], header
+
+
+def normalise_gain(rf, rx_gain, ref_gain):
+    """
+    Scales an RF frame acquired with rx_gain to the amplitude at ref_gain.
+
+    Frames acquired with the AGC enabled have different gains, use the
+    "rx_gain" reported in the header (see parse_header).
+
+    Args:
+        rf (np.ndarray): RF samples of one frame.
+        rx_gain (float): RX gain of the frame in dB.
+        ref_gain (float): Common reference gain in dB.
+    """
+
+    return np.asarray(rf, dtype=float) * 10 ** ((ref_gain - rx_gain) / 20)
+
+
+def decompress_samples(frame: bytes) -> np.ndarray:
+    """
+    Reconstructs the samples of a compressed US frame.
+
+    The Rice codes are walked one by one with lookup tables of the bit
+    stream (next zero bit, value of the next 16 bits), the predictions are
+    undone per block with cumulative sums.
+
+    Args:
+        frame (bytes): Compressed frame as received from the probe.
+
+    Returns:
+        RF samples (int16).
+    """
+
+    stream_len = int.from_bytes(frame[FRAME_HEADER_LEN:COMPRESSED_HEADER_LEN], "little")
+    stream = np.frombuffer(
+        frame[COMPRESSED_HEADER_LEN : COMPRESSED_HEADER_LEN + stream_len], dtype=np.uint8
+    )
+    bits = np.unpackbits(stream)
+    num_bits = len(bits)
+
+    # Position of the next zero bit at or after every position (end of a unary prefix)
+    positions = np.where(bits == 0, np.arange(num_bits), num_bits)
+    next_zero = np.minimum.accumulate(positions[::-1])[::-1].tolist() + [num_bits]
+
+    # Value of the 16 bits starting at every position
+    padded = np.concatenate((bits, np.zeros(16, dtype=np.uint8))).astype(np.int64)
+    windows = np.lib.stride_tricks.sliding_window_view(padded, 16)[: num_bits + 1]
+    word = (windows @ (1 << np.arange(15, -1, -1, dtype=np.int64))).tolist()
+
+    samples = np.zeros(FRAME_NUM_SAMPLES + 2, dtype=np.int64)  # Two zeros before the frame
+    codes = np.zeros(COMPRESS_BLOCK_LEN, dtype=np.int64)
+    pos = 0
+
+    for start in range(2, FRAME_NUM_SAMPLES + 2, COMPRESS_BLOCK_LEN):
+        params = word[pos] >> 10
+        order, k = params >> 4, params & 0x0F
+        pos += 6
+
+        for i in range(COMPRESS_BLOCK_LEN):
+            q = min(next_zero[pos] - pos, COMPRESS_ESCAPE)
+            if q < COMPRESS_ESCAPE:
+                pos += q + 1
+                codes[i] = (q << k) | (word[pos] >> (16 - k) if k else 0)
+                pos += k
+            else:
+                pos += COMPRESS_ESCAPE
+                codes[i] = word[pos]
+                pos += 16
+
+        # Zigzag back to signed residuals, predictions in 16-bit two's complement
+        residuals = (codes >> 1) ^ -(codes & 1)
+        x_last = samples[start - 1]
+        d_last = samples[start - 1] - samples[start - 2]
+        if order == 0:
+            block = residuals
+        elif order == 1:
+            block = x_last + np.cumsum(residuals)
+        else:
+            block = x_last + np.cumsum(d_last + np.cumsum(residuals))
+        samples[start : start + COMPRESS_BLOCK_LEN] = (
+            (block + 0x8000) & 0xFFFF
+        ) - 0x8000
+
+    return samples[2:].astype(np.int16)
+
+
+class DeltaDecoder:
+    """
+    Reconstructs delta encoded and compressed US frames.
+
+    The probe keeps the last frame of every TX/RX config as reference and
+    sends either the full frame (keyframe), the quantised residual to the
+    reference or only the header if the residual is below the threshold.
+    Full frames may arrive losslessly compressed.
+    The decoder mirrors the references of the probe.
+    """
+
+    def __init__(self):
+        self.reset()
+
+    def reset(self):
+        """
+        Forgets all references (e.g. after a new configuration was sent).
+        """
+
+        self.references = {}
+        self.last_acq_nr = None
+
+    def decode(self, frame: bytes):
+        """
+        Decodes a US frame.
+
+        Args:
+            frame (bytes): Frame as received from the probe.
+
+        Returns:
+            Full length frame (see parse_frame), or None if the frame
+            references a frame which was lost.
+        """
+
+        header = parse_header(frame)
+        flags = header["flags"]
+        tx_rx_id = header["tx_rx_id"]
+
+        # A lost frame may have updated the reference of any config
+        # Drop all references and wait for the next keyframes
+        if (
+            self.last_acq_nr is not None
+            and (int(header["acq_nr"]) - self.last_acq_nr) & 0xFFFF != 1
+        ):
+            self.references = {}
+        self.last_acq_nr = int(header["acq_nr"])
+
+        if flags & FRAME_FLAG_COMPRESSED == FRAME_FLAG_COMPRESSED:
+            reference = decompress_samples(frame).astype(np.int32)
+            self.references[tx_rx_id] = reference
+        elif flags & (FRAME_FLAG_DELTA | FRAME_FLAG_UNCHANGED):
+            if tx_rx_id not in self.references:
+                return None
+
+            reference = self.references[tx_rx_id]
+
+            if flags & FRAME_FLAG_DELTA:
+                shift = (flags >> FRAME_FLAG_SHIFT_POS) & 0x07
+                residual = np.frombuffer(
+                    frame[FRAME_HEADER_LEN : FRAME_HEADER_LEN + FRAME_NUM_SAMPLES],
+                    dtype="<i1",
+                ).astype(np.int32)
+                reference = np.clip(
+                    reference + (residual << shift), -32768, 32767
+                ).astype(np.int32)
+                self.references[tx_rx_id] = reference
+        else:
+            reference = np.frombuffer(
+                frame[FRAME_HEADER_LEN:FRAME_LEN], dtype="<i2"
+            ).astype(np.int32)
+            self.references[tx_rx_id] = reference
+
+        return bytes(frame[:FRAME_HEADER_LEN]) + reference.astype("<i2").tobytes()
+
+
+def get_nack_packages(frame_numbers) -> list:
+    """
+    Returns the retransmission requests for the given frame numbers.
+
+    Args:
+        frame_numbers (list): Frame numbers (acq_nr) missing in the stream.
+    """
+
+    packages = []
+    for i in range(0, len(frame_numbers), NACK_MAX_FRAMES):
+        chunk = frame_numbers[i : i + NACK_MAX_FRAMES]
+        packages.append(
+            bytes([NACK_START_BYTE, len(chunk)])
+            + np.array(chunk, dtype="<u2").tobytes()
+        )
+
+    return packages
+
+
+class RetransmissionWindow:
+    """
+    Restores the order of the US frames and finds the missing ones.
+
+    Frames behind a gap in the frame numbers are held back while the missing
+    frames are requested again from the probe. They are released in order
+    once the missing frames arrived, were reported lost by the probe or the
+    timeout passed; the DeltaDecoder then sees the gap as without the window.
+    """
+
+    def __init__(self, timeout=0.25, max_gap=64):
+        """
+        Args:
+            timeout (float): Longest wait for a missing frame in seconds.
+            max_gap (int): Longest gap which is requested, the window restarts behind longer ones.
+        """
+
+        self.timeout = timeout
+        self.max_gap = max_gap
+        self.reset()
+
+    def reset(self):
+        """
+        Forgets the held and missing frames (e.g. after a new configuration was sent).
+        """
+
+        self.next_nr = None  # Frame number released next
+        self.held = {}  # Frames behind the gap by frame number (None: given up)
+        self.missing = {}  # Requested frame numbers and the time of the request
+
+    def __release(self) -> list:
+        frames = []
+        while self.next_nr in self.held:
+            frame = self.held.pop(self.next_nr)
+            self.missing.pop(self.next_nr, None)
+            if frame is not None:
+                frames.append(frame)
+            self.next_nr = (self.next_nr + 1) & 0xFFFF
+
+        return frames
+
+    def __flush(self) -> list:
+        # Releases all held frames in order, the gaps stay
+        frames = [
+            self.held[nr]
+            for nr in sorted(self.held, key=lambda nr: (nr - self.next_nr) & 0xFFFF)
+            if self.held[nr] is not None
+        ]
+        self.held = {}
+        self.missing = {}
+
+        return frames
+
+    def feed(self, frame: bytes, now: float):
+        """
+        Adds a US frame (first transmission or retransmission).
+
+        Args:
+            frame (bytes): Frame as received from the probe.
+            now (float): Current time in seconds (time.monotonic()).
+
+        Returns:
+            Tuple of the frames released in order and the frame numbers to request.
+        """
+
+        nr = int.from_bytes(frame[2:4], "little")
+        if self.next_nr is None:
+            self.next_nr = nr
+
+        ahead = (nr - self.next_nr) & 0xFFFF
+        if ahead >= 0x8000:
+            # Duplicate or given up before it arrived
+            return [], []
+
+        released = []
+        if ahead > self.max_gap:
+            # E.g. the probe dropped many frames, wait for the frames behind the gap only
+            released = self.__flush()
+            self.next_nr = nr
+            ahead = 0
+
+        self.held[nr] = frame
+
+        requests = []
+        for i in range(ahead):
+            missing_nr = (self.next_nr + i) & 0xFFFF
+            if missing_nr not in self.held and missing_nr not in self.missing:
+                self.missing[missing_nr] = now
+                requests.append(missing_nr)
+
+        return released + self.__release(), requests
+
+    def lost(self, nr: int) -> list:
+        """
+        Gives up a frame which the probe reported lost.
+
+        Returns:
+            List of the frames released in order.
+        """
+
+        if nr in self.missing:
+            del self.missing[nr]
+            self.held[nr] = None
+
+        return self.__release()
+
+    def poll(self, now: float) -> list:
+        """
+        Gives up the frames which were requested longer than the timeout ago.
+
+        Returns:
+            List of the frames released in order.
+        """
+
+        for nr, requested in list(self.missing.items()):
+            if now - requested >= self.timeout:
+                del self.missing[nr]
+                self.held[nr] = None
+
+        return self.__release()
+
+
+# Stream of the probe: frames packed back to back into BLE notifications
+#   [0]   sequence number (increments per notification, wraps around)
+#   [1]   offset of the first frame starting in the payload (0xFF: none)
+#   [2-]  payload
+STREAM_HEADER_LEN = 2
+STREAM_NO_RECORD_START = 0xFF
+
+
+class StreamReassembler:
+    """
+    Reassembles the US frames from the notifications of the probe.
+
+    A frame may span several notifications and a notification may hold
+    the end of one and the start of further frames. After a lost
+    notification the reassembler drops the incomplete frame and
+    resynchronises on the next frame start.
+    """
+
+    def __init__(self):
+        self.reset()
+
+    def reset(self):
+        """
+        Drops the incomplete frame (e.g. after a new configuration was sent).
+        """
+
+        self.buffer = bytearray()
+        self.synced = False
+        self.next_seq = None
+
+    def feed(self, data: bytes) -> list:
+        """
+        Adds a notification to the stream.
+
+        Args:
+            data (bytes): Notification as received from the probe.
+
+        Returns:
+            List of the (still delta encoded) frames and feature records completed by the notification.
+        """
+
+        if len(data) < STREAM_HEADER_LEN:
+            return []
+
+        seq, record_start = data[0], data[1]
+        payload = data[STREAM_HEADER_LEN:]
+
+        if self.next_seq is not None and seq != self.next_seq:
+            self.synced = False
+        self.next_seq = (seq + 1) & 0xFF
+
+        if not self.synced:
+            if record_start == STREAM_NO_RECORD_START or record_start >= len(payload):
+                return []
+            payload = payload[record_start:]
+            self.buffer = bytearray()
+            self.synced = True
+
+        self.buffer.extend(payload)
+
+        frames = []
+        while len(self.buffer) >= FRAME_HEADER_LEN:
+            if self.buffer[0] not in (
+                MEAS_START_OF_FRAME_MASK,
+                BENCH_START_OF_FRAME,
+                FEATURE_START_OF_FRAME,
+                LOST_START_OF_FRAME,
+            ):
+                # Corrupted stream, wait for the next frame start
+                self.buffer = bytearray()
+                self.synced = False
+                break
+
+            # Compressed frames and feature records tell their length behind the header
+            if len(self.buffer) < get_header_length(self.buffer):
+                break
+
+            frame_length = get_frame_length(self.buffer)
+            if frame_length < FRAME_HEADER_LEN:
+                # Corrupted stream, wait for the next frame start
+                self.buffer = bytearray()
+                self.synced = False
+                break
+            if len(self.buffer) < frame_length:
+                break
+
+            frames.append(bytes(self.buffer[:frame_length]))
+            del self.buffer[:frame_length]
+
+        return frames
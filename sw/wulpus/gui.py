@@ -167,6 +167,26 @@ class WulpusGuiSingleCh(widgets.VBox):
         """TX/RX ID array."""
         return self._tx_rx_id_arr
 
+    @property
+    def meas_period_arr(self) -> NDArray[np.uint32]:
+        """Measurement period array in microseconds (as reported by the probe)."""
+        return self._meas_period_arr
+
+    @property
+    def rx_gain_arr(self) -> NDArray[np.float32]:
+        """RX gain array in dB (as applied by the probe, NaN if not reported)."""
+        return self._rx_gain_arr
+
+    @property
+    def pll_unlocks_arr(self) -> NDArray[np.uint8]:
+        """PLL unlocks on the probe since the previous frame (retried or dropped shots)."""
+        return self._pll_unlocks_arr
+
+    @property
+    def trig_jitter_arr(self) -> NDArray[np.float32]:
+        """Trigger-to-trigger jitter in microseconds (as measured by the probe, NaN if not measured)."""
+        return self._trig_jitter_arr
+
     @property
     def save_location(self) -> str:
         """Get the save location prefix."""
@@ -209,6 +229,10 @@ class WulpusGuiSingleCh(widgets.VBox):
         self._data_arr = np.zeros((acq_length, num_acqs), dtype=np.int16)
         self._acq_num_arr = np.zeros(num_acqs, dtype=np.uint16)
         self._tx_rx_id_arr = np.zeros(num_acqs, dtype=np.uint8)
+        self._meas_period_arr = np.zeros(num_acqs, dtype=np.uint32)
+        self._rx_gain_arr = np.full(num_acqs, np.nan, dtype=np.float32)
+        self._pll_unlocks_arr = np.zeros(num_acqs, dtype=np.uint8)
+        self._trig_jitter_arr = np.full(num_acqs, np.nan, dtype=np.float32)
 
         # Shared data for implot visualization
         self._implot_raw_data = np.zeros(LINE_N_SAMPLES, dtype=np.float64)
@@ -665,6 +689,10 @@ class WulpusGuiSingleCh(widgets.VBox):
         self._data_arr = np.zeros((acq_length, num_acqs), dtype=np.int16)
         self._acq_num_arr = np.zeros(num_acqs, dtype=np.uint16)
         self._tx_rx_id_arr = np.zeros(num_acqs, dtype=np.uint8)
+        self._meas_period_arr = np.zeros(num_acqs, dtype=np.uint32)
+        self._rx_gain_arr = np.full(num_acqs, np.nan, dtype=np.float32)
+        self._pll_unlocks_arr = np.zeros(num_acqs, dtype=np.uint8)
+        self._trig_jitter_arr = np.full(num_acqs, np.nan, dtype=np.float32)
         self._data_cnt = 0
 
         # Send restart command
@@ -721,6 +749,12 @@ class WulpusGuiSingleCh(widgets.VBox):
     def _send_configuration(self) -> bool:
         """Send configuration package to the device."""
         try:
+            # Delta encoding and buffering are done by the nRF52 of the probe (direct connection only)
+            if self._com_link.type == "direct" and not self._com_link.send_config(
+                self._uss_conf.get_delta_conf_package()
+            ):
+                self._handle_error("Error sending nRF52 settings")
+                return False
             if not self._com_link.send_config(self._uss_conf.get_conf_package()):
                 self._handle_error("Error sending configuration package")
                 return False
@@ -755,6 +789,12 @@ class WulpusGuiSingleCh(widgets.VBox):
             self._data_arr[:, self._data_cnt] = data[0]
             self._acq_num_arr[self._data_cnt] = data[1]
             self._tx_rx_id_arr[self._data_cnt] = data[2]
+            self._meas_period_arr[self._data_cnt] = data[3]["meas_period_us"]
+            if data[3]["rx_gain"] is not None:
+                self._rx_gain_arr[self._data_cnt] = data[3]["rx_gain"]
+            self._pll_unlocks_arr[self._data_cnt] = data[3]["pll_unlocks"]
+            if data[3]["trig_jitter_us"] is not None:
+                self._trig_jitter_arr[self._data_cnt] = data[3]["trig_jitter_us"]
 
             self._data_cnt += 1
 
@@ -851,6 +891,10 @@ class WulpusGuiSingleCh(widgets.VBox):
             data_arr=self._data_arr,
             acq_num_arr=self._acq_num_arr,
             tx_rx_id_arr=self._tx_rx_id_arr,
+            meas_period_arr=self._meas_period_arr,
+            rx_gain_arr=self._rx_gain_arr,
+            pll_unlocks_arr=self._pll_unlocks_arr,
+            trig_jitter_arr=self._trig_jitter_arr,
         )
 
         self._save_data_label.value = f"Data saved in {filename}"
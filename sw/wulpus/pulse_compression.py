@@ -0,0 +1,144 @@
+"""
+Copyright (C) 2023 ETH Zurich. All rights reserved.
+Author: Cedric Hirschi, ETH Zurich
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+SPDX-License-Identifier: Apache-2.0
+"""
+
+import numpy as np
+
+# HSPLL clock of the pulse generator (PPG) in Hertz
+PPG_CLOCK_FREQ = 80e6
+
+# Chips of the coded excitation sequences (must match ppgCodeChips in uslib.c)
+# Each entry holds sequence A and its complementary sequence B
+CODE_CHIPS = {
+    "none": ([1], [1]),
+    "barker5": ([1, 1, 1, -1, 1], [1, 1, 1, -1, 1]),
+    "barker7": ([1, 1, 1, -1, -1, 1, -1], [1, 1, 1, -1, -1, 1, -1]),
+    "barker11": (
+        [1, 1, 1, -1, -1, -1, 1, -1, -1, 1, -1],
+        [1, 1, 1, -1, -1, -1, 1, -1, -1, 1, -1],
+    ),
+    "barker13": (
+        [1, 1, 1, 1, 1, -1, -1, 1, 1, -1, 1, -1, 1],
+        [1, 1, 1, 1, 1, -1, -1, 1, 1, -1, 1, -1, 1],
+    ),
+    "golay8": ([1, 1, 1, -1, 1, 1, -1, 1], [1, 1, 1, -1, -1, -1, 1, -1]),
+}
+
+
+def get_chips(pulse_code, complementary=False):
+    """
+    Returns the chips of a coded excitation sequence.
+
+    Args:
+        pulse_code (str): Name of the code (one of PULSE_CODES).
+        complementary (bool): Return sequence B of a complementary pair.
+
+    Returns:
+        Array of +1/-1 chips.
+    """
+
+    return np.array(CODE_CHIPS[pulse_code][int(complementary)])
+
+
+def is_complementary(pulse_code):
+    """
+    Returns True if the code is a complementary pair transmitted on alternating sweeps.
+    """
+
+    a, b = CODE_CHIPS[pulse_code]
+    return a != b
+
+
+def get_reference(
+    pulse_code,
+    num_pulses,
+    pulse_freq,
+    sampling_freq,
+    duty_cycle=0.5,
+    complementary=False,
+):
+    """
+    Returns the transmitted burst sampled at the RX sampling frequency.
+
+    The burst is modeled like the probe generates it: every chip is num_pulses
+    pulses long and a phase flip between two chips stretches the low period
+    of the last pulse of the chip by half of the carrier period.
+
+    Args:
+        pulse_code (str): Name of the code (one of PULSE_CODES).
+        num_pulses (int): Pulses per chip.
+        pulse_freq (float): Pulse frequency in Hertz.
+        sampling_freq (float): RX sampling frequency in Hertz.
+        duty_cycle (float): Duty cycle of the pulses.
+        complementary (bool): Use sequence B of a complementary pair.
+
+    Returns:
+        Zero-mean reference waveform.
+    """
+
+    chips = get_chips(pulse_code, complementary)
+
+    # Quantize the periods the same way as the firmware
+    per = int(np.floor(PPG_CLOCK_FREQ / pulse_freq + 0.5))
+    hper = int(np.ceil(PPG_CLOCK_FREQ * duty_cycle / pulse_freq - 0.5))
+    lper = per - hper
+
+    # Build the level sequence at the PPG clock
+    levels = []
+    for i, chip in enumerate(chips):
+        flip = (i + 1 < len(chips)) and (chips[i + 1] != chip)
+        for p in range(num_pulses):
+            levels += [1.0] * hper
+            if flip and (p == num_pulses - 1):
+                levels += [0.0] * (lper + per // 2)
+            else:
+                levels += [0.0] * lper
+
+    # Resample to the RX sampling frequency
+    levels = np.array(levels)
+    step = PPG_CLOCK_FREQ / sampling_freq
+    ref = levels[(np.arange(int(len(levels) / step)) * step).astype(int)]
+
+    return ref - np.mean(ref)
+
+
+def compress(rf, reference):
+    """
+    Applies the matched filter to an RF frame.
+
+    Args:
+        rf (np.ndarray): RF samples of one frame.
+        reference (np.ndarray): Reference waveform (see get_reference).
+
+    Returns:
+        Compressed frame with the same length as rf, aligned to the echo onset.
+    """
+
+    rf = np.asarray(rf, dtype=float)
+    out = np.correlate(rf, reference, mode="full")[len(reference) - 1 :]
+
+    return out[: len(rf)] if len(out) >= len(rf) else np.pad(out, (0, len(rf) - len(out)))
+
+
+def compress_pair(rf_a, rf_b, reference_a, reference_b):
+    """
+    Compresses the frames of a complementary pair and sums them.
+
+    The frames must be acquired with the same TX/RX configuration.
+    The probe transmits sequence A on even and sequence B on odd sweeps
+    of the TX/RX configurations, i.e. frame n and n + num_txrx_configs form a pair.
+    """
+
+    return compress(rf_a, reference_a) + compress(rf_b, reference_b)
@@ -16,15 +16,28 @@ SPDX-License-Identifier: Apache-2.0
 """
 
 import numpy as np
+from scipy.signal import firwin
 import wulpus.config_package as cfg
+from wulpus.connection.frame import FRAME_NUM_SAMPLES
+from wulpus.pulse_compression import get_chips
 
 # CONSTANTS
 
 # Protocol related
 START_BYTE_CONF_PACK = 250
 START_BYTE_RESTART = 251
+START_BYTE_REG_CONF_PACK = 252
+START_BYTE_DELTA_CONF_PACK = 249
 # Maximum length of the configuration package
-PACKAGE_LEN = 68
+PACKAGE_LEN = 128
+# HSPLL output frequency of the probe in Hertz
+HSPLL_FREQ = 80000000
+# Pulse duty cycle of the probe in percent
+PULSE_DUTY_CYCLE = 50
+# Maximum number of pulses of a coded burst (PPG_CODE_MAX_PULSES)
+MAX_CODED_PULSES = 30
+# Relative width of the default feature bandpass around the transducer frequency
+FEATURE_BAND_WIDTH = 0.9
 
 
 class WulpusUSSConfigGen:
@@ -33,11 +46,12 @@ class WulpusUSSConfigGen:
 
     Attributes:
         num_acqs (int): Number of acquisitions to perform.
-        dcdc_turnon (int): DC-DC turn on time in microseconds.
-        meas_period (int): Measurement period in microseconds.
+        dcdc_turnon (int): DC-DC settle time before each shot in microseconds. (at least 5 ms)
+        meas_period (int): Measurement period in microseconds. The probe clamps it to
+            the shortest period that fits the capture, the SPI drain and the DC-DC settle time.
         trans_freq (int): Transducer frequency in Hertz.
         pulse_freq (int): Pulse frequency in Hertz.
-        num_pulses (int): Number of pulses to excite the transducer.
+        num_pulses (int): Number of pulses to excite the transducer. (pulses per chip if pulse_code is set)
         sampling_freq (int): Sampling frequency in Hertz.
         oversampling_rate (int): Oversampling rate.
         num_samples (int): Number of samples to acquire.
@@ -52,12 +66,48 @@ class WulpusUSSConfigGen:
         start_adcsampl (int): ADC sampling start time in microseconds.
         restart_capt (int): Capture restart time in microseconds.
         capt_timeout (int): Capture timeout time in microseconds.
+        pulse_code (str): Coded excitation sequence. (must be one of PULSE_CODES)
+        adapt_period_min (int): Shortest period of the motion-adaptive mode in microseconds.
+        adapt_period_max (int): Longest period of the motion-adaptive mode in microseconds.
+            The probe halves the period when the frame-difference energy exceeds motion_threshold
+            and slowly stretches it back when the scene is static. (0 disables the mode)
+        motion_threshold (int): Frame-difference energy threshold of the motion-adaptive mode.
+        ref_mode (str): Reference frame subtraction on the probe. (must be one of REF_MODES)
+            "capture" averages the first ref_avg_num frames of every TX/RX config into a
+            reference frame stored in FRAM and subtracts it from all following frames,
+            "stored" reuses the references of the last capture (also after a power cycle).
+        ref_avg_num (int): Number of frames averaged into the reference frame. (must be one of REF_AVG_NUMS)
+        agc_target_rms (int): Target RMS of the on-probe automatic gain control in ADC codes.
+            The probe adjusts the RX gain of every TX/RX config between the shots, starting
+            from rx_gain, and reports the applied gain in every frame. (0 disables the AGC)
+        agc_min_gain (float): Lowest RX gain of the AGC in dB. (must be one of PGA_GAIN)
+        agc_max_gain (float): Highest RX gain of the AGC in dB. (must be one of PGA_GAIN)
+        delta_mode (str): Delta encoding of the frames by the nRF52. (must be one of DELTA_MODES)
+        delta_shift (int): Quantisation shift of the 8-bit residuals (0 to 7).
+        delta_threshold (int): Frames whose residual stays within this value are not sent.
+        delta_keyframe_interval (int): Frames per TX/RX config between two full frames. (0: never)
+        buffer_policy (str): What the nRF52 drops when its frame buffer overflows. (must be one of BUFFER_POLICIES)
+            "decimate" keeps only every buffer_decimation-th frame of every TX/RX config
+            once the buffer is nearly full.
+        buffer_decimation (int): Decimation factor of the "decimate" policy (1 to 255).
+        compress_mode (str): Lossless compression of the full frames by the nRF52. (must be one of COMPRESS_MODES)
+            Keyframes and frames without delta encoding are sent as Rice coded prediction residuals
+            if that makes them shorter.
+        feature_mode (str): Envelope peaks extracted by the nRF52. (must be one of FEATURE_MODES)
+            "alongside" sends a feature record in front of every frame, "only" sends the records without the frames.
+        feature_decimation (int): Samples averaged into one envelope sample. (must be one of FEATURE_DECIMATIONS)
+            Should span at least one period of the transducer frequency, else the carrier ripple adds peaks.
+        feature_min_sample (int): First sample of the peak search (like min_depth of the waterbath example).
+        feature_num_peaks (int): Strongest envelope peaks per feature record (1 to 4).
+        feature_num_taps (int): Length of the FIR bandpass in front of the envelope (even, 4 to 32).
+        feature_band (tuple): Pass band of the FIR bandpass in Hertz.
+            (None: trans_freq +/- 45 %, like filter_data() of the waterbath example)
     """
 
     def __init__(
         self,
         num_acqs=100,
-        dcdc_turnon=195300,
+        dcdc_turnon=20000,
         meas_period=321965,
         trans_freq=225e4,
         pulse_freq=225e4,
@@ -75,6 +125,28 @@ class WulpusUSSConfigGen:
         start_adcsampl=503,
         restart_capt=3000,
         capt_timeout=3000,
+        pulse_code=cfg.PULSE_CODES[0],
+        adapt_period_min=0,
+        adapt_period_max=0,
+        motion_threshold=1000,
+        ref_mode=cfg.REF_MODES[0],
+        ref_avg_num=8,
+        agc_target_rms=0,
+        agc_min_gain=cfg.PGA_GAIN[0],
+        agc_max_gain=cfg.PGA_GAIN[-1],
+        delta_mode=cfg.DELTA_MODES[0],
+        delta_shift=2,
+        delta_threshold=8,
+        delta_keyframe_interval=64,
+        buffer_policy=cfg.BUFFER_POLICIES[0],
+        buffer_decimation=2,
+        compress_mode=cfg.COMPRESS_MODES[0],
+        feature_mode=cfg.FEATURE_MODES[0],
+        feature_decimation=4,
+        feature_min_sample=0,
+        feature_num_peaks=1,
+        feature_num_taps=16,
+        feature_band=None,
     ):
         # check if sampling frequency is valid
         if sampling_freq not in cfg.USS_CAPTURE_ACQ_RATES:
@@ -93,6 +165,132 @@ class WulpusUSSConfigGen:
                 + str(cfg.PGA_GAIN)
             )
 
+        # check if pulse code is valid
+        if pulse_code not in cfg.PULSE_CODES:
+            raise ValueError(
+                "Pulse code "
+                + str(pulse_code)
+                + " is not allowed.\nAllowed values are: "
+                + str(cfg.PULSE_CODES)
+            )
+        # check if the coded burst fits into the pulse generator
+        if len(get_chips(pulse_code)) * int(num_pulses) > MAX_CODED_PULSES:
+            raise ValueError(
+                "Pulse code "
+                + str(pulse_code)
+                + " with "
+                + str(num_pulses)
+                + " pulses per chip exceeds "
+                + str(MAX_CODED_PULSES)
+                + " pulses."
+            )
+
+        # check if reference frame settings are valid
+        if ref_mode not in cfg.REF_MODES:
+            raise ValueError(
+                "Reference mode "
+                + str(ref_mode)
+                + " is not allowed.\nAllowed values are: "
+                + str(cfg.REF_MODES)
+            )
+        if ref_avg_num not in cfg.REF_AVG_NUMS:
+            raise ValueError(
+                "Number of reference averages of "
+                + str(ref_avg_num)
+                + " is not allowed.\nAllowed values are: "
+                + str(cfg.REF_AVG_NUMS)
+            )
+
+        # check if the AGC settings are valid
+        if agc_min_gain not in cfg.PGA_GAIN or agc_max_gain not in cfg.PGA_GAIN:
+            raise ValueError(
+                "AGC gain bounds of "
+                + str(agc_min_gain)
+                + " and "
+                + str(agc_max_gain)
+                + " are not allowed.\nAllowed values are: "
+                + str(cfg.PGA_GAIN)
+            )
+        if agc_target_rms != 0:
+            if agc_min_gain > agc_max_gain:
+                raise ValueError(
+                    "AGC min gain of "
+                    + str(agc_min_gain)
+                    + " dB exceeds the max of "
+                    + str(agc_max_gain)
+                    + " dB."
+                )
+            if ref_mode != cfg.REF_MODES[0]:
+                raise ValueError(
+                    "The AGC cannot be combined with the reference frame subtraction."
+                )
+
+        # check if delta mode is valid
+        if delta_mode not in cfg.DELTA_MODES:
+            raise ValueError(
+                "Delta mode "
+                + str(delta_mode)
+                + " is not allowed.\nAllowed values are: "
+                + str(cfg.DELTA_MODES)
+            )
+
+        # check if buffer policy is valid
+        if buffer_policy not in cfg.BUFFER_POLICIES:
+            raise ValueError(
+                "Buffer policy "
+                + str(buffer_policy)
+                + " is not allowed.\nAllowed values are: "
+                + str(cfg.BUFFER_POLICIES)
+            )
+
+        # check if compression mode is valid
+        if compress_mode not in cfg.COMPRESS_MODES:
+            raise ValueError(
+                "Compression mode "
+                + str(compress_mode)
+                + " is not allowed.\nAllowed values are: "
+                + str(cfg.COMPRESS_MODES)
+            )
+
+        # check if feature mode is valid
+        if feature_mode not in cfg.FEATURE_MODES:
+            raise ValueError(
+                "Feature mode "
+                + str(feature_mode)
+                + " is not allowed.\nAllowed values are: "
+                + str(cfg.FEATURE_MODES)
+            )
+
+        # check if the bandpass length is valid (arm_fir_q15() takes an even number of taps)
+        if feature_num_taps % 2 != 0:
+            raise ValueError(
+                "Bandpass taps of "
+                + str(feature_num_taps)
+                + " is not allowed.\nThe number of taps must be even."
+            )
+
+        # check if the adaptive period bounds are valid
+        if adapt_period_max != 0 and adapt_period_min > adapt_period_max:
+            raise ValueError(
+                "Adaptive period min of "
+                + str(adapt_period_min)
+                + " us exceeds the max of "
+                + str(adapt_period_max)
+                + " us."
+            )
+
+        # check if the frame-wide processing of the probe sees a full frame
+        if (
+            adapt_period_max != 0 or ref_mode != cfg.REF_MODES[0] or agc_target_rms != 0
+        ) and num_samples != FRAME_NUM_SAMPLES:
+            raise ValueError(
+                "Number of samples of "
+                + str(num_samples)
+                + " is not allowed with the adaptive period, the reference frame subtraction or the AGC.\nThe number of samples must be "
+                + str(FRAME_NUM_SAMPLES)
+                + "."
+            )
+
         # Parse basic settings
         self.num_acqs = int(num_acqs)
         self.dcdc_turnon = int(dcdc_turnon)
@@ -115,6 +313,30 @@ class WulpusUSSConfigGen:
         self.start_adcsampl = int(start_adcsampl)
         self.restart_capt = int(restart_capt)
         self.capt_timeout = int(capt_timeout)
+        self.pulse_code = str(pulse_code)
+        self.adapt_period_min = int(adapt_period_min)
+        self.adapt_period_max = int(adapt_period_max)
+        self.motion_threshold = int(motion_threshold)
+        self.ref_mode = str(ref_mode)
+        self.ref_avg_num = int(ref_avg_num)
+        self.agc_target_rms = int(agc_target_rms)
+        self.agc_min_gain = float(agc_min_gain)
+        self.agc_max_gain = float(agc_max_gain)
+
+        # Parse nRF52 settings
+        self.delta_mode = str(delta_mode)
+        self.delta_shift = int(delta_shift)
+        self.delta_threshold = int(delta_threshold)
+        self.delta_keyframe_interval = int(delta_keyframe_interval)
+        self.buffer_policy = str(buffer_policy)
+        self.buffer_decimation = int(buffer_decimation)
+        self.compress_mode = str(compress_mode)
+        self.feature_mode = str(feature_mode)
+        self.feature_decimation = int(feature_decimation)
+        self.feature_min_sample = int(feature_min_sample)
+        self.feature_num_peaks = int(feature_num_peaks)
+        self.feature_num_taps = int(feature_num_taps)
+        self.feature_band = None if feature_band is None else tuple(feature_band)
 
         # check if configuration is valid
         self.convert_to_registers()  # convert to register saveable values
@@ -149,6 +371,47 @@ class WulpusUSSConfigGen:
         )
         self.restart_capt_reg = int(self.restart_capt * cfg.us_to_ticks["restart_capt"])
         self.capt_timeout_reg = int(self.capt_timeout * cfg.us_to_ticks["capt_timeout"])
+        self.pulse_code_reg = int(
+            cfg.PULSE_CODES_REG[cfg.PULSE_CODES.index(self.pulse_code)]
+        )
+        self.adapt_period_min_reg = int(
+            self.adapt_period_min * cfg.us_to_ticks["adapt_period_min"]
+        )
+        self.adapt_period_max_reg = int(
+            self.adapt_period_max * cfg.us_to_ticks["adapt_period_max"]
+        )
+        self.motion_threshold_reg = int(self.motion_threshold)
+        self.ref_mode_reg = int(cfg.REF_MODES_REG[cfg.REF_MODES.index(self.ref_mode)])
+        self.ref_avg_num_reg = int(
+            cfg.REF_AVG_NUMS_REG[cfg.REF_AVG_NUMS.index(self.ref_avg_num)]
+        )
+        self.agc_target_rms_reg = int(self.agc_target_rms)
+        self.agc_min_gain_reg = int(
+            cfg.PGA_GAIN_REG[cfg.PGA_GAIN.index(self.agc_min_gain)]
+        )
+        self.agc_max_gain_reg = int(
+            cfg.PGA_GAIN_REG[cfg.PGA_GAIN.index(self.agc_max_gain)]
+        )
+        self.delta_mode_reg = int(
+            cfg.DELTA_MODES_REG[cfg.DELTA_MODES.index(self.delta_mode)]
+        )
+        self.delta_shift_reg = int(self.delta_shift)
+        self.delta_threshold_reg = int(self.delta_threshold)
+        self.delta_keyframe_interval_reg = int(self.delta_keyframe_interval)
+        self.buffer_policy_reg = int(
+            cfg.BUFFER_POLICIES_REG[cfg.BUFFER_POLICIES.index(self.buffer_policy)]
+        )
+        self.buffer_decimation_reg = int(self.buffer_decimation)
+        self.compress_mode_reg = int(
+            cfg.COMPRESS_MODES_REG[cfg.COMPRESS_MODES.index(self.compress_mode)]
+        )
+        self.feature_mode_reg = int(
+            cfg.FEATURE_MODES_REG[cfg.FEATURE_MODES.index(self.feature_mode)]
+        )
+        self.feature_decimation_reg = int(self.feature_decimation)
+        self.feature_min_sample_reg = int(self.feature_min_sample)
+        self.feature_num_peaks_reg = int(self.feature_num_peaks)
+        self.feature_num_taps_reg = int(self.feature_num_taps)
 
     def get_conf_package(self):
         # Start byte fixed
@@ -184,6 +447,104 @@ class WulpusUSSConfigGen:
 
         return bytes_arr
 
+    def get_ppg_registers(self):
+        """
+        Returns the PPG low and high period registers (APGLPER, APGHPER).
+
+        Uses the same integer arithmetic as confPPG() in the firmware.
+        """
+
+        per = (HSPLL_FREQ + (self.pulse_freq_reg >> 1)) // self.pulse_freq_reg
+        hper = HSPLL_FREQ * PULSE_DUTY_CYCLE - (self.pulse_freq_reg >> 1)
+        hper = (hper // self.pulse_freq_reg + 99) // 100
+        lper = per - hper
+
+        if (hper > 255) or (lper > 255):
+            raise ValueError(
+                "Pulse frequency of "
+                + str(self.pulse_freq)
+                + " Hz is too low for the pulse generator."
+            )
+
+        return lper, hper
+
+    def get_reg_conf_package(self):
+        """
+        Returns a register-level configuration package.
+
+        All values are final register values, so the probe only range-checks
+        and copies them instead of computing them (see extractUsRegConfig).
+        The package consists of little-endian 16-bit words:
+        [start byte, num TX/RX configs], DC-DC turn on, period, APGLPER, APGHPER,
+        APGC, SDHSCTL1, SDHSCTL2, SDHSCTL6, AATM_A-F, HV-MUX RX start,
+        pulse code, adaptive period min, max, motion threshold,
+        [reference mode, log2 of reference averages], AGC target RMS,
+        [AGC min gain, AGC max gain], TX/RX configuration pairs.
+        """
+
+        # Make sure the values are converted to register saveable values
+        self.convert_to_registers()
+
+        # Validate the settings the same way as the standard package
+        _ = self.get_conf_package()
+
+        # SDHSCTL2 is only range-checked by the probe, the samples must fit into a frame
+        # (the register sample size is twice the number of samples)
+        if not 1 <= self.num_samples_reg <= 2 * FRAME_NUM_SAMPLES:
+            raise ValueError(
+                "Number of samples of "
+                + str(self.num_samples)
+                + " is not allowed.\nAllowed values are: 1 to "
+                + str(FRAME_NUM_SAMPLES)
+            )
+
+        lper, hper = self.get_ppg_registers()
+
+        words = [
+            START_BYTE_REG_CONF_PACK | (self.num_txrx_configs_reg << 8),
+            self.dcdc_turnon_reg,
+            self.meas_period_reg,
+            lper,
+            hper,
+            self.num_pulses_reg,  # APGC (no stop pulses)
+            self.sampling_freq_reg,  # SDHSCTL1 (oversampling rate)
+            self.num_samples_reg - 1,  # SDHSCTL2 (sample size - 1)
+            self.rx_gain_reg,  # SDHSCTL6
+            self.start_ppg_reg,  # AATM_A
+            self.turnon_adc_reg,  # AATM_B
+            self.start_pgainbias_reg,  # AATM_C
+            self.start_adcsampl_reg,  # AATM_D
+            self.restart_capt_reg,  # AATM_E
+            self.capt_timeout_reg,  # AATM_F
+            self.start_hvmuxrx_reg,
+            self.pulse_code_reg,
+            self.adapt_period_min_reg,
+            self.adapt_period_max_reg,
+            self.motion_threshold_reg,
+            self.ref_mode_reg | (self.ref_avg_num_reg << 8),
+            self.agc_target_rms_reg,
+            self.agc_min_gain_reg | (self.agc_max_gain_reg << 8),  # SDHSCTL6 bounds
+        ]
+
+        for i in range(self.num_txrx_configs):
+            words += [int(self.tx_configs[i]), int(self.rx_configs[i])]
+
+        bytes_arr = np.array(words).astype("<u2").tobytes()
+
+        if len(bytes_arr) > PACKAGE_LEN:
+            raise ValueError(
+                "Register-level package of "
+                + str(len(bytes_arr))
+                + " bytes exceeds "
+                + str(PACKAGE_LEN)
+                + " bytes, reduce the number of TX/RX configs."
+            )
+
+        # Add zeros to match the expected package legth if needed
+        bytes_arr += np.zeros(PACKAGE_LEN - len(bytes_arr)).astype("<u1").tobytes()
+
+        return bytes_arr
+
     def get_restart_package(self):
         # Start byte fixed
         bytes_arr = np.array([START_BYTE_RESTART]).astype("<u1").tobytes()
@@ -193,3 +554,49 @@ class WulpusUSSConfigGen:
             bytes_arr += np.zeros(PACKAGE_LEN - len(bytes_arr)).astype("<u1").tobytes()
 
         return bytes_arr
+
+    def get_delta_conf_package(self):
+        """
+        Returns the nRF52 settings package (delta encoding, buffer overflow policy, compression
+        and feature extraction).
+
+        The package is consumed by the nRF52 (direct connection only) and
+        has to be sent before the configuration package.
+        """
+
+        # Start byte fixed
+        bytes_arr = np.array([START_BYTE_DELTA_CONF_PACK]).astype("<u1").tobytes()
+
+        # Make sure the values are converted to register saveable values
+        self.convert_to_registers()
+
+        # Write nRF52 settings
+        for param in cfg.configuration_package[3]:
+            value = getattr(self, param.config_name + "_reg")
+            bytes_arr += param.get_as_bytes(value)
+
+        # Write the taps of the feature bandpass
+        bytes_arr += self.get_feature_taps().tobytes()
+
+        return bytes_arr
+
+    def get_feature_taps(self):
+        """
+        Returns the taps of the feature bandpass as Q15 values (designed with a Hamming window).
+
+        The nRF52 delays the envelope by (feature_num_taps - 1) / 2 samples,
+        the peak positions of the feature records are corrected for it.
+        """
+
+        band = self.feature_band
+        if band is None:
+            band = (
+                self.trans_freq * (1 - FEATURE_BAND_WIDTH / 2),
+                self.trans_freq * (1 + FEATURE_BAND_WIDTH / 2),
+            )
+
+        taps = firwin(
+            self.feature_num_taps, band, pass_zero=False, fs=self.sampling_freq
+        )
+
+        return np.clip(np.round(taps * 32768), -32768, 32767).astype("<i2")
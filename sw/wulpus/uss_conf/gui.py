@@ -106,6 +106,13 @@ class WulpusUSSConfigGUI(widgets.VBox, WulpusUSSConfigGen):
                 # Return the parameter
                 return param
 
+        for param in cfg.configuration_package[3]:
+            # Check if the parameter is an nRF52 setting
+
+            if param.config_name == param_name:
+                # Return the parameter
+                return param
+
         # Parameter not found
         return None
 
@@ -122,6 +129,7 @@ class WulpusUSSConfigGUI(widgets.VBox, WulpusUSSConfigGen):
         entries_acq = []
         entries_exc = []
         entries_adv = []
+        entries_link = []
 
         entries_acq.append(widgets.HTML(value="<b>Measurement settings</b>"))
         entries_acq.append(self.get_param("num_acqs").get_as_widget(self.num_acqs))
@@ -140,6 +148,45 @@ class WulpusUSSConfigGUI(widgets.VBox, WulpusUSSConfigGen):
         # TODO: Add DutyCycle input here
         entries_exc.append(self.get_param("pulse_freq").get_as_widget(self.pulse_freq))
         entries_exc.append(self.get_param("num_pulses").get_as_widget(self.num_pulses))
+        entries_exc.append(self.get_param("pulse_code").get_as_widget(self.pulse_code))
+
+        entries_link.append(widgets.HTML(value="<b>Link settings</b>"))
+        entries_link.append(self.get_param("delta_mode").get_as_widget(self.delta_mode))
+        entries_link.append(
+            self.get_param("delta_shift").get_as_widget(self.delta_shift)
+        )
+        entries_link.append(
+            self.get_param("delta_threshold").get_as_widget(self.delta_threshold)
+        )
+        entries_link.append(
+            self.get_param("delta_keyframe_interval").get_as_widget(
+                self.delta_keyframe_interval
+            )
+        )
+        entries_link.append(
+            self.get_param("buffer_policy").get_as_widget(self.buffer_policy)
+        )
+        entries_link.append(
+            self.get_param("buffer_decimation").get_as_widget(self.buffer_decimation)
+        )
+        entries_link.append(
+            self.get_param("compress_mode").get_as_widget(self.compress_mode)
+        )
+        entries_link.append(
+            self.get_param("feature_mode").get_as_widget(self.feature_mode)
+        )
+        entries_link.append(
+            self.get_param("feature_decimation").get_as_widget(self.feature_decimation)
+        )
+        entries_link.append(
+            self.get_param("feature_min_sample").get_as_widget(self.feature_min_sample)
+        )
+        entries_link.append(
+            self.get_param("feature_num_peaks").get_as_widget(self.feature_num_peaks)
+        )
+        entries_link.append(
+            self.get_param("feature_num_taps").get_as_widget(self.feature_num_taps)
+        )
 
         entries_adv.append(widgets.HTML(value="<b>Advanced settings</b>"))
         entries_adv.append(
@@ -163,13 +210,35 @@ class WulpusUSSConfigGUI(widgets.VBox, WulpusUSSConfigGen):
         entries_adv.append(
             self.get_param("capt_timeout").get_as_widget(self.capt_timeout)
         )
+        entries_adv.append(
+            self.get_param("adapt_period_min").get_as_widget(self.adapt_period_min)
+        )
+        entries_adv.append(
+            self.get_param("adapt_period_max").get_as_widget(self.adapt_period_max)
+        )
+        entries_adv.append(
+            self.get_param("motion_threshold").get_as_widget(self.motion_threshold)
+        )
+        entries_adv.append(self.get_param("ref_mode").get_as_widget(self.ref_mode))
+        entries_adv.append(
+            self.get_param("ref_avg_num").get_as_widget(self.ref_avg_num)
+        )
+        entries_adv.append(
+            self.get_param("agc_target_rms").get_as_widget(self.agc_target_rms)
+        )
+        entries_adv.append(
+            self.get_param("agc_min_gain").get_as_widget(self.agc_min_gain)
+        )
+        entries_adv.append(
+            self.get_param("agc_max_gain").get_as_widget(self.agc_max_gain)
+        )
 
         # Disable capture restart, capture timeout and number of samples (per index is sloppy, but works for now)
         entries_acq[4].disabled = True  # num_samples
         entries_adv[7].disabled = True  # restart_capt
         entries_adv[8].disabled = True  # capt_timeout
 
-        self.entries_left = entries_acq + entries_exc
+        self.entries_left = entries_acq + entries_exc + entries_link
         self.entries_right = entries_adv
 
         for entry in self.entries_left + self.entries_right:
@@ -209,6 +278,14 @@ class WulpusUSSConfigGUI(widgets.VBox, WulpusUSSConfigGen):
                 setattr(self, param.config_name, value)
                 break
 
+        for param in cfg.configuration_package[3]:
+            # Check if the parameter is an nRF52 setting
+
+            if param.friendly_name == name:
+                # Update the value of the parameter
+                setattr(self, param.config_name, value)
+                break
+
         # Update register saveable values
         self.convert_to_registers()
 
@@ -236,6 +313,9 @@ class WulpusUSSConfigGUI(widgets.VBox, WulpusUSSConfigGen):
             for param in cfg.configuration_package[2]:
                 # save GUI settings
                 data[param.config_name] = getattr(self, param.config_name)
+            for param in cfg.configuration_package[3]:
+                # save nRF52 settings
+                data[param.config_name] = getattr(self, param.config_name)
 
             # Write the JSON file
             json.dump(data, f, indent=4)
@@ -373,6 +453,22 @@ class WulpusUSSConfigGUI(widgets.VBox, WulpusUSSConfigGen):
                             entry.value = data[param.config_name]
                             break
 
+                for param in cfg.configuration_package[3]:
+                    # Check if the parameter is an nRF52 setting
+
+                    try:
+                        setattr(self, param.config_name, data[param.config_name])
+                    except KeyError:
+                        # If the parameter is not in the JSON file,
+                        # just keep the current value
+                        continue
+
+                    # update widget value
+                    for entry in self.entries_left + self.entries_right:
+                        if entry.description == param.friendly_name:
+                            entry.value = data[param.config_name]
+                            break
+
         except FileNotFoundError:
             # Filename not found
 